@@ -0,0 +1,114 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+// This example compares the two capture encodings: how many bytes each one
+// takes for the same stream of events, how long it takes to write them and
+// how long it takes to replay them. The events are made up so that no trace
+// has to be started, but they vary the way a real stream does: a handful of
+// event ids, timestamps a few microseconds apart, a few threads and a payload
+// that's mostly the same from one event to the next. Build it in Release.
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#include "..\..\krabs\krabs.hpp"
+#include "examples.h"
+
+namespace {
+
+    const size_t event_count = 1 << 18;
+    const int rounds = 5;
+
+    const GUID provider_id = { 0x43d1a55c, 0x76d6, 0x4f7e, { 0x99, 0x5c, 0x64, 0xc7, 0x11, 0xe5, 0xca, 0xfe } };
+
+    std::vector<krabs::testing::synth_record> make_events()
+    {
+        LARGE_INTEGER now;
+        QueryPerformanceCounter(&now);
+
+        std::vector<krabs::testing::synth_record> events;
+        events.reserve(event_count);
+
+        LONGLONG timestamp = now.QuadPart;
+        for (size_t i = 0; i < event_count; ++i) {
+            EVENT_RECORD record = {};
+            record.EventHeader.Size = sizeof(EVENT_HEADER);
+            record.EventHeader.ProviderId = provider_id;
+            record.EventHeader.EventDescriptor.Id = static_cast<USHORT>(i % 7 == 0 ? 2 : 1 + i % 3);
+            record.EventHeader.EventDescriptor.Version = 1;
+            record.EventHeader.ProcessId = 4242;
+            record.EventHeader.ThreadId = static_cast<ULONG>(5000 + (i % 4) * 4);
+            record.EventHeader.KernelTime = static_cast<ULONG>(i / 64);
+            record.EventHeader.UserTime = static_cast<ULONG>(i / 16);
+            record.BufferContext.ProcessorIndex = static_cast<USHORT>(i % 8);
+
+            timestamp += 20 + static_cast<LONGLONG>((i * 7919) % 97);
+            record.EventHeader.TimeStamp.QuadPart = timestamp;
+
+            // A request id, a status and a url; only the id changes much.
+            std::vector<BYTE> payload(64, 0);
+            const uint64_t request = 100000 + i;
+            const uint32_t status = (i % 50 == 0) ? 404 : 200;
+            const wchar_t url[] = L"https://a.b/c";
+            memcpy(payload.data(), &request, sizeof(request));
+            memcpy(payload.data() + sizeof(request), &status, sizeof(status));
+            memcpy(payload.data() + sizeof(request) + sizeof(status), url, sizeof(url));
+
+            events.emplace_back(record, payload);
+        }
+
+        return events;
+    }
+
+    template <typename Run>
+    double nanoseconds_per_event(Run run)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < rounds; ++i) {
+            run();
+        }
+        auto elapsed = std::chrono::steady_clock::now() - start;
+
+        return std::chrono::duration<double, std::nano>(elapsed).count() / (rounds * event_count);
+    }
+
+    void measure(const wchar_t *name, krabs::capture::encoding mode,
+                 const std::vector<krabs::testing::synth_record> &events)
+    {
+        krabs::trace_context context;
+        std::vector<BYTE> capture;
+        krabs::capture::writer_stats stats = {};
+
+        const double write = nanoseconds_per_event([&] {
+            capture.clear();
+            krabs::capture::writer writer(capture, mode);
+            for (const auto &event : events) {
+                writer(event, context);
+            }
+            writer.flush();
+            stats = writer.stats();
+        });
+
+        size_t replayed = 0;
+        const double replay = nanoseconds_per_event([&] {
+            krabs::capture::reader reader(capture.data(), capture.size());
+            reader.replay([&](const EVENT_RECORD &, const krabs::trace_context &) { ++replayed; });
+        });
+
+        std::wcout << name << L" write:  " << write << L" ns/event" << std::endl;
+        std::wcout << name << L" replay: " << replay << L" ns/event ("
+                   << replayed / rounds << L" events)" << std::endl;
+        std::wcout << name << L" size:   " << stats.bytes << L" bytes, "
+                   << static_cast<double>(stats.bytes) / event_count << L" bytes/event, "
+                   << static_cast<double>(stats.raw_bytes) / stats.bytes << L"x smaller than raw" << std::endl;
+    }
+}
+
+void benchmark_001_capture::start()
+{
+    auto events = make_events();
+
+    measure(L"raw    ", krabs::capture::encoding::raw, events);
+    measure(L"compact", krabs::capture::encoding::compact, events);
+}
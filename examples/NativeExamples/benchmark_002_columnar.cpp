@@ -0,0 +1,104 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+// This example measures the table file: how long table_writer takes per
+// event, how long table_reader takes to hand back the rows and how that
+// compares with parsing the same properties out of each event. The events
+// are WinINet requests made with a record_builder, so no trace has to be
+// started, but the WinINet manifest has to be installed for TDH to find
+// their schema (it is on any desktop Windows). Build it in Release.
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "..\..\krabs\krabs.hpp"
+#include "examples.h"
+
+namespace {
+
+    const size_t event_count = 1 << 17;
+    const int rounds = 5;
+
+    const krabs::guid wininet(L"{43D1A55C-76D6-4F7E-995C-64C711E5CAFE}");
+
+    std::vector<krabs::testing::synth_record> make_requests()
+    {
+        std::vector<krabs::testing::synth_record> events;
+        events.reserve(event_count);
+
+        for (size_t i = 0; i < event_count; ++i) {
+            krabs::testing::record_builder builder(wininet, krabs::id(1057), krabs::version(0));
+            builder.header().ProcessId = static_cast<ULONG>(1000 + i % 16);
+            builder.add_properties()
+                (L"URL", "https://microsoft.com/" + std::to_string(i % 256))
+                (L"Status", static_cast<unsigned int>(i % 50 == 0 ? 404 : 200));
+
+            events.push_back(builder.pack_incomplete());
+        }
+
+        return events;
+    }
+
+    template <typename Run>
+    double nanoseconds_per_event(Run run)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < rounds; ++i) {
+            run();
+        }
+        auto elapsed = std::chrono::steady_clock::now() - start;
+
+        return std::chrono::duration<double, std::nano>(elapsed).count() / (rounds * event_count);
+    }
+}
+
+void benchmark_002_columnar::start()
+{
+    auto events = make_requests();
+    krabs::trace_context context;
+
+    // Sums keep the reads from being optimized away.
+    uint64_t parsed = 0;
+    std::wcout << L"parse:  " << nanoseconds_per_event([&] {
+        for (const auto &event : events) {
+            krabs::schema schema(event, context.schema_locator);
+            krabs::parser parser(schema);
+            parsed += parser.parse<std::string>(L"URL").size();
+            parsed += parser.parse<uint32_t>(L"Status");
+        }
+    }) << L" ns/event" << std::endl;
+
+    std::vector<BYTE> file;
+    krabs::columnar::table_writer_stats stats = {};
+    std::wcout << L"write:  " << nanoseconds_per_event([&] {
+        file.clear();
+        krabs::columnar::table_writer writer(file);
+        for (const auto &event : events) {
+            writer(event, context);
+        }
+        writer.close();
+        stats = writer.stats();
+    }) << L" ns/event" << std::endl;
+
+    uint64_t read = 0;
+    std::wcout << L"read:   " << nanoseconds_per_event([&] {
+        krabs::columnar::table_reader reader(file.data(), file.size());
+        for (size_t i = 0; i < reader.row_groups().size(); ++i) {
+            auto batch = reader.read(i);
+            const auto &url = batch.at(L"URL");
+            auto status = batch.at(L"Status").values<uint32_t>();
+            for (size_t row = 0; row < batch.rows(); ++row) {
+                read += url.string_at(row).size();
+                read += status[row];
+            }
+        }
+    }) << L" ns/event" << std::endl;
+
+    std::wcout << L"size:   " << stats.bytes << L" bytes, "
+               << static_cast<double>(stats.bytes) / event_count << L" bytes/event, "
+               << stats.row_groups << L" row groups, "
+               << stats.dictionary_columns << L" dictionary columns" << std::endl;
+    std::wcout << L"(checks: " << parsed / rounds << L" " << read / rounds << L")" << std::endl;
+}
@@ -0,0 +1,111 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+// This example compares looking schema keys up in a flat_table, the table the
+// schema cache keeps its schemas in, with looking them up in an
+// std::unordered_map. Each is tried with keys in random order and with keys
+// in runs, the way events from one provider and id tend to arrive, since
+// flat_table checks the last key it found before hashing. The keys are made
+// up, so no trace has to be started. Build it in Release.
+
+#include <chrono>
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+
+#include "..\..\krabs\krabs.hpp"
+#include "examples.h"
+
+namespace {
+
+    const size_t lookup_count = 1 << 20;
+    const size_t run_length = 16;
+    const int rounds = 20;
+
+    std::vector<krabs::schema_key> make_keys(size_t count)
+    {
+        const size_t providers = 8;
+
+        std::vector<krabs::schema_key> keys;
+        for (size_t i = 0; i < count; ++i) {
+            EVENT_RECORD record = {};
+            record.EventHeader.ProviderId = krabs::guid(L"{88154140-f63a-4028-8826-b0028614d67b}");
+            record.EventHeader.ProviderId.Data4[7] = static_cast<unsigned char>(i % providers);
+            record.EventHeader.EventDescriptor.Id = static_cast<USHORT>(i / providers);
+            record.EventHeader.EventDescriptor.Version = static_cast<UCHAR>(i % 2);
+            keys.emplace_back(record);
+        }
+
+        return keys;
+    }
+
+    // Indices into the keys: random, or random runs of the same key.
+    std::vector<size_t> make_pattern(size_t key_count, size_t run)
+    {
+        std::vector<size_t> pattern(lookup_count);
+        uint32_t state = 12345;
+        for (size_t i = 0; i < lookup_count; i += run) {
+            state = state * 1664525 + 1013904223;
+            for (size_t j = i; j < i + run && j < lookup_count; ++j) {
+                pattern[j] = (state >> 8) % key_count;
+            }
+        }
+
+        return pattern;
+    }
+
+    template <typename Lookup>
+    double nanoseconds_per_lookup(Lookup lookup)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < rounds; ++i) {
+            lookup();
+        }
+        auto elapsed = std::chrono::steady_clock::now() - start;
+
+        return std::chrono::duration<double, std::nano>(elapsed).count() / (rounds * lookup_count);
+    }
+
+    void measure(size_t key_count)
+    {
+        auto keys = make_keys(key_count);
+
+        krabs::flat_table<krabs::schema_key, int> flat;
+        std::unordered_map<krabs::schema_key, int> map;
+        for (size_t i = 0; i < keys.size(); ++i) {
+            flat[keys[i]] = static_cast<int>(i);
+            map[keys[i]] = static_cast<int>(i);
+        }
+
+        const std::pair<const wchar_t *, size_t> patterns[] = {
+            { L"random", 1 },
+            { L"runs  ", run_length },
+        };
+
+        // Sums keep the lookups from being optimized away.
+        int64_t checks = 0;
+        for (const auto &pattern : patterns) {
+            auto order = make_pattern(key_count, pattern.second);
+
+            std::wcout << key_count << L" keys, " << pattern.first << L": flat_table "
+                       << nanoseconds_per_lookup([&] {
+                for (auto index : order) {
+                    checks += *flat.find(keys[index]);
+                }
+            }) << L" ns/lookup, unordered_map "
+                       << nanoseconds_per_lookup([&] {
+                for (auto index : order) {
+                    checks += map.find(keys[index])->second;
+                }
+            }) << L" ns/lookup" << std::endl;
+        }
+
+        std::wcout << L"(checks: " << checks << L")" << std::endl;
+    }
+}
+
+void benchmark_003_schema_lookup::start()
+{
+    measure(64);
+    measure(4096);
+}
@@ -0,0 +1,98 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+// This example measures how long a provider takes to run its filters on an
+// event, with the same rules written as event_filters, which keep their
+// predicates and callbacks in std::functions, and as a static_provider,
+// whose filters are fixed at compile time. Events are made up and pushed
+// through a trace proxy, so no trace has to be started. Build it in Release.
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#include "..\..\krabs\krabs.hpp"
+#include "examples.h"
+
+namespace {
+
+    struct benchmark_guid {
+        static constexpr GUID value = krabs::guid_parser::parse_guid_literal("{A0C1853B-5C40-4B15-8766-3CF1C58F985A}");
+    };
+
+    const int event_count = 10000000;
+
+    std::vector<krabs::testing::synth_record> make_events()
+    {
+        // A spread of ids and processes, so some rules match and some don't.
+        std::vector<krabs::testing::synth_record> events;
+        for (USHORT id = 1; id <= 8; ++id) {
+            EVENT_RECORD record = {};
+            record.EventHeader.ProviderId = benchmark_guid::value;
+            record.EventHeader.EventDescriptor.Id = id;
+            record.EventHeader.ProcessId = id % 2 == 0 ? 4 : 8;
+            events.emplace_back(record, std::vector<BYTE>());
+        }
+
+        return events;
+    }
+
+    template <typename Trace>
+    double nanoseconds_per_event(Trace &trace, const std::vector<krabs::testing::synth_record> &events)
+    {
+        krabs::testing::user_trace_proxy proxy(trace);
+
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < event_count; ++i) {
+            proxy.push_event(events[i % events.size()]);
+        }
+        auto elapsed = std::chrono::steady_clock::now() - start;
+
+        return std::chrono::duration<double, std::nano>(elapsed).count() / event_count;
+    }
+}
+
+void benchmark_004_static_provider::start()
+{
+    using namespace krabs::predicates;
+
+    const auto events = make_events();
+    long long matched = 0;
+    auto count = [&matched](const EVENT_RECORD &, const krabs::trace_context &) { ++matched; };
+
+    // The rules as event_filters.
+    {
+        krabs::user_trace trace;
+        krabs::provider<> provider(benchmark_guid::value);
+
+        krabs::event_filter first(and_filter(id_is(1), process_id_is(8)));
+        first.add_on_event_callback(count);
+        provider.add_filter(first);
+
+        krabs::event_filter second(or_filter(id_is(2), id_is(3)));
+        second.add_on_event_callback(count);
+        provider.add_filter(second);
+
+        krabs::event_filter third(not_filter(process_id_is(4)));
+        third.add_on_event_callback(count);
+        provider.add_filter(third);
+
+        trace.enable(provider);
+        std::wcout << L"event_filter:    " << nanoseconds_per_event(trace, events) << L" ns/event" << std::endl;
+    }
+
+    // The same rules as a static_provider.
+    {
+        auto first = krabs::make_static_filter(id_is(1) && process_id_is(8), std::ref(count));
+        auto second = krabs::make_static_filter(id_is(2) || id_is(3), std::ref(count));
+        auto third = krabs::make_static_filter(!process_id_is(4), std::ref(count));
+
+        krabs::user_trace trace;
+        krabs::static_provider<benchmark_guid, decltype(first), decltype(second), decltype(third)> provider(first, second, third);
+
+        trace.enable(provider);
+        std::wcout << L"static_provider: " << nanoseconds_per_event(trace, events) << L" ns/event" << std::endl;
+    }
+
+    std::wcout << L"(" << matched << L" callbacks)" << std::endl;
+}
@@ -0,0 +1,76 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+// This example measures how long it takes to turn raw performance counter
+// timestamps into FILETIMEs: dividing by the counter's frequency for each
+// one, and with a timestamp_converter, one at a time and in batches. The
+// timestamps are made up, so no trace has to be started. Build it in
+// Release.
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#include "..\..\krabs\krabs.hpp"
+#include "examples.h"
+
+namespace {
+
+    const size_t timestamp_count = 1 << 20;
+    const int rounds = 20;
+
+    template <typename Convert>
+    double nanoseconds_per_timestamp(Convert convert)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < rounds; ++i) {
+            convert();
+        }
+        auto elapsed = std::chrono::steady_clock::now() - start;
+
+        return std::chrono::duration<double, std::nano>(elapsed).count() / (rounds * timestamp_count);
+    }
+}
+
+void benchmark_005_timestamps::start()
+{
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+
+    auto converter = krabs::timestamp_converter::sample_now(
+        krabs::clock_type::query_performance_counter, frequency.QuadPart);
+
+    // A few minutes of events, a few microseconds apart.
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+
+    std::vector<LONGLONG> timestamps(timestamp_count);
+    for (size_t i = 0; i < timestamp_count; ++i) {
+        timestamps[i] = now.QuadPart + static_cast<LONGLONG>(i) * 97;
+    }
+
+    std::vector<LONGLONG> filetimes(timestamp_count);
+    const LONGLONG anchor = timestamps[0];
+    const LONGLONG anchor_filetime = converter.to_filetime(anchor);
+
+    std::wcout << L"division: " << nanoseconds_per_timestamp([&] {
+        for (size_t i = 0; i < timestamp_count; ++i) {
+            const LONGLONG delta = timestamps[i] - anchor;
+            filetimes[i] = anchor_filetime
+                + (delta / frequency.QuadPart) * 10000000
+                + (delta % frequency.QuadPart) * 10000000 / frequency.QuadPart;
+        }
+    }) << L" ns/timestamp" << std::endl;
+
+    std::wcout << L"scalar:   " << nanoseconds_per_timestamp([&] {
+        for (size_t i = 0; i < timestamp_count; ++i) {
+            filetimes[i] = converter.to_filetime(timestamps[i]);
+        }
+    }) << L" ns/timestamp" << std::endl;
+
+    std::wcout << L"batch:    " << nanoseconds_per_timestamp([&] {
+        converter.to_filetime(timestamps.data(), filetimes.data(), timestamp_count);
+    }) << L" ns/timestamp" << std::endl;
+
+    std::wcout << L"(last: " << converter.to_iso8601(timestamps.back()).c_str() << L")" << std::endl;
+}
@@ -3,6 +3,31 @@
 
 #pragma once
 
+struct benchmark_001_capture
+{
+    static void start();
+};
+
+struct benchmark_002_columnar
+{
+    static void start();
+};
+
+struct benchmark_003_schema_lookup
+{
+    static void start();
+};
+
+struct benchmark_004_static_provider
+{
+    static void start();
+};
+
+struct benchmark_005_timestamps
+{
+    static void start();
+};
+
 struct kernel_and_user_trace_001
 {
     static void start();
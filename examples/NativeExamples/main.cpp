@@ -19,4 +19,9 @@ int main(void)
     //user_trace_005::start();
     //user_trace_006_predicate_vectors::start();
     //user_trace_007_rundown::start();
+    //benchmark_001_capture::start();
+    //benchmark_002_columnar::start();
+    //benchmark_003_schema_lookup::start();
+    //benchmark_004_static_provider::start();
+    //benchmark_005_timestamps::start();
 }
\ No newline at end of file
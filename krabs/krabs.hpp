@@ -30,21 +30,36 @@
 #include "krabs/ut.hpp"
 #include "krabs/kt.hpp"
 #include "krabs/guid.hpp"
+#include "krabs/clock.hpp"
+#include "krabs/timestamp_converter.hpp"
+#include "krabs/flat_table.hpp"
+#include "krabs/delivery_lag.hpp"
+#include "krabs/metrics.hpp"
+#include "krabs/pushdown_policy.hpp"
+#include "krabs/snapshot.hpp"
 #include "krabs/trace.hpp"
 #include "krabs/trace_context.hpp"
 #include "krabs/client.hpp"
 #include "krabs/errors.hpp"
 #include "krabs/schema.hpp"
 #include "krabs/schema_locator.hpp"
+#include "krabs/tracelogging/metadata.hpp"
+#include "krabs/event_view.hpp"
+#include "krabs/event_map.hpp"
 #include "krabs/parse_types.hpp"
 #include "krabs/collection_view.hpp"
 #include "krabs/size_provider.hpp"
 #include "krabs/parser.hpp"
 #include "krabs/property.hpp"
 #include "krabs/provider.hpp"
+#include "krabs/static_provider.hpp"
 #include "krabs/etw.hpp"
 #include "krabs/tdh_helpers.hpp"
 #include "krabs/kernel_providers.hpp"
+#include "krabs/kernel/typed_events.hpp"
+#include "krabs/decoding/byte_view.hpp"
+#include "krabs/decoding/dispatcher.hpp"
+#include "krabs/event_merger.hpp"
 
 #include "krabs/testing/proxy.hpp"
 #include "krabs/testing/filler.hpp"
@@ -55,7 +70,35 @@
 
 #include "krabs/filtering/view_adapters.hpp"
 #include "krabs/filtering/comparers.hpp"
+#include "krabs/filtering/pushdown.hpp"
+#include "krabs/filtering/predicate_graph.hpp"
 #include "krabs/filtering/predicates.hpp"
 #include "krabs/filtering/event_filter.hpp"
+#include "krabs/filtering/filter_dispatch.hpp"
+#include "krabs/filtering/filter_descriptors.hpp"
+
+#include "krabs/etl/etl_format.hpp"
+#include "krabs/etl/etl_reader.hpp"
+
+#include "krabs/capture/capture_format.hpp"
+#include "krabs/capture/compact_codec.hpp"
+#include "krabs/capture/capture_writer.hpp"
+#include "krabs/capture/capture_reader.hpp"
+
+#include "krabs/columnar/column_batch.hpp"
+#include "krabs/columnar/batch_extractor.hpp"
+#include "krabs/columnar/table_format.hpp"
+#include "krabs/columnar/table_writer.hpp"
+#include "krabs/columnar/table_reader.hpp"
+
+#include "krabs/monitoring/metrics_format.hpp"
+#include "krabs/monitoring/metrics_publisher.hpp"
+#include "krabs/monitoring/metrics_reader.hpp"
+#include "krabs/monitoring/metrics_view.hpp"
+
+#include "krabs/format/text_writers.hpp"
+#include "krabs/format/format_plan.hpp"
+#include "krabs/format/text_formatter.hpp"
+#include "krabs/format/json_serializer.hpp"
 
 #pragma warning(pop)
@@ -0,0 +1,317 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#ifndef  WIN32_LEAN_AND_MEAN
+#define  WIN32_LEAN_AND_MEAN
+#endif
+
+#include <windows.h>
+#include <evntcons.h>
+
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#include "../compiler_check.hpp"
+
+namespace krabs { namespace capture {
+
+    /**
+     * <summary>
+     *   Layout of krabs capture files.
+     * </summary>
+     * <remarks>
+     *   A capture file is a file_header followed by a sequence of chunks,
+     *   each one a chunk_header, its payload, and padding up to the next
+     *   multiple of 8 bytes. Chunks are only ever appended, so a file whose
+     *   writer died is readable up to its last complete chunk.
+     *
+     *   A schema chunk holds a schema_chunk and the TRACE_EVENT_INFO buffer
+     *   TDH returned for an event. It is written once, before the first
+     *   event that refers to it.
+     *
+     *   An event chunk holds an event_chunk followed by the event's
+     *   extended data items (DataPtr holding the offset of the item's data
+     *   from the start of the chunk payload), the data of each item
+     *   aligned to 8 bytes, and finally the user data.
+     *
+     *   Writers using encoding::compact write template and block chunks
+     *   instead of event chunks. A template chunk assigns an id to the parts
+     *   of an EVENT_HEADER that repeat across events of the same kind
+     *   (provider, descriptor, header flags, logger) and is written once.
+     *   A block chunk holds a block_chunk, the compact headers of its events
+     *   and their concatenated user data, usually compressed; see
+     *   compact_codec.hpp.
+     * </remarks>
+     */
+    namespace constants {
+        const ULONGLONG file_magic          = 0x3150414353424B52; // "RKBSCAP1"
+        const ULONG     file_version        = 1;
+        const ULONG     no_schema           = 0xFFFFFFFF;
+    }
+
+    enum class chunk_type : ULONG {
+        schema   = 1,
+        event    = 2,
+        header   = 3,
+        block    = 4,
+    };
+
+    /**
+     * <summary>
+     *   How a capture::writer stores events.
+     * </summary>
+     */
+    enum class encoding {
+        // One chunk per event, holding the record as is.
+        raw,
+
+        // Events are gathered in blocks. Headers are coded against templates
+        // with delta timestamps and varints, user data is compressed.
+        compact,
+    };
+
+    struct file_header
+    {
+        ULONGLONG magic;
+        ULONG     version;
+        ULONG     header_size;
+    };
+
+    struct chunk_header
+    {
+        chunk_type type;
+        ULONG      size;
+    };
+
+    struct schema_chunk
+    {
+        ULONG id;
+        ULONG size;
+    };
+
+    struct event_chunk
+    {
+        EVENT_HEADER       header;
+        ETW_BUFFER_CONTEXT buffer_context;
+        ULONG              schema_id;
+        USHORT             extended_data_count;
+        USHORT             user_data_length;
+        ULONG              user_data_offset;
+    };
+
+    /**
+     * <summary>
+     *   The parts of an EVENT_HEADER (and of the buffer context) that are
+     *   the same for every event of a kind. Compared and hashed bytewise, so
+     *   it has no padding.
+     * </summary>
+     */
+    struct header_template
+    {
+        GUID             provider_id;
+        EVENT_DESCRIPTOR descriptor;
+        USHORT           size;
+        USHORT           header_type;
+        USHORT           flags;
+        USHORT           event_property;
+        USHORT           logger_id;
+        USHORT           reserved[3];
+    };
+
+    static_assert(sizeof(header_template) == 48, "header_template must not have padding");
+
+    struct header_chunk
+    {
+        ULONG           id;
+        ULONG           schema_id;
+        header_template header;
+    };
+
+    struct block_chunk
+    {
+        ULONG event_count;
+        ULONG headers_size;
+        ULONG user_data_size;
+        ULONG stored_user_data_size;
+    };
+
+    namespace details {
+
+        inline size_t align8(size_t size)
+        {
+            return (size + 7) & ~static_cast<size_t>(7);
+        }
+
+        template <typename T>
+        T read(const BYTE *data)
+        {
+            T value;
+            memcpy(&value, data, sizeof(T));
+            return value;
+        }
+
+        template <typename T>
+        void append(std::vector<BYTE> &out, const T &value)
+        {
+            auto bytes = reinterpret_cast<const BYTE*>(&value);
+            out.insert(out.end(), bytes, bytes + sizeof(T));
+        }
+
+        inline void pad8(std::vector<BYTE> &out)
+        {
+            out.resize(align8(out.size()), 0);
+        }
+
+        /**
+         * <summary>
+         *   Returns the number of bytes append_event takes for the record,
+         *   padding included.
+         * </summary>
+         */
+        size_t raw_event_size(const EVENT_RECORD &record);
+
+        /**
+         * <summary>
+         *   Appends a complete event chunk for the given record.
+         * </summary>
+         */
+        void append_event(std::vector<BYTE> &out, const EVENT_RECORD &record, ULONG schema_id);
+
+        /**
+         * <summary>
+         *   Appends a complete schema chunk.
+         * </summary>
+         */
+        void append_schema(std::vector<BYTE> &out, ULONG id, const BYTE *schema, ULONG size);
+
+        /**
+         * <summary>
+         *   Rebuilds the EVENT_RECORD stored in an event chunk payload. The
+         *   record points into the payload and into the given item array,
+         *   which keeps its capacity across calls.
+         * </summary>
+         */
+        bool decode_event(
+            const BYTE *payload,
+            size_t size,
+            EVENT_RECORD &record,
+            ULONG &schema_id,
+            std::vector<EVENT_HEADER_EXTENDED_DATA_ITEM> &items);
+
+    } /* namespace details */
+
+    // Implementation
+    // ------------------------------------------------------------------------
+
+    namespace details {
+
+        inline size_t raw_event_size(const EVENT_RECORD &record)
+        {
+            size_t size = sizeof(chunk_header) + sizeof(event_chunk) +
+                sizeof(EVENT_HEADER_EXTENDED_DATA_ITEM) * record.ExtendedDataCount;
+
+            for (USHORT i = 0; i < record.ExtendedDataCount; ++i) {
+                size += align8(record.ExtendedData[i].DataSize);
+            }
+
+            return align8(size + record.UserDataLength);
+        }
+
+        inline void append_event(std::vector<BYTE> &out, const EVENT_RECORD &record, ULONG schema_id)
+        {
+            size_t start = out.size();
+            append(out, chunk_header{ chunk_type::event, 0 });
+            size_t payload = out.size();
+
+            size_t items_size = sizeof(EVENT_HEADER_EXTENDED_DATA_ITEM) * record.ExtendedDataCount;
+            size_t user_data_offset = sizeof(event_chunk) + items_size;
+            for (USHORT i = 0; i < record.ExtendedDataCount; ++i) {
+                user_data_offset += align8(record.ExtendedData[i].DataSize);
+            }
+
+            event_chunk event = {};
+            event.header              = record.EventHeader;
+            event.buffer_context      = record.BufferContext;
+            event.schema_id           = schema_id;
+            event.extended_data_count = record.ExtendedDataCount;
+            event.user_data_length    = record.UserDataLength;
+            event.user_data_offset    = static_cast<ULONG>(user_data_offset);
+            append(out, event);
+
+            size_t data_offset = sizeof(event_chunk) + items_size;
+            for (USHORT i = 0; i < record.ExtendedDataCount; ++i) {
+                auto item = record.ExtendedData[i];
+                item.DataPtr = data_offset;
+                append(out, item);
+                data_offset += align8(item.DataSize);
+            }
+
+            for (USHORT i = 0; i < record.ExtendedDataCount; ++i) {
+                const auto &item = record.ExtendedData[i];
+                auto data = reinterpret_cast<const BYTE*>(item.DataPtr);
+                out.insert(out.end(), data, data + item.DataSize);
+                pad8(out);
+            }
+
+            auto user_data = static_cast<const BYTE*>(record.UserData);
+            out.insert(out.end(), user_data, user_data + record.UserDataLength);
+
+            ULONG size = static_cast<ULONG>(out.size() - payload);
+            memcpy(out.data() + start + offsetof(chunk_header, size), &size, sizeof(size));
+            pad8(out);
+        }
+
+        inline void append_schema(std::vector<BYTE> &out, ULONG id, const BYTE *schema, ULONG size)
+        {
+            append(out, chunk_header{ chunk_type::schema, static_cast<ULONG>(sizeof(schema_chunk) + size) });
+            append(out, schema_chunk{ id, size });
+            out.insert(out.end(), schema, schema + size);
+            pad8(out);
+        }
+
+        inline bool decode_event(
+            const BYTE *payload,
+            size_t size,
+            EVENT_RECORD &record,
+            ULONG &schema_id,
+            std::vector<EVENT_HEADER_EXTENDED_DATA_ITEM> &items)
+        {
+            if (size < sizeof(event_chunk)) {
+                return false;
+            }
+
+            auto event = read<event_chunk>(payload);
+            size_t items_end = sizeof(event_chunk) + sizeof(EVENT_HEADER_EXTENDED_DATA_ITEM) * event.extended_data_count;
+            if (items_end > size || size_t(event.user_data_offset) + event.user_data_length > size) {
+                return false;
+            }
+
+            items.resize(event.extended_data_count);
+            for (USHORT i = 0; i < event.extended_data_count; ++i) {
+                auto &item = items[i];
+                item = read<EVENT_HEADER_EXTENDED_DATA_ITEM>(payload + sizeof(event_chunk) + i * sizeof(item));
+                if (item.DataPtr > size || item.DataSize > size - item.DataPtr) {
+                    return false;
+                }
+
+                item.DataPtr = reinterpret_cast<ULONGLONG>(payload + item.DataPtr);
+            }
+
+            record = {};
+            record.EventHeader       = event.header;
+            record.BufferContext     = event.buffer_context;
+            record.ExtendedDataCount = event.extended_data_count;
+            record.ExtendedData      = items.empty() ? nullptr : items.data();
+            record.UserDataLength    = event.user_data_length;
+            record.UserData          = const_cast<BYTE*>(payload + event.user_data_offset);
+
+            schema_id = event.schema_id;
+            return true;
+        }
+
+    } /* namespace details */
+
+} /* namespace capture */ } /* namespace krabs */
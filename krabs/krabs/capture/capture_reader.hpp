@@ -0,0 +1,343 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#ifndef  WIN32_LEAN_AND_MEAN
+#define  WIN32_LEAN_AND_MEAN
+#endif
+
+#include <windows.h>
+#include <evntcons.h>
+
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../compiler_check.hpp"
+#include "../trace.hpp"
+#include "../trace_context.hpp"
+#include "capture_format.hpp"
+#include "compact_codec.hpp"
+
+namespace krabs { namespace capture {
+
+    /**
+     * <summary>
+     *   Counters describing what a capture reader found in a file.
+     * </summary>
+     */
+    struct reader_stats
+    {
+        uint64_t events;
+        uint64_t schemas;
+        uint64_t malformed;
+        bool     truncated;
+    };
+
+    /**
+     * <summary>
+     *   Replays a capture file written by capture::writer. Events are handed
+     *   out in the order they were recorded, as fast as they can be
+     *   dispatched, and the schemas stored in the file are given to the
+     *   trace's schema locator so that parsing them never calls TDH.
+     *   Both encodings are read transparently.
+     * </summary>
+     */
+    class reader {
+    public:
+
+        /**
+         * <summary>
+         *   Opens and maps the given capture file.
+         * </summary>
+         * <example>
+         *   krabs::capture::reader reader(L"C:\\captures\\powershell.krabs");
+         *   krabs::user_trace trace;
+         *   trace.enable(powershell_provider);
+         *   reader.replay(trace);
+         * </example>
+         */
+        reader(const std::wstring &file_name);
+
+        /**
+         * <summary>
+         *   Reads a capture that is already in memory. The memory has to stay
+         *   valid for the lifetime of the reader.
+         * </summary>
+         */
+        reader(const BYTE *data, size_t size);
+
+        ~reader();
+
+        reader(const reader &) = delete;
+        reader &operator=(const reader &) = delete;
+
+        /**
+         * <summary>
+         *   Sends every event of the capture through the providers and
+         *   filters enabled on the given trace, as if it came from ETW. The
+         *   trace doesn't need to be started.
+         * </summary>
+         */
+        template <typename T>
+        void replay(krabs::trace<T> &trace);
+
+        /**
+         * <summary>
+         *   Calls the given function with every event of the capture.
+         * </summary>
+         */
+        void replay(const std::function<void(const EVENT_RECORD &, const krabs::trace_context &)> &callback);
+
+        /**
+         * <summary>
+         *   Returns the counters collected by the last replay.
+         * </summary>
+         */
+        reader_stats stats() const;
+
+    private:
+        struct schema_ref {
+            const BYTE *data;
+            ULONG size;
+            bool seeded;
+        };
+
+        void replay(
+            const krabs::trace_context &context,
+            const std::function<void(const EVENT_RECORD &)> &on_record);
+
+        void dispatch(
+            const EVENT_RECORD &record,
+            ULONG schema_id,
+            const krabs::trace_context &context,
+            const std::function<void(const EVENT_RECORD &)> &on_record);
+
+    private:
+        HANDLE file_;
+        HANDLE mapping_;
+        const BYTE *data_;
+        size_t size_;
+        bool owns_view_;
+
+        std::vector<schema_ref> schemas_;
+        std::vector<header_chunk> templates_;
+        std::vector<EVENT_HEADER_EXTENDED_DATA_ITEM> items_;
+        details::block_decoder block_;
+        reader_stats stats_;
+
+        krabs::trace_context context_;
+    };
+
+    // Implementation
+    // ------------------------------------------------------------------------
+
+    inline reader::reader(const std::wstring &file_name)
+    : file_(INVALID_HANDLE_VALUE)
+    , mapping_(nullptr)
+    , data_(nullptr)
+    , size_(0)
+    , owns_view_(true)
+    , schemas_()
+    , templates_()
+    , items_()
+    , block_()
+    , stats_()
+    , context_()
+    {
+        file_ = CreateFileW(
+            file_name.c_str(),
+            GENERIC_READ,
+            FILE_SHARE_READ | FILE_SHARE_WRITE,
+            nullptr,
+            OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL,
+            nullptr);
+
+        if (file_ == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error("Could not open the capture file");
+        }
+
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file_, &size)) {
+            CloseHandle(file_);
+            throw std::runtime_error("Could not get the size of the capture file");
+        }
+
+        size_ = static_cast<size_t>(size.QuadPart);
+        if (size_ > 0) {
+            mapping_ = CreateFileMappingW(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        }
+        if (mapping_ != nullptr) {
+            data_ = static_cast<const BYTE*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+        }
+
+        if (data_ == nullptr) {
+            if (mapping_ != nullptr) {
+                CloseHandle(mapping_);
+            }
+            CloseHandle(file_);
+            throw std::runtime_error("Could not map the capture file");
+        }
+
+        if (size_ < sizeof(file_header) ||
+            details::read<file_header>(data_).magic != constants::file_magic) {
+            UnmapViewOfFile(data_);
+            CloseHandle(mapping_);
+            CloseHandle(file_);
+            throw std::runtime_error("Not a krabs capture file");
+        }
+    }
+
+    inline reader::reader(const BYTE *data, size_t size)
+    : file_(INVALID_HANDLE_VALUE)
+    , mapping_(nullptr)
+    , data_(data)
+    , size_(size)
+    , owns_view_(false)
+    , schemas_()
+    , templates_()
+    , items_()
+    , block_()
+    , stats_()
+    , context_()
+    {
+        if (size_ < sizeof(file_header) ||
+            details::read<file_header>(data_).magic != constants::file_magic) {
+            throw std::runtime_error("Not a krabs capture file");
+        }
+    }
+
+    inline reader::~reader()
+    {
+        if (owns_view_) {
+            UnmapViewOfFile(data_);
+            CloseHandle(mapping_);
+            CloseHandle(file_);
+        }
+    }
+
+    inline reader_stats reader::stats() const
+    {
+        return stats_;
+    }
+
+    template <typename T>
+    void reader::replay(krabs::trace<T> &trace)
+    {
+        krabs::details::trace_manager<krabs::trace<T>> manager(trace);
+
+        replay(manager.context(), [&](const EVENT_RECORD &record) { manager.on_event(record); });
+    }
+
+    inline void reader::replay(const std::function<void(const EVENT_RECORD &, const krabs::trace_context &)> &callback)
+    {
+        replay(context_, [&](const EVENT_RECORD &record) { callback(record, context_); });
+    }
+
+    inline void reader::replay(
+        const krabs::trace_context &context,
+        const std::function<void(const EVENT_RECORD &)> &on_record)
+    {
+        stats_ = {};
+        schemas_.clear();
+        templates_.clear();
+
+        auto header = details::read<file_header>(data_);
+        if (header.version != constants::file_version || header.header_size < sizeof(file_header)) {
+            throw std::runtime_error("Unsupported krabs capture file version");
+        }
+
+        size_t offset = details::align8(header.header_size);
+        while (offset < size_) {
+            if (size_ - offset < sizeof(chunk_header)) {
+                stats_.truncated = true;
+                break;
+            }
+
+            auto chunk = details::read<chunk_header>(data_ + offset);
+            const BYTE *payload = data_ + offset + sizeof(chunk_header);
+            if (size_ - offset - sizeof(chunk_header) < chunk.size) {
+                stats_.truncated = true;
+                break;
+            }
+
+            offset += details::align8(sizeof(chunk_header) + chunk.size);
+
+            if (chunk.type == chunk_type::schema) {
+                auto schema = chunk.size >= sizeof(schema_chunk)
+                    ? details::read<schema_chunk>(payload)
+                    : schema_chunk{ 0, 0 };
+
+                // Writers number schemas in the order they write them.
+                if (schema.size == 0 || schema.size > chunk.size - sizeof(schema_chunk) ||
+                    schema.id != schemas_.size()) {
+                    ++stats_.malformed;
+                    continue;
+                }
+
+                schemas_.push_back({ payload + sizeof(schema_chunk), schema.size, false });
+                ++stats_.schemas;
+            } else if (chunk.type == chunk_type::event) {
+                EVENT_RECORD record;
+                ULONG schema_id = constants::no_schema;
+                if (!details::decode_event(payload, chunk.size, record, schema_id, items_)) {
+                    ++stats_.malformed;
+                    continue;
+                }
+
+                dispatch(record, schema_id, context, on_record);
+            } else if (chunk.type == chunk_type::header) {
+                if (chunk.size < sizeof(header_chunk)) {
+                    ++stats_.malformed;
+                    continue;
+                }
+
+                auto header = details::read<header_chunk>(payload);
+                if (header.id != templates_.size()) {
+                    ++stats_.malformed;
+                    continue;
+                }
+
+                templates_.push_back(header);
+            } else if (chunk.type == chunk_type::block) {
+                if (!block_.reset(payload, chunk.size)) {
+                    ++stats_.malformed;
+                    continue;
+                }
+
+                EVENT_RECORD record;
+                ULONG schema_id = constants::no_schema;
+                bool malformed = false;
+                while (block_.next(templates_, record, schema_id, malformed)) {
+                    dispatch(record, schema_id, context, on_record);
+                }
+
+                stats_.malformed += malformed ? 1 : 0;
+            }
+
+            // Unknown chunk types are skipped so newer writers stay readable.
+        }
+    }
+
+    inline void reader::dispatch(
+        const EVENT_RECORD &record,
+        ULONG schema_id,
+        const krabs::trace_context &context,
+        const std::function<void(const EVENT_RECORD &)> &on_record)
+    {
+        // Seed the schema the first time it is used rather than when it is
+        // read, because the key comes from the event.
+        if (schema_id < schemas_.size() && schemas_[schema_id].data && !schemas_[schema_id].seeded) {
+            auto &schema = schemas_[schema_id];
+            context.schema_locator.add_event_schema(record, schema.data, schema.size);
+            schema.seeded = true;
+        }
+
+        ++stats_.events;
+        on_record(record);
+    }
+
+} /* namespace capture */ } /* namespace krabs */
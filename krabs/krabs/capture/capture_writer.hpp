@@ -0,0 +1,327 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#ifndef  WIN32_LEAN_AND_MEAN
+#define  WIN32_LEAN_AND_MEAN
+#endif
+
+#include <windows.h>
+#include <evntcons.h>
+
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../compiler_check.hpp"
+#include "../errors.hpp"
+#include "../schema_locator.hpp"
+#include "../trace_context.hpp"
+#include "capture_format.hpp"
+#include "compact_codec.hpp"
+
+namespace krabs { namespace capture {
+
+    /**
+     * <summary>
+     *   Counters describing what a capture writer has recorded.
+     * </summary>
+     */
+    struct writer_stats
+    {
+        uint64_t events;
+        uint64_t schemas;
+        uint64_t bytes;
+
+        // What the events would have taken with encoding::raw, to compare
+        // against bytes.
+        uint64_t raw_bytes;
+    };
+
+    namespace details {
+
+        struct header_template_hash {
+            size_t operator()(const header_template &header) const
+            {
+                // FNV-1a over the bytes; header_template has no padding.
+                auto bytes = reinterpret_cast<const BYTE*>(&header);
+                size_t h = static_cast<size_t>(14695981039346656037ULL);
+                for (size_t i = 0; i < sizeof(header); ++i) {
+                    h = (h ^ bytes[i]) * static_cast<size_t>(1099511628211ULL);
+                }
+                return h;
+            }
+        };
+
+        struct header_template_equal {
+            bool operator()(const header_template &lhs, const header_template &rhs) const
+            {
+                return memcmp(&lhs, &rhs, sizeof(header_template)) == 0;
+            }
+        };
+
+    } /* namespace details */
+
+    /**
+     * <summary>
+     *   Records the events it is called with into a capture file that a
+     *   capture::reader can replay later without ETW or TDH. Each event is
+     *   stored with its header, user data and extended data; the schema of
+     *   each distinct kind of event is stored once.
+     * </summary>
+     * <remarks>
+     *   The writer is a callback: add it to the providers to record with
+     *   add_on_event_callback. It isn't synchronized, so use one writer per
+     *   trace.
+     *   With encoding::compact, events are held back until a block fills up
+     *   or flush is called, and the destructor flushes.
+     * </remarks>
+     */
+    class writer {
+    public:
+
+        /**
+         * <summary>
+         *   Creates (or truncates) the given capture file.
+         * </summary>
+         * <example>
+         *   krabs::capture::writer writer(
+         *       L"C:\\captures\\powershell.krabs",
+         *       krabs::capture::encoding::compact);
+         *   krabs::provider<> powershell(L"Microsoft-Windows-PowerShell");
+         *   powershell.add_on_event_callback(writer);
+         * </example>
+         */
+        writer(const std::wstring &file_name, encoding mode = encoding::raw);
+
+        /**
+         * <summary>
+         *   Appends the capture to the given vector instead of a file. The
+         *   vector has to outlive the writer.
+         * </summary>
+         */
+        writer(std::vector<BYTE> &destination, encoding mode = encoding::raw);
+
+        ~writer();
+
+        writer(const writer &) = delete;
+        writer &operator=(const writer &) = delete;
+
+        /**
+         * <summary>
+         *   Records an event. Its schema is taken from the context's schema
+         *   locator; events TDH has no schema for are recorded without one.
+         * </summary>
+         */
+        void operator()(const EVENT_RECORD &record, const krabs::trace_context &context);
+
+        /**
+         * <summary>
+         *   Closes the current block, if any, and writes out the buffered
+         *   chunks.
+         * </summary>
+         */
+        void flush();
+
+        /**
+         * <summary>
+         *   Returns the counters of this writer.
+         * </summary>
+         */
+        writer_stats stats() const;
+
+    private:
+        ULONG schema_id(const EVENT_RECORD &record, const krabs::trace_context &context);
+        ULONG template_id(const EVENT_RECORD &record, const krabs::trace_context &context);
+        void write_out();
+
+        // Chunks are gathered in memory and written out in blocks of about
+        // this size.
+        static const size_t flush_threshold = 1024 * 1024;
+
+        // A compact block is closed once its headers and user data reach
+        // this size, so a reader never has to hold much more in memory.
+        static const size_t block_threshold = 64 * 1024;
+
+    private:
+        HANDLE file_;
+        std::vector<BYTE> buffer_;
+        std::vector<BYTE> &out_;
+        encoding encoding_;
+        std::unordered_map<schema_key, ULONG> schema_ids_;
+        std::unordered_map<
+            header_template,
+            ULONG,
+            details::header_template_hash,
+            details::header_template_equal> template_ids_;
+        details::block_encoder block_;
+        writer_stats stats_;
+    };
+
+    // Implementation
+    // ------------------------------------------------------------------------
+
+    inline writer::writer(const std::wstring &file_name, encoding mode)
+    : file_(INVALID_HANDLE_VALUE)
+    , buffer_()
+    , out_(buffer_)
+    , encoding_(mode)
+    , schema_ids_()
+    , template_ids_()
+    , block_()
+    , stats_()
+    {
+        file_ = CreateFileW(
+            file_name.c_str(),
+            GENERIC_WRITE,
+            FILE_SHARE_READ,
+            nullptr,
+            CREATE_ALWAYS,
+            FILE_ATTRIBUTE_NORMAL,
+            nullptr);
+
+        if (file_ == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error("Could not create the capture file");
+        }
+
+        buffer_.reserve(flush_threshold + 64 * 1024);
+        details::append(out_, file_header{ constants::file_magic, constants::file_version, sizeof(file_header) });
+        stats_.bytes = sizeof(file_header);
+    }
+
+    inline writer::writer(std::vector<BYTE> &destination, encoding mode)
+    : file_(INVALID_HANDLE_VALUE)
+    , buffer_()
+    , out_(destination)
+    , encoding_(mode)
+    , schema_ids_()
+    , template_ids_()
+    , block_()
+    , stats_()
+    {
+        details::append(out_, file_header{ constants::file_magic, constants::file_version, sizeof(file_header) });
+        stats_.bytes = sizeof(file_header);
+    }
+
+    inline writer::~writer()
+    {
+        try {
+            flush();
+        } catch (...) {
+            // Nowhere to report this from a destructor.
+        }
+
+        if (file_ != INVALID_HANDLE_VALUE) {
+            CloseHandle(file_);
+        }
+    }
+
+    inline void writer::operator()(const EVENT_RECORD &record, const krabs::trace_context &context)
+    {
+        size_t before = out_.size();
+
+        if (encoding_ == encoding::compact) {
+            block_.add(record, template_id(record, context));
+            if (block_.size() >= block_threshold) {
+                block_.flush(out_);
+            }
+        } else {
+            details::append_event(out_, record, schema_id(record, context));
+        }
+
+        ++stats_.events;
+        stats_.bytes += out_.size() - before;
+        stats_.raw_bytes += details::raw_event_size(record);
+
+        if (out_.size() >= flush_threshold) {
+            write_out();
+        }
+    }
+
+    inline void writer::flush()
+    {
+        size_t before = out_.size();
+        block_.flush(out_);
+        stats_.bytes += out_.size() - before;
+
+        write_out();
+    }
+
+    inline void writer::write_out()
+    {
+        if (file_ == INVALID_HANDLE_VALUE || buffer_.empty()) {
+            return;
+        }
+
+        DWORD written = 0;
+        if (!WriteFile(file_, buffer_.data(), static_cast<DWORD>(buffer_.size()), &written, nullptr) ||
+            written != buffer_.size()) {
+            throw std::runtime_error("Could not write to the capture file");
+        }
+
+        buffer_.clear();
+    }
+
+    inline writer_stats writer::stats() const
+    {
+        return stats_;
+    }
+
+    inline ULONG writer::schema_id(const EVENT_RECORD &record, const krabs::trace_context &context)
+    {
+        auto key = schema_key(record);
+        auto found = schema_ids_.find(key);
+        if (found != schema_ids_.end()) {
+            return found->second;
+        }
+
+        ULONG id = constants::no_schema;
+        try {
+            ULONG size = 0;
+            auto schema = context.schema_locator.get_event_schema(record, size);
+
+            id = static_cast<ULONG>(stats_.schemas++);
+            details::append_schema(out_, id, reinterpret_cast<const BYTE*>(schema), size);
+        } catch (const std::exception &) {
+            // Still worth recording: the header and user data stand alone.
+        }
+
+        schema_ids_.emplace(key, id);
+        return id;
+    }
+
+    inline ULONG writer::template_id(const EVENT_RECORD &record, const krabs::trace_context &context)
+    {
+        header_template header;
+        memset(&header, 0, sizeof(header));
+        header.provider_id    = record.EventHeader.ProviderId;
+        header.descriptor     = record.EventHeader.EventDescriptor;
+        header.size           = record.EventHeader.Size;
+        header.header_type    = record.EventHeader.HeaderType;
+        header.flags          = record.EventHeader.Flags;
+        header.event_property = record.EventHeader.EventProperty;
+        header.logger_id      = record.BufferContext.LoggerId;
+
+        auto found = template_ids_.find(header);
+        if (found != template_ids_.end()) {
+            return found->second;
+        }
+
+        // The schema goes out first; its key is part of the template, so
+        // there is one schema per template at most.
+        header_chunk chunk;
+        chunk.schema_id = schema_id(record, context);
+        chunk.id        = static_cast<ULONG>(template_ids_.size());
+        chunk.header    = header;
+
+        details::append(out_, chunk_header{ chunk_type::header, sizeof(header_chunk) });
+        details::append(out_, chunk);
+        details::pad8(out_);
+
+        template_ids_.emplace(header, chunk.id);
+        return chunk.id;
+    }
+
+} /* namespace capture */ } /* namespace krabs */
@@ -0,0 +1,570 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#ifndef  WIN32_LEAN_AND_MEAN
+#define  WIN32_LEAN_AND_MEAN
+#endif
+
+#include <windows.h>
+#include <evntcons.h>
+
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "../compiler_check.hpp"
+#include "capture_format.hpp"
+
+namespace krabs { namespace capture { namespace details {
+
+    /**
+     * <summary>
+     *   Appends an unsigned LEB128 varint.
+     * </summary>
+     */
+    void put_varint(std::vector<BYTE> &out, ULONGLONG value);
+
+    /**
+     * <summary>
+     *   Reads an unsigned LEB128 varint, advancing the cursor. Returns false
+     *   if the varint runs past the end or is longer than 64 bits.
+     * </summary>
+     */
+    bool get_varint(const BYTE *&cursor, const BYTE *end, ULONGLONG &value);
+
+    inline ULONGLONG zigzag(LONGLONG value)
+    {
+        return (static_cast<ULONGLONG>(value) << 1) ^ static_cast<ULONGLONG>(value >> 63);
+    }
+
+    inline LONGLONG unzigzag(ULONGLONG value)
+    {
+        return static_cast<LONGLONG>(value >> 1) ^ -static_cast<LONGLONG>(value & 1);
+    }
+
+    /**
+     * <summary>
+     *   Compresses with a small LZ77 coder: a sequence of (literal run,
+     *   match length, match offset) triples, all varints, with matches found
+     *   through a hash of the next four bytes and offsets of up to 64KB.
+     *   The point is to squeeze the repetition out of user data quickly,
+     *   not to compete with general purpose compressors.
+     * </summary>
+     */
+    void lz_compress(const BYTE *data, size_t size, std::vector<BYTE> &out);
+
+    /**
+     * <summary>
+     *   Decompresses exactly `size` bytes into `out`. Returns false when the
+     *   input is malformed or doesn't produce exactly that many bytes.
+     * </summary>
+     */
+    bool lz_decompress(const BYTE *data, size_t data_size, BYTE *out, size_t size);
+
+    /**
+     * <summary>
+     *   Gathers events into a block_chunk for encoding::compact.
+     * </summary>
+     */
+    class block_encoder {
+    public:
+        block_encoder();
+
+        /**
+         * <summary>
+         *   Adds an event whose header matches the template with the given id.
+         * </summary>
+         */
+        void add(const EVENT_RECORD &record, ULONG template_id);
+
+        size_t count() const;
+
+        /**
+         * <summary>
+         *   Size of the block before the user data is compressed.
+         * </summary>
+         */
+        size_t size() const;
+
+        /**
+         * <summary>
+         *   Appends the block as a chunk and starts a new one.
+         * </summary>
+         */
+        void flush(std::vector<BYTE> &out);
+
+    private:
+        std::vector<BYTE> headers_;
+        std::vector<BYTE> user_data_;
+        std::vector<BYTE> compressed_;
+        size_t count_;
+        LONGLONG last_timestamp_;
+        ULONG last_process_id_;
+        ULONG last_thread_id_;
+    };
+
+    /**
+     * <summary>
+     *   Turns a block_chunk back into EVENT_RECORDs, one at a time. The
+     *   records point into buffers owned by the decoder, which are reused by
+     *   the next call to reset.
+     * </summary>
+     */
+    class block_decoder {
+    public:
+        block_decoder();
+
+        /**
+         * <summary>
+         *   Starts decoding the given block payload. Returns false if the
+         *   block header or its user data is malformed.
+         * </summary>
+         */
+        bool reset(const BYTE *payload, size_t size);
+
+        /**
+         * <summary>
+         *   Decodes the next event. Returns false once the block is exhausted
+         *   and sets `malformed` if it ended early.
+         * </summary>
+         */
+        bool next(
+            const std::vector<header_chunk> &templates,
+            EVENT_RECORD &record,
+            ULONG &schema_id,
+            bool &malformed);
+
+    private:
+        std::vector<BYTE> user_data_;
+        std::vector<EVENT_HEADER_EXTENDED_DATA_ITEM> items_;
+        const BYTE *cursor_;
+        const BYTE *end_;
+        size_t remaining_;
+        size_t user_data_offset_;
+        LONGLONG last_timestamp_;
+        ULONG last_process_id_;
+        ULONG last_thread_id_;
+    };
+
+    // Per event flags in a compact block.
+    namespace compact_flags {
+        const BYTE same_ids       = 0x01;
+        const BYTE activity_id    = 0x02;
+        const BYTE processor_time = 0x04;
+        const BYTE extended_data  = 0x08;
+    }
+
+    // Implementation
+    // ------------------------------------------------------------------------
+
+    inline void put_varint(std::vector<BYTE> &out, ULONGLONG value)
+    {
+        while (value >= 0x80) {
+            out.push_back(static_cast<BYTE>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<BYTE>(value));
+    }
+
+    inline bool get_varint(const BYTE *&cursor, const BYTE *end, ULONGLONG &value)
+    {
+        value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (cursor == end) {
+                return false;
+            }
+
+            BYTE b = *cursor++;
+            value |= static_cast<ULONGLONG>(b & 0x7F) << shift;
+            if ((b & 0x80) == 0) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    inline void lz_compress(const BYTE *data, size_t size, std::vector<BYTE> &out)
+    {
+        const size_t min_match = 4;
+        const size_t max_offset = 0xFFFF;
+        const int hash_bits = 12;
+
+        std::vector<size_t> table(size_t(1) << hash_bits, SIZE_MAX);
+        const auto hash = [&](size_t at) {
+            uint32_t v;
+            memcpy(&v, data + at, sizeof(v));
+            return static_cast<uint32_t>(v * 2654435761u) >> (32 - hash_bits);
+        };
+
+        size_t anchor = 0;
+        size_t i = 0;
+        while (i + min_match <= size) {
+            auto &slot = table[hash(i)];
+            size_t candidate = slot;
+            slot = i;
+
+            if (candidate == SIZE_MAX || i - candidate > max_offset ||
+                memcmp(data + candidate, data + i, min_match) != 0) {
+                ++i;
+                continue;
+            }
+
+            size_t length = min_match;
+            while (i + length < size && data[candidate + length] == data[i + length]) {
+                ++length;
+            }
+
+            put_varint(out, i - anchor);
+            out.insert(out.end(), data + anchor, data + i);
+            put_varint(out, length);
+            put_varint(out, i - candidate);
+
+            i += length;
+            anchor = i;
+        }
+
+        // The final run of literals is terminated by a zero length match.
+        put_varint(out, size - anchor);
+        out.insert(out.end(), data + anchor, data + size);
+        put_varint(out, 0);
+    }
+
+    inline bool lz_decompress(const BYTE *data, size_t data_size, BYTE *out, size_t size)
+    {
+        const BYTE *cursor = data;
+        const BYTE *end = data + data_size;
+        size_t written = 0;
+
+        for (;;) {
+            ULONGLONG literals = 0;
+            if (!get_varint(cursor, end, literals) ||
+                literals > size_t(end - cursor) || literals > size - written) {
+                return false;
+            }
+
+            memcpy(out + written, cursor, static_cast<size_t>(literals));
+            cursor += literals;
+            written += static_cast<size_t>(literals);
+
+            ULONGLONG length = 0;
+            if (!get_varint(cursor, end, length)) {
+                return false;
+            }
+
+            if (length == 0) {
+                return written == size && cursor == end;
+            }
+
+            ULONGLONG offset = 0;
+            if (!get_varint(cursor, end, offset) ||
+                offset == 0 || offset > written || length > size - written) {
+                return false;
+            }
+
+            // Matches may overlap the bytes they produce, so copy forwards.
+            BYTE *to = out + written;
+            const BYTE *from = to - offset;
+            for (size_t j = 0; j < length; ++j) {
+                to[j] = from[j];
+            }
+            written += static_cast<size_t>(length);
+        }
+    }
+
+    inline block_encoder::block_encoder()
+    : headers_()
+    , user_data_()
+    , compressed_()
+    , count_(0)
+    , last_timestamp_(0)
+    , last_process_id_(0)
+    , last_thread_id_(0)
+    {}
+
+    inline size_t block_encoder::count() const
+    {
+        return count_;
+    }
+
+    inline size_t block_encoder::size() const
+    {
+        return headers_.size() + user_data_.size();
+    }
+
+    inline void block_encoder::add(const EVENT_RECORD &record, ULONG template_id)
+    {
+        static const GUID empty_guid = {};
+        const auto &header = record.EventHeader;
+
+        BYTE flags = 0;
+        if (count_ > 0 && header.ProcessId == last_process_id_ && header.ThreadId == last_thread_id_) {
+            flags |= compact_flags::same_ids;
+        }
+        if (memcmp(&header.ActivityId, &empty_guid, sizeof(GUID)) != 0) {
+            flags |= compact_flags::activity_id;
+        }
+        if (header.ProcessorTime != 0) {
+            flags |= compact_flags::processor_time;
+        }
+        if (record.ExtendedDataCount > 0) {
+            flags |= compact_flags::extended_data;
+        }
+
+        put_varint(headers_, template_id);
+        put_varint(headers_, zigzag(header.TimeStamp.QuadPart - last_timestamp_));
+        headers_.push_back(flags);
+
+        if ((flags & compact_flags::same_ids) == 0) {
+            put_varint(headers_, header.ProcessId);
+            put_varint(headers_, header.ThreadId);
+        }
+
+        put_varint(headers_, record.BufferContext.ProcessorIndex);
+
+        if (flags & compact_flags::activity_id) {
+            append(headers_, header.ActivityId);
+        }
+        if (flags & compact_flags::processor_time) {
+            put_varint(headers_, header.ProcessorTime);
+        }
+
+        if (flags & compact_flags::extended_data) {
+            put_varint(headers_, record.ExtendedDataCount);
+            for (USHORT i = 0; i < record.ExtendedDataCount; ++i) {
+                const auto &item = record.ExtendedData[i];
+
+                // Linkage and Reserved2 share the word after ExtType.
+                USHORT bits = 0;
+                memcpy(&bits, reinterpret_cast<const BYTE*>(&item) + 2 * sizeof(USHORT), sizeof(bits));
+
+                put_varint(headers_, item.ExtType);
+                put_varint(headers_, bits);
+                put_varint(headers_, item.DataSize);
+
+                auto data = reinterpret_cast<const BYTE*>(item.DataPtr);
+                headers_.insert(headers_.end(), data, data + item.DataSize);
+            }
+        }
+
+        put_varint(headers_, record.UserDataLength);
+        auto user_data = static_cast<const BYTE*>(record.UserData);
+        user_data_.insert(user_data_.end(), user_data, user_data + record.UserDataLength);
+
+        last_timestamp_ = header.TimeStamp.QuadPart;
+        last_process_id_ = header.ProcessId;
+        last_thread_id_ = header.ThreadId;
+        ++count_;
+    }
+
+    inline void block_encoder::flush(std::vector<BYTE> &out)
+    {
+        if (count_ == 0) {
+            return;
+        }
+
+        compressed_.clear();
+        lz_compress(user_data_.data(), user_data_.size(), compressed_);
+
+        // Keep the user data as is when it doesn't compress.
+        const auto &stored = compressed_.size() < user_data_.size() ? compressed_ : user_data_;
+
+        block_chunk block = {};
+        block.event_count           = static_cast<ULONG>(count_);
+        block.headers_size          = static_cast<ULONG>(headers_.size());
+        block.user_data_size        = static_cast<ULONG>(user_data_.size());
+        block.stored_user_data_size = static_cast<ULONG>(stored.size());
+
+        size_t payload = sizeof(block_chunk) + headers_.size() + stored.size();
+        append(out, chunk_header{ chunk_type::block, static_cast<ULONG>(payload) });
+        append(out, block);
+        out.insert(out.end(), headers_.begin(), headers_.end());
+        out.insert(out.end(), stored.begin(), stored.end());
+        pad8(out);
+
+        headers_.clear();
+        user_data_.clear();
+        count_ = 0;
+        last_timestamp_ = 0;
+        last_process_id_ = 0;
+        last_thread_id_ = 0;
+    }
+
+    inline block_decoder::block_decoder()
+    : user_data_()
+    , items_()
+    , cursor_(nullptr)
+    , end_(nullptr)
+    , remaining_(0)
+    , user_data_offset_(0)
+    , last_timestamp_(0)
+    , last_process_id_(0)
+    , last_thread_id_(0)
+    {}
+
+    inline bool block_decoder::reset(const BYTE *payload, size_t size)
+    {
+        remaining_ = 0;
+        if (size < sizeof(block_chunk)) {
+            return false;
+        }
+
+        auto block = read<block_chunk>(payload);
+        size_t available = size - sizeof(block_chunk);
+        if (block.headers_size > available ||
+            block.stored_user_data_size > available - block.headers_size ||
+            block.stored_user_data_size > block.user_data_size) {
+            return false;
+        }
+
+        const BYTE *headers = payload + sizeof(block_chunk);
+        const BYTE *stored = headers + block.headers_size;
+
+        user_data_.resize(block.user_data_size);
+        if (block.stored_user_data_size == block.user_data_size) {
+            if (!user_data_.empty()) {
+                memcpy(user_data_.data(), stored, user_data_.size());
+            }
+        } else if (!lz_decompress(stored, block.stored_user_data_size, user_data_.data(), user_data_.size())) {
+            return false;
+        }
+
+        cursor_ = headers;
+        end_ = stored;
+        remaining_ = block.event_count;
+        user_data_offset_ = 0;
+        last_timestamp_ = 0;
+        last_process_id_ = 0;
+        last_thread_id_ = 0;
+        return true;
+    }
+
+    inline bool block_decoder::next(
+        const std::vector<header_chunk> &templates,
+        EVENT_RECORD &record,
+        ULONG &schema_id,
+        bool &malformed)
+    {
+        malformed = false;
+        if (remaining_ == 0) {
+            return false;
+        }
+
+        // Anything inconsistent ends the block; the events before it are fine.
+        const auto fail = [&]() {
+            malformed = true;
+            remaining_ = 0;
+            return false;
+        };
+
+        ULONGLONG template_id = 0;
+        ULONGLONG delta = 0;
+        if (!get_varint(cursor_, end_, template_id) ||
+            template_id >= templates.size() ||
+            !get_varint(cursor_, end_, delta) || cursor_ == end_) {
+            return fail();
+        }
+
+        const auto &entry = templates[static_cast<size_t>(template_id)];
+        BYTE flags = *cursor_++;
+
+        record = {};
+        auto &header = record.EventHeader;
+        header.Size            = entry.header.size;
+        header.HeaderType      = entry.header.header_type;
+        header.Flags           = entry.header.flags;
+        header.EventProperty   = entry.header.event_property;
+        header.ProviderId      = entry.header.provider_id;
+        header.EventDescriptor = entry.header.descriptor;
+        record.BufferContext.LoggerId = entry.header.logger_id;
+
+        header.TimeStamp.QuadPart = last_timestamp_ + unzigzag(delta);
+
+        if (flags & compact_flags::same_ids) {
+            header.ProcessId = last_process_id_;
+            header.ThreadId = last_thread_id_;
+        } else {
+            ULONGLONG process_id = 0;
+            ULONGLONG thread_id = 0;
+            if (!get_varint(cursor_, end_, process_id) || !get_varint(cursor_, end_, thread_id)) {
+                return fail();
+            }
+            header.ProcessId = static_cast<ULONG>(process_id);
+            header.ThreadId = static_cast<ULONG>(thread_id);
+        }
+
+        ULONGLONG processor = 0;
+        if (!get_varint(cursor_, end_, processor)) {
+            return fail();
+        }
+        record.BufferContext.ProcessorIndex = static_cast<USHORT>(processor);
+
+        if (flags & compact_flags::activity_id) {
+            if (size_t(end_ - cursor_) < sizeof(GUID)) {
+                return fail();
+            }
+            header.ActivityId = read<GUID>(cursor_);
+            cursor_ += sizeof(GUID);
+        }
+
+        if (flags & compact_flags::processor_time) {
+            ULONGLONG processor_time = 0;
+            if (!get_varint(cursor_, end_, processor_time)) {
+                return fail();
+            }
+            header.ProcessorTime = processor_time;
+        }
+
+        items_.clear();
+        if (flags & compact_flags::extended_data) {
+            ULONGLONG count = 0;
+            if (!get_varint(cursor_, end_, count) || count > USHRT_MAX) {
+                return fail();
+            }
+
+            for (ULONGLONG i = 0; i < count; ++i) {
+                ULONGLONG type = 0;
+                ULONGLONG bits = 0;
+                ULONGLONG size = 0;
+                if (!get_varint(cursor_, end_, type) || !get_varint(cursor_, end_, bits) ||
+                    !get_varint(cursor_, end_, size) || size > USHRT_MAX || size > size_t(end_ - cursor_)) {
+                    return fail();
+                }
+
+                EVENT_HEADER_EXTENDED_DATA_ITEM item = {};
+                USHORT word = static_cast<USHORT>(bits);
+                memcpy(reinterpret_cast<BYTE*>(&item) + 2 * sizeof(USHORT), &word, sizeof(word));
+                item.ExtType  = static_cast<USHORT>(type);
+                item.DataSize = static_cast<USHORT>(size);
+                item.DataPtr  = reinterpret_cast<ULONGLONG>(cursor_);
+                items_.push_back(item);
+
+                cursor_ += size;
+            }
+        }
+
+        ULONGLONG length = 0;
+        if (!get_varint(cursor_, end_, length) || length > USHRT_MAX ||
+            length > user_data_.size() - user_data_offset_) {
+            return fail();
+        }
+
+        record.ExtendedDataCount = static_cast<USHORT>(items_.size());
+        record.ExtendedData      = items_.empty() ? nullptr : items_.data();
+        record.UserDataLength    = static_cast<USHORT>(length);
+        record.UserData          = user_data_.data() + user_data_offset_;
+        user_data_offset_ += static_cast<size_t>(length);
+
+        last_timestamp_ = header.TimeStamp.QuadPart;
+        last_process_id_ = header.ProcessId;
+        last_thread_id_ = header.ThreadId;
+
+        schema_id = entry.schema_id;
+        --remaining_;
+        return true;
+    }
+
+} /* namespace details */ } /* namespace capture */ } /* namespace krabs */
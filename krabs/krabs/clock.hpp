@@ -0,0 +1,47 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#ifndef  WIN32_LEAN_AND_MEAN
+#define  WIN32_LEAN_AND_MEAN
+#endif
+
+#include <windows.h>
+
+#include "compiler_check.hpp"
+#include "timestamp_converter.hpp"
+
+namespace krabs {
+
+    // Implementation
+    // ------------------------------------------------------------------------
+
+    inline timestamp_converter timestamp_converter::sample_now(clock_type clock, LONGLONG ticks_per_second)
+    {
+        LONGLONG timestamp = 0;
+        FILETIME now;
+
+        switch (clock) {
+        case clock_type::query_performance_counter: {
+            LARGE_INTEGER counter;
+            QueryPerformanceCounter(&counter);
+            GetSystemTimePreciseAsFileTime(&now);
+            timestamp = counter.QuadPart;
+            break;
+        }
+        case clock_type::cpu_cycle_counter:
+            timestamp = static_cast<LONGLONG>(ReadTimeStampCounter());
+            GetSystemTimePreciseAsFileTime(&now);
+            break;
+        default:
+            return timestamp_converter();
+        }
+
+        const LONGLONG filetime = static_cast<LONGLONG>(
+            (static_cast<ULONGLONG>(now.dwHighDateTime) << 32) | now.dwLowDateTime);
+
+        return timestamp_converter(clock, ticks_per_second, timestamp, filetime);
+    }
+
+} /* namespace krabs */
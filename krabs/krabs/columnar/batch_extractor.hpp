@@ -0,0 +1,259 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#ifndef  WIN32_LEAN_AND_MEAN
+#define  WIN32_LEAN_AND_MEAN
+#endif
+
+#include <windows.h>
+#include <evntcons.h>
+
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "../compiler_check.hpp"
+#include "../errors.hpp"
+#include "../guid.hpp"
+#include "../parser.hpp"
+#include "../schema.hpp"
+#include "../trace_context.hpp"
+#include "column_batch.hpp"
+
+namespace krabs { namespace columnar {
+
+    typedef void(*c_batch_callback)(const column_batch &);
+    typedef std::function<void(const column_batch &)> batch_callback;
+
+    /**
+     * <summary>
+     *   Counters describing the work done by a batch_extractor.
+     * </summary>
+     */
+    struct extractor_stats
+    {
+        uint64_t events;
+        uint64_t batches;
+
+        // Events whose schema couldn't be found or whose properties couldn't
+        // be located; they don't get a row.
+        uint64_t skipped;
+
+        // Values stored as null because their size didn't fit the column
+        // type (e.g. a different event version).
+        uint64_t mismatched;
+    };
+
+    /**
+     * <summary>
+     *   Collects selected properties of one kind of event into columns,
+     *   handing out a column_batch whenever it fills up.
+     * </summary>
+     * <remarks>
+     *   Column types come from the schema of the first event extracted.
+     *   Values are located with a parser over the schema from the trace's
+     *   schema cache and copied straight into the columns, so there's no
+     *   per-value parse&lt;T&gt; call or allocation once the buffers have
+     *   grown. The batch handed to callbacks is reused afterwards; copy or
+     *   consume it before returning.
+     * </remarks>
+     */
+    class batch_extractor {
+    public:
+
+        /**
+         * <summary>
+         *   Constructs an extractor for the given event of the given
+         *   provider, producing batches of `batch_size` rows.
+         * </summary>
+         * <example>
+         *   krabs::columnar::batch_extractor extractor(
+         *       process_provider_guid, 1, { L"ProcessID", L"ImageName" });
+         *   extractor.add_on_batch_callback([](const krabs::columnar::column_batch &batch) {
+         *       auto pids = batch.at(L"ProcessID").values&lt;uint32_t&gt;();
+         *       // ...
+         *   });
+         *   provider.add_on_event_callback(extractor);
+         * </example>
+         */
+        batch_extractor(
+            const krabs::guid &provider,
+            USHORT event_id,
+            const std::vector<std::wstring> &properties,
+            size_t batch_size = 4096);
+
+        batch_extractor(const batch_extractor &) = delete;
+        batch_extractor &operator=(const batch_extractor &) = delete;
+
+        /**
+         * <summary>
+         * Adds a function to call with each full batch.
+         * </summary>
+         */
+        void add_on_batch_callback(c_batch_callback callback);
+
+        template <typename U>
+        void add_on_batch_callback(U &callback);
+
+        template <typename U>
+        void add_on_batch_callback(const U &callback);
+
+        /**
+         * <summary>
+         *   Extracts the event if it is the one this extractor was built
+         *   for, and ignores it otherwise. Meant to be used as a provider
+         *   callback.
+         * </summary>
+         */
+        void operator()(const EVENT_RECORD &record, const krabs::trace_context &context);
+
+        /**
+         * <summary>
+         *   Hands out the rows collected so far, if any. Call this when the
+         *   trace stops; the destructor doesn't.
+         * </summary>
+         */
+        void flush();
+
+        extractor_stats stats() const;
+
+    private:
+        void extract(const EVENT_RECORD &record, const krabs::trace_context &context);
+
+    private:
+        krabs::guid provider_;
+        USHORT event_id_;
+        std::vector<std::wstring> properties_;
+        size_t batch_size_;
+        bool typed_;
+
+        column_batch batch_;
+        std::vector<property_info> located_;
+        std::deque<batch_callback> callbacks_;
+        extractor_stats stats_;
+    };
+
+    // Implementation
+    // ------------------------------------------------------------------------
+
+    inline batch_extractor::batch_extractor(
+        const krabs::guid &provider,
+        USHORT event_id,
+        const std::vector<std::wstring> &properties,
+        size_t batch_size)
+    : provider_(provider)
+    , event_id_(event_id)
+    , properties_(properties)
+    , batch_size_(batch_size)
+    , typed_(false)
+    , batch_(provider, event_id)
+    , located_()
+    , callbacks_()
+    , stats_()
+    {
+        if (batch_size_ == 0) {
+            throw krabs::invalid_parameter();
+        }
+
+        located_.reserve(properties_.size());
+    }
+
+    inline void batch_extractor::add_on_batch_callback(c_batch_callback callback)
+    {
+        // C function pointers don't interact well with std::ref, so we
+        // overload to take care of this scenario.
+        callbacks_.push_back(callback);
+    }
+
+    template <typename U>
+    void batch_extractor::add_on_batch_callback(U &callback)
+    {
+        // Keep calling the instance that was handed to us rather than a copy.
+        callbacks_.push_back(std::ref(callback));
+    }
+
+    template <typename U>
+    void batch_extractor::add_on_batch_callback(const U &callback)
+    {
+        // Temporaries can't be wrapped in a std::ref, so copy them.
+        callbacks_.push_back(callback);
+    }
+
+    inline void batch_extractor::operator()(const EVENT_RECORD &record, const krabs::trace_context &context)
+    {
+        if (record.EventHeader.EventDescriptor.Id != event_id_ ||
+            !(provider_ == record.EventHeader.ProviderId)) {
+            return;
+        }
+
+        ++stats_.events;
+        extract(record, context);
+
+        if (batch_.rows() >= batch_size_) {
+            flush();
+        }
+    }
+
+    inline void batch_extractor::extract(const EVENT_RECORD &record, const krabs::trace_context &context)
+    {
+        // Locate every property before appending anything, so an event that
+        // can't be parsed doesn't leave a partial row behind.
+        located_.clear();
+        try {
+            krabs::schema schema(record, context.schema_locator);
+            krabs::parser parser(schema);
+
+            for (const auto &name : properties_) {
+                located_.push_back(parser.find_property(name));
+            }
+        } catch (const std::exception &) {
+            ++stats_.skipped;
+            return;
+        }
+
+        if (!typed_) {
+            for (size_t i = 0; i < properties_.size(); ++i) {
+                auto type = located_[i].found()
+                    ? column_type_of(*located_[i].pEventPropertyInfo_)
+                    : column_type::binary;
+                batch_.add_column(properties_[i], type);
+            }
+            typed_ = true;
+        }
+
+        batch_.begin_row(record);
+        for (size_t i = 0; i < located_.size(); ++i) {
+            auto &column = batch_.column_at(i);
+            const auto &property = located_[i];
+
+            if (!property.found()) {
+                column.append_null();
+            } else if (!column.append(property.pPropertyIndex_, property.length_)) {
+                ++stats_.mismatched;
+            }
+        }
+    }
+
+    inline void batch_extractor::flush()
+    {
+        if (batch_.rows() == 0) {
+            return;
+        }
+
+        ++stats_.batches;
+        for (auto &callback : callbacks_) {
+            callback(batch_);
+        }
+
+        batch_.clear();
+    }
+
+    inline extractor_stats batch_extractor::stats() const
+    {
+        return stats_;
+    }
+
+} /* namespace columnar */ } /* namespace krabs */
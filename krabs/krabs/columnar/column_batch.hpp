@@ -0,0 +1,555 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#ifndef  WIN32_LEAN_AND_MEAN
+#define  WIN32_LEAN_AND_MEAN
+#endif
+
+#include <windows.h>
+#include <evntcons.h>
+#include <tdh.h>
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../compiler_check.hpp"
+#include "../guid.hpp"
+
+namespace krabs { namespace columnar {
+
+    /**
+     * <summary>
+     *   The physical type of a column. Fixed width types hold one value per
+     *   row; strings and binary hold offsets into a byte arena.
+     * </summary>
+     */
+    enum class column_type : uint8_t {
+        int8 = 1,
+        uint8,
+        int16,
+        uint16,
+        int32,
+        uint32,
+        int64,
+        uint64,
+        float32,
+        float64,
+        boolean,
+        guid,
+        unicode_string,
+        ansi_string,
+        binary,
+    };
+
+    /**
+     * <summary>
+     *   Returns the size of one value of a fixed width column type, or 0 for
+     *   the variable width ones.
+     * </summary>
+     */
+    size_t column_width(column_type type);
+
+    /**
+     * <summary>
+     *   Picks the column type for a property from its TDH description.
+     *   Properties that aren't a single scalar or string (arrays, structs)
+     *   become binary columns holding their raw bytes.
+     * </summary>
+     */
+    column_type column_type_of(const EVENT_PROPERTY_INFO &property);
+
+    namespace details {
+
+        template <typename T> struct column_type_for;
+        template <> struct column_type_for<int8_t>   { static const column_type value = column_type::int8; };
+        template <> struct column_type_for<uint8_t>  { static const column_type value = column_type::uint8; };
+        template <> struct column_type_for<int16_t>  { static const column_type value = column_type::int16; };
+        template <> struct column_type_for<uint16_t> { static const column_type value = column_type::uint16; };
+        template <> struct column_type_for<int32_t>  { static const column_type value = column_type::int32; };
+        template <> struct column_type_for<uint32_t> { static const column_type value = column_type::uint32; };
+        template <> struct column_type_for<int64_t>  { static const column_type value = column_type::int64; };
+        template <> struct column_type_for<uint64_t> { static const column_type value = column_type::uint64; };
+        template <> struct column_type_for<float>    { static const column_type value = column_type::float32; };
+        template <> struct column_type_for<double>   { static const column_type value = column_type::float64; };
+        template <> struct column_type_for<bool>     { static const column_type value = column_type::boolean; };
+        template <> struct column_type_for<GUID>     { static const column_type value = column_type::guid; };
+
+    } /* namespace details */
+
+    /**
+     * <summary>
+     *   One property of many events, stored contiguously.
+     * </summary>
+     * <remarks>
+     *   Fixed width values are packed in `data`, one per row, with null rows
+     *   zeroed. Strings and binary values are packed back to back in the
+     *   arena; row i spans [offsets[i], offsets[i + 1]). Unicode strings are
+     *   UTF-16 without terminators. Bit i of the validity bitmap is set when
+     *   row i has a value.
+     * </remarks>
+     */
+    class column {
+    public:
+
+        column(const std::wstring &name, column_type type);
+
+        const std::wstring &name() const;
+        column_type type() const;
+
+        /**
+         * <summary>Returns the number of rows in the column.</summary>
+         */
+        size_t size() const;
+
+        bool is_null(size_t row) const;
+        size_t null_count() const;
+
+        /**
+         * <summary>
+         *   Returns the values of a fixed width column, e.g.
+         *   `column.values&lt;uint32_t&gt;()`. Throws if T doesn't match the
+         *   column type.
+         * </summary>
+         */
+        template <typename T>
+        const T *values() const;
+
+        /**
+         * <summary>Returns the validity bitmap, 64 rows per word.</summary>
+         */
+        const std::vector<uint64_t> &validity() const;
+
+        /**
+         * <summary>Returns the raw bytes of a fixed width column.</summary>
+         */
+        const std::vector<BYTE> &data() const;
+
+        /**
+         * <summary>
+         *   Returns the row offsets into the arena of a variable width
+         *   column; there are size() + 1 of them.
+         * </summary>
+         */
+        const std::vector<uint32_t> &offsets() const;
+        const std::vector<BYTE> &arena() const;
+
+        std::wstring wstring_at(size_t row) const;
+        std::string string_at(size_t row) const;
+
+        /**
+         * <summary>
+         *   Appends a value given as the property's raw bytes. Returns false
+         *   (and appends a null) if the bytes don't fit the column type.
+         * </summary>
+         */
+        bool append(const BYTE *value, size_t size);
+        void append_null();
+
+        /**
+         * <summary>Removes all rows, keeping the memory for reuse.</summary>
+         */
+        void clear();
+
+    private:
+        void set_valid(size_t row);
+
+    private:
+        std::wstring name_;
+        column_type type_;
+        size_t width_;
+        size_t rows_;
+        size_t nulls_;
+        std::vector<uint64_t> validity_;
+        std::vector<BYTE> data_;
+        std::vector<uint32_t> offsets_;
+        std::vector<BYTE> arena_;
+    };
+
+    /**
+     * <summary>
+     *   A set of columns with the same number of rows, for events of one
+     *   provider and event id, along with columns for the header fields.
+     * </summary>
+     */
+    class column_batch {
+    public:
+
+        column_batch(const krabs::guid &provider, USHORT event_id);
+
+        const krabs::guid &provider() const;
+        USHORT event_id() const;
+
+        /**
+         * <summary>Returns the number of events in the batch.</summary>
+         */
+        size_t rows() const;
+
+        const std::vector<LONGLONG> &timestamps() const;
+        const std::vector<ULONG> &process_ids() const;
+        const std::vector<ULONG> &thread_ids() const;
+
+        size_t column_count() const;
+        const column &operator[](size_t index) const;
+
+        /**
+         * <summary>
+         *   Returns the column of the given property, throwing
+         *   std::out_of_range if the batch has none.
+         * </summary>
+         */
+        const column &at(const std::wstring &name) const;
+
+        /**
+         * <summary>
+         *   Adds a column. All columns are added before the first row.
+         * </summary>
+         */
+        column &add_column(const std::wstring &name, column_type type);
+        column &column_at(size_t index);
+
+        /**
+         * <summary>
+         *   Starts a row with the header fields of the given event. The
+         *   caller then appends exactly one value or null to every column.
+         * </summary>
+         */
+        void begin_row(const EVENT_RECORD &record);
+
+        /**
+         * <summary>Removes all rows, keeping the columns and memory.</summary>
+         */
+        void clear();
+
+    private:
+        krabs::guid provider_;
+        USHORT event_id_;
+        std::vector<LONGLONG> timestamps_;
+        std::vector<ULONG> process_ids_;
+        std::vector<ULONG> thread_ids_;
+        std::vector<column> columns_;
+    };
+
+    // Implementation
+    // ------------------------------------------------------------------------
+
+    inline size_t column_width(column_type type)
+    {
+        switch (type) {
+        case column_type::int8:
+        case column_type::uint8:
+        case column_type::boolean:
+            return 1;
+        case column_type::int16:
+        case column_type::uint16:
+            return 2;
+        case column_type::int32:
+        case column_type::uint32:
+        case column_type::float32:
+            return 4;
+        case column_type::int64:
+        case column_type::uint64:
+        case column_type::float64:
+            return 8;
+        case column_type::guid:
+            return sizeof(GUID);
+        default:
+            return 0;
+        }
+    }
+
+    inline column_type column_type_of(const EVENT_PROPERTY_INFO &property)
+    {
+        if ((property.Flags & (PropertyStruct | PropertyParamCount)) != 0 || property.count > 1) {
+            return column_type::binary;
+        }
+
+        switch (property.nonStructType.InType) {
+        case TDH_INTYPE_INT8:          return column_type::int8;
+        case TDH_INTYPE_UINT8:         return column_type::uint8;
+        case TDH_INTYPE_INT16:         return column_type::int16;
+        case TDH_INTYPE_UINT16:        return column_type::uint16;
+        case TDH_INTYPE_INT32:         return column_type::int32;
+        case TDH_INTYPE_UINT32:        return column_type::uint32;
+        case TDH_INTYPE_HEXINT32:      return column_type::uint32;
+        case TDH_INTYPE_INT64:         return column_type::int64;
+        case TDH_INTYPE_UINT64:        return column_type::uint64;
+        case TDH_INTYPE_HEXINT64:      return column_type::uint64;
+        case TDH_INTYPE_POINTER:       return column_type::uint64;
+        case TDH_INTYPE_SIZET:         return column_type::uint64;
+        case TDH_INTYPE_FILETIME:      return column_type::int64;
+        case TDH_INTYPE_FLOAT:         return column_type::float32;
+        case TDH_INTYPE_DOUBLE:        return column_type::float64;
+        case TDH_INTYPE_BOOLEAN:       return column_type::boolean;
+        case TDH_INTYPE_GUID:          return column_type::guid;
+        case TDH_INTYPE_UNICODESTRING: return column_type::unicode_string;
+        case TDH_INTYPE_ANSISTRING:    return column_type::ansi_string;
+        default:                       return column_type::binary;
+        }
+    }
+
+    inline column::column(const std::wstring &name, column_type type)
+    : name_(name)
+    , type_(type)
+    , width_(column_width(type))
+    , rows_(0)
+    , nulls_(0)
+    , validity_()
+    , data_()
+    , offsets_(1, 0)
+    , arena_()
+    {}
+
+    inline const std::wstring &column::name() const
+    {
+        return name_;
+    }
+
+    inline column_type column::type() const
+    {
+        return type_;
+    }
+
+    inline size_t column::size() const
+    {
+        return rows_;
+    }
+
+    inline bool column::is_null(size_t row) const
+    {
+        return (validity_[row / 64] & (uint64_t(1) << (row % 64))) == 0;
+    }
+
+    inline size_t column::null_count() const
+    {
+        return nulls_;
+    }
+
+    template <typename T>
+    const T *column::values() const
+    {
+        if (details::column_type_for<T>::value != type_) {
+            throw std::runtime_error("Column type doesn't match requested type");
+        }
+
+        return reinterpret_cast<const T*>(data_.data());
+    }
+
+    inline const std::vector<uint64_t> &column::validity() const
+    {
+        return validity_;
+    }
+
+    inline const std::vector<BYTE> &column::data() const
+    {
+        return data_;
+    }
+
+    inline const std::vector<uint32_t> &column::offsets() const
+    {
+        return offsets_;
+    }
+
+    inline const std::vector<BYTE> &column::arena() const
+    {
+        return arena_;
+    }
+
+    inline std::wstring column::wstring_at(size_t row) const
+    {
+        if (type_ != column_type::unicode_string) {
+            throw std::runtime_error("Column type doesn't match requested type");
+        }
+
+        auto start = reinterpret_cast<const wchar_t*>(arena_.data() + offsets_[row]);
+        return std::wstring(start, (offsets_[row + 1] - offsets_[row]) / sizeof(wchar_t));
+    }
+
+    inline std::string column::string_at(size_t row) const
+    {
+        if (type_ != column_type::ansi_string) {
+            throw std::runtime_error("Column type doesn't match requested type");
+        }
+
+        auto start = reinterpret_cast<const char*>(arena_.data() + offsets_[row]);
+        return std::string(start, offsets_[row + 1] - offsets_[row]);
+    }
+
+    inline void column::set_valid(size_t row)
+    {
+        validity_[row / 64] |= uint64_t(1) << (row % 64);
+    }
+
+    inline bool column::append(const BYTE *value, size_t size)
+    {
+        const size_t row = rows_;
+        if (row / 64 >= validity_.size()) {
+            validity_.push_back(0);
+        }
+
+        if (width_ > 0) {
+            size_t at = data_.size();
+            data_.resize(at + width_, 0);
+
+            // Booleans are 4 bytes in ETW. Pointers and size_t are 4 bytes in
+            // events from 32 bit processes; they are zero extended.
+            bool fits = size == width_ ||
+                (type_ == column_type::boolean && size <= sizeof(ULONG)) ||
+                (type_ == column_type::uint64 && size == 4);
+
+            if (!fits) {
+                ++rows_;
+                ++nulls_;
+                return false;
+            }
+
+            if (type_ == column_type::boolean) {
+                ULONG flag = 0;
+                memcpy(&flag, value, size);
+                data_[at] = flag != 0;
+            } else {
+                memcpy(data_.data() + at, value, size);
+            }
+        } else {
+            // Strings carry the terminator (if any) in their length.
+            if (type_ == column_type::unicode_string) {
+                auto chars = reinterpret_cast<const wchar_t*>(value);
+                size_t count = size / sizeof(wchar_t);
+                while (count > 0 && chars[count - 1] == L'\0') {
+                    --count;
+                }
+                size = count * sizeof(wchar_t);
+            } else if (type_ == column_type::ansi_string) {
+                while (size > 0 && value[size - 1] == '\0') {
+                    --size;
+                }
+            }
+
+            arena_.insert(arena_.end(), value, value + size);
+            offsets_.push_back(static_cast<uint32_t>(arena_.size()));
+        }
+
+        set_valid(row);
+        ++rows_;
+        return true;
+    }
+
+    inline void column::append_null()
+    {
+        if (rows_ / 64 >= validity_.size()) {
+            validity_.push_back(0);
+        }
+
+        if (width_ > 0) {
+            data_.resize(data_.size() + width_, 0);
+        } else {
+            offsets_.push_back(static_cast<uint32_t>(arena_.size()));
+        }
+
+        ++rows_;
+        ++nulls_;
+    }
+
+    inline void column::clear()
+    {
+        rows_ = 0;
+        nulls_ = 0;
+        validity_.clear();
+        data_.clear();
+        offsets_.resize(1);
+        arena_.clear();
+    }
+
+    inline column_batch::column_batch(const krabs::guid &provider, USHORT event_id)
+    : provider_(provider)
+    , event_id_(event_id)
+    , timestamps_()
+    , process_ids_()
+    , thread_ids_()
+    , columns_()
+    {}
+
+    inline const krabs::guid &column_batch::provider() const
+    {
+        return provider_;
+    }
+
+    inline USHORT column_batch::event_id() const
+    {
+        return event_id_;
+    }
+
+    inline size_t column_batch::rows() const
+    {
+        return timestamps_.size();
+    }
+
+    inline const std::vector<LONGLONG> &column_batch::timestamps() const
+    {
+        return timestamps_;
+    }
+
+    inline const std::vector<ULONG> &column_batch::process_ids() const
+    {
+        return process_ids_;
+    }
+
+    inline const std::vector<ULONG> &column_batch::thread_ids() const
+    {
+        return thread_ids_;
+    }
+
+    inline size_t column_batch::column_count() const
+    {
+        return columns_.size();
+    }
+
+    inline const column &column_batch::operator[](size_t index) const
+    {
+        return columns_[index];
+    }
+
+    inline const column &column_batch::at(const std::wstring &name) const
+    {
+        for (const auto &column : columns_) {
+            if (column.name() == name) {
+                return column;
+            }
+        }
+
+        throw std::out_of_range("The batch has no column with the given name");
+    }
+
+    inline column &column_batch::add_column(const std::wstring &name, column_type type)
+    {
+        columns_.emplace_back(name, type);
+        return columns_.back();
+    }
+
+    inline column &column_batch::column_at(size_t index)
+    {
+        return columns_[index];
+    }
+
+    inline void column_batch::begin_row(const EVENT_RECORD &record)
+    {
+        timestamps_.push_back(record.EventHeader.TimeStamp.QuadPart);
+        process_ids_.push_back(record.EventHeader.ProcessId);
+        thread_ids_.push_back(record.EventHeader.ThreadId);
+    }
+
+    inline void column_batch::clear()
+    {
+        timestamps_.clear();
+        process_ids_.clear();
+        thread_ids_.clear();
+        for (auto &column : columns_) {
+            column.clear();
+        }
+    }
+
+} /* namespace columnar */ } /* namespace krabs */
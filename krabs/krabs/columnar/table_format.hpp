@@ -0,0 +1,401 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#ifndef  WIN32_LEAN_AND_MEAN
+#define  WIN32_LEAN_AND_MEAN
+#endif
+
+#include <windows.h>
+#include <evntcons.h>
+
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../compiler_check.hpp"
+#include "../capture/capture_format.hpp"
+#include "column_batch.hpp"
+
+namespace krabs { namespace columnar {
+
+    /**
+     * <summary>
+     *   Layout of krabs table files.
+     * </summary>
+     * <remarks>
+     *   A table file holds decoded events as columns, one table per kind of
+     *   event (provider, id, opcode, version and level, like a schema_key).
+     *   It is a file_header followed by chunks, each one a chunk_header, its
+     *   payload, and padding up to the next multiple of 8 bytes, and ends
+     *   with a file_trailer once the writer is closed.
+     *
+     *   A table chunk describes a table: a table_chunk, the provider, event
+     *   and opcode names, then the type and name of every column. Names are
+     *   stored as a ULONG count of wchar_t followed by the characters.
+     *   It is written before the first row group of the table.
+     *
+     *   A row group chunk holds a row_group_chunk, the timestamps, process
+     *   ids and thread ids of its rows (padded to 8 bytes), and then every
+     *   column in table order: a column_chunk, the validity bitmap (one bit
+     *   per row, set for values that are present) and the values. Fixed
+     *   width columns store one value per row. Variable width columns store
+     *   rows + 1 offsets and the bytes they index. Dictionary encoded
+     *   columns store the count of distinct values, their offsets and bytes,
+     *   and then one index per row.
+     *
+     *   The footer chunk lists the offset of every table and row group so
+     *   readers can skip straight to the ones they want; the trailer at the
+     *   very end of the file gives the offset of the footer. A file whose
+     *   writer died has no footer and is read by walking its chunks.
+     * </remarks>
+     */
+    namespace constants {
+        const ULONGLONG table_file_magic    = 0x314C4F4353424B52; // "RKBSCOL1"
+        const ULONG     table_file_version  = 1;
+    }
+
+    enum class table_chunk_type : ULONG {
+        table     = 1,
+        row_group = 2,
+        footer    = 3,
+    };
+
+    enum class column_encoding : ULONG {
+        plain      = 0,
+        dictionary = 1,
+    };
+
+    struct table_file_header
+    {
+        ULONGLONG magic;
+        ULONG     version;
+        ULONG     header_size;
+    };
+
+    struct table_chunk_header
+    {
+        table_chunk_type type;
+        ULONG            size;
+    };
+
+    struct table_chunk
+    {
+        ULONG  id;
+        GUID   provider;
+        USHORT event_id;
+        UCHAR  version;
+        UCHAR  opcode;
+        UCHAR  level;
+        UCHAR  reserved[3];
+        ULONG  column_count;
+    };
+
+    struct row_group_chunk
+    {
+        ULONG table_id;
+        ULONG rows;
+        ULONG column_count;
+        ULONG reserved;
+    };
+
+    struct column_chunk
+    {
+        column_type     type;
+        UCHAR           reserved[3];
+        column_encoding encoding;
+
+        // Bytes that follow this header, padding included.
+        ULONG           size;
+        ULONG           reserved2;
+    };
+
+    struct footer_chunk
+    {
+        ULONG table_count;
+        ULONG row_group_count;
+    };
+
+    struct row_group_entry
+    {
+        ULONGLONG offset;
+        ULONG     table_id;
+        ULONG     rows;
+    };
+
+    struct file_trailer
+    {
+        ULONGLONG footer_offset;
+        ULONGLONG magic;
+    };
+
+    namespace details {
+
+        using krabs::capture::details::align8;
+        using krabs::capture::details::append;
+        using krabs::capture::details::pad8;
+        using krabs::capture::details::read;
+
+        /**
+         * <summary>
+         *   Appends a count-prefixed string.
+         * </summary>
+         */
+        void append_name(std::vector<BYTE> &out, const std::wstring &name);
+
+        /**
+         * <summary>
+         *   Reads a count-prefixed string, advancing the cursor. Returns
+         *   false if it runs past the end.
+         * </summary>
+         */
+        bool read_name(const BYTE *&cursor, const BYTE *end, std::wstring &name);
+
+        /**
+         * <summary>
+         *   Appends a column_chunk and the column's data, dictionary encoding
+         *   string columns whose values repeat enough to be worth it.
+         *   Returns the encoding that was used.
+         * </summary>
+         */
+        column_encoding append_column(std::vector<BYTE> &out, const column &column);
+
+        /**
+         * <summary>
+         *   Appends the values of one column chunk, `rows` long, to the given
+         *   (empty) column. Returns false if the chunk is malformed. The
+         *   cursor is left after the chunk.
+         * </summary>
+         */
+        bool read_column(const BYTE *&cursor, const BYTE *end, size_t rows, column &column);
+
+    } /* namespace details */
+
+    // Implementation
+    // ------------------------------------------------------------------------
+
+    namespace details {
+
+        inline void append_name(std::vector<BYTE> &out, const std::wstring &name)
+        {
+            append(out, static_cast<ULONG>(name.size()));
+            auto bytes = reinterpret_cast<const BYTE*>(name.data());
+            out.insert(out.end(), bytes, bytes + name.size() * sizeof(wchar_t));
+        }
+
+        inline bool read_name(const BYTE *&cursor, const BYTE *end, std::wstring &name)
+        {
+            if (static_cast<size_t>(end - cursor) < sizeof(ULONG)) {
+                return false;
+            }
+
+            auto count = read<ULONG>(cursor);
+            cursor += sizeof(ULONG);
+            if ((end - cursor) / sizeof(wchar_t) < count) {
+                return false;
+            }
+
+            name.resize(count);
+            memcpy(&name[0], cursor, count * sizeof(wchar_t));
+            cursor += count * sizeof(wchar_t);
+            return true;
+        }
+
+        inline column_encoding append_column(std::vector<BYTE> &out, const column &column)
+        {
+            const size_t rows = column.size();
+            const auto &offsets = column.offsets();
+            const auto &arena = column.arena();
+
+            size_t header_at = out.size();
+            append(out, column_chunk{ column.type(), { 0 }, column_encoding::plain, 0, 0 });
+
+            size_t start = out.size();
+            auto validity = reinterpret_cast<const BYTE*>(column.validity().data());
+            out.insert(out.end(), validity, validity + ((rows + 63) / 64) * sizeof(uint64_t));
+
+            // Strings that repeat (image names, paths, command lines) are
+            // stored once. A dictionary with more than one entry per two rows
+            // isn't worth the indices, so give up on it as soon as that's
+            // clear.
+            bool strings = column.type() == column_type::unicode_string ||
+                           column.type() == column_type::ansi_string;
+
+            std::unordered_map<std::string, ULONG> entries;
+            std::vector<ULONG> indices;
+            if (strings && rows > 1) {
+                indices.reserve(rows);
+                for (size_t row = 0; row < rows; ++row) {
+                    std::string value(
+                        reinterpret_cast<const char*>(arena.data() + offsets[row]),
+                        offsets[row + 1] - offsets[row]);
+
+                    auto inserted = entries.emplace(std::move(value), static_cast<ULONG>(entries.size()));
+                    indices.push_back(inserted.first->second);
+                    if (entries.size() * 2 > rows) {
+                        indices.clear();
+                        break;
+                    }
+                }
+            }
+
+            column_encoding encoding = column_encoding::plain;
+            if (!indices.empty()) {
+                encoding = column_encoding::dictionary;
+
+                std::vector<const std::string*> ordered(entries.size());
+                for (const auto &entry : entries) {
+                    ordered[entry.second] = &entry.first;
+                }
+
+                append(out, static_cast<ULONG>(ordered.size()));
+                ULONG offset = 0;
+                append(out, offset);
+                for (auto value : ordered) {
+                    offset += static_cast<ULONG>(value->size());
+                    append(out, offset);
+                }
+                for (auto value : ordered) {
+                    out.insert(out.end(), value->begin(), value->end());
+                }
+
+                out.resize(start + align8(out.size() - start), 0);
+                auto bytes = reinterpret_cast<const BYTE*>(indices.data());
+                out.insert(out.end(), bytes, bytes + indices.size() * sizeof(ULONG));
+            } else if (column_width(column.type()) > 0) {
+                out.insert(out.end(), column.data().begin(), column.data().end());
+            } else {
+                auto bytes = reinterpret_cast<const BYTE*>(offsets.data());
+                out.insert(out.end(), bytes, bytes + offsets.size() * sizeof(uint32_t));
+                out.insert(out.end(), arena.begin(), arena.end());
+            }
+
+            out.resize(start + align8(out.size() - start), 0);
+
+            column_chunk header{ column.type(), { 0 }, encoding, static_cast<ULONG>(out.size() - start), 0 };
+            memcpy(out.data() + header_at, &header, sizeof(header));
+            return encoding;
+        }
+
+        inline bool read_column(const BYTE *&cursor, const BYTE *end, size_t rows, column &column)
+        {
+            if (static_cast<size_t>(end - cursor) < sizeof(column_chunk)) {
+                return false;
+            }
+
+            auto header = read<column_chunk>(cursor);
+            cursor += sizeof(column_chunk);
+            if (header.type != column.type() || static_cast<size_t>(end - cursor) < header.size) {
+                return false;
+            }
+
+            const BYTE *data = cursor;
+            const BYTE *data_end = cursor + header.size;
+            cursor = data_end;
+
+            size_t validity_size = ((rows + 63) / 64) * sizeof(uint64_t);
+            if (static_cast<size_t>(data_end - data) < validity_size) {
+                return false;
+            }
+
+            const BYTE *validity = data;
+            data += validity_size;
+            auto present = [&](size_t row) {
+                return (read<uint64_t>(validity + (row / 64) * sizeof(uint64_t)) & (uint64_t(1) << (row % 64))) != 0;
+            };
+
+            const size_t width = column_width(column.type());
+            if (header.encoding == column_encoding::dictionary) {
+                if (width > 0 || static_cast<size_t>(data_end - data) < sizeof(ULONG)) {
+                    return false;
+                }
+
+                auto count = read<ULONG>(data);
+                data += sizeof(ULONG);
+                if (static_cast<size_t>(data_end - data) / sizeof(ULONG) <= count) {
+                    return false;
+                }
+
+                const BYTE *offsets = data;
+                const BYTE *values = offsets + (count + 1) * sizeof(ULONG);
+                ULONG values_size = read<ULONG>(offsets + count * sizeof(ULONG));
+                if (static_cast<size_t>(data_end - values) < values_size) {
+                    return false;
+                }
+
+                const BYTE *indices = values + align8(values - validity + values_size) - (values - validity);
+                if (static_cast<size_t>(data_end - indices) / sizeof(ULONG) < rows) {
+                    return false;
+                }
+
+                for (size_t row = 0; row < rows; ++row) {
+                    auto index = read<ULONG>(indices + row * sizeof(ULONG));
+                    if (!present(row)) {
+                        column.append_null();
+                        continue;
+                    }
+
+                    if (index >= count) {
+                        return false;
+                    }
+
+                    auto from = read<ULONG>(offsets + index * sizeof(ULONG));
+                    auto to = read<ULONG>(offsets + (index + 1) * sizeof(ULONG));
+                    if (from > to || to > values_size) {
+                        return false;
+                    }
+
+                    column.append(values + from, to - from);
+                }
+
+                return true;
+            }
+
+            if (header.encoding != column_encoding::plain) {
+                return false;
+            }
+
+            if (width > 0) {
+                if (static_cast<size_t>(data_end - data) / width < rows) {
+                    return false;
+                }
+
+                for (size_t row = 0; row < rows; ++row) {
+                    if (present(row)) {
+                        column.append(data + row * width, width);
+                    } else {
+                        column.append_null();
+                    }
+                }
+
+                return true;
+            }
+
+            if (static_cast<size_t>(data_end - data) / sizeof(uint32_t) <= rows) {
+                return false;
+            }
+
+            const BYTE *offsets = data;
+            const BYTE *values = offsets + (rows + 1) * sizeof(uint32_t);
+            for (size_t row = 0; row < rows; ++row) {
+                auto from = read<uint32_t>(offsets + row * sizeof(uint32_t));
+                auto to = read<uint32_t>(offsets + (row + 1) * sizeof(uint32_t));
+                if (from > to || to > static_cast<size_t>(data_end - values)) {
+                    return false;
+                }
+
+                if (present(row)) {
+                    column.append(values + from, to - from);
+                } else {
+                    column.append_null();
+                }
+            }
+
+            return true;
+        }
+
+    } /* namespace details */
+
+} /* namespace columnar */ } /* namespace krabs */
@@ -0,0 +1,452 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#ifndef  WIN32_LEAN_AND_MEAN
+#define  WIN32_LEAN_AND_MEAN
+#endif
+
+#include <windows.h>
+#include <evntcons.h>
+
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../compiler_check.hpp"
+#include "column_batch.hpp"
+#include "table_format.hpp"
+
+namespace krabs { namespace columnar {
+
+    /**
+     * <summary>
+     *   Describes one table of a table file.
+     * </summary>
+     */
+    struct table_info
+    {
+        ULONG  id;
+        GUID   provider;
+        USHORT event_id;
+        UCHAR  version;
+        UCHAR  opcode;
+        UCHAR  level;
+
+        std::wstring provider_name;
+        std::wstring event_name;
+        std::wstring opcode_name;
+        std::vector<std::pair<std::wstring, column_type>> columns;
+    };
+
+    /**
+     * <summary>
+     *   Locates one row group of a table file.
+     * </summary>
+     */
+    struct row_group_info
+    {
+        ULONGLONG offset;
+        ULONG     table_id;
+        ULONG     rows;
+    };
+
+    /**
+     * <summary>
+     *   Reads a table file written by table_writer. The tables and the list
+     *   of row groups are loaded up front, from the footer when the file
+     *   has one; row groups are decoded on demand.
+     * </summary>
+     */
+    class table_reader {
+    public:
+
+        /**
+         * <summary>
+         *   Opens and maps the given table file.
+         * </summary>
+         * <example>
+         *   krabs::columnar::table_reader reader(L"C:\\export\\processes.krabst");
+         *   for (size_t i = 0; i &lt; reader.row_groups().size(); ++i) {
+         *       auto batch = reader.read(i);
+         *       // ...
+         *   }
+         * </example>
+         */
+        table_reader(const std::wstring &file_name);
+
+        /**
+         * <summary>
+         *   Reads a table file that is already in memory. The memory has to
+         *   stay valid for the lifetime of the reader.
+         * </summary>
+         */
+        table_reader(const BYTE *data, size_t size);
+
+        ~table_reader();
+
+        table_reader(const table_reader &) = delete;
+        table_reader &operator=(const table_reader &) = delete;
+
+        const std::vector<table_info> &tables() const;
+        const std::vector<row_group_info> &row_groups() const;
+
+        /**
+         * <summary>
+         *   Returns whether the file was closed properly, i.e. has a footer.
+         *   Files without one are read up to their last complete chunk.
+         * </summary>
+         */
+        bool complete() const;
+
+        /**
+         * <summary>
+         *   Decodes the given row group into a batch whose columns are those
+         *   of its table. Throws std::out_of_range for an index past the end
+         *   and std::runtime_error if the row group is malformed.
+         * </summary>
+         */
+        column_batch read(size_t row_group) const;
+
+    private:
+        void load();
+        bool load_footer();
+        void walk();
+        bool load_table(const BYTE *payload, size_t size);
+
+    private:
+        HANDLE file_;
+        HANDLE mapping_;
+        const BYTE *data_;
+        size_t size_;
+        bool owns_view_;
+        bool complete_;
+
+        std::vector<table_info> tables_;
+        std::vector<row_group_info> row_groups_;
+    };
+
+    // Implementation
+    // ------------------------------------------------------------------------
+
+    inline table_reader::table_reader(const std::wstring &file_name)
+    : file_(INVALID_HANDLE_VALUE)
+    , mapping_(nullptr)
+    , data_(nullptr)
+    , size_(0)
+    , owns_view_(true)
+    , complete_(false)
+    , tables_()
+    , row_groups_()
+    {
+        file_ = CreateFileW(
+            file_name.c_str(),
+            GENERIC_READ,
+            FILE_SHARE_READ | FILE_SHARE_WRITE,
+            nullptr,
+            OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL,
+            nullptr);
+
+        if (file_ == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error("Could not open the table file");
+        }
+
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file_, &size)) {
+            CloseHandle(file_);
+            throw std::runtime_error("Could not get the size of the table file");
+        }
+
+        size_ = static_cast<size_t>(size.QuadPart);
+        if (size_ > 0) {
+            mapping_ = CreateFileMappingW(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        }
+        if (mapping_ != nullptr) {
+            data_ = static_cast<const BYTE*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+        }
+
+        if (data_ == nullptr) {
+            if (mapping_ != nullptr) {
+                CloseHandle(mapping_);
+            }
+            CloseHandle(file_);
+            throw std::runtime_error("Could not map the table file");
+        }
+
+        try {
+            load();
+        } catch (...) {
+            UnmapViewOfFile(data_);
+            CloseHandle(mapping_);
+            CloseHandle(file_);
+            throw;
+        }
+    }
+
+    inline table_reader::table_reader(const BYTE *data, size_t size)
+    : file_(INVALID_HANDLE_VALUE)
+    , mapping_(nullptr)
+    , data_(data)
+    , size_(size)
+    , owns_view_(false)
+    , complete_(false)
+    , tables_()
+    , row_groups_()
+    {
+        load();
+    }
+
+    inline table_reader::~table_reader()
+    {
+        if (owns_view_) {
+            UnmapViewOfFile(data_);
+            CloseHandle(mapping_);
+            CloseHandle(file_);
+        }
+    }
+
+    inline const std::vector<table_info> &table_reader::tables() const
+    {
+        return tables_;
+    }
+
+    inline const std::vector<row_group_info> &table_reader::row_groups() const
+    {
+        return row_groups_;
+    }
+
+    inline bool table_reader::complete() const
+    {
+        return complete_;
+    }
+
+    inline column_batch table_reader::read(size_t row_group) const
+    {
+        const auto &entry = row_groups_.at(row_group);
+        const auto &table = tables_[entry.table_id];
+
+        column_batch batch(table.provider, table.event_id);
+        for (const auto &column : table.columns) {
+            batch.add_column(column.first, column.second);
+        }
+
+        const BYTE *cursor = data_ + entry.offset + sizeof(table_chunk_header);
+        const BYTE *end = cursor + details::read<table_chunk_header>(data_ + entry.offset).size;
+        if (static_cast<size_t>(end - cursor) < sizeof(row_group_chunk)) {
+            throw std::runtime_error("Malformed row group");
+        }
+
+        auto header = details::read<row_group_chunk>(cursor);
+        cursor += sizeof(row_group_chunk);
+
+        const size_t rows = header.rows;
+        const size_t header_fields = details::align8(rows * (sizeof(LONGLONG) + 2 * sizeof(ULONG)));
+        if (header.rows != entry.rows ||
+            header.column_count != table.columns.size() ||
+            rows > static_cast<size_t>(end - cursor) ||
+            static_cast<size_t>(end - cursor) < header_fields) {
+            throw std::runtime_error("Malformed row group");
+        }
+
+        // begin_row takes the header fields from a record.
+        EVENT_RECORD record;
+        memset(&record, 0, sizeof(record));
+        const BYTE *timestamps = cursor;
+        const BYTE *process_ids = timestamps + rows * sizeof(LONGLONG);
+        const BYTE *thread_ids = process_ids + rows * sizeof(ULONG);
+        for (size_t row = 0; row < rows; ++row) {
+            record.EventHeader.TimeStamp.QuadPart = details::read<LONGLONG>(timestamps + row * sizeof(LONGLONG));
+            record.EventHeader.ProcessId = details::read<ULONG>(process_ids + row * sizeof(ULONG));
+            record.EventHeader.ThreadId = details::read<ULONG>(thread_ids + row * sizeof(ULONG));
+            batch.begin_row(record);
+        }
+
+        cursor += header_fields;
+        for (size_t i = 0; i < table.columns.size(); ++i) {
+            if (!details::read_column(cursor, end, rows, batch.column_at(i))) {
+                throw std::runtime_error("Malformed row group");
+            }
+        }
+
+        return batch;
+    }
+
+    inline void table_reader::load()
+    {
+        if (size_ < sizeof(table_file_header) ||
+            details::read<table_file_header>(data_).magic != constants::table_file_magic) {
+            throw std::runtime_error("Not a krabs table file");
+        }
+
+        auto header = details::read<table_file_header>(data_);
+        if (header.version != constants::table_file_version || header.header_size < sizeof(table_file_header)) {
+            throw std::runtime_error("Unsupported krabs table file version");
+        }
+
+        complete_ = load_footer();
+        if (!complete_) {
+            tables_.clear();
+            row_groups_.clear();
+            walk();
+        }
+    }
+
+    inline bool table_reader::load_footer()
+    {
+        if (size_ < sizeof(table_file_header) + sizeof(file_trailer)) {
+            return false;
+        }
+
+        auto trailer = details::read<file_trailer>(data_ + size_ - sizeof(file_trailer));
+        size_t limit = size_ - sizeof(file_trailer);
+        if (trailer.magic != constants::table_file_magic ||
+            trailer.footer_offset < sizeof(table_file_header) ||
+            trailer.footer_offset > limit - sizeof(table_chunk_header) - sizeof(footer_chunk)) {
+            return false;
+        }
+
+        auto chunk = details::read<table_chunk_header>(data_ + trailer.footer_offset);
+        const BYTE *cursor = data_ + trailer.footer_offset + sizeof(table_chunk_header);
+        if (chunk.type != table_chunk_type::footer ||
+            chunk.size > limit - trailer.footer_offset - sizeof(table_chunk_header)) {
+            return false;
+        }
+
+        const BYTE *end = cursor + chunk.size;
+        auto footer = details::read<footer_chunk>(cursor);
+        cursor += sizeof(footer_chunk);
+
+        size_t available = end - cursor;
+        if (footer.row_group_count > available / sizeof(row_group_entry) ||
+            footer.table_count > (available - footer.row_group_count * sizeof(row_group_entry)) / sizeof(ULONGLONG)) {
+            return false;
+        }
+
+        for (ULONG i = 0; i < footer.row_group_count; ++i) {
+            auto entry = details::read<row_group_entry>(cursor);
+            cursor += sizeof(row_group_entry);
+
+            if (entry.table_id >= footer.table_count ||
+                entry.offset > trailer.footer_offset - sizeof(table_chunk_header)) {
+                return false;
+            }
+
+            auto row_group = details::read<table_chunk_header>(data_ + entry.offset);
+            if (row_group.type != table_chunk_type::row_group ||
+                row_group.size > trailer.footer_offset - entry.offset - sizeof(table_chunk_header)) {
+                return false;
+            }
+
+            row_groups_.push_back({ entry.offset, entry.table_id, entry.rows });
+        }
+
+        for (ULONG i = 0; i < footer.table_count; ++i) {
+            auto offset = details::read<ULONGLONG>(cursor);
+            cursor += sizeof(ULONGLONG);
+
+            if (offset > trailer.footer_offset - sizeof(table_chunk_header)) {
+                return false;
+            }
+
+            auto table = details::read<table_chunk_header>(data_ + offset);
+            if (table.type != table_chunk_type::table ||
+                table.size > trailer.footer_offset - offset - sizeof(table_chunk_header) ||
+                !load_table(data_ + offset + sizeof(table_chunk_header), table.size)) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    inline void table_reader::walk()
+    {
+        auto header = details::read<table_file_header>(data_);
+
+        size_t offset = details::align8(header.header_size);
+        while (offset < size_ && size_ - offset >= sizeof(table_chunk_header)) {
+            auto chunk = details::read<table_chunk_header>(data_ + offset);
+            const BYTE *payload = data_ + offset + sizeof(table_chunk_header);
+            if (size_ - offset - sizeof(table_chunk_header) < chunk.size) {
+                break;
+            }
+
+            if (chunk.type == table_chunk_type::table) {
+                // Malformed tables make their row groups unreadable, so stop
+                // at them like at a truncation.
+                if (!load_table(payload, chunk.size)) {
+                    break;
+                }
+            } else if (chunk.type == table_chunk_type::row_group) {
+                if (chunk.size < sizeof(row_group_chunk)) {
+                    break;
+                }
+
+                auto row_group = details::read<row_group_chunk>(payload);
+                if (row_group.table_id >= tables_.size()) {
+                    break;
+                }
+
+                row_groups_.push_back({ offset, row_group.table_id, row_group.rows });
+            }
+
+            offset += details::align8(sizeof(table_chunk_header) + chunk.size);
+        }
+    }
+
+    inline bool table_reader::load_table(const BYTE *payload, size_t size)
+    {
+        if (size < sizeof(table_chunk)) {
+            return false;
+        }
+
+        auto description = details::read<table_chunk>(payload);
+
+        // Writers number tables in the order they write them.
+        if (description.id != tables_.size()) {
+            return false;
+        }
+
+        table_info table;
+        table.id       = description.id;
+        table.provider = description.provider;
+        table.event_id = description.event_id;
+        table.version  = description.version;
+        table.opcode   = description.opcode;
+        table.level    = description.level;
+
+        const BYTE *cursor = payload + sizeof(table_chunk);
+        const BYTE *end = payload + size;
+        if (!details::read_name(cursor, end, table.provider_name) ||
+            !details::read_name(cursor, end, table.event_name) ||
+            !details::read_name(cursor, end, table.opcode_name)) {
+            return false;
+        }
+
+        for (ULONG i = 0; i < description.column_count; ++i) {
+            if (static_cast<size_t>(end - cursor) < sizeof(ULONG)) {
+                return false;
+            }
+
+            auto type = details::read<ULONG>(cursor);
+            cursor += sizeof(ULONG);
+            if (type < static_cast<ULONG>(column_type::int8) || type > static_cast<ULONG>(column_type::binary)) {
+                return false;
+            }
+
+            std::wstring name;
+            if (!details::read_name(cursor, end, name)) {
+                return false;
+            }
+
+            table.columns.emplace_back(std::move(name), static_cast<column_type>(type));
+        }
+
+        tables_.push_back(std::move(table));
+        return true;
+    }
+
+} /* namespace columnar */ } /* namespace krabs */
@@ -0,0 +1,439 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#ifndef  WIN32_LEAN_AND_MEAN
+#define  WIN32_LEAN_AND_MEAN
+#endif
+
+#include <windows.h>
+#include <evntcons.h>
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../compiler_check.hpp"
+#include "../errors.hpp"
+#include "../parser.hpp"
+#include "../schema.hpp"
+#include "../schema_locator.hpp"
+#include "../trace_context.hpp"
+#include "batch_extractor.hpp"
+#include "column_batch.hpp"
+#include "table_format.hpp"
+
+namespace krabs { namespace columnar {
+
+    /**
+     * <summary>
+     *   Counters describing what a table writer has written.
+     * </summary>
+     */
+    struct table_writer_stats
+    {
+        uint64_t events;
+
+        // Events whose schema couldn't be found; they aren't written.
+        uint64_t skipped;
+
+        uint64_t tables;
+        uint64_t row_groups;
+        uint64_t dictionary_columns;
+        uint64_t bytes;
+    };
+
+    /**
+     * <summary>
+     *   Writes the events it is called with into a table file, decoded: each
+     *   kind of event gets a table with a column per top level property, and
+     *   its rows are written in row groups of a fixed size.
+     * </summary>
+     * <remarks>
+     *   The writer is a callback: add it to the providers to export with
+     *   add_on_event_callback. It isn't synchronized, so use one writer per
+     *   trace. Rows are held in memory until their row group fills up;
+     *   call close (or let the destructor do it) to write the remaining
+     *   rows and the footer. Use table_reader to read the file back.
+     * </remarks>
+     */
+    class table_writer {
+    public:
+
+        /**
+         * <summary>
+         *   Creates (or truncates) the given table file.
+         * </summary>
+         * <example>
+         *   krabs::columnar::table_writer writer(L"C:\\export\\processes.krabst");
+         *   krabs::kernel::process_provider process_provider;
+         *   process_provider.add_on_event_callback(writer);
+         *   // ... once the trace has stopped:
+         *   writer.close();
+         * </example>
+         */
+        table_writer(const std::wstring &file_name, size_t row_group_size = 65536);
+
+        /**
+         * <summary>
+         *   Appends the table file to the given vector instead of a file. The
+         *   vector has to outlive the writer.
+         * </summary>
+         */
+        table_writer(std::vector<BYTE> &destination, size_t row_group_size = 65536);
+
+        ~table_writer();
+
+        table_writer(const table_writer &) = delete;
+        table_writer &operator=(const table_writer &) = delete;
+
+        /**
+         * <summary>
+         *   Decodes an event into the rows of its table.
+         * </summary>
+         */
+        void operator()(const EVENT_RECORD &record, const krabs::trace_context &context);
+
+        /**
+         * <summary>
+         *   Writes every partial row group. Row groups are smaller than the
+         *   configured size afterwards, so only do this when needed.
+         * </summary>
+         */
+        void flush();
+
+        /**
+         * <summary>
+         *   Flushes and writes the footer. The writer ignores events
+         *   afterwards.
+         * </summary>
+         */
+        void close();
+
+        /**
+         * <summary>
+         *   Returns the counters of this writer.
+         * </summary>
+         */
+        table_writer_stats stats() const;
+
+    private:
+        struct table {
+            ULONG id;
+            schema_key key;
+            std::wstring provider_name;
+            std::wstring event_name;
+            std::wstring opcode_name;
+            std::unique_ptr<batch_extractor> extractor;
+
+            table(const schema_key &k) : id(no_table), key(k) {}
+        };
+
+        table *table_for(const EVENT_RECORD &record, const krabs::trace_context &context);
+        void write_row_group(table &table, const column_batch &batch);
+        void write_chunk(table_chunk_type type);
+        void write_out();
+        ULONGLONG offset() const;
+
+        static const ULONG no_table = 0xFFFFFFFF;
+
+        // Chunks are gathered in memory and written out in blocks of about
+        // this size.
+        static const size_t flush_threshold = 1024 * 1024;
+
+    private:
+        HANDLE file_;
+        std::vector<BYTE> buffer_;
+        std::vector<BYTE> &out_;
+        size_t base_;
+        ULONGLONG written_;
+        size_t row_group_size_;
+        bool closed_;
+
+        std::unordered_map<schema_key, std::unique_ptr<table>> tables_;
+        std::vector<ULONGLONG> table_offsets_;
+        std::vector<row_group_entry> row_groups_;
+        std::vector<BYTE> chunk_;
+        table_writer_stats stats_;
+    };
+
+    // Implementation
+    // ------------------------------------------------------------------------
+
+    inline table_writer::table_writer(const std::wstring &file_name, size_t row_group_size)
+    : file_(INVALID_HANDLE_VALUE)
+    , buffer_()
+    , out_(buffer_)
+    , base_(0)
+    , written_(0)
+    , row_group_size_(row_group_size)
+    , closed_(false)
+    , tables_()
+    , table_offsets_()
+    , row_groups_()
+    , chunk_()
+    , stats_()
+    {
+        if (row_group_size_ == 0) {
+            throw krabs::invalid_parameter();
+        }
+
+        file_ = CreateFileW(
+            file_name.c_str(),
+            GENERIC_WRITE,
+            FILE_SHARE_READ,
+            nullptr,
+            CREATE_ALWAYS,
+            FILE_ATTRIBUTE_NORMAL,
+            nullptr);
+
+        if (file_ == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error("Could not create the table file");
+        }
+
+        buffer_.reserve(flush_threshold + 64 * 1024);
+        details::append(out_, table_file_header{
+            constants::table_file_magic, constants::table_file_version, sizeof(table_file_header) });
+    }
+
+    inline table_writer::table_writer(std::vector<BYTE> &destination, size_t row_group_size)
+    : file_(INVALID_HANDLE_VALUE)
+    , buffer_()
+    , out_(destination)
+    , base_(destination.size())
+    , written_(0)
+    , row_group_size_(row_group_size)
+    , closed_(false)
+    , tables_()
+    , table_offsets_()
+    , row_groups_()
+    , chunk_()
+    , stats_()
+    {
+        if (row_group_size_ == 0) {
+            throw krabs::invalid_parameter();
+        }
+
+        details::append(out_, table_file_header{
+            constants::table_file_magic, constants::table_file_version, sizeof(table_file_header) });
+    }
+
+    inline table_writer::~table_writer()
+    {
+        try {
+            close();
+        } catch (...) {
+            // Nowhere to report this from a destructor.
+        }
+
+        if (file_ != INVALID_HANDLE_VALUE) {
+            CloseHandle(file_);
+        }
+    }
+
+    inline void table_writer::operator()(const EVENT_RECORD &record, const krabs::trace_context &context)
+    {
+        if (closed_) {
+            return;
+        }
+
+        ++stats_.events;
+
+        auto table = table_for(record, context);
+        if (table == nullptr) {
+            ++stats_.skipped;
+            return;
+        }
+
+        (*table->extractor)(record, context);
+    }
+
+    inline void table_writer::flush()
+    {
+        for (auto &entry : tables_) {
+            entry.second->extractor->flush();
+        }
+
+        write_out();
+    }
+
+    inline void table_writer::close()
+    {
+        if (closed_) {
+            return;
+        }
+
+        flush();
+        closed_ = true;
+
+        ULONGLONG footer_offset = offset();
+
+        chunk_.clear();
+        details::append(chunk_, table_chunk_header{ table_chunk_type::footer, 0 });
+        details::append(chunk_, footer_chunk{
+            static_cast<ULONG>(table_offsets_.size()), static_cast<ULONG>(row_groups_.size()) });
+        for (const auto &entry : row_groups_) {
+            details::append(chunk_, entry);
+        }
+        for (auto table_offset : table_offsets_) {
+            details::append(chunk_, table_offset);
+        }
+        write_chunk(table_chunk_type::footer);
+
+        details::append(out_, file_trailer{ footer_offset, constants::table_file_magic });
+        write_out();
+    }
+
+    inline table_writer_stats table_writer::stats() const
+    {
+        auto stats = stats_;
+        stats.bytes = offset();
+        for (const auto &entry : tables_) {
+            stats.skipped += entry.second->extractor->stats().skipped;
+        }
+
+        return stats;
+    }
+
+    inline table_writer::table *table_writer::table_for(
+        const EVENT_RECORD &record,
+        const krabs::trace_context &context)
+    {
+        auto key = schema_key(record);
+        auto found = tables_.find(key);
+        if (found != tables_.end()) {
+            return found->second.get();
+        }
+
+        // Events TDH doesn't know are retried the next time they show up,
+        // in case their provider registers its manifest in the meantime.
+        std::unique_ptr<table> created(new table(key));
+        std::vector<std::wstring> names;
+        try {
+            krabs::schema schema(record, context.schema_locator);
+            krabs::parser parser(schema);
+
+            for (auto &property : parser.properties()) {
+                names.push_back(property.name());
+            }
+
+            created->provider_name = schema.provider_name();
+            created->event_name = schema.event_name();
+            created->opcode_name = schema.opcode_name();
+        } catch (const std::exception &) {
+            return nullptr;
+        }
+
+        created->extractor.reset(new batch_extractor(
+            record.EventHeader.ProviderId,
+            record.EventHeader.EventDescriptor.Id,
+            names,
+            row_group_size_));
+
+        auto table = created.get();
+        table->extractor->add_on_batch_callback([this, table](const column_batch &batch) {
+            write_row_group(*table, batch);
+        });
+
+        tables_.emplace(key, std::move(created));
+        return table;
+    }
+
+    inline void table_writer::write_row_group(table &table, const column_batch &batch)
+    {
+        // Column types are only known once the first batch is extracted, so
+        // the table is described right before its first row group.
+        if (table.id == no_table) {
+            table.id = static_cast<ULONG>(table_offsets_.size());
+            table_offsets_.push_back(offset());
+
+            table_chunk description;
+            memset(&description, 0, sizeof(description));
+            description.id           = table.id;
+            description.provider     = table.key.provider;
+            description.event_id     = table.key.id;
+            description.version      = table.key.version;
+            description.opcode       = table.key.opcode;
+            description.level        = table.key.level;
+            description.column_count = static_cast<ULONG>(batch.column_count());
+
+            chunk_.clear();
+            details::append(chunk_, table_chunk_header{ table_chunk_type::table, 0 });
+            details::append(chunk_, description);
+            details::append_name(chunk_, table.provider_name);
+            details::append_name(chunk_, table.event_name);
+            details::append_name(chunk_, table.opcode_name);
+            for (size_t i = 0; i < batch.column_count(); ++i) {
+                details::append(chunk_, static_cast<ULONG>(batch[i].type()));
+                details::append_name(chunk_, batch[i].name());
+            }
+            write_chunk(table_chunk_type::table);
+
+            ++stats_.tables;
+        }
+
+        const size_t rows = batch.rows();
+        row_groups_.push_back({ offset(), table.id, static_cast<ULONG>(rows) });
+
+        chunk_.clear();
+        details::append(chunk_, table_chunk_header{ table_chunk_type::row_group, 0 });
+        details::append(chunk_, row_group_chunk{
+            table.id, static_cast<ULONG>(rows), static_cast<ULONG>(batch.column_count()), 0 });
+
+        auto timestamps = reinterpret_cast<const BYTE*>(batch.timestamps().data());
+        auto process_ids = reinterpret_cast<const BYTE*>(batch.process_ids().data());
+        auto thread_ids = reinterpret_cast<const BYTE*>(batch.thread_ids().data());
+        chunk_.insert(chunk_.end(), timestamps, timestamps + rows * sizeof(LONGLONG));
+        chunk_.insert(chunk_.end(), process_ids, process_ids + rows * sizeof(ULONG));
+        chunk_.insert(chunk_.end(), thread_ids, thread_ids + rows * sizeof(ULONG));
+        details::pad8(chunk_);
+
+        for (size_t i = 0; i < batch.column_count(); ++i) {
+            if (details::append_column(chunk_, batch[i]) == column_encoding::dictionary) {
+                ++stats_.dictionary_columns;
+            }
+        }
+        write_chunk(table_chunk_type::row_group);
+
+        ++stats_.row_groups;
+    }
+
+    inline void table_writer::write_chunk(table_chunk_type type)
+    {
+        // chunk_ starts with a placeholder header; fill in the size now that
+        // the payload is complete.
+        details::pad8(chunk_);
+        table_chunk_header header{ type, static_cast<ULONG>(chunk_.size() - sizeof(table_chunk_header)) };
+        memcpy(chunk_.data(), &header, sizeof(header));
+
+        out_.insert(out_.end(), chunk_.begin(), chunk_.end());
+        if (out_.size() >= flush_threshold) {
+            write_out();
+        }
+    }
+
+    inline void table_writer::write_out()
+    {
+        if (file_ == INVALID_HANDLE_VALUE || buffer_.empty()) {
+            return;
+        }
+
+        DWORD written = 0;
+        if (!WriteFile(file_, buffer_.data(), static_cast<DWORD>(buffer_.size()), &written, nullptr) ||
+            written != buffer_.size()) {
+            throw std::runtime_error("Could not write to the table file");
+        }
+
+        written_ += buffer_.size();
+        buffer_.clear();
+    }
+
+    inline ULONGLONG table_writer::offset() const
+    {
+        return written_ + (out_.size() - base_);
+    }
+
+} /* namespace columnar */ } /* namespace krabs */
@@ -0,0 +1,303 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+// Deliberately free of windows.h and the compiler check: headers made by
+// tools/generate_decoders.py only need this one, so the views they declare
+// can decode user data copied out of a capture on any platform. Matching
+// them to EVENT_RECORDs is left to dispatcher.hpp.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace krabs {
+
+    /**
+     * <summary>
+     *   Where a field of an event starts: a number of bytes plus a number
+     *   of pointers, whose size depends on the machine that logged the event.
+     * </summary>
+     */
+    struct field_offset {
+        uint16_t bytes;
+        uint16_t pointers;
+
+        constexpr size_t at(size_t pointer_size) const
+        {
+            return bytes + pointers * pointer_size;
+        }
+    };
+
+namespace decoding {
+
+    /**
+     * <summary>
+     *   The TDH_INTYPE values of the fields generated views read, so that
+     *   their descriptors don't need tdh.h. dispatcher.hpp checks that
+     *   they're the same.
+     * </summary>
+     */
+    const uint16_t in_unicode_string = 1;
+    const uint16_t in_ansi_string    = 2;
+    const uint16_t in_int8           = 3;
+    const uint16_t in_uint8          = 4;
+    const uint16_t in_int16          = 5;
+    const uint16_t in_uint16         = 6;
+    const uint16_t in_int32          = 7;
+    const uint16_t in_uint32         = 8;
+    const uint16_t in_int64          = 9;
+    const uint16_t in_uint64         = 10;
+    const uint16_t in_float          = 11;
+    const uint16_t in_double         = 12;
+    const uint16_t in_boolean        = 13;
+    const uint16_t in_guid           = 15;
+    const uint16_t in_pointer        = 16;
+    const uint16_t in_filetime       = 17;
+    const uint16_t in_systemtime     = 18;
+    const uint16_t in_hexint32       = 20;
+    const uint16_t in_hexint64       = 21;
+
+    /**
+     * <summary>
+     *   A GUID as it's laid out in user data.
+     * </summary>
+     */
+    struct guid {
+        uint32_t data1;
+        uint16_t data2;
+        uint16_t data3;
+        uint8_t data4[8];
+    };
+
+    inline bool operator==(const guid &a, const guid &b)
+    {
+        return memcmp(&a, &b, sizeof(guid)) == 0;
+    }
+
+    inline bool operator!=(const guid &a, const guid &b)
+    {
+        return !(a == b);
+    }
+
+    /**
+     * <summary>
+     *   A SYSTEMTIME as it's laid out in user data.
+     * </summary>
+     */
+    struct systemtime {
+        uint16_t year;
+        uint16_t month;
+        uint16_t day_of_week;
+        uint16_t day;
+        uint16_t hour;
+        uint16_t minute;
+        uint16_t second;
+        uint16_t milliseconds;
+    };
+
+    /**
+     * <summary>
+     *   Describes one field of a generated event view. Fields that follow a
+     *   variable sized one (a string) can't have an offset from the start of
+     *   the user data; their offset is from the end of that field instead,
+     *   which `after` names by index.
+     * </summary>
+     */
+    struct field_descriptor {
+        static constexpr int from_start = -1;
+
+        const wchar_t *name;
+        uint16_t in_type;
+        krabs::field_offset offset;
+        int after;
+    };
+
+    /**
+     * <summary>
+     *   Base of the views over user data whose layout is known ahead of
+     *   time. Reads fields straight out of the bytes at offsets that are
+     *   known at compile time, instead of going through TDH and looking
+     *   properties up by name.
+     * </summary>
+     * <remarks>
+     *   A view doesn't copy the data; it's only valid for as long as the
+     *   data is. Reading a field that runs past the end of the data throws
+     *   std::out_of_range, like the parser does. Wide strings are UTF-16,
+     *   and are read a code unit per wchar_t.
+     * </remarks>
+     */
+    class byte_view {
+    public:
+        byte_view(const uint8_t *data, size_t size, size_t pointer_size);
+
+        /**
+         * <summary>
+         *   4 for events logged by 32-bit machines, 8 otherwise.
+         * </summary>
+         */
+        size_t pointer_size() const;
+
+    protected:
+        template <typename T>
+        T read(size_t offset) const;
+
+        uint64_t read_pointer(size_t offset) const;
+
+        // Strings run to their terminator or to the end of the data.
+        // `next` is set to where the field after the string starts.
+        std::wstring read_wstring(size_t offset, size_t &next) const;
+        std::string read_string(size_t offset, size_t &next) const;
+
+        // Where the field after a string starts, without copying it.
+        size_t skip_wstring(size_t offset) const;
+        size_t skip_string(size_t offset) const;
+
+        void check(size_t offset, size_t size) const;
+
+        /**
+         * <summary>
+         *   Works out where each of the fields starts, skipping each
+         *   string once. Offsets past the end are kept, so that it's
+         *   reading the field that throws.
+         * </summary>
+         */
+        template <size_t N>
+        void locate(const field_descriptor (&fields)[N], size_t (&offsets)[N]) const;
+
+    protected:
+        const uint8_t *data_;
+        size_t size_;
+        size_t pointer_size_;
+    };
+
+    // Declared here so that generated headers can name a dispatcher over
+    // their views without dispatcher.hpp, which needs Windows.
+    template <typename... Events>
+    class dispatcher;
+
+    // Implementation
+    // ------------------------------------------------------------------------
+
+    inline byte_view::byte_view(const uint8_t *data, size_t size, size_t pointer_size)
+    : data_(data)
+    , size_(size)
+    , pointer_size_(pointer_size)
+    {}
+
+    inline size_t byte_view::pointer_size() const
+    {
+        return pointer_size_;
+    }
+
+    inline void byte_view::check(size_t offset, size_t size) const
+    {
+        if (offset > size_ || size > size_ - offset) {
+            throw std::out_of_range("Property length past end of property buffer");
+        }
+    }
+
+    template <typename T>
+    T byte_view::read(size_t offset) const
+    {
+        check(offset, sizeof(T));
+
+        T value;
+        memcpy(&value, data_ + offset, sizeof(T));
+        return value;
+    }
+
+    inline uint64_t byte_view::read_pointer(size_t offset) const
+    {
+        if (pointer_size_ == 4) {
+            return read<uint32_t>(offset);
+        }
+
+        return read<uint64_t>(offset);
+    }
+
+    inline std::wstring byte_view::read_wstring(size_t offset, size_t &next) const
+    {
+        check(offset, 0);
+
+        std::wstring value;
+        size_t at = offset;
+        while (size_ - at >= sizeof(uint16_t)) {
+            uint16_t c;
+            memcpy(&c, data_ + at, sizeof(c));
+            at += sizeof(c);
+            if (c == 0) {
+                break;
+            }
+            value.push_back(static_cast<wchar_t>(c));
+        }
+
+        next = at;
+        return value;
+    }
+
+    inline std::string byte_view::read_string(size_t offset, size_t &next) const
+    {
+        check(offset, 0);
+
+        auto start = reinterpret_cast<const char*>(data_ + offset);
+        auto terminator = static_cast<const char*>(memchr(start, 0, size_ - offset));
+        size_t length = terminator != nullptr ? terminator - start : size_ - offset;
+
+        next = offset + length + (terminator != nullptr ? 1 : 0);
+        return std::string(start, length);
+    }
+
+    inline size_t byte_view::skip_wstring(size_t offset) const
+    {
+        check(offset, 0);
+
+        size_t at = offset;
+        while (size_ - at >= sizeof(uint16_t)) {
+            uint16_t c;
+            memcpy(&c, data_ + at, sizeof(c));
+            at += sizeof(c);
+            if (c == 0) {
+                break;
+            }
+        }
+
+        return at;
+    }
+
+    inline size_t byte_view::skip_string(size_t offset) const
+    {
+        check(offset, 0);
+
+        auto start = data_ + offset;
+        auto terminator = static_cast<const uint8_t*>(memchr(start, 0, size_ - offset));
+        return terminator != nullptr ? (terminator - data_) + 1 : size_;
+    }
+
+    template <size_t N>
+    void byte_view::locate(const field_descriptor (&fields)[N], size_t (&offsets)[N]) const
+    {
+        // Where each string ends; fields that follow one start from there.
+        size_t ends[N];
+
+        for (size_t i = 0; i < N; ++i) {
+            const auto &field = fields[i];
+            const size_t start = field.after == field_descriptor::from_start ? 0 : ends[field.after];
+            offsets[i] = start + field.offset.at(pointer_size_);
+
+            ends[i] = offsets[i];
+            if (offsets[i] <= size_) {
+                if (field.in_type == in_unicode_string) {
+                    ends[i] = skip_wstring(offsets[i]);
+                }
+                else if (field.in_type == in_ansi_string) {
+                    ends[i] = skip_string(offsets[i]);
+                }
+            }
+        }
+    }
+
+} /* namespace decoding */ } /* namespace krabs */
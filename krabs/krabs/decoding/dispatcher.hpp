@@ -0,0 +1,203 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#ifndef  WIN32_LEAN_AND_MEAN
+#define  WIN32_LEAN_AND_MEAN
+#endif
+
+#include <windows.h>
+#include <tdh.h>
+#include <evntcons.h>
+
+#include <algorithm>
+#include <functional>
+#include <tuple>
+#include <vector>
+
+#include "../compiler_check.hpp"
+#include "byte_view.hpp"
+#include "../filtering/event_filter.hpp"
+#include "../trace_context.hpp"
+
+namespace krabs { namespace decoding {
+
+    static_assert(sizeof(guid) == sizeof(GUID), "guid has to be laid out as GUID is");
+    static_assert(in_unicode_string == TDH_INTYPE_UNICODESTRING &&
+                  in_ansi_string == TDH_INTYPE_ANSISTRING &&
+                  in_uint32 == TDH_INTYPE_UINT32 &&
+                  in_boolean == TDH_INTYPE_BOOLEAN &&
+                  in_guid == TDH_INTYPE_GUID &&
+                  in_pointer == TDH_INTYPE_POINTER &&
+                  in_systemtime == TDH_INTYPE_SYSTEMTIME &&
+                  in_hexint64 == TDH_INTYPE_HEXINT64,
+                  "the in_ values have to be TDH's");
+
+    /**
+     * <summary>
+     *   The GUID a generated header declares, for example to enable its
+     *   provider.
+     * </summary>
+     */
+    inline GUID to_guid(const guid &id)
+    {
+        GUID result;
+        memcpy(&result, &id, sizeof(result));
+        return result;
+    }
+
+    /**
+     * <summary>
+     *   Whether the record is the event Event is a view of.
+     * </summary>
+     */
+    template <typename Event>
+    bool matches(const EVENT_RECORD &record)
+    {
+        const auto &descriptor = record.EventHeader.EventDescriptor;
+        return descriptor.Id == Event::id && descriptor.Version == Event::version &&
+               memcmp(&record.EventHeader.ProviderId, &Event::provider(), sizeof(GUID)) == 0;
+    }
+
+    /**
+     * <summary>
+     *   The view of the record's user data, which is only valid for as
+     *   long as the record is.
+     * </summary>
+     */
+    template <typename Event>
+    Event view_of(const EVENT_RECORD &record)
+    {
+        const size_t pointer_size = (record.EventHeader.Flags & EVENT_HEADER_FLAG_32_BIT_HEADER) != 0 ? 4 : 8;
+        return Event(static_cast<const uint8_t*>(record.UserData), record.UserDataLength, pointer_size);
+    }
+
+    /**
+     * <summary>
+     *   Routes each event to the callback registered for its generated view,
+     *   and events that none of the views match (such as a version the
+     *   manifest didn't have) to a fallback, which can decode them with the
+     *   parser.
+     * </summary>
+     * <remarks>
+     *   Each event type is expected to have a static `id`, `version` and
+     *   provider(), and a constructor from the user data and the pointer
+     *   size, as the views made by tools/generate_decoders.py do. Generated
+     *   headers declare a dispatcher over all of the provider's events.
+     *
+     *   The dispatcher is a callback itself, so it plugs into
+     *   provider::add_on_event_callback or event_filter::add_on_event_callback.
+     *   Events that match a view with no callback are dropped.
+     * </remarks>
+     * <example>
+     *   sample::dispatcher dispatch;
+     *   dispatch.on<sample::request_start_v1>([](const sample::request_start_v1 &start, const krabs::trace_context &) {
+     *       std::wcout << start.path() << std::endl;
+     *   });
+     *   dispatch.otherwise([](const EVENT_RECORD &record, const krabs::trace_context &context) {
+     *       krabs::schema schema(record, context.schema_locator);
+     *       krabs::parser parser(schema);
+     *       // ...
+     *   });
+     *
+     *   krabs::event_filter filter(sample::dispatcher::event_ids());
+     *   filter.add_on_event_callback(dispatch);
+     *   provider.add_filter(filter);
+     * </example>
+     */
+    template <typename... Events>
+    class dispatcher {
+    public:
+
+        /**
+         * <summary>
+         *   Calls the callback with the view for each event that matches
+         *   Event. Replaces any callback set before for Event.
+         * </summary>
+         */
+        template <typename Event, typename F>
+        void on(F callback);
+
+        /**
+         * <summary>
+         *   Calls the callback with the record for events none of the views
+         *   match.
+         * </summary>
+         */
+        template <typename F>
+        void otherwise(F callback);
+
+        void operator()(const EVENT_RECORD &record, const krabs::trace_context &trace_context) const;
+
+        /**
+         * <summary>
+         *   The distinct ids of the events, to build an event_filter that
+         *   has ETW drop everything else.
+         * </summary>
+         */
+        static std::vector<unsigned short> event_ids();
+
+    private:
+        template <typename Event>
+        bool dispatch(const EVENT_RECORD &record, const krabs::trace_context &trace_context) const;
+
+    private:
+        std::tuple<std::function<void(const Events &, const krabs::trace_context &)>...> callbacks_;
+        krabs::provider_callback fallback_;
+    };
+
+    // Implementation
+    // ------------------------------------------------------------------------
+
+    template <typename... Events>
+    template <typename Event, typename F>
+    void dispatcher<Events...>::on(F callback)
+    {
+        std::get<std::function<void(const Event &, const krabs::trace_context &)>>(callbacks_) = callback;
+    }
+
+    template <typename... Events>
+    template <typename F>
+    void dispatcher<Events...>::otherwise(F callback)
+    {
+        fallback_ = callback;
+    }
+
+    template <typename... Events>
+    void dispatcher<Events...>::operator()(const EVENT_RECORD &record, const krabs::trace_context &trace_context) const
+    {
+        // Stops at the first view that matches.
+        const bool matched = (false || ... || dispatch<Events>(record, trace_context));
+
+        if (!matched && fallback_) {
+            fallback_(record, trace_context);
+        }
+    }
+
+    template <typename... Events>
+    template <typename Event>
+    bool dispatcher<Events...>::dispatch(const EVENT_RECORD &record, const krabs::trace_context &trace_context) const
+    {
+        if (!matches<Event>(record)) {
+            return false;
+        }
+
+        const auto &callback = std::get<std::function<void(const Event &, const krabs::trace_context &)>>(callbacks_);
+        if (callback) {
+            callback(view_of<Event>(record), trace_context);
+        }
+
+        return true;
+    }
+
+    template <typename... Events>
+    std::vector<unsigned short> dispatcher<Events...>::event_ids()
+    {
+        std::vector<unsigned short> ids = { static_cast<unsigned short>(Events::id)... };
+        std::sort(ids.begin(), ids.end());
+        ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+        return ids;
+    }
+
+} /* namespace decoding */ } /* namespace krabs */
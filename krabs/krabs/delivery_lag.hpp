@@ -0,0 +1,286 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+
+#include <windows.h>
+#include <evntcons.h>
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "clock.hpp"
+#include "compiler_check.hpp"
+#include "guid.hpp"
+#include "metrics.hpp"
+
+namespace krabs {
+
+    /**
+     * <summary>
+     * Passed to the alert callback of a delivery_lag_tracker when a
+     * provider's lag reaches the threshold. Lags are in 100-nanosecond
+     * intervals.
+     * </summary>
+     */
+    struct delivery_lag_alert {
+        GUID provider;
+        uint64_t lag;
+        uint64_t threshold;
+    };
+
+    typedef std::function<void(const delivery_lag_alert &)> delivery_lag_callback;
+
+    /**
+     * <summary>
+     * Measures how late events are by the time the trace gets them: the
+     * time now minus the event's timestamp, for one in every sample_every
+     * events. Lags are kept per provider in histograms that can be read
+     * while the trace runs.
+     * </summary>
+     * <remarks>
+     * Timestamps are converted to FILETIMEs with the given converter,
+     * which leaves them as they are unless the trace keeps raw
+     * timestamps, and the lag is taken against the time from
+     * GetSystemTimePreciseAsFileTime. A timestamp from the future, which
+     * can happen when the system time is adjusted, counts as no lag.
+     *
+     * The alert callback is called on the thread processing events, when
+     * a sampled lag reaches the threshold, and not again for the provider
+     * until a sampled lag is back under it. It should hand the alert off
+     * rather than do slow work, which would only add to the lag.
+     *
+     * record() keys lags by EventHeader.ProviderId, which for MOF events
+     * is the event class rather than the provider. Traces sample() the
+     * event and record_lag() it for the provider they dispatch it to.
+     *
+     * Only the thread processing events records. Up to provider_capacity
+     * providers are told apart; the lags of any more are counted against
+     * an empty GUID.
+     * </remarks>
+     * <example>
+     *   krabs::delivery_lag_tracker tracker(64, 2000, [](const krabs::delivery_lag_alert &alert) {
+     *       // more than two seconds behind
+     *   });
+     *   tracker.record(record);
+     *   for (auto &provider : tracker.metrics()) { ... }
+     * </example>
+     */
+    class delivery_lag_tracker {
+    public:
+        static const size_t provider_capacity = 256;
+
+        /**
+         * <param name="sample_every">how many events to record one lag for</param>
+         * <param name="alert_threshold_ms">
+         *   the lag, in milliseconds, at which to call on_alert; 0 for never
+         * </param>
+         * <param name="on_alert">called when a provider's lag reaches the threshold</param>
+         */
+        delivery_lag_tracker(
+            uint64_t sample_every = 64,
+            uint64_t alert_threshold_ms = 0,
+            delivery_lag_callback on_alert = nullptr);
+
+        ~delivery_lag_tracker();
+
+        delivery_lag_tracker(const delivery_lag_tracker &) = delete;
+        delivery_lag_tracker &operator=(const delivery_lag_tracker &) = delete;
+
+        /**
+         * <summary>
+         * Counts an event, and records its lag if it's one to sample.
+         * </summary>
+         */
+        void record(
+            const EVENT_RECORD &record,
+            const timestamp_converter &timestamps = timestamp_converter());
+
+        /**
+         * <summary>
+         * Counts an event and, if it's one to sample, sets lag to how late
+         * it is and returns true. Nothing is recorded.
+         * </summary>
+         */
+        bool sample(
+            const EVENT_RECORD &record,
+            const timestamp_converter &timestamps,
+            uint64_t &lag);
+
+        /**
+         * <summary>
+         * Records a lag, in 100-nanosecond intervals, for the provider.
+         * </summary>
+         */
+        void record_lag(const GUID &provider, uint64_t lag);
+
+        /**
+         * <summary>
+         * The lags recorded so far, for each provider that has any.
+         * </summary>
+         */
+        std::vector<delivery_lag_metrics> metrics() const;
+
+    private:
+        struct provider_lag {
+            GUID provider;
+            details::live_histogram lag;
+            volatile uint64_t alerts;
+            bool alerting;
+        };
+
+        provider_lag &find(const GUID &provider);
+
+    private:
+        const uint64_t sample_every_;
+        uint64_t countdown_;
+        const uint64_t threshold_;
+        delivery_lag_callback on_alert_;
+
+        // Published once filled in, so that readers only ever see complete
+        // entries. Probed from a hash of the GUID.
+        provider_lag *volatile slots_[provider_capacity];
+        provider_lag *volatile overflow_;
+    };
+
+    // Implementation
+    // ------------------------------------------------------------------------
+
+    inline delivery_lag_tracker::delivery_lag_tracker(
+        uint64_t sample_every,
+        uint64_t alert_threshold_ms,
+        delivery_lag_callback on_alert)
+    : sample_every_(sample_every == 0 ? 1 : sample_every)
+    , countdown_(1)
+    , threshold_(alert_threshold_ms * 10000)
+    , on_alert_(on_alert)
+    , overflow_(nullptr)
+    {
+        for (auto &slot : slots_) {
+            slot = nullptr;
+        }
+    }
+
+    inline delivery_lag_tracker::~delivery_lag_tracker()
+    {
+        for (auto slot : slots_) {
+            delete slot;
+        }
+
+        delete overflow_;
+    }
+
+    inline void delivery_lag_tracker::record(
+        const EVENT_RECORD &record,
+        const timestamp_converter &timestamps)
+    {
+        uint64_t lag = 0;
+        if (sample(record, timestamps, lag)) {
+            record_lag(record.EventHeader.ProviderId, lag);
+        }
+    }
+
+    inline bool delivery_lag_tracker::sample(
+        const EVENT_RECORD &record,
+        const timestamp_converter &timestamps,
+        uint64_t &lag)
+    {
+        if (--countdown_ != 0) {
+            return false;
+        }
+
+        countdown_ = sample_every_;
+
+        FILETIME now;
+        GetSystemTimePreciseAsFileTime(&now);
+
+        const LONGLONG received = static_cast<LONGLONG>(
+            (static_cast<ULONGLONG>(now.dwHighDateTime) << 32) | now.dwLowDateTime);
+        const LONGLONG sent = timestamps.to_filetime(record.EventHeader.TimeStamp.QuadPart);
+
+        lag = received > sent ? static_cast<uint64_t>(received - sent) : 0;
+        return true;
+    }
+
+    inline void delivery_lag_tracker::record_lag(const GUID &provider, uint64_t lag)
+    {
+        auto &entry = find(provider);
+        entry.lag.record(lag);
+
+        if (threshold_ == 0) {
+            return;
+        }
+
+        if (lag < threshold_) {
+            entry.alerting = false;
+            return;
+        }
+
+        if (!entry.alerting) {
+            entry.alerting = true;
+            ++entry.alerts;
+
+            if (on_alert_) {
+                delivery_lag_alert alert = { provider, lag, threshold_ };
+                on_alert_(alert);
+            }
+        }
+    }
+
+    inline std::vector<delivery_lag_metrics> delivery_lag_tracker::metrics() const
+    {
+        std::vector<delivery_lag_metrics> result;
+
+        auto add = [&result](const provider_lag *entry) {
+            if (entry == nullptr) {
+                return;
+            }
+
+            delivery_lag_metrics metrics;
+            metrics.provider = entry->provider;
+            metrics.alerts = entry->alerts;
+            entry->lag.add_to(metrics.lag);
+            result.push_back(metrics);
+        };
+
+        for (auto slot : slots_) {
+            add(slot);
+        }
+
+        add(overflow_);
+        return result;
+    }
+
+    inline delivery_lag_tracker::provider_lag &delivery_lag_tracker::find(const GUID &provider)
+    {
+        // Sequential GUIDs often only differ in their last bytes.
+        const size_t start = std::hash<krabs::guid>()(krabs::guid(provider)) % provider_capacity;
+
+        for (size_t i = 0; i < provider_capacity; ++i) {
+            auto &slot = slots_[(start + i) % provider_capacity];
+
+            if (slot == nullptr) {
+                auto entry = new provider_lag();
+                entry->provider = provider;
+                InterlockedExchangePointer(reinterpret_cast<PVOID volatile *>(&slot), entry);
+                return *entry;
+            }
+
+            if (IsEqualGUID(slot->provider, provider)) {
+                return *slot;
+            }
+        }
+
+        if (overflow_ == nullptr) {
+            InterlockedExchangePointer(reinterpret_cast<PVOID volatile *>(&overflow_), new provider_lag());
+        }
+
+        return *overflow_;
+    }
+
+} /* namespace krabs */
@@ -0,0 +1,775 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+// Deliberately free of windows.h and the compiler check: an .etl file is
+// just bytes, and tools that read one on another platform (a capture copied
+// off a machine, say) only need this header. The records it decodes into
+// are laid out as EVENT_RECORD's parts are, which etl_reader.hpp checks
+// before handing them out as EVENT_RECORDs; the reader also holds what
+// needs Windows, the file mapping and the decoding threads.
+//
+// The layout of .etl files isn't part of the SDK headers either. Everything
+// in this file works on plain bytes so the decoder doesn't depend on the
+// structure packing of the machine that reads the file.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include "../timestamp_converter.hpp"
+
+namespace krabs { namespace etl {
+
+    /**
+     * <summary>
+     *   Values of the HeaderType byte that starts every record in an ETL
+     *   buffer. The 32 and 64 variants give the pointer size of the process
+     *   that wrote the event.
+     * </summary>
+     */
+    enum class record_type : uint8_t {
+        system32 = 1,
+        system64 = 2,
+        compact32 = 3,
+        compact64 = 4,
+        full_header32 = 10,
+        instance32 = 11,
+        timed = 12,
+        error = 13,
+        wnode_header = 14,
+        message = 15,
+        perfinfo32 = 16,
+        perfinfo64 = 17,
+        event_header32 = 18,
+        event_header64 = 19,
+        full_header64 = 20,
+        instance64 = 21
+    };
+
+    // The clock a session stamped its events with, from
+    // TRACE_LOGFILE_HEADER.ReservedFlags.
+    using krabs::clock_type;
+
+    /**
+     * <summary>
+     *   The parts of the TRACE_LOGFILE_HEADER that are needed to interpret
+     *   the rest of the file.
+     * </summary>
+     */
+    struct logfile_info
+    {
+        uint32_t buffer_size;
+        uint32_t version;
+        uint32_t provider_version;
+        uint32_t number_of_processors;
+        int64_t end_time;
+        uint32_t log_file_mode;
+        uint32_t buffers_written;
+        uint32_t pointer_size;
+        uint32_t events_lost;
+        uint32_t cpu_speed_mhz;
+        int64_t boot_time;
+        int64_t perf_freq;
+        int64_t start_time;
+        clock_type clock;
+        uint32_t buffers_lost;
+
+        // Raw timestamp of the header event, which was taken at start_time.
+        int64_t start_timestamp;
+    };
+
+    /**
+     * <summary>
+     *   A GUID, laid out as it is in the file.
+     * </summary>
+     */
+    struct guid
+    {
+        uint32_t data1;
+        uint16_t data2;
+        uint16_t data3;
+        uint8_t data4[8];
+    };
+
+    inline bool operator==(const guid &a, const guid &b)
+    {
+        return memcmp(&a, &b, sizeof(guid)) == 0;
+    }
+
+    inline bool operator!=(const guid &a, const guid &b)
+    {
+        return !(a == b);
+    }
+
+    /**
+     * <summary>
+     *   An EVENT_DESCRIPTOR.
+     * </summary>
+     */
+    struct event_descriptor
+    {
+        uint16_t id;
+        uint8_t version;
+        uint8_t channel;
+        uint8_t level;
+        uint8_t opcode;
+        uint16_t task;
+        uint64_t keyword;
+    };
+
+    /**
+     * <summary>
+     *   An EVENT_HEADER. The flags are EVENT_HEADER_FLAG_* values, a few of
+     *   which are in constants.
+     * </summary>
+     */
+    struct event_header
+    {
+        uint16_t size;
+        uint16_t header_type;
+        uint16_t flags;
+        uint16_t event_property;
+        uint32_t thread_id;
+        uint32_t process_id;
+        int64_t timestamp;
+        guid provider_id;
+        event_descriptor descriptor;
+        uint32_t kernel_time;
+        uint32_t user_time;
+        guid activity_id;
+    };
+
+    /**
+     * <summary>
+     *   An EVENT_HEADER_EXTENDED_DATA_ITEM. Bit 0 of linkage is set on every
+     *   item of a record but the last, and data_ptr is the address of the
+     *   item's data.
+     * </summary>
+     */
+    struct extended_item
+    {
+        uint16_t reserved1;
+        uint16_t ext_type;
+        uint16_t linkage;
+        uint16_t data_size;
+        uint64_t data_ptr;
+    };
+
+    /**
+     * <summary>
+     *   An ETW_BUFFER_CONTEXT.
+     * </summary>
+     */
+    struct buffer_context
+    {
+        uint8_t processor_number;
+        uint8_t alignment;
+        uint16_t logger_id;
+    };
+
+    /**
+     * <summary>
+     *   An EVENT_RECORD without the user context, which only a consumer
+     *   sets.
+     * </summary>
+     */
+    struct event_record
+    {
+        event_header header;
+        buffer_context context;
+        uint16_t extended_data_count;
+        uint16_t user_data_length;
+        const extended_item *extended_data;
+        const uint8_t *user_data;
+    };
+
+    // The sizes and offsets of the Windows structures, so that a record can
+    // be copied into one as it is.
+    static_assert(sizeof(guid) == 16, "guid layout changed");
+    static_assert(sizeof(event_descriptor) == 16, "event_descriptor layout changed");
+    static_assert(sizeof(event_header) == 80, "event_header layout changed");
+    static_assert(offsetof(event_header, timestamp) == 16, "event_header layout changed");
+    static_assert(offsetof(event_header, provider_id) == 24, "event_header layout changed");
+    static_assert(offsetof(event_header, descriptor) == 40, "event_header layout changed");
+    static_assert(offsetof(event_header, kernel_time) == 56, "event_header layout changed");
+    static_assert(offsetof(event_header, activity_id) == 64, "event_header layout changed");
+    static_assert(sizeof(extended_item) == 16, "extended_item layout changed");
+    static_assert(sizeof(buffer_context) == 4, "buffer_context layout changed");
+
+    /**
+     * <summary>
+     *   The events decoded from one ETL buffer. User and extended data point
+     *   into the buffer they were decoded from, so the buffer must outlive
+     *   this object.
+     * </summary>
+     */
+    struct decoded_buffer
+    {
+        std::vector<event_record> records;
+        std::vector<extended_item> extended_data;
+        size_t skipped;
+        bool malformed;
+    };
+
+    namespace constants {
+        // sizeof(WMI_BUFFER_HEADER)
+        const size_t buffer_header_size = 0x48;
+
+        const size_t buffer_offset_buffer_size = 0x00;
+        const size_t buffer_offset_saved_offset = 0x04;
+        const size_t buffer_offset_client_context = 0x28;
+        const size_t buffer_offset_filled = 0x30;
+
+        // The top two bits of the first ULONG of each record,
+        // TRACE_HEADER_FLAG | TRACE_HEADER_EVENT_TRACE.
+        const uint8_t record_marker = 0xC0;
+
+        // sizeof(SYSTEM_TRACE_HEADER), sizeof(SYSTEM_TRACE_HEADER) without
+        // the CPU times, sizeof(PERFINFO_TRACE_HEADER), sizeof(EVENT_TRACE_HEADER)
+        const size_t system_header_size = 32;
+        const size_t compact_header_size = 24;
+        const size_t perfinfo_header_size = 16;
+        const size_t full_header_size = 48;
+        const size_t extended_item_header_size = 8;
+
+        // EVENT_TRACE_GROUP_HEADER | EVENT_TRACE_TYPE_INFO
+        const uint16_t logfile_header_hook = 0x0000;
+
+        // Only set in files written by Windows 8 and later.
+        const uint32_t compressed_mode = 0x04000000;
+
+        // EVENT_HEADER_FLAG_*
+        const uint16_t header_flag_extended_info = 0x0001;
+        const uint16_t header_flag_no_cputime = 0x0010;
+        const uint16_t header_flag_32_bit = 0x0020;
+        const uint16_t header_flag_64_bit = 0x0040;
+        const uint16_t header_flag_classic = 0x0100;
+    }
+
+    namespace details {
+
+        template <typename T>
+        T read(const uint8_t *data)
+        {
+            T value;
+            memcpy(&value, data, sizeof(T));
+            return value;
+        }
+
+        inline size_t align8(size_t size)
+        {
+            return (size + 7) & ~static_cast<size_t>(7);
+        }
+
+        // The MOF class GUIDs of the kernel event groups, as in
+        // kernel_guids.hpp, which needs Windows.
+        const guid event_trace_guid        = { 0x68fdd900, 0x4a3e, 0x11d1, { 0x84, 0xf4, 0x00, 0x00, 0xf8, 0x04, 0x64, 0xe3 } };
+        const guid disk_io_guid            = { 0x3d6fa8d4, 0xfe05, 0x11d0, { 0x9d, 0xda, 0x00, 0xc0, 0x4f, 0xd7, 0xba, 0x7c } };
+        const guid page_fault_guid         = { 0x3d6fa8d3, 0xfe05, 0x11d0, { 0x9d, 0xda, 0x00, 0xc0, 0x4f, 0xd7, 0xba, 0x7c } };
+        const guid process_guid            = { 0x3d6fa8d0, 0xfe05, 0x11d0, { 0x9d, 0xda, 0x00, 0xc0, 0x4f, 0xd7, 0xba, 0x7c } };
+        const guid file_io_guid            = { 0x90cbdc39, 0x4a3e, 0x11d1, { 0x84, 0xf4, 0x00, 0x00, 0xf8, 0x04, 0x64, 0xe3 } };
+        const guid thread_guid             = { 0x3d6fa8d1, 0xfe05, 0x11d0, { 0x9d, 0xda, 0x00, 0xc0, 0x4f, 0xd7, 0xba, 0x7c } };
+        const guid tcp_ip_guid             = { 0x9a280ac0, 0xc8e0, 0x11d1, { 0x84, 0xe2, 0x00, 0xc0, 0x4f, 0xb9, 0x98, 0xa2 } };
+        const guid udp_ip_guid             = { 0xbf3a50c5, 0xa9c9, 0x4988, { 0xa0, 0x05, 0x2d, 0xf0, 0xb7, 0xc8, 0x0f, 0x80 } };
+        const guid registry_guid           = { 0xae53722e, 0xc863, 0x11d2, { 0x86, 0x59, 0x00, 0xc0, 0x4f, 0xa3, 0x21, 0xa1 } };
+        const guid debug_guid              = { 0x13976d09, 0xa327, 0x438c, { 0x95, 0x0b, 0x7f, 0x03, 0x19, 0x28, 0x15, 0xc7 } };
+        const guid event_trace_config_guid = { 0x01853a65, 0x418f, 0x4f36, { 0xae, 0xfc, 0xdc, 0x0f, 0x1d, 0x2f, 0xd2, 0x35 } };
+        const guid pool_trace_guid         = { 0x0268a8b6, 0x74fd, 0x4302, { 0x9d, 0xd0, 0x6e, 0x8f, 0x17, 0x95, 0xc0, 0xcf } };
+        const guid perf_info_guid          = { 0xce1dbfb4, 0x137e, 0x4da6, { 0x87, 0xb0, 0x3f, 0x59, 0xaa, 0x10, 0x2c, 0xbc } };
+        const guid ob_trace_guid           = { 0x89497f50, 0xeffe, 0x4440, { 0x8c, 0xf2, 0xce, 0x6b, 0x1c, 0xdc, 0xac, 0xa7 } };
+        const guid power_guid              = { 0xe43445e0, 0x0903, 0x48c3, { 0xb8, 0x78, 0xff, 0x0f, 0xcc, 0xeb, 0xdd, 0x04 } };
+        const guid image_load_guid         = { 0x2cb15d1d, 0x5fc1, 0x11d2, { 0xab, 0xe1, 0x00, 0xa0, 0xc9, 0x11, 0xf5, 0x18 } };
+        const guid stack_walk_guid         = { 0xdef2fe46, 0x7bd6, 0x4b80, { 0xbd, 0x94, 0xf5, 0x7f, 0xe2, 0x0d, 0x0c, 0xe3 } };
+        const guid ums_event_guid          = { 0x9aec974b, 0x5b8e, 0x4118, { 0x9b, 0x92, 0x31, 0x86, 0xd8, 0x00, 0x2c, 0xe5 } };
+        const guid alpc_guid               = { 0x45d8cccd, 0x539f, 0x4b72, { 0xa8, 0xb7, 0x5c, 0x68, 0x31, 0x42, 0x60, 0x9a } };
+        const guid split_io_guid           = { 0xd837ca92, 0x12b9, 0x44a5, { 0xad, 0x6a, 0x3a, 0x65, 0xb3, 0x57, 0x8a, 0xa8 } };
+        const guid system_trace_guid       = { 0x9e814aad, 0x3204, 0x11d2, { 0x9a, 0x82, 0x00, 0x60, 0x08, 0xa8, 0x69, 0x39 } };
+
+        /**
+         * <summary>
+         *   Maps the group byte of a kernel hook id (EVENT_TRACE_GROUP_*) to
+         *   the MOF class GUID that TDH knows the event by.
+         * </summary>
+         */
+        inline const guid &guid_of_group(uint8_t group)
+        {
+            switch (group) {
+            case 0x00: return event_trace_guid;
+            case 0x01: return disk_io_guid;
+            case 0x02: return page_fault_guid;
+            case 0x03: return process_guid;
+            case 0x04: return file_io_guid;
+            case 0x05: return thread_guid;
+            case 0x06: return tcp_ip_guid;
+            case 0x08: return udp_ip_guid;
+            case 0x09: return registry_guid;
+            case 0x0A: return debug_guid;
+            case 0x0B: return event_trace_config_guid;
+            case 0x0E: return pool_trace_guid;
+            case 0x0F: return perf_info_guid;
+            case 0x11: return ob_trace_guid;
+            case 0x12: return power_guid;
+            case 0x14: return image_load_guid;
+            case 0x15: return perf_info_guid;
+            case 0x18: return stack_walk_guid;
+            case 0x19: return ums_event_guid;
+            case 0x1A: return alpc_guid;
+            case 0x1B: return split_io_guid;
+            default:   return system_trace_guid;
+            }
+        }
+
+        inline uint16_t pointer_flag(record_type type)
+        {
+            switch (type) {
+            case record_type::system32:
+            case record_type::compact32:
+            case record_type::perfinfo32:
+            case record_type::full_header32:
+            case record_type::event_header32:
+                return constants::header_flag_32_bit;
+            default:
+                return constants::header_flag_64_bit;
+            }
+        }
+
+        /**
+         * <summary>
+         *   Returns the size of the record at the given position or 0 if
+         *   there is no record there.
+         * </summary>
+         */
+        inline size_t record_size(const uint8_t *data, size_t available)
+        {
+            if (available < 8 || (data[3] & constants::record_marker) != constants::record_marker) {
+                return 0;
+            }
+
+            switch (static_cast<record_type>(data[2])) {
+            case record_type::system32:
+            case record_type::system64:
+            case record_type::compact32:
+            case record_type::compact64:
+            case record_type::perfinfo32:
+            case record_type::perfinfo64:
+                // These start with a version, the size follows the marker.
+                return read<uint16_t>(data + 4);
+            default:
+                return read<uint16_t>(data);
+            }
+        }
+
+        /**
+         * <summary>
+         *   Fills the header of a kernel event that uses one of the compact
+         *   system header layouts.
+         * </summary>
+         */
+        inline size_t decode_system_header(const uint8_t *data, size_t size, record_type type, event_record &record)
+        {
+            auto &header = record.header;
+            const uint16_t hook_id = read<uint16_t>(data + 6);
+
+            size_t header_size;
+            switch (type) {
+            case record_type::system32:
+            case record_type::system64:
+                header_size = constants::system_header_size;
+                break;
+            case record_type::compact32:
+            case record_type::compact64:
+                header_size = constants::compact_header_size;
+                break;
+            default:
+                header_size = constants::perfinfo_header_size;
+                break;
+            }
+
+            if (size < header_size) {
+                return 0;
+            }
+
+            header.provider_id = guid_of_group(static_cast<uint8_t>(hook_id >> 8));
+            header.descriptor.opcode = static_cast<uint8_t>(hook_id & 0xFF);
+            header.descriptor.version = static_cast<uint8_t>(read<uint16_t>(data));
+            header.flags = constants::header_flag_classic | pointer_flag(type);
+
+            if (header_size == constants::perfinfo_header_size) {
+                // PerfInfo events (interrupts, DPCs, samples) aren't attributed
+                // to a thread.
+                header.thread_id = 0xFFFFFFFF;
+                header.process_id = 0xFFFFFFFF;
+                header.timestamp = read<int64_t>(data + 8);
+                header.flags |= constants::header_flag_no_cputime;
+            } else {
+                header.thread_id = read<uint32_t>(data + 8);
+                header.process_id = read<uint32_t>(data + 12);
+                header.timestamp = read<int64_t>(data + 16);
+
+                if (header_size == constants::system_header_size) {
+                    header.kernel_time = read<uint32_t>(data + 24);
+                    header.user_time = read<uint32_t>(data + 28);
+                } else {
+                    header.flags |= constants::header_flag_no_cputime;
+                }
+            }
+
+            return header_size;
+        }
+
+        /**
+         * <summary>
+         *   Fills the header of a classic (MOF) event written with
+         *   TraceEvent, which uses an EVENT_TRACE_HEADER.
+         * </summary>
+         */
+        inline size_t decode_full_header(const uint8_t *data, size_t size, record_type type, event_record &record)
+        {
+            if (size < constants::full_header_size) {
+                return 0;
+            }
+
+            auto &header = record.header;
+            header.descriptor.opcode = data[4];
+            header.descriptor.level = data[5];
+            header.descriptor.version = static_cast<uint8_t>(read<uint16_t>(data + 6));
+            header.thread_id = read<uint32_t>(data + 8);
+            header.process_id = read<uint32_t>(data + 12);
+            header.timestamp = read<int64_t>(data + 16);
+            header.provider_id = read<guid>(data + 24);
+            header.kernel_time = read<uint32_t>(data + 40);
+            header.user_time = read<uint32_t>(data + 44);
+            header.flags = constants::header_flag_classic | pointer_flag(type);
+
+            return constants::full_header_size;
+        }
+
+        /**
+         * <summary>
+         *   Fills the header of a manifest or TraceLogging event, which is
+         *   stored as an EVENT_HEADER followed by its extended data items.
+         * </summary>
+         */
+        inline size_t decode_event_header(
+            const uint8_t *data,
+            size_t size,
+            record_type type,
+            event_record &record,
+            std::vector<extended_item> &extended_data)
+        {
+            if (size < sizeof(event_header)) {
+                return 0;
+            }
+
+            memcpy(&record.header, data, sizeof(event_header));
+            record.header.header_type = 0;
+            record.header.flags |= pointer_flag(type);
+
+            size_t offset = sizeof(event_header);
+            if ((record.header.flags & constants::header_flag_extended_info) == 0) {
+                return offset;
+            }
+
+            // Each item is the first half of an EVENT_HEADER_EXTENDED_DATA_ITEM
+            // followed by its data, aligned to 8 bytes. Linkage is set on
+            // every item but the last.
+            for (;;) {
+                if (offset + constants::extended_item_header_size > size) {
+                    return 0;
+                }
+
+                extended_item item = {};
+                memcpy(&item, data + offset, constants::extended_item_header_size);
+                offset += constants::extended_item_header_size;
+
+                if (offset + item.data_size > size) {
+                    return 0;
+                }
+
+                // Temporarily an offset from the start of the record, fixed up
+                // once the item vector stops growing.
+                item.data_ptr = offset;
+                extended_data.push_back(item);
+                ++record.extended_data_count;
+
+                offset = align8(offset + item.data_size);
+                if ((item.linkage & 1) == 0) {
+                    break;
+                }
+            }
+
+            return offset < size ? offset : size;
+        }
+    }
+
+    /**
+     * <summary>
+     *   Reads the header of the ETL buffer at the start of `data`. Returns
+     *   false if it doesn't look like one.
+     * </summary>
+     */
+    inline bool read_buffer_header(
+        const uint8_t *data,
+        size_t available,
+        uint32_t &buffer_size,
+        uint32_t &filled,
+        buffer_context &context)
+    {
+        if (available < constants::buffer_header_size) {
+            return false;
+        }
+
+        buffer_size = details::read<uint32_t>(data + constants::buffer_offset_buffer_size);
+        filled = details::read<uint32_t>(data + constants::buffer_offset_filled);
+        context = details::read<buffer_context>(data + constants::buffer_offset_client_context);
+
+        // Older writers only maintain the saved offset.
+        if (filled < constants::buffer_header_size || filled > buffer_size) {
+            filled = details::read<uint32_t>(data + constants::buffer_offset_saved_offset);
+        }
+
+        return buffer_size >= constants::buffer_header_size &&
+               buffer_size <= available &&
+               filled >= constants::buffer_header_size &&
+               filled <= buffer_size;
+    }
+
+    /**
+     * <summary>
+     *   Decodes every event of one ETL buffer into records laid out as
+     *   ProcessTrace would deliver them with PROCESS_TRACE_MODE_RAW_TIMESTAMP.
+     *   Records of kinds that can't be turned into an EVENT_RECORD (WMI
+     *   instance, message and error records) are counted and skipped.
+     * </summary>
+     */
+    inline void decode_buffer(const uint8_t *data, size_t available, decoded_buffer &result)
+    {
+        result.records.clear();
+        result.extended_data.clear();
+        result.skipped = 0;
+        result.malformed = false;
+
+        uint32_t buffer_size = 0;
+        uint32_t filled = 0;
+        buffer_context context = {};
+        if (!read_buffer_header(data, available, buffer_size, filled, context)) {
+            result.malformed = true;
+            return;
+        }
+
+        // Where each record's extended data starts in extended_data.
+        std::vector<size_t> first_item;
+
+        size_t offset = constants::buffer_header_size;
+        while (offset < filled) {
+            const uint8_t *current = data + offset;
+            size_t size = details::record_size(current, filled - offset);
+            if (size == 0) {
+                // The unused tail of a buffer is filled with 0xFF bytes.
+                break;
+            }
+
+            if (size < 8 || size > filled - offset) {
+                result.malformed = true;
+                break;
+            }
+
+            auto type = static_cast<record_type>(current[2]);
+
+            event_record record = {};
+            record.context = context;
+            size_t extended_start = result.extended_data.size();
+            size_t header_size = 0;
+            bool supported = true;
+
+            switch (type) {
+            case record_type::system32:
+            case record_type::system64:
+            case record_type::compact32:
+            case record_type::compact64:
+            case record_type::perfinfo32:
+            case record_type::perfinfo64:
+                header_size = details::decode_system_header(current, size, type, record);
+                break;
+            case record_type::full_header32:
+            case record_type::full_header64:
+                header_size = details::decode_full_header(current, size, type, record);
+                break;
+            case record_type::event_header32:
+            case record_type::event_header64:
+                header_size = details::decode_event_header(current, size, type, record, result.extended_data);
+                break;
+            default:
+                supported = false;
+                break;
+            }
+
+            if (!supported) {
+                ++result.skipped;
+            } else if (header_size == 0) {
+                result.extended_data.resize(extended_start);
+                result.malformed = true;
+                break;
+            } else {
+                record.header.size = static_cast<uint16_t>(size);
+                record.user_data_length = static_cast<uint16_t>(size - header_size);
+                record.user_data = record.user_data_length > 0
+                    ? current + header_size
+                    : nullptr;
+
+                // Like the extended data, data_ptr is relative to the record.
+                for (size_t i = extended_start; i < result.extended_data.size(); ++i) {
+                    result.extended_data[i].data_ptr += reinterpret_cast<uintptr_t>(current);
+                }
+
+                first_item.push_back(extended_start);
+                result.records.push_back(record);
+            }
+
+            offset += details::align8(size);
+        }
+
+        for (size_t i = 0; i < result.records.size(); ++i) {
+            auto &record = result.records[i];
+            record.extended_data = record.extended_data_count > 0
+                ? &result.extended_data[first_item[i]]
+                : nullptr;
+        }
+    }
+
+    /**
+     * <summary>
+     *   Reads the TRACE_LOGFILE_HEADER carried by the first event of an ETL
+     *   file. Returns false if the record isn't the logfile header.
+     * </summary>
+     */
+    inline bool read_logfile_header(const event_record &record, logfile_info &info)
+    {
+        if (record.header.provider_id != details::event_trace_guid ||
+            record.header.descriptor.opcode != constants::logfile_header_hook) {
+            return false;
+        }
+
+        auto data = record.user_data;
+        size_t size = record.user_data_length;
+        if (size < 56) {
+            return false;
+        }
+
+        info = {};
+        info.buffer_size = details::read<uint32_t>(data);
+        info.version = details::read<uint32_t>(data + 4);
+        info.provider_version = details::read<uint32_t>(data + 8);
+        info.number_of_processors = details::read<uint32_t>(data + 12);
+        info.end_time = details::read<int64_t>(data + 16);
+        info.log_file_mode = details::read<uint32_t>(data + 32);
+        info.buffers_written = details::read<uint32_t>(data + 36);
+        info.pointer_size = details::read<uint32_t>(data + 44);
+        info.events_lost = details::read<uint32_t>(data + 48);
+        info.cpu_speed_mhz = details::read<uint32_t>(data + 52);
+        info.start_timestamp = record.header.timestamp;
+
+        if (info.pointer_size != 4 && info.pointer_size != 8) {
+            return false;
+        }
+
+        // LoggerName and LogFileName are pointers in the writer's bitness,
+        // followed by a 172 byte TIME_ZONE_INFORMATION and 8 byte aligned
+        // LARGE_INTEGERs.
+        size_t boot_time = details::align8(56 + 2 * info.pointer_size + 172);
+        if (size < boot_time + 32) {
+            return false;
+        }
+
+        info.boot_time = details::read<int64_t>(data + boot_time);
+        info.perf_freq = details::read<int64_t>(data + boot_time + 8);
+        info.start_time = details::read<int64_t>(data + boot_time + 16);
+        info.clock = static_cast<clock_type>(details::read<uint32_t>(data + boot_time + 24));
+        info.buffers_lost = details::read<uint32_t>(data + boot_time + 28);
+
+        return true;
+    }
+
+    /**
+     * <summary>
+     *   The converter for the raw timestamps of the file, anchored on the
+     *   logfile header event, which was stamped at start_time.
+     * </summary>
+     */
+    inline krabs::timestamp_converter make_timestamp_converter(const logfile_info &info)
+    {
+        const int64_t ticks_per_second = info.clock == clock_type::cpu_cycle_counter
+            ? static_cast<int64_t>(info.cpu_speed_mhz) * 1000000
+            : info.perf_freq;
+
+        return krabs::timestamp_converter(info.clock, ticks_per_second, info.start_timestamp, info.start_time);
+    }
+
+    /**
+     * <summary>
+     *   Converts a raw timestamp from the file to a FILETIME value, which is
+     *   what ProcessTrace hands out unless asked for raw timestamps.
+     * </summary>
+     */
+    inline int64_t to_filetime(const logfile_info &info, int64_t timestamp)
+    {
+        return make_timestamp_converter(info).to_filetime(timestamp);
+    }
+
+    /**
+     * <summary>
+     *   Reads the logfile header out of the first buffer of an ETL image and
+     *   checks that the rest of the image can be decoded. Throws
+     *   std::runtime_error if it can't.
+     * </summary>
+     */
+    inline logfile_info read_image_header(const uint8_t *data, size_t size)
+    {
+        decoded_buffer first;
+        decode_buffer(data, size, first);
+
+        logfile_info info;
+        if (first.records.empty() || !read_logfile_header(first.records.front(), info)) {
+            throw std::runtime_error("Not an ETL file: the logfile header is missing");
+        }
+
+        if (info.log_file_mode & constants::compressed_mode) {
+            throw std::runtime_error("Compressed ETL files are not supported");
+        }
+
+        if (info.buffer_size < constants::buffer_header_size) {
+            throw std::runtime_error("The ETL file has an invalid buffer size");
+        }
+
+        return info;
+    }
+
+    /**
+     * <summary>
+     *   Where each buffer of an ETL image of the given size starts, in file
+     *   order. A partial buffer at the end is left out.
+     * </summary>
+     * <example>
+     *   auto info = krabs::etl::read_image_header(bytes.data(), bytes.size());
+     *   krabs::etl::decoded_buffer buffer;
+     *   for (auto offset : krabs::etl::buffer_offsets(info, bytes.size())) {
+     *       krabs::etl::decode_buffer(bytes.data() + offset, bytes.size() - offset, buffer);
+     *       // buffer.records ...
+     *   }
+     * </example>
+     */
+    inline std::vector<size_t> buffer_offsets(const logfile_info &info, size_t size)
+    {
+        std::vector<size_t> offsets;
+        for (size_t offset = 0; offset + info.buffer_size <= size; offset += info.buffer_size) {
+            offsets.push_back(offset);
+        }
+
+        return offsets;
+    }
+
+} /* namespace etl */ } /* namespace krabs */
@@ -0,0 +1,580 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#ifndef  WIN32_LEAN_AND_MEAN
+#define  WIN32_LEAN_AND_MEAN
+#endif
+
+#include <windows.h>
+#include <evntcons.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../compiler_check.hpp"
+#include "../errors.hpp"
+#include "../trace.hpp"
+#include "../trace_context.hpp"
+#include "etl_format.hpp"
+
+namespace krabs { namespace etl {
+
+    // etl_format.hpp decodes into its own structures so that it doesn't need
+    // Windows; they're handed out as the Windows ones they're laid out like.
+    static_assert(sizeof(event_header) == sizeof(EVENT_HEADER), "event_header doesn't match EVENT_HEADER");
+    static_assert(offsetof(event_header, timestamp) == offsetof(EVENT_HEADER, TimeStamp), "event_header doesn't match EVENT_HEADER");
+    static_assert(offsetof(event_header, provider_id) == offsetof(EVENT_HEADER, ProviderId), "event_header doesn't match EVENT_HEADER");
+    static_assert(offsetof(event_header, descriptor) == offsetof(EVENT_HEADER, EventDescriptor), "event_header doesn't match EVENT_HEADER");
+    static_assert(offsetof(event_header, activity_id) == offsetof(EVENT_HEADER, ActivityId), "event_header doesn't match EVENT_HEADER");
+    static_assert(sizeof(event_descriptor) == sizeof(EVENT_DESCRIPTOR), "event_descriptor doesn't match EVENT_DESCRIPTOR");
+    static_assert(sizeof(extended_item) == sizeof(EVENT_HEADER_EXTENDED_DATA_ITEM), "extended_item doesn't match EVENT_HEADER_EXTENDED_DATA_ITEM");
+    static_assert(sizeof(buffer_context) == sizeof(ETW_BUFFER_CONTEXT), "buffer_context doesn't match ETW_BUFFER_CONTEXT");
+    static_assert(constants::header_flag_extended_info == EVENT_HEADER_FLAG_EXTENDED_INFO, "EVENT_HEADER_FLAG_EXTENDED_INFO changed");
+    static_assert(constants::header_flag_no_cputime == EVENT_HEADER_FLAG_NO_CPUTIME, "EVENT_HEADER_FLAG_NO_CPUTIME changed");
+    static_assert(constants::header_flag_32_bit == EVENT_HEADER_FLAG_32_BIT_HEADER, "EVENT_HEADER_FLAG_32_BIT_HEADER changed");
+    static_assert(constants::header_flag_64_bit == EVENT_HEADER_FLAG_64_BIT_HEADER, "EVENT_HEADER_FLAG_64_BIT_HEADER changed");
+    static_assert(constants::header_flag_classic == EVENT_HEADER_FLAG_CLASSIC_HEADER, "EVENT_HEADER_FLAG_CLASSIC_HEADER changed");
+
+    namespace details {
+
+        /**
+         * <summary>
+         *   The EVENT_RECORD that ProcessTrace would have delivered for a
+         *   decoded record. It points at the same user and extended data.
+         * </summary>
+         */
+        inline EVENT_RECORD to_event_record(const event_record &record)
+        {
+            EVENT_RECORD result = {};
+            memcpy(&result.EventHeader, &record.header, sizeof(EVENT_HEADER));
+            memcpy(&result.BufferContext, &record.context, sizeof(ETW_BUFFER_CONTEXT));
+            result.ExtendedDataCount = record.extended_data_count;
+            result.UserDataLength = record.user_data_length;
+            result.ExtendedData = reinterpret_cast<PEVENT_HEADER_EXTENDED_DATA_ITEM>(
+                const_cast<extended_item*>(record.extended_data));
+            result.UserData = const_cast<uint8_t*>(record.user_data);
+            return result;
+        }
+    }
+
+    /**
+     * <summary>
+     *   Counters describing what an etl reader found in a file.
+     * </summary>
+     */
+    struct reader_stats
+    {
+        uint64_t buffers;
+        uint64_t events;
+        uint64_t skipped;
+        uint64_t malformed_buffers;
+    };
+
+    /**
+     * <summary>
+     *   Reads events out of an .etl file without going through OpenTrace and
+     *   ProcessTrace. The file is memory mapped, its buffers are decoded in
+     *   parallel and the events are handed to a trace's providers in file
+     *   order, one buffer after the other.
+     * </summary>
+     * <remarks>
+     *   This is the Windows side of the reader: the mapping, the threads
+     *   and the trace plumbing. The decoding itself is in etl_format.hpp,
+     *   which can be used on its own on any platform.
+     * </remarks>
+     * <remarks>
+     *   The decoding threads are started the first time the file is
+     *   processed and kept until the reader is destroyed. They decode up to
+     *   four buffers each ahead of the one being handed out, so decoding
+     *   overlaps with the callbacks.
+     * </remarks>
+     * <remarks>
+     *   Files written with per-processor buffering hold one stream of buffers
+     *   per CPU, so events are only ordered within a buffer. Push them
+     *   through an event_merger if they are needed in timestamp order.
+     *   Compressed files (EVENT_TRACE_COMPRESSED_MODE) aren't supported.
+     * </remarks>
+     */
+    class reader {
+    public:
+
+        /**
+         * <summary>
+         *   Opens and maps the given .etl file.
+         * </summary>
+         * <example>
+         *   krabs::etl::reader reader(L"C:\\traces\\boot.etl");
+         *   krabs::user_trace trace;
+         *   trace.enable(powershell_provider);
+         *   reader.process(trace);
+         * </example>
+         */
+        reader(const std::wstring &file_name);
+
+        /**
+         * <summary>
+         *   Reads an ETL image that is already in memory. The memory has to
+         *   stay valid for the lifetime of the reader.
+         * </summary>
+         */
+        reader(const BYTE *data, size_t size);
+
+        ~reader();
+
+        reader(const reader &) = delete;
+        reader &operator=(const reader &) = delete;
+
+        /**
+         * <summary>
+         *   Returns the logfile header of the file.
+         * </summary>
+         */
+        const logfile_info &header() const;
+
+        /**
+         * <summary>
+         *   Sets the number of threads that decode buffers. Defaults to the
+         *   number of processors; 1 decodes on the calling thread. Must not
+         *   be called while the file is being processed.
+         * </summary>
+         */
+        void set_worker_count(size_t workers);
+
+        /**
+         * <summary>
+         *   Keeps timestamps in the clock the file was written with instead of
+         *   converting them to FILETIMEs, like
+         *   PROCESS_TRACE_MODE_RAW_TIMESTAMP does for ProcessTrace.
+         * </summary>
+         */
+        void set_raw_timestamps(bool raw);
+
+        /**
+         * <summary>
+         *   Sends every event of the file through the providers and filters
+         *   enabled on the given trace, as if it came from ProcessTrace. The
+         *   trace doesn't need to be started.
+         * </summary>
+         */
+        template <typename T>
+        void process(krabs::trace<T> &trace);
+
+        /**
+         * <summary>
+         *   Calls the given function with every event of the file.
+         * </summary>
+         */
+        void process(const std::function<void(const EVENT_RECORD &, const krabs::trace_context &)> &callback);
+
+        /**
+         * <summary>
+         *   Returns the counters collected by the last call to process.
+         * </summary>
+         */
+        reader_stats stats() const;
+
+    private:
+        // A place in the ring of buffers the workers decode into. Buffer i
+        // of the file goes into slot i % slots_.size().
+        struct decode_slot {
+            decoded_buffer buffer;
+            std::string error;
+            bool ready;
+        };
+
+        void index_buffers();
+        void decode_one(size_t index, decoded_buffer &buffer) const;
+        void for_each_record(const std::function<void(const EVENT_RECORD &)> &on_record, const std::function<void(size_t)> &on_buffer);
+        void dispatch(decoded_buffer &buffer, const std::function<void(const EVENT_RECORD &)> &on_record, const std::function<void(size_t)> &on_buffer);
+        void start_workers();
+        void stop_workers();
+        void finish_run();
+        void run_worker();
+        static DWORD WINAPI decode_thread(LPVOID parameter);
+
+    private:
+        HANDLE file_;
+        HANDLE mapping_;
+        const BYTE *data_;
+        size_t size_;
+        bool owns_view_;
+
+        logfile_info header_;
+        krabs::timestamp_converter timestamps_;
+        std::vector<size_t> buffers_;
+        size_t workers_;
+        bool raw_timestamps_;
+        reader_stats stats_;
+
+        krabs::trace_context context_;
+
+        // std::thread and std::mutex aren't available when krabs is
+        // compiled with /clr. Everything below is guarded by lock_.
+        SRWLOCK lock_;
+        CONDITION_VARIABLE work_ready_;
+        CONDITION_VARIABLE buffer_ready_;
+        std::vector<HANDLE> threads_;
+        std::vector<decode_slot> slots_;
+        size_t next_decode_;
+        size_t next_dispatch_;
+        size_t end_;
+        size_t decoding_;
+        bool stopping_;
+    };
+
+    // Implementation
+    // ------------------------------------------------------------------------
+
+    inline reader::reader(const std::wstring &file_name)
+    : file_(INVALID_HANDLE_VALUE)
+    , mapping_(nullptr)
+    , data_(nullptr)
+    , size_(0)
+    , owns_view_(true)
+    , header_()
+    , timestamps_()
+    , workers_(1)
+    , raw_timestamps_(false)
+    , stats_()
+    , context_()
+    , next_decode_(0)
+    , next_dispatch_(0)
+    , end_(0)
+    , decoding_(0)
+    , stopping_(false)
+    {
+        InitializeSRWLock(&lock_);
+        InitializeConditionVariable(&work_ready_);
+        InitializeConditionVariable(&buffer_ready_);
+
+        file_ = CreateFileW(
+            file_name.c_str(),
+            GENERIC_READ,
+            FILE_SHARE_READ,
+            nullptr,
+            OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL,
+            nullptr);
+
+        if (file_ == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error("Could not open the ETL file");
+        }
+
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file_, &size)) {
+            CloseHandle(file_);
+            throw std::runtime_error("Could not get the size of the ETL file");
+        }
+
+        size_ = static_cast<size_t>(size.QuadPart);
+        mapping_ = CreateFileMappingW(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping_ != nullptr) {
+            data_ = static_cast<const BYTE*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+        }
+
+        if (data_ == nullptr) {
+            if (mapping_ != nullptr) {
+                CloseHandle(mapping_);
+            }
+            CloseHandle(file_);
+            throw std::runtime_error("Could not map the ETL file");
+        }
+
+        try {
+            index_buffers();
+        } catch (...) {
+            UnmapViewOfFile(data_);
+            CloseHandle(mapping_);
+            CloseHandle(file_);
+            throw;
+        }
+    }
+
+    inline reader::reader(const BYTE *data, size_t size)
+    : file_(INVALID_HANDLE_VALUE)
+    , mapping_(nullptr)
+    , data_(data)
+    , size_(size)
+    , owns_view_(false)
+    , header_()
+    , timestamps_()
+    , workers_(1)
+    , raw_timestamps_(false)
+    , stats_()
+    , context_()
+    , next_decode_(0)
+    , next_dispatch_(0)
+    , end_(0)
+    , decoding_(0)
+    , stopping_(false)
+    {
+        InitializeSRWLock(&lock_);
+        InitializeConditionVariable(&work_ready_);
+        InitializeConditionVariable(&buffer_ready_);
+
+        index_buffers();
+    }
+
+    inline reader::~reader()
+    {
+        stop_workers();
+
+        if (owns_view_) {
+            UnmapViewOfFile(data_);
+            CloseHandle(mapping_);
+            CloseHandle(file_);
+        }
+    }
+
+    inline const logfile_info &reader::header() const
+    {
+        return header_;
+    }
+
+    inline void reader::set_worker_count(size_t workers)
+    {
+        // WaitForMultipleObjects can't wait on more handles than this.
+        workers = (std::max)(size_t(1), (std::min)(workers, size_t(MAXIMUM_WAIT_OBJECTS)));
+
+        if (workers != workers_) {
+            // The next call to process starts as many as are asked for.
+            stop_workers();
+            workers_ = workers;
+        }
+    }
+
+    inline void reader::set_raw_timestamps(bool raw)
+    {
+        raw_timestamps_ = raw;
+
+        // Callbacks convert raw timestamps themselves, the same way.
+        context_.timestamps = raw ? timestamps_ : krabs::timestamp_converter();
+    }
+
+    inline reader_stats reader::stats() const
+    {
+        return stats_;
+    }
+
+    inline void reader::index_buffers()
+    {
+        // The first buffer starts with the logfile header event, which gives
+        // the size of every buffer in the file.
+        header_ = read_image_header(data_, size_);
+        timestamps_ = make_timestamp_converter(header_);
+        buffers_ = buffer_offsets(header_, size_);
+
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        set_worker_count(info.dwNumberOfProcessors);
+    }
+
+    template <typename T>
+    void reader::process(krabs::trace<T> &trace)
+    {
+        krabs::details::trace_manager<krabs::trace<T>> manager(trace);
+        manager.set_timestamps(context_.timestamps);
+
+        for_each_record(
+            [&](const EVENT_RECORD &record) { manager.on_event(record); },
+            [&](size_t buffers) { manager.set_buffers_processed(buffers); });
+    }
+
+    inline void reader::process(const std::function<void(const EVENT_RECORD &, const krabs::trace_context &)> &callback)
+    {
+        for_each_record(
+            [&](const EVENT_RECORD &record) { callback(record, context_); },
+            [](size_t) {});
+    }
+
+    inline void reader::for_each_record(
+        const std::function<void(const EVENT_RECORD &)> &on_record,
+        const std::function<void(size_t)> &on_buffer)
+    {
+        stats_ = {};
+
+        if (workers_ > 1) {
+            start_workers();
+        }
+
+        if (threads_.empty()) {
+            decoded_buffer buffer;
+            for (size_t i = 0; i < buffers_.size(); ++i) {
+                decode_one(i, buffer);
+                dispatch(buffer, on_record, on_buffer);
+            }
+            return;
+        }
+
+        AcquireSRWLockExclusive(&lock_);
+        for (auto &slot : slots_) {
+            slot.ready = false;
+            slot.error.clear();
+        }
+        next_decode_ = 0;
+        next_dispatch_ = 0;
+        end_ = buffers_.size();
+        ReleaseSRWLockExclusive(&lock_);
+        WakeAllConditionVariable(&work_ready_);
+
+        try {
+            for (size_t i = 0; i < buffers_.size(); ++i) {
+                auto &slot = slots_[i % slots_.size()];
+
+                AcquireSRWLockExclusive(&lock_);
+                while (!slot.ready) {
+                    SleepConditionVariableSRW(&buffer_ready_, &lock_, INFINITE, 0);
+                }
+                ReleaseSRWLockExclusive(&lock_);
+
+                if (!slot.error.empty()) {
+                    throw std::runtime_error(slot.error);
+                }
+
+                dispatch(slot.buffer, on_record, on_buffer);
+
+                // Lets a worker decode the buffer that goes into this slot next.
+                AcquireSRWLockExclusive(&lock_);
+                slot.ready = false;
+                ++next_dispatch_;
+                ReleaseSRWLockExclusive(&lock_);
+                WakeAllConditionVariable(&work_ready_);
+            }
+        } catch (...) {
+            finish_run();
+            throw;
+        }
+
+        finish_run();
+    }
+
+    inline void reader::dispatch(
+        decoded_buffer &buffer,
+        const std::function<void(const EVENT_RECORD &)> &on_record,
+        const std::function<void(size_t)> &on_buffer)
+    {
+        ++stats_.buffers;
+        stats_.skipped += buffer.skipped;
+        stats_.malformed_buffers += buffer.malformed ? 1 : 0;
+
+        for (auto &record : buffer.records) {
+            if (!raw_timestamps_) {
+                record.header.timestamp = timestamps_.to_filetime(record.header.timestamp);
+            }
+
+            ++stats_.events;
+            on_record(details::to_event_record(record));
+        }
+
+        on_buffer(static_cast<size_t>(stats_.buffers));
+    }
+
+    inline void reader::decode_one(size_t index, decoded_buffer &buffer) const
+    {
+        size_t offset = buffers_[index];
+        decode_buffer(data_ + offset, size_ - offset, buffer);
+    }
+
+    inline void reader::start_workers()
+    {
+        if (!threads_.empty()) {
+            return;
+        }
+
+        // A few buffers per worker keeps memory use flat regardless of the
+        // size of the file, and the workers busy while one is dispatched.
+        slots_.resize(workers_ * 4);
+        stopping_ = false;
+        end_ = 0;
+
+        for (size_t i = 0; i < workers_; ++i) {
+            HANDLE thread = CreateThread(nullptr, 0, decode_thread, this, 0, nullptr);
+            if (thread == nullptr) {
+                // Make do with the ones that started, or decode on the
+                // calling thread if none did.
+                break;
+            }
+
+            threads_.push_back(thread);
+        }
+    }
+
+    inline void reader::stop_workers()
+    {
+        if (threads_.empty()) {
+            return;
+        }
+
+        AcquireSRWLockExclusive(&lock_);
+        stopping_ = true;
+        ReleaseSRWLockExclusive(&lock_);
+        WakeAllConditionVariable(&work_ready_);
+
+        WaitForMultipleObjects(static_cast<DWORD>(threads_.size()), threads_.data(), TRUE, INFINITE);
+        for (auto thread : threads_) {
+            CloseHandle(thread);
+        }
+
+        threads_.clear();
+    }
+
+    inline void reader::finish_run()
+    {
+        // Stops the workers from picking up more buffers and waits for the
+        // ones they're on, in case a callback threw before the end.
+        AcquireSRWLockExclusive(&lock_);
+        end_ = next_decode_;
+        while (decoding_ > 0) {
+            SleepConditionVariableSRW(&buffer_ready_, &lock_, INFINITE, 0);
+        }
+        ReleaseSRWLockExclusive(&lock_);
+    }
+
+    inline void reader::run_worker()
+    {
+        for (;;) {
+            AcquireSRWLockExclusive(&lock_);
+            while (!stopping_ && (next_decode_ >= end_ || next_decode_ >= next_dispatch_ + slots_.size())) {
+                SleepConditionVariableSRW(&work_ready_, &lock_, INFINITE, 0);
+            }
+
+            if (stopping_) {
+                ReleaseSRWLockExclusive(&lock_);
+                return;
+            }
+
+            const size_t index = next_decode_++;
+            ++decoding_;
+            ReleaseSRWLockExclusive(&lock_);
+
+            auto &slot = slots_[index % slots_.size()];
+            std::string error;
+            try {
+                decode_one(index, slot.buffer);
+            } catch (const std::exception &e) {
+                error = e.what();
+            }
+
+            AcquireSRWLockExclusive(&lock_);
+            slot.error = error;
+            slot.ready = true;
+            --decoding_;
+            ReleaseSRWLockExclusive(&lock_);
+            WakeAllConditionVariable(&buffer_ready_);
+        }
+    }
+
+    inline DWORD WINAPI reader::decode_thread(LPVOID parameter)
+    {
+        static_cast<reader*>(parameter)->run_worker();
+        return 0;
+    }
+
+} /* namespace etl */ } /* namespace krabs */
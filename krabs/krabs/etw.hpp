@@ -91,6 +91,21 @@ namespace krabs { namespace details {
          */
         void on_event(const EVENT_RECORD &record);
 
+        /**
+         * <summary>
+         * Returns the context the underlying trace passes to its callbacks.
+         * </summary>
+         */
+        const trace_context &context() const;
+
+        /**
+         * <summary>
+         * Sets how the underlying trace's callbacks convert timestamps, for
+         * events that don't come from an ETW session.
+         * </summary>
+         */
+        void set_timestamps(const timestamp_converter &timestamps);
+
     private:
         trace_info fill_trace_info();
         EVENT_TRACE_LOGFILE fill_logfile();
@@ -204,6 +219,18 @@ namespace krabs { namespace details {
         trace_.on_event(record);
     }
 
+    template <typename T>
+    const trace_context &trace_manager<T>::context() const
+    {
+        return trace_.context_;
+    }
+
+    template <typename T>
+    void trace_manager<T>::set_timestamps(const timestamp_converter &timestamps)
+    {
+        trace_.context_.timestamps = timestamps;
+    }
+
     template <typename T>
     trace_info trace_manager<T>::fill_trace_info()
     {
@@ -211,7 +238,7 @@ namespace krabs { namespace details {
         info.properties.Wnode.BufferSize    = sizeof(trace_info);
         info.properties.Wnode.Guid          = T::trace_type::get_trace_guid();
         info.properties.Wnode.Flags         = WNODE_FLAG_TRACED_GUID;
-        info.properties.Wnode.ClientContext = 1; // QPC clock resolution
+        info.properties.Wnode.ClientContext = static_cast<ULONG>(trace_.clock_);
         info.properties.BufferSize          = trace_.properties_.BufferSize;
         info.properties.MinimumBuffers      = trace_.properties_.MinimumBuffers;
         info.properties.MaximumBuffers      = trace_.properties_.MaximumBuffers;
@@ -239,6 +266,8 @@ namespace krabs { namespace details {
         file.LoggerName          = const_cast<wchar_t*>(trace_.name_.c_str());
         file.ProcessTraceMode    = PROCESS_TRACE_MODE_EVENT_RECORD |
                                    PROCESS_TRACE_MODE_REAL_TIME;
+        if (trace_.raw_timestamps_)
+            file.ProcessTraceMode |= PROCESS_TRACE_MODE_RAW_TIMESTAMP;
         file.Context             = (void *)&trace_;
         file.EventRecordCallback = trace_callback_thunk<T>;
         file.BufferCallback      = trace_buffer_callback<T>;
@@ -255,6 +284,9 @@ namespace krabs { namespace details {
             &info.properties,
             EVENT_TRACE_CONTROL_STOP);
 
+        // Providers enabled from now on wait for the next start.
+        trace_.registrationHandle_ = INVALID_PROCESSTRACE_HANDLE;
+
         if (status != ERROR_WMI_INSTANCE_NOT_FOUND) {
             error_check_common_conditions(status);
         }
@@ -327,6 +359,26 @@ namespace krabs { namespace details {
         if (trace_.sessionHandle_ == INVALID_PROCESSTRACE_HANDLE) {
             throw open_trace_failure();
         }
+
+        // With raw timestamps, callbacks get a converter anchored on now.
+        // The header says which clock the session really uses, which is
+        // the clock it was started with if another process started it.
+        if (trace_.raw_timestamps_) {
+            auto clock = static_cast<clock_type>(file.LogfileHeader.ReservedFlags);
+            if (clock != clock_type::query_performance_counter && clock != clock_type::cpu_cycle_counter) {
+                clock = trace_.clock_;
+            }
+
+            const LONGLONG ticks_per_second = clock == clock_type::cpu_cycle_counter
+                ? static_cast<LONGLONG>(file.LogfileHeader.CpuSpeedInMHz) * 1000000
+                : file.LogfileHeader.PerfFreq.QuadPart;
+
+            trace_.context_.timestamps = timestamp_converter::sample_now(clock, ticks_per_second);
+        }
+        else {
+            trace_.context_.timestamps = timestamp_converter();
+        }
+
         return file;
     }
 
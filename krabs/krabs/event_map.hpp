@@ -0,0 +1,414 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#ifndef  WIN32_LEAN_AND_MEAN
+#define  WIN32_LEAN_AND_MEAN
+#endif
+
+#include <windows.h>
+#include <tdh.h>
+#include <evntrace.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "compiler_check.hpp"
+#include "errors.hpp"
+
+#pragma comment(lib, "tdh.lib")
+
+namespace krabs {
+
+    /**
+     * <summary>
+     * A value map or bitmap from a provider's manifest (or MOF class), which
+     * gives names to the values of an integer property. Built from the
+     * EVENT_MAP_INFO that TdhGetEventMapInformation returns.
+     * </summary>
+     * <remarks>
+     * The TDH buffer is kept as is so that it can be saved with a capture and
+     * handed back to schema_locator::add_event_map to decode offline.
+     * </remarks>
+     */
+    class event_map {
+    public:
+
+        struct entry {
+            ULONG value;
+            std::wstring name;
+        };
+
+        /**
+         * <summary>
+         * Builds the map from an EVENT_MAP_INFO buffer of the given size.
+         * Throws std::runtime_error if the buffer is malformed.
+         * </summary>
+         */
+        event_map(const BYTE *info, ULONG size);
+
+        /**
+         * <summary>
+         * The name of the map, as referenced by properties.
+         * </summary>
+         */
+        const std::wstring &name() const;
+
+        /**
+         * <summary>
+         * Whether each entry names a bit (or group of bits) rather than a
+         * whole value.
+         * </summary>
+         */
+        bool is_bitmap() const;
+
+        /**
+         * <summary>
+         * The entries, ordered by value.
+         * </summary>
+         */
+        const std::vector<entry> &entries() const;
+
+        /**
+         * <summary>
+         * Returns the name of the given value, or nullptr if it has none.
+         * The name lives as long as the map does.
+         * </summary>
+         */
+        const std::wstring *find(ULONG value) const;
+
+        /**
+         * <summary>
+         * Calls `on_name(const std::wstring &)` for each entry whose bits are
+         * all set in value, and returns the bits no entry accounted for.
+         * </summary>
+         * <example>
+         *     ULONG unnamed = map.for_each_set(flags, [&](const std::wstring &name) {
+         *         names.push_back(name);
+         *     });
+         * </example>
+         */
+        template <typename F>
+        ULONG for_each_set(ULONG value, F &&on_name) const;
+
+        /**
+         * <summary>
+         * The EVENT_MAP_INFO buffer the map was built from.
+         * </summary>
+         */
+        const BYTE *data() const;
+        ULONG size() const;
+
+    private:
+        const wchar_t *string_at(ULONG offset) const;
+
+    private:
+        std::vector<BYTE> buffer_;
+        std::wstring name_;
+        bool bitmap_;
+        std::vector<entry> entries_;
+    };
+
+    /**
+     * <summary>
+     * The value of an integer property along with the map that names it, as
+     * returned by parser::parse_mapped.
+     * </summary>
+     * <example>
+     *    auto access = parser.parse_mapped(L"DesiredAccess");
+     *    access.for_each_name([](const std::wstring &flag) {
+     *        std::wcout << flag << std::endl;
+     *    });
+     * </example>
+     */
+    class mapped_value {
+    public:
+        mapped_value(ULONG value, const event_map *map);
+
+        /**
+         * <summary>
+         * The raw value of the property.
+         * </summary>
+         */
+        ULONG value() const;
+
+        /**
+         * <summary>
+         * Whether the provider's map could be found. Without it there are no
+         * names, only the value.
+         * </summary>
+         */
+        bool has_map() const;
+
+        bool is_bitmap() const;
+
+        /**
+         * <summary>
+         * For a value map, the name of the value. Empty if the value has no
+         * name or the map is a bitmap.
+         * </summary>
+         */
+        const std::wstring &name() const;
+
+        /**
+         * <summary>
+         * Calls `on_name(const std::wstring &)` with the name of each set flag
+         * of a bitmap, or with the name of the value for a value map. Returns
+         * the bits of the value that weren't named.
+         * </summary>
+         */
+        template <typename F>
+        ULONG for_each_name(F &&on_name) const;
+
+        /**
+         * <summary>
+         * The names joined with " | ", followed by any unnamed bits in hex,
+         * or the value in decimal if it has no name at all.
+         * </summary>
+         */
+        std::wstring to_wstring() const;
+
+    private:
+        ULONG value_;
+        const event_map *map_;
+    };
+
+    /**
+     * <summary>
+     * Gets the named map for the event's provider from TDH. Returns an
+     * empty buffer if the provider has no such map.
+     * </summary>
+     */
+    std::vector<BYTE> get_event_map_from_tdh(const EVENT_RECORD &record, const std::wstring &map_name);
+
+    // Implementation
+    // ------------------------------------------------------------------------
+
+    inline event_map::event_map(const BYTE *info, ULONG size)
+    : buffer_(info, info + size)
+    , name_()
+    , bitmap_(false)
+    , entries_()
+    {
+        const ULONG header = FIELD_OFFSET(EVENT_MAP_INFO, MapEntryArray);
+        if (size < header) {
+            throw std::runtime_error("Event map is truncated");
+        }
+
+        auto map = reinterpret_cast<const EVENT_MAP_INFO*>(buffer_.data());
+        if (map->EntryCount > (size - header) / sizeof(EVENT_MAP_ENTRY)) {
+            throw std::runtime_error("Event map entries run past its end");
+        }
+
+        name_ = string_at(map->NameOffset);
+
+        const ULONG flags = map->Flag;
+        bitmap_ = (flags & (EVENTMAP_INFO_FLAG_MANIFEST_BITMAP | EVENTMAP_INFO_FLAG_WBEM_BITMAP)) != 0;
+
+        // Pattern maps and MOF maps keyed by strings don't name integers.
+        const bool wbem = (flags & (EVENTMAP_INFO_FLAG_WBEM_VALUEMAP | EVENTMAP_INFO_FLAG_WBEM_BITMAP)) != 0;
+        if ((flags & EVENTMAP_INFO_FLAG_MANIFEST_PATTERNMAP) != 0 ||
+            (wbem && map->MapEntryValueType == EVENTMAP_ENTRY_VALUETYPE_STRING)) {
+            return;
+        }
+
+        // MOF maps without values are indexed by position.
+        const bool indexed = (flags & EVENTMAP_INFO_FLAG_WBEM_NO_MAP) != 0;
+
+        entries_.reserve(map->EntryCount);
+        for (ULONG i = 0; i < map->EntryCount; ++i) {
+            const auto &item = map->MapEntryArray[i];
+
+            entry e;
+            e.value = indexed ? (bitmap_ ? (i < 32 ? 1UL << i : 0) : i) : item.Value;
+            e.name = string_at(item.OutputOffset);
+
+            // Manifest names come back with a trailing space.
+            while (!e.name.empty() && e.name.back() == L' ') {
+                e.name.pop_back();
+            }
+
+            entries_.push_back(std::move(e));
+        }
+
+        std::sort(entries_.begin(), entries_.end(), [](const entry &lhs, const entry &rhs) {
+            return lhs.value < rhs.value;
+        });
+    }
+
+    inline const std::wstring &event_map::name() const
+    {
+        return name_;
+    }
+
+    inline bool event_map::is_bitmap() const
+    {
+        return bitmap_;
+    }
+
+    inline const std::vector<event_map::entry> &event_map::entries() const
+    {
+        return entries_;
+    }
+
+    inline const std::wstring *event_map::find(ULONG value) const
+    {
+        auto found = std::lower_bound(entries_.begin(), entries_.end(), value,
+            [](const entry &lhs, ULONG rhs) { return lhs.value < rhs; });
+
+        if (found == entries_.end() || found->value != value) {
+            return nullptr;
+        }
+
+        return &found->name;
+    }
+
+    template <typename F>
+    ULONG event_map::for_each_set(ULONG value, F &&on_name) const
+    {
+        ULONG unnamed = value;
+        for (const auto &e : entries_) {
+            if (e.value != 0 && (value & e.value) == e.value) {
+                on_name(e.name);
+                unnamed &= ~e.value;
+            }
+        }
+
+        return unnamed;
+    }
+
+    inline const BYTE *event_map::data() const
+    {
+        return buffer_.data();
+    }
+
+    inline ULONG event_map::size() const
+    {
+        return static_cast<ULONG>(buffer_.size());
+    }
+
+    inline const wchar_t *event_map::string_at(ULONG offset) const
+    {
+        if (offset == 0) {
+            return L"";
+        }
+
+        // The string has to end inside the buffer.
+        const size_t count = offset < buffer_.size() ? (buffer_.size() - offset) / sizeof(wchar_t) : 0;
+        auto text = reinterpret_cast<const wchar_t*>(buffer_.data() + offset);
+        if (std::find(text, text + count, L'\0') == text + count) {
+            throw std::runtime_error("Event map string runs past its end");
+        }
+
+        return text;
+    }
+
+    inline mapped_value::mapped_value(ULONG value, const event_map *map)
+    : value_(value)
+    , map_(map)
+    {}
+
+    inline ULONG mapped_value::value() const
+    {
+        return value_;
+    }
+
+    inline bool mapped_value::has_map() const
+    {
+        return map_ != nullptr;
+    }
+
+    inline bool mapped_value::is_bitmap() const
+    {
+        return map_ != nullptr && map_->is_bitmap();
+    }
+
+    inline const std::wstring &mapped_value::name() const
+    {
+        static const std::wstring unnamed;
+
+        const std::wstring *found = nullptr;
+        if (map_ != nullptr && !map_->is_bitmap()) {
+            found = map_->find(value_);
+        }
+
+        return found != nullptr ? *found : unnamed;
+    }
+
+    template <typename F>
+    ULONG mapped_value::for_each_name(F &&on_name) const
+    {
+        if (map_ == nullptr) {
+            return value_;
+        }
+
+        if (map_->is_bitmap()) {
+            return map_->for_each_set(value_, on_name);
+        }
+
+        const std::wstring *found = map_->find(value_);
+        if (found == nullptr) {
+            return value_;
+        }
+
+        on_name(*found);
+        return 0;
+    }
+
+    inline std::wstring mapped_value::to_wstring() const
+    {
+        std::wstring text;
+        ULONG unnamed = for_each_name([&](const std::wstring &name) {
+            if (!text.empty()) {
+                text += L" | ";
+            }
+            text += name;
+        });
+
+        if (text.empty()) {
+            return std::to_wstring(value_);
+        }
+
+        if (unnamed != 0) {
+            const wchar_t digits[] = L"0123456789ABCDEF";
+            std::wstring hex;
+            for (; unnamed != 0; unnamed >>= 4) {
+                hex.insert(hex.begin(), digits[unnamed & 0xF]);
+            }
+            text += L" | 0x" + hex;
+        }
+
+        return text;
+    }
+
+    inline std::vector<BYTE> get_event_map_from_tdh(const EVENT_RECORD &record, const std::wstring &map_name)
+    {
+        ULONG size = 0;
+        ULONG status = TdhGetEventMapInformation(
+            (PEVENT_RECORD)&record,
+            (LPWSTR)map_name.c_str(),
+            NULL,
+            &size);
+
+        if (status == ERROR_NOT_FOUND) {
+            return std::vector<BYTE>();
+        }
+
+        if (status != ERROR_INSUFFICIENT_BUFFER) {
+            error_check_common_conditions(status);
+        }
+
+        std::vector<BYTE> buffer(size);
+        error_check_common_conditions(
+            TdhGetEventMapInformation(
+            (PEVENT_RECORD)&record,
+            (LPWSTR)map_name.c_str(),
+            (PEVENT_MAP_INFO)buffer.data(),
+            &size));
+
+        return buffer;
+    }
+}
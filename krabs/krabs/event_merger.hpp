@@ -0,0 +1,601 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#ifndef  WIN32_LEAN_AND_MEAN
+#define  WIN32_LEAN_AND_MEAN
+#endif
+
+#include <windows.h>
+#include <evntcons.h>
+
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <vector>
+
+#include "compiler_check.hpp"
+#include "errors.hpp"
+#include "trace_context.hpp"
+
+namespace krabs {
+
+    typedef void(*c_provider_callback)(const EVENT_RECORD &, const krabs::trace_context &);
+    typedef std::function<void(const EVENT_RECORD &, const krabs::trace_context &)> provider_callback;
+
+    /**
+     * <summary>
+     *   What an event_merger does with an event that arrives after events
+     *   with a later timestamp have already been delivered.
+     * </summary>
+     */
+    enum class late_event_policy {
+        deliver,
+        drop
+    };
+
+    /**
+     * <summary>
+     *   Counters describing the work done by an event_merger.
+     * </summary>
+     */
+    struct merge_stats
+    {
+        uint64_t events_received;
+        uint64_t events_delivered;
+        uint64_t events_late;
+        uint64_t events_dropped;
+        uint64_t events_forced;
+        size_t   max_depth;
+    };
+
+    namespace details {
+
+        /**
+         * <summary>
+         *   Deep copies an EVENT_RECORD into the given buffer so that the copy
+         *   outlives the ETW buffer the original points into. The extended
+         *   data items and user data of the copy point into the buffer, which
+         *   keeps its capacity across calls.
+         * </summary>
+         */
+        void copy_event_record(
+            const EVENT_RECORD &source,
+            EVENT_RECORD &destination,
+            std::vector<BYTE> &buffer);
+
+    } /* namespace details */
+
+    /**
+     * <summary>
+     *   Merges the events of several sources (trace sessions, or the per-CPU
+     *   buffers of a single session) into one stream ordered by
+     *   EventHeader.TimeStamp.
+     * </summary>
+     * <remarks>
+     *   Each source is expected to be ordered up to its own lateness window:
+     *   sessions that use EVENT_TRACE_NO_PER_PROCESSOR_BUFFERING (the krabs
+     *   default) deliver events in order, sessions that buffer per processor
+     *   do not. An event is released once every source that has delivered
+     *   anything has moved past it, or once it is more than max_delay behind
+     *   the newest event seen, so quiet sources cannot stall the stream.
+     *   Events are copied into a fixed number of slots; when all slots are in
+     *   use, the oldest event is released early.
+     *   All sources must report timestamps in the same clock, which is the
+     *   case for sessions started by krabs with default properties.
+     *   Events are delivered one at a time, in order, without the merger's
+     *   lock held, so callbacks may call back into the merger. While one
+     *   thread is delivering, events released by other threads are queued
+     *   and delivered by that thread, so no source waits on another
+     *   source's callbacks.
+     * </remarks>
+     */
+    class event_merger {
+    public:
+
+        /**
+         * <summary>
+         *   Constructs a merger that keeps at most `capacity` events and waits
+         *   at most `max_delay` timestamp ticks for a quiet source.
+         * </summary>
+         * <example>
+         *   // QPC ticks, so this waits for about half a second
+         *   LARGE_INTEGER frequency;
+         *   QueryPerformanceFrequency(&frequency);
+         *   krabs::event_merger merger(frequency.QuadPart / 2);
+         * </example>
+         */
+        event_merger(
+            LONGLONG max_delay,
+            size_t capacity = 4096,
+            late_event_policy policy = late_event_policy::deliver);
+
+        event_merger(const event_merger &) = delete;
+        event_merger &operator=(const event_merger &) = delete;
+
+        /**
+         * <summary>
+         * Adds a function to call with each event in timestamp order.
+         * </summary>
+         */
+        void add_on_event_callback(c_provider_callback callback);
+
+        template <typename U>
+        void add_on_event_callback(U &callback);
+
+        template <typename U>
+        void add_on_event_callback(const U &callback);
+
+        /**
+         * <summary>
+         *   Registers a new source and returns the callback that feeds it.
+         *   The callback can be given to providers or used as the default
+         *   callback of a trace. `window` is how far, in timestamp ticks,
+         *   events of this source may be out of order. Sources are numbered
+         *   from zero in the order they are added.
+         * </summary>
+         * <example>
+         *   krabs::event_merger merger(max_delay);
+         *   merger.add_on_event_callback(my_ordered_callback);
+         *
+         *   auto user_source = merger.add_source();
+         *   powershell_provider.add_on_event_callback(user_source);
+         *
+         *   auto kernel_source = merger.add_source();
+         *   process_provider.add_on_event_callback(kernel_source);
+         * </example>
+         */
+        provider_callback add_source(LONGLONG window = 0);
+
+        /**
+         * <summary>
+         *   Marks a source as finished so it no longer holds back the
+         *   events of the other sources.
+         * </summary>
+         */
+        void close_source(size_t source);
+
+        /**
+         * <summary>
+         *   Adds an event from the given source.
+         * </summary>
+         */
+        void push(size_t source, const EVENT_RECORD &record, const krabs::trace_context &context);
+
+        /**
+         * <summary>
+         *   Delivers every buffered event in timestamp order. Call when the
+         *   sources have stopped. If another thread is delivering events at
+         *   the time, that thread delivers the flushed events too.
+         * </summary>
+         */
+        void flush();
+
+        /**
+         * <summary>
+         *   Returns the number of events currently held back.
+         * </summary>
+         */
+        size_t depth() const;
+
+        /**
+         * <summary>
+         *   Returns the counters of this merger.
+         * </summary>
+         */
+        merge_stats stats() const;
+
+        /**
+         * <summary>
+         *   Returns the number of late events that came from the given source.
+         * </summary>
+         */
+        uint64_t late_events(size_t source) const;
+
+    private:
+        struct slot {
+            EVENT_RECORD record;
+            std::vector<BYTE> buffer;
+            const krabs::trace_context *context;
+            LONGLONG timestamp;
+            uint64_t sequence;
+        };
+
+        // An event that left the heap and waits to be delivered. It owns its
+        // buffer, so the slot it came from can be reused in the meantime.
+        struct released {
+            EVENT_RECORD record;
+            std::vector<BYTE> buffer;
+            const krabs::trace_context *context;
+        };
+
+        struct source_state {
+            LONGLONG window;
+            LONGLONG newest;
+            bool seen;
+            bool closed;
+            uint64_t late;
+        };
+
+        bool is_later(size_t left, size_t right) const;
+        bool can_release(LONGLONG timestamp) const;
+        void release_ready();
+        void release_top();
+        std::vector<BYTE> take_buffer();
+        void deliver_pending(SRWLOCK &lock);
+
+    private:
+        const LONGLONG max_delay_;
+        const late_event_policy policy_;
+
+        std::vector<slot> slots_;
+        std::vector<size_t> free_;
+        std::vector<size_t> heap_;
+        std::deque<source_state> sources_;
+        std::deque<provider_callback> callbacks_;
+        std::vector<released> pending_;
+        std::vector<std::vector<BYTE>> spare_buffers_;
+        bool delivering_;
+
+        LONGLONG newest_;
+        LONGLONG last_released_;
+        bool released_any_;
+        uint64_t sequence_;
+        merge_stats stats_;
+
+        mutable SRWLOCK lock_;
+    };
+
+    // Implementation
+    // ------------------------------------------------------------------------
+
+    namespace details {
+
+        inline void copy_event_record(
+            const EVENT_RECORD &source,
+            EVENT_RECORD &destination,
+            std::vector<BYTE> &buffer)
+        {
+            const auto align = [](size_t size) { return (size + 7) & ~static_cast<size_t>(7); };
+
+            // The item array goes first so it is suitably aligned, followed by
+            // each item's data and finally the user data.
+            size_t items_size = sizeof(EVENT_HEADER_EXTENDED_DATA_ITEM) * source.ExtendedDataCount;
+            size_t required = items_size;
+            for (USHORT i = 0; i < source.ExtendedDataCount; ++i) {
+                required += align(source.ExtendedData[i].DataSize);
+            }
+
+            size_t user_data_offset = required;
+            required += source.UserDataLength;
+
+            buffer.resize(required);
+            destination = source;
+
+            auto items = reinterpret_cast<PEVENT_HEADER_EXTENDED_DATA_ITEM>(buffer.data());
+            size_t offset = items_size;
+            for (USHORT i = 0; i < source.ExtendedDataCount; ++i) {
+                items[i] = source.ExtendedData[i];
+                if (items[i].DataSize > 0) {
+                    memcpy(buffer.data() + offset, reinterpret_cast<const void*>(source.ExtendedData[i].DataPtr), items[i].DataSize);
+                }
+                items[i].DataPtr = reinterpret_cast<ULONGLONG>(buffer.data() + offset);
+                offset += align(items[i].DataSize);
+            }
+
+            if (source.UserDataLength > 0) {
+                memcpy(buffer.data() + user_data_offset, source.UserData, source.UserDataLength);
+            }
+
+            destination.ExtendedData = source.ExtendedDataCount > 0 ? items : nullptr;
+            destination.UserData = source.UserDataLength > 0 ? buffer.data() + user_data_offset : nullptr;
+        }
+
+        /**
+         * <summary>
+         *   Holds an SRWLOCK exclusively for the lifetime of the object.
+         *   std::mutex isn't available when krabs is compiled with /clr.
+         * </summary>
+         */
+        class exclusive_lock {
+        public:
+            exclusive_lock(SRWLOCK &lock) : lock_(lock) { AcquireSRWLockExclusive(&lock_); }
+            ~exclusive_lock() { ReleaseSRWLockExclusive(&lock_); }
+
+            SRWLOCK &native() { return lock_; }
+
+            exclusive_lock(const exclusive_lock &) = delete;
+            exclusive_lock &operator=(const exclusive_lock &) = delete;
+
+        private:
+            SRWLOCK &lock_;
+        };
+
+    } /* namespace details */
+
+    inline event_merger::event_merger(
+        LONGLONG max_delay,
+        size_t capacity,
+        late_event_policy policy)
+    : max_delay_(max_delay)
+    , policy_(policy)
+    , slots_(capacity)
+    , delivering_(false)
+    , newest_(0)
+    , last_released_(0)
+    , released_any_(false)
+    , sequence_(0)
+    , stats_()
+    {
+        if (capacity == 0 || max_delay < 0) {
+            throw krabs::invalid_parameter();
+        }
+
+        InitializeSRWLock(&lock_);
+
+        free_.reserve(capacity);
+        heap_.reserve(capacity);
+        for (size_t i = capacity; i > 0; --i) {
+            free_.push_back(i - 1);
+        }
+    }
+
+    inline void event_merger::add_on_event_callback(c_provider_callback callback)
+    {
+        // C function pointers don't interact well with std::ref, so we
+        // overload to take care of this scenario.
+        callbacks_.push_back(callback);
+    }
+
+    template <typename U>
+    void event_merger::add_on_event_callback(U &callback)
+    {
+        // Keep calling the instance that was handed to us rather than a copy.
+        callbacks_.push_back(std::ref(callback));
+    }
+
+    template <typename U>
+    void event_merger::add_on_event_callback(const U &callback)
+    {
+        // Temporaries can't be wrapped in a std::ref, so copy them.
+        callbacks_.push_back(callback);
+    }
+
+    inline provider_callback event_merger::add_source(LONGLONG window)
+    {
+        if (window < 0) {
+            throw krabs::invalid_parameter();
+        }
+
+        details::exclusive_lock guard(lock_);
+
+        size_t source = sources_.size();
+        sources_.push_back({ window, 0, false, false, 0 });
+
+        return [this, source](const EVENT_RECORD &record, const krabs::trace_context &context) {
+            push(source, record, context);
+        };
+    }
+
+    inline void event_merger::close_source(size_t source)
+    {
+        details::exclusive_lock guard(lock_);
+
+        if (source >= sources_.size()) {
+            throw krabs::invalid_parameter();
+        }
+
+        sources_[source].closed = true;
+        release_ready();
+        deliver_pending(guard.native());
+    }
+
+    inline void event_merger::push(
+        size_t source,
+        const EVENT_RECORD &record,
+        const krabs::trace_context &context)
+    {
+        details::exclusive_lock guard(lock_);
+
+        if (source >= sources_.size()) {
+            throw krabs::invalid_parameter();
+        }
+
+        auto &state = sources_[source];
+        LONGLONG timestamp = record.EventHeader.TimeStamp.QuadPart;
+
+        ++stats_.events_received;
+
+        if (released_any_ && timestamp < last_released_) {
+            ++stats_.events_late;
+            ++state.late;
+
+            if (policy_ == late_event_policy::drop) {
+                ++stats_.events_dropped;
+            } else {
+                // The record points into an ETW buffer that may be reused
+                // before another thread gets around to delivering it.
+                released late = { {}, take_buffer(), &context };
+                details::copy_event_record(record, late.record, late.buffer);
+                pending_.push_back(std::move(late));
+                ++stats_.events_delivered;
+                deliver_pending(guard.native());
+            }
+            return;
+        }
+
+        if (free_.empty()) {
+            ++stats_.events_forced;
+            release_top();
+        }
+
+        size_t index = free_.back();
+        free_.pop_back();
+
+        auto &entry = slots_[index];
+        details::copy_event_record(record, entry.record, entry.buffer);
+        entry.context = &context;
+        entry.timestamp = timestamp;
+        entry.sequence = sequence_++;
+
+        heap_.push_back(index);
+        std::push_heap(heap_.begin(), heap_.end(), [this](size_t l, size_t r) { return is_later(l, r); });
+        stats_.max_depth = (std::max)(stats_.max_depth, heap_.size());
+
+        if (!state.seen || timestamp > state.newest) {
+            state.newest = timestamp;
+            state.seen = true;
+        }
+
+        newest_ = (std::max)(newest_, timestamp);
+
+        release_ready();
+        deliver_pending(guard.native());
+    }
+
+    inline void event_merger::flush()
+    {
+        details::exclusive_lock guard(lock_);
+
+        while (!heap_.empty()) {
+            release_top();
+        }
+
+        deliver_pending(guard.native());
+    }
+
+    inline size_t event_merger::depth() const
+    {
+        details::exclusive_lock guard(lock_);
+        return heap_.size();
+    }
+
+    inline merge_stats event_merger::stats() const
+    {
+        details::exclusive_lock guard(lock_);
+        return stats_;
+    }
+
+    inline uint64_t event_merger::late_events(size_t source) const
+    {
+        details::exclusive_lock guard(lock_);
+
+        if (source >= sources_.size()) {
+            throw krabs::invalid_parameter();
+        }
+
+        return sources_[source].late;
+    }
+
+    inline bool event_merger::is_later(size_t left, size_t right) const
+    {
+        // std heaps put the largest element on top, so "larger" means "later"
+        // to keep the earliest event there. Ties keep their arrival order.
+        const auto &l = slots_[left];
+        const auto &r = slots_[right];
+
+        if (l.timestamp != r.timestamp) {
+            return l.timestamp > r.timestamp;
+        }
+
+        return l.sequence > r.sequence;
+    }
+
+    inline bool event_merger::can_release(LONGLONG timestamp) const
+    {
+        if (timestamp <= newest_ - max_delay_) {
+            return true;
+        }
+
+        // Every open source must have moved past the event, allowing for the
+        // source's own reordering window. A source that hasn't delivered
+        // anything yet could still deliver an earlier event.
+        for (const auto &source : sources_) {
+            if (source.closed) {
+                continue;
+            }
+
+            if (!source.seen || timestamp > source.newest - source.window) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    inline void event_merger::release_ready()
+    {
+        while (!heap_.empty() && can_release(slots_[heap_.front()].timestamp)) {
+            release_top();
+        }
+    }
+
+    inline void event_merger::release_top()
+    {
+        std::pop_heap(heap_.begin(), heap_.end(), [this](size_t l, size_t r) { return is_later(l, r); });
+        size_t index = heap_.back();
+        heap_.pop_back();
+
+        auto &entry = slots_[index];
+        last_released_ = entry.timestamp;
+        released_any_ = true;
+
+        // Swapping the buffer out moves its storage, so the record's
+        // pointers stay valid while the slot takes a spare buffer.
+        released event = { entry.record, take_buffer(), entry.context };
+        event.buffer.swap(entry.buffer);
+        pending_.push_back(std::move(event));
+
+        free_.push_back(index);
+        ++stats_.events_delivered;
+    }
+
+    inline std::vector<BYTE> event_merger::take_buffer()
+    {
+        if (spare_buffers_.empty()) {
+            return std::vector<BYTE>();
+        }
+
+        auto buffer = std::move(spare_buffers_.back());
+        spare_buffers_.pop_back();
+        return buffer;
+    }
+
+    inline void event_merger::deliver_pending(SRWLOCK &lock)
+    {
+        // Only one thread delivers at a time so events stay in order. The
+        // others leave their events in pending_ for it and return.
+        if (delivering_) {
+            return;
+        }
+
+        delivering_ = true;
+        std::vector<released> batch;
+
+        while (!pending_.empty()) {
+            batch.swap(pending_);
+
+            ReleaseSRWLockExclusive(&lock);
+            try {
+                for (const auto &event : batch) {
+                    for (auto &callback : callbacks_) {
+                        callback(event.record, *event.context);
+                    }
+                }
+            } catch (...) {
+                AcquireSRWLockExclusive(&lock);
+                delivering_ = false;
+                throw;
+            }
+            AcquireSRWLockExclusive(&lock);
+
+            for (auto &event : batch) {
+                spare_buffers_.push_back(std::move(event.buffer));
+            }
+            batch.clear();
+        }
+
+        delivering_ = false;
+    }
+}
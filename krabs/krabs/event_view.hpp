@@ -0,0 +1,77 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#ifndef  WIN32_LEAN_AND_MEAN
+#define  WIN32_LEAN_AND_MEAN
+#endif
+
+#include <windows.h>
+#include <tdh.h>
+#include <evntcons.h>
+
+#include <cstdint>
+
+#include "compiler_check.hpp"
+#include "parse_types.hpp"
+#include "decoding/byte_view.hpp"
+
+namespace krabs {
+
+    /**
+     * <summary>
+     *   Base of the typed views over events whose layout is known ahead of
+     *   time, such as krabs::kernel's. Reads fields straight out of the user
+     *   data at offsets that are known at compile time, instead of going
+     *   through TDH and looking properties up by name.
+     * </summary>
+     * <remarks>
+     *   A view doesn't copy the event; it's only valid during the callback
+     *   it was handed to. Reading a field that runs past the end of the user
+     *   data throws std::out_of_range, like the parser does.
+     * </remarks>
+     */
+    class event_view : public decoding::byte_view {
+    public:
+        explicit event_view(const EVENT_RECORD &record);
+
+        const EVENT_RECORD &record() const;
+
+    protected:
+        // A WBEMSID: a TOKEN_USER followed by the SID.
+        krabs::sid read_wbem_sid(size_t offset, size_t &next) const;
+
+    protected:
+        const EVENT_RECORD &record_;
+    };
+
+    // Implementation
+    // ------------------------------------------------------------------------
+
+    inline event_view::event_view(const EVENT_RECORD &record)
+    : decoding::byte_view(
+        static_cast<const uint8_t*>(record.UserData),
+        record.UserDataLength,
+        (record.EventHeader.Flags & EVENT_HEADER_FLAG_32_BIT_HEADER) != 0 ? 4 : 8)
+    , record_(record)
+    {}
+
+    inline const EVENT_RECORD &event_view::record() const
+    {
+        return record_;
+    }
+
+    inline krabs::sid event_view::read_wbem_sid(size_t offset, size_t &next) const
+    {
+        // The TOKEN_USER is two pointers, then the SID: 8 bytes plus 4 for
+        // each sub-authority.
+        const size_t sid_at = offset + 2 * pointer_size_;
+        const size_t sub_authorities = read<uint8_t>(sid_at + 1);
+        const size_t sid_size = 8 + 4 * sub_authorities;
+        check(sid_at, sid_size);
+
+        next = sid_at + sid_size;
+        return krabs::sid::from_bytes(data_ + sid_at, sid_size);
+    }
+}
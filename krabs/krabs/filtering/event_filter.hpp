@@ -6,10 +6,14 @@
 #include <evntcons.h>
 #include <functional>
 #include <deque>
+#include <memory>
+#include <utility>
 #include <vector>
 
 #include "../compiler_check.hpp"
 #include "../trace_context.hpp"
+#include "predicate_graph.hpp"
+#include "pushdown.hpp"
 
 namespace krabs { namespace testing {
     class event_filter_proxy;
@@ -37,7 +41,8 @@ namespace krabs {
      *   Each event_filter has a single predicate (which can do complicated
      *   checks and logic on the event). All callbacks registered under the
      *   filter are invoked only if the predicate returns true for a given
-     *   event.
+     *   event. A filter with event ids that's added to a provider is only
+     *   given events with one of its ids.
      * </remarks>
      */
     class event_filter {
@@ -71,6 +76,33 @@ namespace krabs {
          */
         event_filter(std::vector<unsigned short> event_ids, filter_predicate predicate = nullptr);
 
+        /**
+         * <summary>
+         *   Constructs an event_filter from one of the krabs predicates.
+         *   Besides running the predicate, whatever ETW can check for it,
+         *   like process_id_is or property_is on a number or a wide
+         *   string, is handed to ETW when the trace starts, so events that
+         *   fail those checks are never delivered. Payload checks are only
+         *   handed over for filters with event ids. When filters on the same
+         *   provider share parts of their predicates, like an id_is or a
+         *   property_iends_with with the same arguments, those parts are
+         *   only run once per event for all of them.
+         * </summary>
+         * <example>
+         *   krabs::event_filter filter(1, krabs::predicates::and_filter(
+         *       krabs::predicates::process_id_is(1234),
+         *       krabs::predicates::property_is(L"Status", uint32_t(5))));
+         * </example>
+         */
+        template <typename Predicate, typename = decltype(std::declval<const Predicate&>().pushdown())>
+        event_filter(const Predicate &predicate);
+
+        template <typename Predicate, typename = decltype(std::declval<const Predicate&>().pushdown())>
+        event_filter(unsigned short event_id, const Predicate &predicate);
+
+        template <typename Predicate, typename = decltype(std::declval<const Predicate&>().pushdown())>
+        event_filter(std::vector<unsigned short> event_ids, const Predicate &predicate);
+
         /**
          * <summary>
          * Adds a function to call when an event for this filter is fired.
@@ -89,20 +121,54 @@ namespace krabs {
             return provider_filter_event_ids_;
         }
 
+        /**
+         * <summary>
+         *   The conditions ETW checks for this filter before events are
+         *   delivered, besides its event ids.
+         * </summary>
+         */
+        const krabs::filter_pushdown& pushdown() const
+        {
+            return pushdown_;
+        }
+
     private:
 
         /**
          * <summary>
          *   Called when an event occurs, forwards to callbacks if the event
-         *   satisfies the predicate.
+         *   satisfies the predicate. Returns whether it did.
+         * </summary>
+         */
+        bool on_event(const EVENT_RECORD &record, const krabs::trace_context &trace_context) const;
+
+        /**
+         * <summary>
+         *   Whether the event satisfies the predicate, if there is one.
          * </summary>
          */
-        void on_event(const EVENT_RECORD &record, const krabs::trace_context &trace_context) const;
+        bool matches(const EVENT_RECORD &record, const krabs::trace_context &trace_context) const;
+
+        /**
+         * <summary>
+         *   Calls the callbacks for an event that's known to satisfy the
+         *   predicate. Returns whether there were any.
+         * </summary>
+         */
+        bool call_callbacks(const EVENT_RECORD &record, const krabs::trace_context &trace_context) const;
+
+        template <typename Predicate>
+        void share_predicate(const Predicate &predicate);
 
     private:
         std::deque<provider_callback> callbacks_;
         filter_predicate predicate_{ nullptr };
         std::vector<unsigned short> provider_filter_event_ids_;
+        krabs::filter_pushdown pushdown_;
+
+        // Set for krabs predicates, and points into the predicate, which
+        // copies of the filter share.
+        std::shared_ptr<const krabs::predicate_expression> expression_;
 
     private:
         template <typename T>
@@ -128,6 +194,46 @@ namespace krabs {
       predicate_(predicate)
     {}
 
+    template <typename Predicate, typename>
+    event_filter::event_filter(const Predicate &predicate)
+    : pushdown_(details::pushdown_of(predicate))
+    {
+        share_predicate(predicate);
+        pushdown_.scope_payload(provider_filter_event_ids_);
+    }
+
+    template <typename Predicate, typename>
+    event_filter::event_filter(unsigned short event_id, const Predicate &predicate)
+    : provider_filter_event_ids_{ event_id },
+      pushdown_(details::pushdown_of(predicate))
+    {
+        share_predicate(predicate);
+        pushdown_.scope_payload(provider_filter_event_ids_);
+    }
+
+    template <typename Predicate, typename>
+    event_filter::event_filter(std::vector<unsigned short> event_ids, const Predicate &predicate)
+    : provider_filter_event_ids_{ event_ids },
+      pushdown_(details::pushdown_of(predicate))
+    {
+        share_predicate(predicate);
+        pushdown_.scope_payload(provider_filter_event_ids_);
+    }
+
+    template <typename Predicate>
+    void event_filter::share_predicate(const Predicate &predicate)
+    {
+        // The expression's checks point into this copy, so it has to stay
+        // put for as long as any copy of the filter is around.
+        std::shared_ptr<const Predicate> shared = std::make_shared<Predicate>(predicate);
+
+        predicate_ = [shared](const EVENT_RECORD &record, const krabs::trace_context &trace_context) {
+            return (*shared)(record, trace_context);
+        };
+
+        expression_ = std::make_shared<krabs::predicate_expression>(details::expression_of(*shared, shared));
+    }
+
     inline void event_filter::add_on_event_callback(c_provider_callback callback)
     {
         // C function pointers don't interact well with std::ref, so we
@@ -155,18 +261,30 @@ namespace krabs {
         callbacks_.push_back(callback);
     }
 
-    inline void event_filter::on_event(const EVENT_RECORD &record, const krabs::trace_context &trace_context) const
+    inline bool event_filter::on_event(const EVENT_RECORD &record, const krabs::trace_context &trace_context) const
     {
         if (callbacks_.empty()) {
-            return;
+            return false;
         }
 
-        if (predicate_ != nullptr && !predicate_(record, trace_context)) {
-            return;
+        if (!matches(record, trace_context)) {
+            return false;
         }
 
+        return call_callbacks(record, trace_context);
+    }
+
+    inline bool event_filter::matches(const EVENT_RECORD &record, const krabs::trace_context &trace_context) const
+    {
+        return predicate_ == nullptr || predicate_(record, trace_context);
+    }
+
+    inline bool event_filter::call_callbacks(const EVENT_RECORD &record, const krabs::trace_context &trace_context) const
+    {
         for (auto &callback : callbacks_) {
             callback(record, trace_context);
         }
+
+        return !callbacks_.empty();
     }
 } /* namespace krabs */
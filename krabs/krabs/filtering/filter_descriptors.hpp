@@ -0,0 +1,361 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+
+#include <windows.h>
+#include <evntrace.h>
+#include <tdh.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <deque>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "../compiler_check.hpp"
+#include "pushdown.hpp"
+
+#pragma comment(lib, "tdh.lib")
+
+namespace krabs {
+
+    /**
+     * <summary>
+     *   Builds the EVENT_FILTER_DESCRIPTORs that are handed to
+     *   EnableTraceEx2, and owns the memory they point to. Filters ETW
+     *   can't take, like too many ids, are left out rather than failing
+     *   the enable, since leaving a filter out only lets more through.
+     * </summary>
+     * <example>
+     *   krabs::filter_descriptors filters;
+     *   filters.add_event_ids({ 1, 2 });
+     *   filters.add_process_ids({ 1234 });
+     *   parameters.EnableFilterDesc = filters.data();
+     *   parameters.FilterDescCount = filters.count();
+     * </example>
+     */
+    class filter_descriptors {
+    public:
+        filter_descriptors();
+        ~filter_descriptors();
+
+        filter_descriptors(const filter_descriptors &) = delete;
+        filter_descriptors &operator=(const filter_descriptors &) = delete;
+
+        /**
+         * <summary>
+         *   Only lets through the events with the given ids.
+         * </summary>
+         */
+        bool add_event_ids(const std::set<unsigned short> &event_ids);
+
+        /**
+         * <summary>
+         *   Lets through every event except those with the given ids. Only
+         *   one of this and add_event_ids can be used.
+         * </summary>
+         */
+        bool add_excluded_event_ids(const std::set<unsigned short> &event_ids);
+
+        /**
+         * <summary>
+         *   Only collects stacks for the events with the given ids. Stacks
+         *   also have to be turned on with EVENT_ENABLE_PROPERTY_STACK_TRACE.
+         * </summary>
+         */
+        bool add_stack_walk_ids(const std::set<unsigned short> &event_ids);
+
+        /**
+         * <summary>
+         *   Only lets through events from the given processes.
+         * </summary>
+         */
+        bool add_process_ids(const std::set<ULONG> &process_ids);
+
+        /**
+         * <summary>
+         *   Only lets through events from processes started from the given
+         *   executables, named by file name like L"notepad.exe".
+         * </summary>
+         */
+        bool add_executable_names(const std::set<std::wstring> &names);
+
+        /**
+         * <summary>
+         *   Only lets through events whose fields match the filters. TDH
+         *   builds these from the provider's manifest, so they're skipped
+         *   for providers without one. Payload filters only cover the ids
+         *   they name, so this needs the event id filter to be added first.
+         * </summary>
+         */
+        bool add_payload(const GUID &provider, const std::vector<payload_filter> &filters);
+
+        PEVENT_FILTER_DESCRIPTOR data();
+        ULONG count() const;
+
+    private:
+        bool add(ULONG type, std::vector<BYTE> &&buffer);
+        bool has(ULONG type) const;
+
+        std::vector<EVENT_FILTER_DESCRIPTOR> descriptors_;
+        std::deque<std::vector<BYTE>> buffers_;
+        EVENT_FILTER_DESCRIPTOR payload_;
+        bool event_ids_in_;
+    };
+
+    namespace details {
+
+        /**
+         * <summary>
+         *   The EVENT_FILTER_EVENT_ID buffer for the ids, as used by both
+         *   the event id and the stack walk filters.
+         * </summary>
+         */
+        inline std::vector<BYTE> event_id_filter_bytes(const std::set<unsigned short> &event_ids, BOOLEAN filter_in = TRUE)
+        {
+            std::vector<BYTE> buffer(offsetof(EVENT_FILTER_EVENT_ID, Events) + event_ids.size() * sizeof(USHORT), 0);
+
+            auto filter = reinterpret_cast<PEVENT_FILTER_EVENT_ID>(buffer.data());
+            filter->FilterIn = filter_in;
+            filter->Count = static_cast<USHORT>(event_ids.size());
+
+            auto index = 0;
+            for (auto id : event_ids) {
+                filter->Events[index] = id;
+                index++;
+            }
+
+            return buffer;
+        }
+
+        /**
+         * <summary>
+         *   Points TDH's payload predicates at the strings of ours, which
+         *   have to outlive them.
+         * </summary>
+         */
+        inline std::vector<PAYLOAD_FILTER_PREDICATE> to_tdh_predicates(const std::vector<payload_predicate> &clause)
+        {
+            std::vector<PAYLOAD_FILTER_PREDICATE> predicates;
+            for (const auto &predicate : clause) {
+                PAYLOAD_FILTER_PREDICATE tdh_predicate;
+                tdh_predicate.FieldName = const_cast<LPWSTR>(predicate.field.c_str());
+                tdh_predicate.CompareOp = predicate.compare_op;
+                tdh_predicate.Value = const_cast<LPWSTR>(predicate.value.c_str());
+                predicates.push_back(tdh_predicate);
+            }
+
+            return predicates;
+        }
+
+        /**
+         * <summary>
+         *   Returns the descriptors of every event in the provider's
+         *   manifest, or nothing if TDH doesn't know the provider.
+         * </summary>
+         */
+        inline std::vector<EVENT_DESCRIPTOR> manifest_events(const GUID &provider)
+        {
+            GUID id = provider;
+            ULONG size = 0;
+            std::vector<BYTE> buffer;
+
+            ULONG status = TdhEnumerateManifestProviderEvents(&id, nullptr, &size);
+            while (status == ERROR_INSUFFICIENT_BUFFER) {
+                buffer.resize(size);
+                status = TdhEnumerateManifestProviderEvents(
+                    &id, reinterpret_cast<PPROVIDER_EVENT_INFO>(buffer.data()), &size);
+            }
+
+            if (status != ERROR_SUCCESS) {
+                return {};
+            }
+
+            auto info = reinterpret_cast<const PROVIDER_EVENT_INFO*>(buffer.data());
+            return std::vector<EVENT_DESCRIPTOR>(
+                info->EventDescriptorsArray, info->EventDescriptorsArray + info->NumberOfEvents);
+        }
+    } /* namespace details */
+
+    // Implementation
+    // ------------------------------------------------------------------------
+
+    inline filter_descriptors::filter_descriptors()
+    : payload_()
+    , event_ids_in_(false)
+    {}
+
+    inline filter_descriptors::~filter_descriptors()
+    {
+        if (payload_.Ptr != 0) {
+            TdhCleanupPayloadEventFilterDescriptor(&payload_);
+        }
+    }
+
+    inline bool filter_descriptors::add_event_ids(const std::set<unsigned short> &event_ids)
+    {
+        if (event_ids.empty() || event_ids.size() > MAX_EVENT_FILTER_EVENT_ID_COUNT) {
+            return false;
+        }
+
+        event_ids_in_ = add(EVENT_FILTER_TYPE_EVENT_ID, details::event_id_filter_bytes(event_ids));
+        return event_ids_in_;
+    }
+
+    inline bool filter_descriptors::add_excluded_event_ids(const std::set<unsigned short> &event_ids)
+    {
+        if (event_ids.empty() || event_ids.size() > MAX_EVENT_FILTER_EVENT_ID_COUNT) {
+            return false;
+        }
+
+        return add(EVENT_FILTER_TYPE_EVENT_ID, details::event_id_filter_bytes(event_ids, FALSE));
+    }
+
+    inline bool filter_descriptors::add_stack_walk_ids(const std::set<unsigned short> &event_ids)
+    {
+        if (event_ids.empty() || event_ids.size() > MAX_EVENT_FILTER_EVENT_ID_COUNT) {
+            return false;
+        }
+
+        return add(EVENT_FILTER_TYPE_STACKWALK, details::event_id_filter_bytes(event_ids));
+    }
+
+    inline bool filter_descriptors::add_process_ids(const std::set<ULONG> &process_ids)
+    {
+        if (process_ids.empty() || process_ids.size() > MAX_EVENT_FILTER_PID_COUNT) {
+            return false;
+        }
+
+        std::vector<BYTE> buffer(process_ids.size() * sizeof(ULONG));
+        auto index = 0;
+        for (auto id : process_ids) {
+            memcpy(buffer.data() + index * sizeof(ULONG), &id, sizeof(ULONG));
+            index++;
+        }
+
+        return add(EVENT_FILTER_TYPE_PID, std::move(buffer));
+    }
+
+    inline bool filter_descriptors::add_executable_names(const std::set<std::wstring> &names)
+    {
+        if (names.empty() || !details::executable_names_fit(names)) {
+            return false;
+        }
+
+        const std::wstring joined = details::join_executable_names(names);
+        const size_t size = (joined.size() + 1) * sizeof(wchar_t);
+
+        auto start = reinterpret_cast<const BYTE*>(joined.c_str());
+        return add(EVENT_FILTER_TYPE_EXECUTABLE_NAME, std::vector<BYTE>(start, start + size));
+    }
+
+    inline bool filter_descriptors::add_payload(const GUID &provider, const std::vector<payload_filter> &filters)
+    {
+        if (filters.empty() || !event_ids_in_ || has(EVENT_FILTER_TYPE_PAYLOAD)) {
+            return false;
+        }
+
+        // Payload filters are made per event descriptor, so every version
+        // of each id needs its own.
+        const auto events = details::manifest_events(provider);
+        std::vector<PVOID> created;
+        bool failed = false;
+
+        for (const auto &filter : filters) {
+            for (const auto &descriptor : events) {
+                if (std::find(filter.event_ids.begin(), filter.event_ids.end(), descriptor.Id) == filter.event_ids.end()) {
+                    continue;
+                }
+
+                for (const auto &clause : filter.clauses) {
+                    auto predicates = details::to_tdh_predicates(clause);
+                    PVOID payload_filter = nullptr;
+
+                    ULONG status = TdhCreatePayloadFilter(
+                        &provider,
+                        &descriptor,
+                        FALSE,
+                        static_cast<ULONG>(predicates.size()),
+                        predicates.data(),
+                        &payload_filter);
+
+                    if (status != ERROR_SUCCESS) {
+                        failed = true;
+                        break;
+                    }
+
+                    created.push_back(payload_filter);
+                }
+            }
+        }
+
+        // An event gets through if it matches any of the filters for its
+        // descriptor, which is the union the clauses stand for.
+        ULONG status = ERROR_INVALID_PARAMETER;
+        if (!failed && !created.empty()) {
+            std::vector<BOOLEAN> match_any(created.size(), TRUE);
+            status = TdhAggregatePayloadFilters(
+                static_cast<ULONG>(created.size()),
+                created.data(),
+                match_any.data(),
+                &payload_);
+        }
+
+        for (auto &payload_filter : created) {
+            TdhDeletePayloadFilter(&payload_filter);
+        }
+
+        if (status != ERROR_SUCCESS) {
+            payload_ = EVENT_FILTER_DESCRIPTOR();
+            return false;
+        }
+
+        descriptors_.push_back(payload_);
+        return true;
+    }
+
+    inline PEVENT_FILTER_DESCRIPTOR filter_descriptors::data()
+    {
+        return descriptors_.empty() ? nullptr : descriptors_.data();
+    }
+
+    inline ULONG filter_descriptors::count() const
+    {
+        return static_cast<ULONG>(descriptors_.size());
+    }
+
+    inline bool filter_descriptors::add(ULONG type, std::vector<BYTE> &&buffer)
+    {
+        if (has(type) || descriptors_.size() >= MAX_EVENT_FILTERS_COUNT) {
+            return false;
+        }
+
+        buffers_.push_back(std::move(buffer));
+
+        EVENT_FILTER_DESCRIPTOR descriptor;
+        descriptor.Ptr = reinterpret_cast<ULONGLONG>(buffers_.back().data());
+        descriptor.Size = static_cast<ULONG>(buffers_.back().size());
+        descriptor.Type = type;
+        descriptors_.push_back(descriptor);
+        return true;
+    }
+
+    inline bool filter_descriptors::has(ULONG type) const
+    {
+        for (const auto &descriptor : descriptors_) {
+            if (descriptor.Type == type) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+} /* namespace krabs */
@@ -0,0 +1,154 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <algorithm>
+#include <bitset>
+#include <cstdint>
+#include <vector>
+
+#include "../compiler_check.hpp"
+
+namespace krabs { namespace details {
+
+    /**
+     * <summary>
+     *   Tells which of a provider's filters an event id can reach. Filters
+     *   are named by the order they were added in. A filter with event ids
+     *   only gets events with one of them, and a filter without any gets
+     *   every event.
+     * </summary>
+     * <remarks>
+     *   Which ids have filters of their own is kept in a bitmap of every
+     *   possible id. Counting the set bits before an id gives its place
+     *   in the sorted list of ids, and so its list of filters, without a
+     *   search. Each list already holds the filters without ids, in order,
+     *   so an event only ever visits the filters that can take it.
+     * </remarks>
+     * <example>
+     *   krabs::details::filter_dispatch dispatch;
+     *   dispatch.add(0, { 5 });
+     *   dispatch.add(1, {});
+     *   for (auto filter : dispatch.candidates(5)) {
+     *       // 0, then 1
+     *   }
+     * </example>
+     */
+    class filter_dispatch {
+    public:
+        filter_dispatch();
+
+        /**
+         * <summary>
+         *   Adds the next filter, which gets events with the given ids, or
+         *   every event if there are none.
+         * </summary>
+         */
+        void add(unsigned int filter, const std::vector<unsigned short> &event_ids);
+
+        /**
+         * <summary>
+         *   The filters an event with the id has to be given to, in the
+         *   order they were added.
+         * </summary>
+         */
+        const std::vector<unsigned int> &candidates(unsigned short id) const;
+
+        /**
+         * <summary>
+         *   Whether some filter was added for the id itself.
+         * </summary>
+         */
+        bool has_event_id(unsigned short id) const;
+
+        /**
+         * <summary>
+         *   The ids filters were added for, sorted.
+         * </summary>
+         */
+        const std::vector<unsigned short> &event_ids() const;
+
+    private:
+        size_t slot(unsigned short id) const;
+
+        static const size_t words = 65536 / 64;
+
+        // Left empty until a filter with ids is added, since most
+        // providers don't have any.
+        std::vector<uint64_t> bits_;
+        std::vector<uint32_t> ranks_;
+
+        std::vector<unsigned short> ids_;
+        std::vector<std::vector<unsigned int>> by_id_;
+        std::vector<unsigned int> any_id_;
+    };
+
+    // Implementation
+    // ------------------------------------------------------------------------
+
+    inline filter_dispatch::filter_dispatch()
+    {}
+
+    inline void filter_dispatch::add(unsigned int filter, const std::vector<unsigned short> &event_ids)
+    {
+        if (event_ids.empty()) {
+            any_id_.push_back(filter);
+            for (auto &filters : by_id_) {
+                filters.push_back(filter);
+            }
+
+            return;
+        }
+
+        if (bits_.empty()) {
+            bits_.resize(words, 0);
+            ranks_.resize(words, 0);
+        }
+
+        for (auto id : event_ids) {
+            auto place = std::lower_bound(ids_.begin(), ids_.end(), id);
+            auto index = place - ids_.begin();
+
+            if (place == ids_.end() || *place != id) {
+                ids_.insert(place, id);
+                by_id_.insert(by_id_.begin() + index, any_id_);
+                bits_[id / 64] |= uint64_t(1) << (id % 64);
+            }
+
+            // The same id can be given twice.
+            auto &filters = by_id_[index];
+            if (filters.empty() || filters.back() != filter) {
+                filters.push_back(filter);
+            }
+        }
+
+        uint32_t before = 0;
+        for (size_t word = 0; word < words; ++word) {
+            ranks_[word] = before;
+            before += static_cast<uint32_t>(std::bitset<64>(bits_[word]).count());
+        }
+    }
+
+    inline const std::vector<unsigned int> &filter_dispatch::candidates(unsigned short id) const
+    {
+        return has_event_id(id) ? by_id_[slot(id)] : any_id_;
+    }
+
+    inline bool filter_dispatch::has_event_id(unsigned short id) const
+    {
+        return !bits_.empty() && (bits_[id / 64] >> (id % 64)) & 1;
+    }
+
+    inline const std::vector<unsigned short> &filter_dispatch::event_ids() const
+    {
+        return ids_;
+    }
+
+    inline size_t filter_dispatch::slot(unsigned short id) const
+    {
+        const uint64_t below = (uint64_t(1) << (id % 64)) - 1;
+        return ranks_[id / 64] + std::bitset<64>(bits_[id / 64] & below).count();
+    }
+
+} /* namespace details */ } /* namespace krabs */
@@ -0,0 +1,369 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <evntcons.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+
+#include "../compiler_check.hpp"
+#include "../trace_context.hpp"
+
+namespace krabs {
+
+    /**
+     * <summary>
+     *   How a predicate is built out of smaller ones, so that the parts
+     *   the filters of a provider have in common can be run once per event
+     *   for all of them. Leaves do the actual checks. A leaf with a key is
+     *   the same check as any other leaf with that key; a leaf without
+     *   one is never shared.
+     * </summary>
+     * <remarks>
+     *   all, any and none combine their children in order and stop as soon
+     *   as the answer is known, like the predicates they come from.
+     * </remarks>
+     */
+    struct predicate_expression {
+        enum kind_type { leaf, all, any, none };
+
+        kind_type kind;
+        std::wstring key;
+        std::function<bool(const EVENT_RECORD &, const krabs::trace_context &)> evaluate;
+        std::vector<predicate_expression> children;
+
+        static predicate_expression combine(kind_type kind, std::vector<predicate_expression> &&children);
+    };
+
+    namespace details {
+
+        /**
+         * <summary>
+         *   Merges the expressions of a provider's filters into one graph,
+         *   where each distinct check and each distinct combination of
+         *   checks is a single node, and works out the nodes for an event
+         *   at most once each.
+         * </summary>
+         * <remarks>
+         *   The answers for the current event are kept in the graph, so it
+         *   can only be used for one event at a time, as on the thread that
+         *   processes a trace.
+         * </remarks>
+         * <example>
+         *   krabs::details::predicate_graph graph;
+         *   auto first = graph.add(expression_of_first_filter);
+         *   auto second = graph.add(expression_of_second_filter);
+         *   graph.begin_event();
+         *   if (graph.evaluate(first, record, context)) { ... }
+         *   if (graph.evaluate(second, record, context)) { ... }
+         * </example>
+         */
+        class predicate_graph {
+        public:
+            predicate_graph();
+
+            // A copy starts without answers, which the thread processing
+            // events could be in the middle of writing.
+            predicate_graph(const predicate_graph &other);
+            predicate_graph &operator=(const predicate_graph &other);
+
+            /**
+             * <summary>
+             *   Adds the expression, reusing the nodes the graph already
+             *   has for any part of it. Returns the node for the whole.
+             * </summary>
+             */
+            unsigned int add(const predicate_expression &expression);
+
+            /**
+             * <summary>
+             *   Forgets the answers for the previous event.
+             * </summary>
+             */
+            void begin_event() const;
+
+            /**
+             * <summary>
+             *   Whether the event satisfies the node's expression.
+             * </summary>
+             */
+            bool evaluate(unsigned int node, const EVENT_RECORD &record, const krabs::trace_context &context) const;
+
+            size_t size() const { return nodes_.size(); }
+
+        private:
+            struct node {
+                predicate_expression::kind_type kind;
+                std::function<bool(const EVENT_RECORD &, const krabs::trace_context &)> evaluate;
+                std::vector<unsigned int> children;
+            };
+
+            unsigned int add_node(node &&n, const std::wstring &key);
+
+            std::vector<node> nodes_;
+            std::unordered_map<std::wstring, unsigned int> shared_;
+
+            // A node's answer is only good for the event it was worked out
+            // for, which is told apart by its number.
+            mutable std::vector<uint32_t> answered_;
+            mutable std::vector<unsigned char> answers_;
+            mutable uint32_t event_;
+        };
+
+        /**
+         * <summary>
+         *   A leaf that runs the predicate, which has to live inside what
+         *   owner points to. The leaf keeps the owner alive.
+         * </summary>
+         */
+        template <typename Predicate>
+        predicate_expression leaf_expression(
+            const Predicate &predicate,
+            const std::shared_ptr<const void> &owner,
+            const std::wstring &key = std::wstring())
+        {
+            std::shared_ptr<const Predicate> self(owner, &predicate);
+
+            predicate_expression expression;
+            expression.kind = predicate_expression::leaf;
+            expression.key = key;
+            expression.evaluate = [self](const EVENT_RECORD &record, const krabs::trace_context &context) {
+                return (*self)(record, context);
+            };
+
+            return expression;
+        }
+
+        /**
+         * <summary>
+         *   Returns the expression of a predicate, or a leaf that can't be
+         *   shared for predicates that don't describe one, like lambdas.
+         * </summary>
+         */
+        template <typename Predicate>
+        auto expression_of(const Predicate &predicate, const std::shared_ptr<const void> &owner, int)
+            -> decltype(predicate.expression(owner))
+        {
+            return predicate.expression(owner);
+        }
+
+        template <typename Predicate>
+        predicate_expression expression_of(const Predicate &predicate, const std::shared_ptr<const void> &owner, long)
+        {
+            return leaf_expression(predicate, owner);
+        }
+
+        template <typename Predicate>
+        predicate_expression expression_of(const Predicate &predicate, const std::shared_ptr<const void> &owner)
+        {
+            return expression_of(predicate, owner, 0);
+        }
+
+        /**
+         * <summary>
+         *   Appends a value to a leaf's key. Only integers and strings are
+         *   written out; for anything else it returns false, and the leaf
+         *   gets no key.
+         * </summary>
+         */
+        template <typename T>
+        typename std::enable_if<std::is_integral<T>::value, bool>::type
+        append_key(std::wstring &key, const T &value)
+        {
+            key += std::to_wstring(value);
+            key += L';';
+            return true;
+        }
+
+        inline bool append_key(std::wstring &key, const std::wstring &value)
+        {
+            // The length keeps strings with ';' in them apart.
+            key += std::to_wstring(value.size());
+            key += L':';
+            key += value;
+            key += L';';
+            return true;
+        }
+
+        inline bool append_key(std::wstring &key, const std::string &value)
+        {
+            return append_key(key, std::wstring(value.begin(), value.end()));
+        }
+
+        template <typename T>
+        typename std::enable_if<!std::is_integral<T>::value, bool>::type
+        append_key(std::wstring &key, const T &)
+        {
+            return false;
+        }
+
+        /**
+         * <summary>
+         *   Appends the name of a type, which tells apart predicates that
+         *   only differ in their template arguments.
+         * </summary>
+         */
+        template <typename T>
+        void append_type_key(std::wstring &key)
+        {
+            const std::string name = typeid(T).name();
+            key.append(name.begin(), name.end());
+            key += L';';
+        }
+
+    } /* namespace details */
+
+    // Implementation
+    // ------------------------------------------------------------------------
+
+    inline predicate_expression predicate_expression::combine(
+        kind_type kind,
+        std::vector<predicate_expression> &&children)
+    {
+        predicate_expression expression;
+        expression.kind = kind;
+        expression.children = std::move(children);
+        return expression;
+    }
+
+    namespace details {
+
+        inline predicate_graph::predicate_graph()
+        : event_(1)
+        {}
+
+        inline predicate_graph::predicate_graph(const predicate_graph &other)
+        : nodes_(other.nodes_)
+        , shared_(other.shared_)
+        , answered_(other.nodes_.size(), 0)
+        , answers_(other.nodes_.size(), 0)
+        , event_(1)
+        {}
+
+        inline predicate_graph &predicate_graph::operator=(const predicate_graph &other)
+        {
+            nodes_ = other.nodes_;
+            shared_ = other.shared_;
+            answered_.assign(nodes_.size(), 0);
+            answers_.assign(nodes_.size(), 0);
+            event_ = 1;
+            return *this;
+        }
+
+        inline unsigned int predicate_graph::add(const predicate_expression &expression)
+        {
+            node n;
+            n.kind = expression.kind;
+
+            if (expression.kind == predicate_expression::leaf) {
+                n.evaluate = expression.evaluate;
+                return add_node(std::move(n), expression.key.empty() ? expression.key : L"leaf;" + expression.key);
+            }
+
+            // A combination is the same as another if its children are the
+            // same nodes, which they are once they're added.
+            std::wstring key = std::to_wstring(static_cast<int>(expression.kind)) + L"(";
+
+            for (const auto &child : expression.children) {
+                const auto index = add(child);
+                n.children.push_back(index);
+                key += std::to_wstring(index) + L",";
+            }
+
+            return add_node(std::move(n), key);
+        }
+
+        inline void predicate_graph::begin_event() const
+        {
+            if (++event_ == 0) {
+                // Answers from 4 billion events ago would look current.
+                std::fill(answered_.begin(), answered_.end(), 0);
+                event_ = 1;
+            }
+        }
+
+        inline bool predicate_graph::evaluate(
+            unsigned int index,
+            const EVENT_RECORD &record,
+            const krabs::trace_context &context) const
+        {
+            if (answered_[index] == event_) {
+                return answers_[index] != 0;
+            }
+
+            const auto &n = nodes_[index];
+            bool answer = false;
+
+            switch (n.kind) {
+            case predicate_expression::leaf:
+                answer = n.evaluate(record, context);
+                break;
+
+            case predicate_expression::all:
+                answer = true;
+                for (auto child : n.children) {
+                    if (!evaluate(child, record, context)) {
+                        answer = false;
+                        break;
+                    }
+                }
+                break;
+
+            case predicate_expression::any:
+                for (auto child : n.children) {
+                    if (evaluate(child, record, context)) {
+                        answer = true;
+                        break;
+                    }
+                }
+                break;
+
+            case predicate_expression::none:
+                answer = true;
+                for (auto child : n.children) {
+                    if (evaluate(child, record, context)) {
+                        answer = false;
+                        break;
+                    }
+                }
+                break;
+            }
+
+            answered_[index] = event_;
+            answers_[index] = answer ? 1 : 0;
+            return answer;
+        }
+
+        inline unsigned int predicate_graph::add_node(node &&n, const std::wstring &key)
+        {
+            if (!key.empty()) {
+                auto match = shared_.find(key);
+                if (match != shared_.end()) {
+                    return match->second;
+                }
+            }
+
+            const auto index = static_cast<unsigned int>(nodes_.size());
+            nodes_.push_back(std::move(n));
+            answered_.push_back(0);
+            answers_.push_back(0);
+
+            if (!key.empty()) {
+                shared_[key] = index;
+            }
+
+            return index;
+        }
+
+    } /* namespace details */
+
+} /* namespace krabs */
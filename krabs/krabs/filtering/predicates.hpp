@@ -6,10 +6,14 @@
 #include <evntcons.h>
 #include <functional>
 #include <algorithm>
+#include <memory>
 #include <string>
+#include <type_traits>
 
 #include "../compiler_check.hpp"
 #include "comparers.hpp"
+#include "predicate_graph.hpp"
+#include "pushdown.hpp"
 #include "../trace_context.hpp"
 #include "view_adapters.hpp"
 
@@ -29,6 +33,31 @@ namespace krabs { namespace predicates {
         struct predicate_base
         {
             virtual bool operator()(const EVENT_RECORD&, const krabs::trace_context&) const = 0;
+
+            /**
+             * <summary>
+             *   The conditions ETW can check for this predicate before events
+             *   are delivered. Predicates that can't be checked by ETW have
+             *   none.
+             * </summary>
+             */
+            virtual krabs::filter_pushdown pushdown() const
+            {
+                return krabs::filter_pushdown();
+            }
+
+            /**
+             * <summary>
+             *   How this predicate is built out of smaller checks, so that
+             *   the checks filters share are only run once per event. owner
+             *   is what keeps the predicate alive. Predicates that don't
+             *   say are a single check that isn't shared.
+             * </summary>
+             */
+            virtual krabs::predicate_expression expression(const std::shared_ptr<const void> &owner) const
+            {
+                return krabs::details::leaf_expression(*this, owner);
+            }
         };
 
         /**
@@ -41,6 +70,11 @@ namespace krabs { namespace predicates {
             {
                 return true;
             }
+
+            krabs::predicate_expression expression(const std::shared_ptr<const void> &owner) const
+            {
+                return krabs::details::leaf_expression(*this, owner, L"any_event");
+            }
         };
 
         /**
@@ -53,6 +87,11 @@ namespace krabs { namespace predicates {
             {
                 return false;
             }
+
+            krabs::predicate_expression expression(const std::shared_ptr<const void> &owner) const
+            {
+                return krabs::details::leaf_expression(*this, owner, L"no_event");
+            }
         };
 
         /**
@@ -72,6 +111,20 @@ namespace krabs { namespace predicates {
                 return (t1_(record, trace_context) && t2_(record, trace_context));
             }
 
+            krabs::filter_pushdown pushdown() const
+            {
+                return krabs::filter_pushdown::both(
+                    krabs::details::pushdown_of(t1_),
+                    krabs::details::pushdown_of(t2_));
+            }
+
+            krabs::predicate_expression expression(const std::shared_ptr<const void> &owner) const
+            {
+                return krabs::predicate_expression::combine(krabs::predicate_expression::all, {
+                    krabs::details::expression_of(t1_, owner),
+                    krabs::details::expression_of(t2_, owner) });
+            }
+
         private:
             const T1 t1_;
             const T2 t2_;
@@ -94,6 +147,20 @@ namespace krabs { namespace predicates {
                 return (t1_(record, trace_context) || t2_(record, trace_context));
             }
 
+            krabs::filter_pushdown pushdown() const
+            {
+                return krabs::filter_pushdown::either(
+                    krabs::details::pushdown_of(t1_),
+                    krabs::details::pushdown_of(t2_));
+            }
+
+            krabs::predicate_expression expression(const std::shared_ptr<const void> &owner) const
+            {
+                return krabs::predicate_expression::combine(krabs::predicate_expression::any, {
+                    krabs::details::expression_of(t1_, owner),
+                    krabs::details::expression_of(t2_, owner) });
+            }
+
         private:
             const T1 t1_;
             const T2 t2_;
@@ -115,6 +182,12 @@ namespace krabs { namespace predicates {
                 return !t1_(record, trace_context);
             }
 
+            krabs::predicate_expression expression(const std::shared_ptr<const void> &owner) const
+            {
+                return krabs::predicate_expression::combine(krabs::predicate_expression::none, {
+                    krabs::details::expression_of(t1_, owner) });
+            }
+
         private:
             const T1 t1_;
         };
@@ -144,6 +217,33 @@ namespace krabs { namespace predicates {
                 }
             }
 
+            krabs::filter_pushdown pushdown() const
+            {
+                krabs::filter_pushdown result;
+                krabs::payload_predicate predicate;
+
+                if (krabs::details::make_payload_predicate(property_, expected_, predicate)) {
+                    krabs::payload_filter filter;
+                    filter.clauses.push_back({ predicate });
+                    result.payload.push_back(filter);
+                }
+
+                return result;
+            }
+
+            krabs::predicate_expression expression(const std::shared_ptr<const void> &owner) const
+            {
+                std::wstring key = L"property_is;";
+                krabs::details::append_type_key<T>(key);
+                krabs::details::append_key(key, property_);
+
+                if (!krabs::details::append_key(key, expected_)) {
+                    key.clear();
+                }
+
+                return krabs::details::leaf_expression(*this, owner, key);
+            }
+
         private:
             const std::wstring property_;
             const T expected_;
@@ -186,6 +286,21 @@ namespace krabs { namespace predicates {
                 }
             }
 
+            krabs::predicate_expression expression(const std::shared_ptr<const void> &owner) const
+            {
+                std::wstring key = L"property_view_predicate;";
+                krabs::details::append_type_key<T>(key);
+                krabs::details::append_type_key<Adapter>(key);
+                krabs::details::append_type_key<Predicate>(key);
+                krabs::details::append_key(key, property_);
+
+                if (!krabs::details::append_key(key, expected_)) {
+                    key.clear();
+                }
+
+                return krabs::details::leaf_expression(*this, owner, key);
+            }
+
         private:
             const std::wstring property_;
             const T expected_;
@@ -226,6 +341,11 @@ namespace krabs { namespace predicates {
             return (record.EventHeader.EventDescriptor.Id == expected_);
         }
 
+        krabs::predicate_expression expression(const std::shared_ptr<const void> &owner) const
+        {
+            return krabs::details::leaf_expression(*this, owner, L"id_is;" + std::to_wstring(expected_));
+        }
+
     private:
         USHORT expected_;
     };
@@ -245,6 +365,11 @@ namespace krabs { namespace predicates {
             return (record.EventHeader.EventDescriptor.Opcode == expected_);
         }
 
+        krabs::predicate_expression expression(const std::shared_ptr<const void> &owner) const
+        {
+            return krabs::details::leaf_expression(*this, owner, L"opcode_is;" + std::to_wstring(expected_));
+        }
+
     private:
         USHORT expected_;
     };
@@ -268,6 +393,28 @@ namespace krabs { namespace predicates {
             }
             return false;
         }
+
+        krabs::filter_pushdown pushdown() const
+        {
+            if (list_.empty()) {
+                return krabs::filter_pushdown();
+            }
+
+            auto result = list_[0]->pushdown();
+            for (size_t i = 1; i < list_.size(); ++i) {
+                result = krabs::filter_pushdown::either(result, list_[i]->pushdown());
+            }
+            return result;
+        }
+
+        krabs::predicate_expression expression(const std::shared_ptr<const void> &owner) const
+        {
+            std::vector<krabs::predicate_expression> children;
+            for (auto &item : list_) {
+                children.push_back(item->expression(owner));
+            }
+            return krabs::predicate_expression::combine(krabs::predicate_expression::any, std::move(children));
+        }
     private:
         std::vector<details::predicate_base*> list_;
     };
@@ -294,6 +441,29 @@ namespace krabs { namespace predicates {
             }
             return true;
         }
+
+        krabs::filter_pushdown pushdown() const
+        {
+            krabs::filter_pushdown result;
+            for (auto& item : list_) {
+                result = krabs::filter_pushdown::both(result, item->pushdown());
+            }
+            return result;
+        }
+
+        krabs::predicate_expression expression(const std::shared_ptr<const void> &owner) const
+        {
+            // Unlike an empty all, an empty all_of accepts nothing.
+            if (list_.empty()) {
+                return krabs::details::leaf_expression(*this, owner, L"no_event");
+            }
+
+            std::vector<krabs::predicate_expression> children;
+            for (auto &item : list_) {
+                children.push_back(item->expression(owner));
+            }
+            return krabs::predicate_expression::combine(krabs::predicate_expression::all, std::move(children));
+        }
     private:
         std::vector<details::predicate_base*> list_;
     };
@@ -317,6 +487,15 @@ namespace krabs { namespace predicates {
             }
             return true;
         }
+
+        krabs::predicate_expression expression(const std::shared_ptr<const void> &owner) const
+        {
+            std::vector<krabs::predicate_expression> children;
+            for (auto &item : list_) {
+                children.push_back(item->expression(owner));
+            }
+            return krabs::predicate_expression::combine(krabs::predicate_expression::none, std::move(children));
+        }
     private:
         std::vector<details::predicate_base*> list_;
     };
@@ -336,6 +515,11 @@ namespace krabs { namespace predicates {
             return (record.EventHeader.EventDescriptor.Version == expected_);
         }
 
+        krabs::predicate_expression expression(const std::shared_ptr<const void> &owner) const
+        {
+            return krabs::details::leaf_expression(*this, owner, L"version_is;" + std::to_wstring(expected_));
+        }
+
     private:
         USHORT expected_;
     };
@@ -355,6 +539,18 @@ namespace krabs { namespace predicates {
             return (record.EventHeader.ProcessId == expected_);
         }
 
+        krabs::filter_pushdown pushdown() const
+        {
+            krabs::filter_pushdown result;
+            result.process_ids.insert(expected_);
+            return result;
+        }
+
+        krabs::predicate_expression expression(const std::shared_ptr<const void> &owner) const
+        {
+            return krabs::details::leaf_expression(*this, owner, L"process_id_is;" + std::to_wstring(expected_));
+        }
+
     private:
         ULONG expected_;
     };
@@ -549,4 +745,35 @@ namespace krabs { namespace predicates {
         return details::not_filter<T1>(t1);
     }
 
+    namespace details {
+
+        template <typename T>
+        using if_predicate = typename std::enable_if<std::is_base_of<predicate_base, T>::value>::type;
+
+        /**
+         * <summary>
+         *   Operators for combining predicates, as in
+         *   id_is(1) && !process_id_is(4). The result keeps the type of
+         *   each part, so calls to them can be inlined.
+         * </summary>
+         */
+        template <typename T1, typename T2, typename = if_predicate<T1>, typename = if_predicate<T2>>
+        and_filter<T1, T2> operator&&(const T1 &t1, const T2 &t2)
+        {
+            return and_filter<T1, T2>(t1, t2);
+        }
+
+        template <typename T1, typename T2, typename = if_predicate<T1>, typename = if_predicate<T2>>
+        or_filter<T1, T2> operator||(const T1 &t1, const T2 &t2)
+        {
+            return or_filter<T1, T2>(t1, t2);
+        }
+
+        template <typename T1, typename = if_predicate<T1>>
+        not_filter<T1> operator!(const T1 &t1)
+        {
+            return not_filter<T1>(t1);
+        }
+    } /* namespace details */
+
 } /* namespace predicates */ } /* namespace krabs */
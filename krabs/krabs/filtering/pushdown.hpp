@@ -0,0 +1,338 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+
+#include <windows.h>
+#include <evntrace.h>
+#include <tdh.h>
+
+#include <algorithm>
+#include <iterator>
+#include <set>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "../compiler_check.hpp"
+
+namespace krabs {
+
+    /**
+     * <summary>
+     *   A comparison ETW can make against a field of an event before the
+     *   event reaches the session, as in PAYLOAD_FILTER_PREDICATE. The
+     *   value is written out as text and ETW reads it as the field's type.
+     * </summary>
+     */
+    struct payload_predicate {
+        std::wstring field;
+        USHORT compare_op;
+        std::wstring value;
+    };
+
+    /**
+     * <summary>
+     *   Payload predicates for the events with the given ids. An event
+     *   passes if every predicate of any one of the clauses matches.
+     * </summary>
+     */
+    struct payload_filter {
+        std::vector<unsigned short> event_ids;
+        std::vector<std::vector<payload_predicate>> clauses;
+    };
+
+    /**
+     * <summary>
+     *   The conditions ETW can check for a filter before events are
+     *   delivered, worked out from its predicate. Each one is something
+     *   every event the predicate accepts must satisfy, so handing them to
+     *   ETW only drops events the predicate would have dropped anyway.
+     *   The predicate still runs on what gets through.
+     * </summary>
+     * <remarks>
+     *   An empty set or list places no condition on events.
+     * </remarks>
+     */
+    struct filter_pushdown {
+        std::set<ULONG> process_ids;
+        std::set<std::wstring> executable_names;
+        std::vector<payload_filter> payload;
+
+        bool empty() const;
+
+        /**
+         * <summary>
+         *   Ties payload filters to the event ids of the filter they belong
+         *   to. ETW needs an event descriptor for each payload filter, so
+         *   without ids they're dropped.
+         * </summary>
+         */
+        void scope_payload(const std::vector<unsigned short> &event_ids);
+
+        /**
+         * <summary>
+         *   The conditions for events that satisfy both. When the two can't
+         *   be combined, the left one is kept, which is still a condition
+         *   such events satisfy.
+         * </summary>
+         */
+        static filter_pushdown both(const filter_pushdown &lhs, const filter_pushdown &rhs);
+
+        /**
+         * <summary>
+         *   The conditions for events that satisfy either. A condition
+         *   only one of them has, or one too big for ETW, is dropped.
+         * </summary>
+         */
+        static filter_pushdown either(const filter_pushdown &lhs, const filter_pushdown &rhs);
+    };
+
+    namespace details {
+
+        // Caps the number of clauses a payload filter can grow to, since
+        // ETW makes one filter for each clause and event descriptor.
+        static const size_t max_payload_clauses = 8;
+
+        /**
+         * <summary>
+         *   Joins executable names the way ETW takes them, as one string
+         *   with the names split by semicolons.
+         * </summary>
+         */
+        inline std::wstring join_executable_names(const std::set<std::wstring> &names)
+        {
+            std::wstring joined;
+            for (const auto &name : names) {
+                if (!joined.empty()) {
+                    joined += L';';
+                }
+
+                joined += name;
+            }
+
+            return joined;
+        }
+
+        /**
+         * <summary>
+         *   Whether the joined names, with their terminator, fit in the
+         *   data of a single filter descriptor.
+         * </summary>
+         */
+        inline bool executable_names_fit(const std::set<std::wstring> &names)
+        {
+            return (join_executable_names(names).size() + 1) * sizeof(wchar_t) <= MAX_EVENT_FILTER_DATA_SIZE;
+        }
+
+        /**
+         * <summary>
+         *   Returns the pushdown of a predicate, or nothing for predicates
+         *   that don't describe one, like lambdas.
+         * </summary>
+         */
+        template <typename Predicate>
+        auto pushdown_of(const Predicate &predicate, int) -> decltype(predicate.pushdown())
+        {
+            return predicate.pushdown();
+        }
+
+        template <typename Predicate>
+        filter_pushdown pushdown_of(const Predicate &, long)
+        {
+            return filter_pushdown();
+        }
+
+        template <typename Predicate>
+        filter_pushdown pushdown_of(const Predicate &predicate)
+        {
+            return pushdown_of(predicate, 0);
+        }
+
+        /**
+         * <summary>
+         *   Fills in the payload predicate ETW would use to compare a
+         *   property to the value. Only integers and wide strings have a
+         *   text form ETW reads the same way krabs compares them.
+         * </summary>
+         */
+        template <typename T>
+        typename std::enable_if<
+            std::is_integral<T>::value &&
+            !std::is_same<T, bool>::value &&
+            !std::is_same<T, char>::value &&
+            !std::is_same<T, wchar_t>::value, bool>::type
+        make_payload_predicate(const std::wstring &field, const T &value, payload_predicate &predicate)
+        {
+            predicate.field = field;
+            predicate.compare_op = PAYLOADFIELD_EQ;
+            predicate.value = std::to_wstring(value);
+            return true;
+        }
+
+        inline bool make_payload_predicate(const std::wstring &field, const std::wstring &value, payload_predicate &predicate)
+        {
+            predicate.field = field;
+            predicate.compare_op = PAYLOADFIELD_IS;
+            predicate.value = value;
+            return true;
+        }
+
+        template <typename T>
+        typename std::enable_if<
+            !std::is_integral<T>::value ||
+            std::is_same<T, bool>::value ||
+            std::is_same<T, char>::value ||
+            std::is_same<T, wchar_t>::value, bool>::type
+        make_payload_predicate(const std::wstring &, const T &, payload_predicate &)
+        {
+            return false;
+        }
+    } /* namespace details */
+
+    // Implementation
+    // ------------------------------------------------------------------------
+
+    inline bool operator==(const payload_predicate &lhs, const payload_predicate &rhs)
+    {
+        return lhs.field == rhs.field &&
+               lhs.compare_op == rhs.compare_op &&
+               lhs.value == rhs.value;
+    }
+
+    inline bool filter_pushdown::empty() const
+    {
+        return process_ids.empty() && executable_names.empty() && payload.empty();
+    }
+
+    inline void filter_pushdown::scope_payload(const std::vector<unsigned short> &event_ids)
+    {
+        if (event_ids.empty()) {
+            payload.clear();
+            return;
+        }
+
+        for (auto &filter : payload) {
+            filter.event_ids = event_ids;
+        }
+    }
+
+    inline filter_pushdown filter_pushdown::both(const filter_pushdown &lhs, const filter_pushdown &rhs)
+    {
+        filter_pushdown result = lhs;
+
+        if (result.process_ids.empty()) {
+            result.process_ids = rhs.process_ids;
+        }
+        else if (!rhs.process_ids.empty()) {
+            std::set<ULONG> common;
+            std::set_intersection(
+                lhs.process_ids.begin(), lhs.process_ids.end(),
+                rhs.process_ids.begin(), rhs.process_ids.end(),
+                std::inserter(common, common.end()));
+
+            // Nothing satisfies both, but ETW can't be asked for nothing.
+            if (!common.empty()) {
+                result.process_ids.swap(common);
+            }
+        }
+
+        if (result.executable_names.empty()) {
+            result.executable_names = rhs.executable_names;
+        }
+        else if (!rhs.executable_names.empty()) {
+            std::set<std::wstring> common;
+            std::set_intersection(
+                lhs.executable_names.begin(), lhs.executable_names.end(),
+                rhs.executable_names.begin(), rhs.executable_names.end(),
+                std::inserter(common, common.end()));
+
+            if (!common.empty()) {
+                result.executable_names.swap(common);
+            }
+        }
+
+        if (result.payload.empty()) {
+            result.payload = rhs.payload;
+        }
+        else if (lhs.payload.size() == 1 && rhs.payload.size() == 1 &&
+                 lhs.payload[0].event_ids == rhs.payload[0].event_ids) {
+            // (a or b) and (c or d) is (a and c) or (a and d) or ...
+            const auto &left = lhs.payload[0].clauses;
+            const auto &right = rhs.payload[0].clauses;
+            if (left.size() * right.size() <= details::max_payload_clauses) {
+                std::vector<std::vector<payload_predicate>> clauses;
+                bool fits = true;
+
+                for (const auto &l : left) {
+                    for (const auto &r : right) {
+                        std::vector<payload_predicate> clause = l;
+                        clause.insert(clause.end(), r.begin(), r.end());
+                        fits = fits && clause.size() <= MAX_PAYLOAD_PREDICATES;
+                        clauses.push_back(std::move(clause));
+                    }
+                }
+
+                if (fits) {
+                    result.payload[0].clauses.swap(clauses);
+                }
+            }
+        }
+
+        return result;
+    }
+
+    inline filter_pushdown filter_pushdown::either(const filter_pushdown &lhs, const filter_pushdown &rhs)
+    {
+        filter_pushdown result;
+
+        if (!lhs.process_ids.empty() && !rhs.process_ids.empty()) {
+            result.process_ids = lhs.process_ids;
+            result.process_ids.insert(rhs.process_ids.begin(), rhs.process_ids.end());
+
+            if (result.process_ids.size() > MAX_EVENT_FILTER_PID_COUNT) {
+                result.process_ids.clear();
+            }
+        }
+
+        if (!lhs.executable_names.empty() && !rhs.executable_names.empty()) {
+            result.executable_names = lhs.executable_names;
+            result.executable_names.insert(rhs.executable_names.begin(), rhs.executable_names.end());
+
+            if (!details::executable_names_fit(result.executable_names)) {
+                result.executable_names.clear();
+            }
+        }
+
+        if (!lhs.payload.empty() && !rhs.payload.empty()) {
+            result.payload = lhs.payload;
+            for (const auto &filter : rhs.payload) {
+                auto match = std::find_if(result.payload.begin(), result.payload.end(),
+                    [&](const payload_filter &f) { return f.event_ids == filter.event_ids; });
+
+                if (match == result.payload.end()) {
+                    result.payload.push_back(filter);
+                }
+                else {
+                    match->clauses.insert(match->clauses.end(), filter.clauses.begin(), filter.clauses.end());
+                }
+            }
+
+            size_t clauses = 0;
+            for (const auto &filter : result.payload) {
+                clauses += filter.clauses.size();
+            }
+
+            if (clauses > details::max_payload_clauses) {
+                result.payload.clear();
+            }
+        }
+
+        return result;
+    }
+
+} /* namespace krabs */
@@ -0,0 +1,207 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "compiler_check.hpp"
+
+namespace krabs {
+
+    /**
+     * <summary>
+     * An open-addressing hash table with linear probing, for lookups that
+     * happen on every event. Keys sit inline in one array, so a probe is a
+     * scan of adjacent memory rather than a walk of node pointers. Values
+     * are allocated separately and never move, so references to them stay
+     * valid until they're erased, as with std::unordered_map.
+     * </summary>
+     * <remarks>
+     * Events tend to come in runs from the same provider and id, so the
+     * last key found is remembered and checked before hashing.
+     *
+     * Key needs operator== and a default constructor, and Hash should mix
+     * well in its low bits: the table is a power of two and masks the hash.
+     * </remarks>
+     */
+    template <typename Key, typename T, typename Hash = std::hash<Key>>
+    class flat_table {
+    public:
+        flat_table();
+
+        /**
+         * <summary>
+         * Returns the value for the key, adding a value-initialized one if
+         * there isn't one yet.
+         * </summary>
+         */
+        T &operator[](const Key &key);
+
+        /**
+         * <summary>
+         * Returns the value for the key, or nullptr.
+         * </summary>
+         */
+        T *find(const Key &key) const;
+
+        /**
+         * <summary>
+         * Removes the key. Returns false if it wasn't there.
+         * </summary>
+         */
+        bool erase(const Key &key);
+
+        size_t size() const { return count_; }
+
+        void clear();
+
+    private:
+        struct slot {
+            Key key;
+            std::unique_ptr<T> value;
+        };
+
+        size_t probe(const Key &key) const;
+        size_t home(const Key &key) const;
+        void grow();
+
+        std::vector<slot> slots_;
+        size_t count_;
+
+        mutable Key memo_key_;
+        mutable T *memo_value_;
+    };
+
+    // Implementation
+    // ------------------------------------------------------------------------
+
+    template <typename Key, typename T, typename Hash>
+    flat_table<Key, T, Hash>::flat_table()
+    : slots_(16)
+    , count_(0)
+    , memo_key_()
+    , memo_value_(nullptr)
+    {}
+
+    template <typename Key, typename T, typename Hash>
+    T &flat_table<Key, T, Hash>::operator[](const Key &key)
+    {
+        if (memo_value_ != nullptr && memo_key_ == key) {
+            return *memo_value_;
+        }
+
+        size_t index = probe(key);
+        if (!slots_[index].value) {
+            // Keep the load at three quarters at most so probes stay short.
+            if ((count_ + 1) * 4 > slots_.size() * 3) {
+                grow();
+                index = probe(key);
+            }
+
+            slots_[index].key = key;
+            slots_[index].value.reset(new T());
+            ++count_;
+        }
+
+        memo_key_ = key;
+        memo_value_ = slots_[index].value.get();
+        return *memo_value_;
+    }
+
+    template <typename Key, typename T, typename Hash>
+    T *flat_table<Key, T, Hash>::find(const Key &key) const
+    {
+        if (memo_value_ != nullptr && memo_key_ == key) {
+            return memo_value_;
+        }
+
+        auto value = slots_[probe(key)].value.get();
+        if (value != nullptr) {
+            memo_key_ = key;
+            memo_value_ = value;
+        }
+
+        return value;
+    }
+
+    template <typename Key, typename T, typename Hash>
+    bool flat_table<Key, T, Hash>::erase(const Key &key)
+    {
+        size_t hole = probe(key);
+        if (!slots_[hole].value) {
+            return false;
+        }
+
+        if (memo_value_ == slots_[hole].value.get()) {
+            memo_value_ = nullptr;
+        }
+
+        slots_[hole].value.reset();
+        --count_;
+
+        // Shift back the rest of the run rather than leaving a tombstone,
+        // moving each key that would otherwise be cut off from its home.
+        const size_t mask = slots_.size() - 1;
+        for (size_t next = (hole + 1) & mask; slots_[next].value; next = (next + 1) & mask) {
+            const size_t wanted = home(slots_[next].key);
+            const bool reachable = (hole <= next)
+                ? (hole < wanted && wanted <= next)
+                : (hole < wanted || wanted <= next);
+
+            if (!reachable) {
+                slots_[hole] = std::move(slots_[next]);
+                hole = next;
+            }
+        }
+
+        return true;
+    }
+
+    template <typename Key, typename T, typename Hash>
+    void flat_table<Key, T, Hash>::clear()
+    {
+        for (auto &entry : slots_) {
+            entry.value.reset();
+        }
+
+        count_ = 0;
+        memo_value_ = nullptr;
+    }
+
+    template <typename Key, typename T, typename Hash>
+    size_t flat_table<Key, T, Hash>::probe(const Key &key) const
+    {
+        // Returns the key's slot, or the empty slot it would go in.
+        const size_t mask = slots_.size() - 1;
+        size_t index = home(key);
+        while (slots_[index].value && !(slots_[index].key == key)) {
+            index = (index + 1) & mask;
+        }
+
+        return index;
+    }
+
+    template <typename Key, typename T, typename Hash>
+    size_t flat_table<Key, T, Hash>::home(const Key &key) const
+    {
+        return static_cast<size_t>(Hash()(key)) & (slots_.size() - 1);
+    }
+
+    template <typename Key, typename T, typename Hash>
+    void flat_table<Key, T, Hash>::grow()
+    {
+        std::vector<slot> old(slots_.size() * 2);
+        old.swap(slots_);
+
+        for (auto &entry : old) {
+            if (entry.value) {
+                slots_[probe(entry.key)] = std::move(entry);
+            }
+        }
+    }
+
+} /* namespace krabs */
@@ -0,0 +1,764 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#ifndef  WIN32_LEAN_AND_MEAN
+#define  WIN32_LEAN_AND_MEAN
+#endif
+
+#include <windows.h>
+#include <evntcons.h>
+#include <tdh.h>
+
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "../compiler_check.hpp"
+#include "../event_map.hpp"
+#include "../size_provider.hpp"
+#include "text_writers.hpp"
+
+namespace krabs { namespace format {
+
+    /**
+     * <summary>
+     *   How the value of a property is rendered, decided once per schema
+     *   from the property's TDH in and out types.
+     * </summary>
+     */
+    enum class value_format : uint8_t {
+        signed_int,
+        unsigned_int,
+        hex_int,
+        float32,
+        float64,
+        boolean,
+        pointer,
+        sizet,
+        guid,
+        filetime,
+        systemtime,
+        sid,
+        wbem_sid,
+        ipv4,
+        ipv6,
+        port,
+        socket_address,
+        unicode_string,
+        ansi_string,
+        counted_unicode_string,
+        counted_ansi_string,
+        unicode_char,
+        ansi_char,
+        binary,
+    };
+
+    /**
+     * <summary>
+     *   Where the size of a value comes from, and so where the next value
+     *   starts. Decided once per schema so that walking the user data
+     *   doesn't need to look at the property's flags again.
+     * </summary>
+     */
+    enum class size_source : uint8_t {
+        // property_format::width bytes.
+        fixed,
+
+        // The pointer size of the event.
+        pointer,
+
+        // A SID, whose size is in its header.
+        sid,
+
+        // A TOKEN_USER followed by a SID.
+        wbem_sid,
+
+        // A string ending at its terminator or at the end of the data.
+        terminated,
+
+        // A string preceded by its size in bytes.
+        counted,
+
+        // The value of an earlier integer property, in bytes.
+        length_property,
+
+        // Asked of the size_provider, which may call TDH.
+        lookup,
+    };
+
+    /**
+     * <summary>
+     *   One top level property of a schema, as the formatters see it.
+     * </summary>
+     */
+    struct property_format
+    {
+        // Marks a property that doesn't read or save a length slot.
+        static const uint8_t no_slot = 0xFF;
+
+        std::wstring name;
+
+        // The name as UTF-8, ready to be written out.
+        std::string utf8_name;
+
+        // Index in TRACE_EVENT_INFO::EventPropertyInfoArray.
+        ULONG index;
+
+        value_format format;
+
+        size_source source;
+
+        // Size of the value when source is size_source::fixed.
+        USHORT width;
+
+        // For size_source::length_property, the slot holding the length.
+        uint8_t length_slot;
+
+        // The slot this property's value is saved in because a later
+        // property takes its length from it.
+        uint8_t saved_slot;
+
+        // The value map or bitmap named by the manifest, empty if none.
+        std::wstring map_name;
+
+        // The map itself, once the schema_locator has found it.
+        const event_map *map;
+    };
+
+    /**
+     * <summary>
+     *   What a formatter needs to know about a schema, worked out once from
+     *   its TRACE_EVENT_INFO so that formatting an event is a single pass
+     *   over its user data.
+     * </summary>
+     * <remarks>
+     *   Plans are cached next to their schema; see
+     *   schema_locator::get_format_plan.
+     * </remarks>
+     */
+    struct format_plan
+    {
+        // The most properties of one schema whose values can be used as the
+        // length of a later one. Past that, sizes are looked up.
+        static const uint8_t max_length_slots = 8;
+
+        std::string provider_name;
+        std::string event_name;
+        std::string task_name;
+        std::string opcode_name;
+
+        std::vector<property_format> properties;
+    };
+
+    /**
+     * <summary>
+     *   Builds the plan for the given schema.
+     * </summary>
+     */
+    format_plan make_format_plan(const TRACE_EVENT_INFO &schema);
+
+    namespace details {
+
+        // Returned by property_size when a property doesn't fit.
+        const ULONG bad_size = static_cast<ULONG>(-1);
+
+        /**
+         * <summary>
+         *   Returns the number of bytes the property takes at `at`, or
+         *   bad_size if it runs past `end`. `lengths` holds the saved
+         *   length slots of the event.
+         * </summary>
+         */
+        ULONG property_size(
+            const property_format &property,
+            const EVENT_PROPERTY_INFO &info,
+            const BYTE *at,
+            const BYTE *end,
+            const EVENT_RECORD &record,
+            const uint64_t *lengths);
+
+        /**
+         * <summary>
+         *   Calls `on_value(property, data, size)` for each top level property
+         *   of the record, in order. Stops early (returning false) if the user
+         *   data runs out before the last property.
+         * </summary>
+         */
+        template <typename F>
+        bool for_each_value(
+            const format_plan &plan,
+            const TRACE_EVENT_INFO &schema,
+            const EVENT_RECORD &record,
+            F &&on_value);
+
+        /**
+         * <summary>
+         *   Appends the text of a value. With json set, strings and other
+         *   non-numeric values are quoted and escaped, and non-finite floats
+         *   become null.
+         * </summary>
+         */
+        template <bool json, typename Out>
+        void append_value(
+            Out &out,
+            const property_format &property,
+            const BYTE *data,
+            ULONG size,
+            const EVENT_RECORD &record);
+
+    } /* namespace details */
+
+    // Implementation
+    // ------------------------------------------------------------------------
+
+    namespace details {
+
+        inline std::string to_utf8(const wchar_t *text)
+        {
+            std::string out;
+            append_wide<false>(out, text, wcslen(text));
+            return out;
+        }
+
+        inline const wchar_t *schema_string(const TRACE_EVENT_INFO &schema, ULONG offset)
+        {
+            return offset == 0
+                ? L""
+                : reinterpret_cast<const wchar_t*>(reinterpret_cast<const BYTE*>(&schema) + offset);
+        }
+
+        inline bool is_integer(value_format format)
+        {
+            return format == value_format::signed_int ||
+                   format == value_format::unsigned_int ||
+                   format == value_format::hex_int;
+        }
+
+        inline value_format integer_format(USHORT out_type, bool is_signed)
+        {
+            switch (out_type) {
+            case TDH_OUTTYPE_HEXINT8:
+            case TDH_OUTTYPE_HEXINT16:
+            case TDH_OUTTYPE_HEXINT32:
+            case TDH_OUTTYPE_HEXINT64:
+            case TDH_OUTTYPE_WIN32ERROR:
+            case TDH_OUTTYPE_NTSTATUS:
+            case TDH_OUTTYPE_HRESULT:
+            case TDH_OUTTYPE_ERRORCODE:
+                return value_format::hex_int;
+            default:
+                return is_signed ? value_format::signed_int : value_format::unsigned_int;
+            }
+        }
+
+        inline void classify(const EVENT_PROPERTY_INFO &info, value_format &format, USHORT &width)
+        {
+            format = value_format::binary;
+            width = 0;
+
+            // Arrays and structs are written out as their raw bytes.
+            if ((info.Flags & (PropertyStruct | PropertyParamCount)) != 0 || info.count > 1) {
+                return;
+            }
+
+            const USHORT in_type = info.nonStructType.InType;
+            const USHORT out_type = info.nonStructType.OutType;
+            switch (in_type) {
+            case TDH_INTYPE_INT8:   format = integer_format(out_type, true);  width = 1; break;
+            case TDH_INTYPE_UINT8:  format = integer_format(out_type, false); width = 1; break;
+            case TDH_INTYPE_INT16:  format = integer_format(out_type, true);  width = 2; break;
+            case TDH_INTYPE_UINT16:
+                format = out_type == TDH_OUTTYPE_PORT ? value_format::port : integer_format(out_type, false);
+                width = 2;
+                break;
+            case TDH_INTYPE_INT32:  format = integer_format(out_type, true);  width = 4; break;
+            case TDH_INTYPE_UINT32:
+                format = out_type == TDH_OUTTYPE_IPV4 ? value_format::ipv4 : integer_format(out_type, false);
+                width = 4;
+                break;
+            case TDH_INTYPE_INT64:  format = integer_format(out_type, true);  width = 8; break;
+            case TDH_INTYPE_UINT64: format = integer_format(out_type, false); width = 8; break;
+            case TDH_INTYPE_HEXINT32: format = value_format::hex_int; width = 4; break;
+            case TDH_INTYPE_HEXINT64: format = value_format::hex_int; width = 8; break;
+            case TDH_INTYPE_FLOAT:  format = value_format::float32; width = 4; break;
+            case TDH_INTYPE_DOUBLE: format = value_format::float64; width = 8; break;
+            case TDH_INTYPE_BOOLEAN: format = value_format::boolean; width = 4; break;
+            case TDH_INTYPE_POINTER: format = value_format::pointer; break;
+            case TDH_INTYPE_SIZET:   format = value_format::sizet; break;
+            case TDH_INTYPE_GUID:    format = value_format::guid; width = sizeof(GUID); break;
+            case TDH_INTYPE_FILETIME:   format = value_format::filetime; width = 8; break;
+            case TDH_INTYPE_SYSTEMTIME: format = value_format::systemtime; width = sizeof(SYSTEMTIME); break;
+            case TDH_INTYPE_SID:     format = value_format::sid; break;
+            case TDH_INTYPE_WBEMSID: format = value_format::wbem_sid; break;
+            case TDH_INTYPE_UNICODESTRING:
+            case TDH_INTYPE_NONNULLTERMINATEDSTRING:
+                format = value_format::unicode_string;
+                break;
+            case TDH_INTYPE_ANSISTRING:
+            case TDH_INTYPE_NONNULLTERMINATEDANSISTRING:
+                format = value_format::ansi_string;
+                break;
+            case TDH_INTYPE_COUNTEDSTRING:
+            case TDH_INTYPE_MANIFEST_COUNTEDSTRING:
+                format = value_format::counted_unicode_string;
+                break;
+            case TDH_INTYPE_COUNTEDANSISTRING:
+            case TDH_INTYPE_MANIFEST_COUNTEDANSISTRING:
+                format = value_format::counted_ansi_string;
+                break;
+            case TDH_INTYPE_UNICODECHAR: format = value_format::unicode_char; width = 2; break;
+            case TDH_INTYPE_ANSICHAR:    format = value_format::ansi_char; width = 1; break;
+            case TDH_INTYPE_BINARY:
+                if (out_type == TDH_OUTTYPE_IPV6) {
+                    format = value_format::ipv6;
+                    width = 16;
+                } else if (out_type == TDH_OUTTYPE_SOCKETADDRESS) {
+                    format = value_format::socket_address;
+                }
+                break;
+            default:
+                break;
+            }
+        }
+
+        inline ULONG pointer_size(const EVENT_RECORD &record)
+        {
+            return (record.EventHeader.Flags & EVENT_HEADER_FLAG_32_BIT_HEADER) != 0 ? 4 : 8;
+        }
+
+        inline ULONG sid_size(const BYTE *at, const BYTE *end)
+        {
+            if (end - at < 8) {
+                return bad_size;
+            }
+
+            return 8 + 4 * static_cast<ULONG>(at[1]);
+        }
+
+        inline size_source choose_source(const EVENT_PROPERTY_INFO &info, value_format format, USHORT &width)
+        {
+            if ((info.Flags & (PropertyStruct | PropertyParamCount)) != 0) {
+                return size_source::lookup;
+            }
+
+            if (info.count > 1) {
+                // A fixed count array of fixed width values.
+                value_format element;
+                USHORT element_width;
+                EVENT_PROPERTY_INFO single = info;
+                single.count = 1;
+                classify(single, element, element_width);
+
+                ULONG total = static_cast<ULONG>(element_width) * info.count;
+                if (element_width == 0 || total > USHRT_MAX) {
+                    return size_source::lookup;
+                }
+
+                width = static_cast<USHORT>(total);
+                return size_source::fixed;
+            }
+
+            if (width != 0) {
+                return size_source::fixed;
+            }
+
+            const bool bytes = format == value_format::binary || format == value_format::socket_address;
+            switch (format) {
+            case value_format::pointer:
+            case value_format::sizet:
+                return size_source::pointer;
+            case value_format::sid:
+                return size_source::sid;
+            case value_format::wbem_sid:
+                return size_source::wbem_sid;
+            default:
+                break;
+            }
+
+            if ((info.Flags & PropertyParamLength) != 0) {
+                // String lengths may be in characters; leave those to TDH.
+                return bytes ? size_source::length_property : size_source::lookup;
+            }
+
+            if (info.length > 0) {
+                if (bytes) {
+                    width = info.length;
+                    return size_source::fixed;
+                }
+
+                return size_source::lookup;
+            }
+
+            switch (format) {
+            case value_format::unicode_string:
+            case value_format::ansi_string:
+                return info.Flags == 0 ? size_source::terminated : size_source::lookup;
+            case value_format::counted_unicode_string:
+            case value_format::counted_ansi_string:
+                return info.Flags == 0 ? size_source::counted : size_source::lookup;
+            default:
+                return size_source::lookup;
+            }
+        }
+
+    } /* namespace details */
+
+    inline format_plan make_format_plan(const TRACE_EVENT_INFO &schema)
+    {
+        format_plan plan;
+        plan.provider_name = details::to_utf8(details::schema_string(schema, schema.ProviderNameOffset));
+        plan.event_name    = details::to_utf8(details::schema_string(schema, schema.EventNameOffset));
+        plan.task_name     = details::to_utf8(details::schema_string(schema, schema.TaskNameOffset));
+        plan.opcode_name   = details::to_utf8(details::schema_string(schema, schema.OpcodeNameOffset));
+
+        plan.properties.reserve(schema.TopLevelPropertyCount);
+        uint8_t slots = 0;
+        for (ULONG i = 0; i < schema.TopLevelPropertyCount; ++i) {
+            const auto &info = schema.EventPropertyInfoArray[i];
+
+            property_format property;
+            property.name        = details::schema_string(schema, info.NameOffset);
+            property.utf8_name   = details::to_utf8(property.name.c_str());
+            property.index       = i;
+            property.length_slot = property_format::no_slot;
+            property.saved_slot  = property_format::no_slot;
+            property.map         = nullptr;
+            details::classify(info, property.format, property.width);
+            property.source = details::choose_source(info, property.format, property.width);
+
+            if ((info.Flags & PropertyStruct) == 0 && info.nonStructType.MapNameOffset != 0) {
+                property.map_name = details::schema_string(schema, info.nonStructType.MapNameOffset);
+            }
+
+            if (property.source == size_source::length_property) {
+                // The length has to be an earlier integer we can save while
+                // walking the data.
+                const ULONG from = info.lengthPropertyIndex;
+                property_format *length = from < i ? &plan.properties[from] : nullptr;
+                if (length == nullptr || length->width == 0 || !details::is_integer(length->format)) {
+                    property.source = size_source::lookup;
+                } else if (length->saved_slot != property_format::no_slot) {
+                    property.length_slot = length->saved_slot;
+                } else if (slots < format_plan::max_length_slots) {
+                    length->saved_slot = slots++;
+                    property.length_slot = length->saved_slot;
+                } else {
+                    property.source = size_source::lookup;
+                }
+            }
+
+            plan.properties.push_back(std::move(property));
+        }
+
+        return plan;
+    }
+
+    namespace details {
+
+        template <typename T>
+        T read_value(const BYTE *data)
+        {
+            T value;
+            memcpy(&value, data, sizeof(T));
+            return value;
+        }
+
+        inline uint64_t read_unsigned(const BYTE *data, ULONG size)
+        {
+            switch (size) {
+            case 1: return read_value<uint8_t>(data);
+            case 2: return read_value<uint16_t>(data);
+            case 4: return read_value<uint32_t>(data);
+            case 8: return read_value<uint64_t>(data);
+            default: return 0;
+            }
+        }
+
+        inline int64_t read_signed(const BYTE *data, ULONG size)
+        {
+            switch (size) {
+            case 1: return read_value<int8_t>(data);
+            case 2: return read_value<int16_t>(data);
+            case 4: return read_value<int32_t>(data);
+            case 8: return read_value<int64_t>(data);
+            default: return 0;
+            }
+        }
+
+        inline ULONG property_size(
+            const property_format &property,
+            const EVENT_PROPERTY_INFO &info,
+            const BYTE *at,
+            const BYTE *end,
+            const EVENT_RECORD &record,
+            const uint64_t *lengths)
+        {
+            const size_t left = end - at;
+
+            uint64_t size = 0;
+            switch (property.source) {
+            case size_source::fixed:
+                size = property.width;
+                break;
+            case size_source::pointer:
+                size = pointer_size(record);
+                break;
+            case size_source::sid:
+                size = sid_size(at, end);
+                break;
+            case size_source::wbem_sid: {
+                // A TOKEN_USER (two pointers) followed by the SID.
+                ULONG token_user = 2 * pointer_size(record);
+                size = left < token_user ? bad_size : sid_size(at + token_user, end);
+                size = size == bad_size ? size : size + token_user;
+                break;
+            }
+            case size_source::terminated:
+                if (property.format == value_format::unicode_string) {
+                    // Up to and including the terminator, or to the end of
+                    // the data for a trailing unterminated string.
+                    const BYTE *p = at;
+                    while (end - p >= 2) {
+                        bool terminator = p[0] == 0 && p[1] == 0;
+                        p += 2;
+                        if (terminator) {
+                            break;
+                        }
+                    }
+                    size = p - at;
+                } else {
+                    const BYTE *terminator = static_cast<const BYTE*>(memchr(at, 0, left));
+                    size = terminator ? terminator - at + 1 : left;
+                }
+                break;
+            case size_source::counted: {
+                USHORT length = 0;
+                if (left < sizeof(length)) {
+                    return bad_size;
+                }
+                memcpy(&length, at, sizeof(length));
+                size = sizeof(length) + length;
+                break;
+            }
+            case size_source::length_property:
+                size = lengths[property.length_slot];
+                break;
+            case size_source::lookup:
+                if (left > 0) {
+                    size = size_provider::get_property_size(at, property.name.c_str(), record, info);
+                }
+                break;
+            }
+
+            return size > left ? bad_size : static_cast<ULONG>(size);
+        }
+
+        template <typename F>
+        bool for_each_value(
+            const format_plan &plan,
+            const TRACE_EVENT_INFO &schema,
+            const EVENT_RECORD &record,
+            F &&on_value)
+        {
+            const BYTE *at = static_cast<const BYTE*>(record.UserData);
+            const BYTE *end = at + record.UserDataLength;
+            uint64_t lengths[format_plan::max_length_slots];
+
+            for (const auto &property : plan.properties) {
+                const auto &info = schema.EventPropertyInfoArray[property.index];
+
+                // Providers may leave out a trailing empty string entirely.
+                if (at == end) {
+                    bool string = property.format == value_format::unicode_string ||
+                                  property.format == value_format::ansi_string;
+                    if (!string || &property != &plan.properties.back()) {
+                        return false;
+                    }
+
+                    on_value(property, at, ULONG(0));
+                    return true;
+                }
+
+                ULONG size = property_size(property, info, at, end, record, lengths);
+                if (size == bad_size) {
+                    return false;
+                }
+
+                if (property.saved_slot != property_format::no_slot) {
+                    lengths[property.saved_slot] = read_unsigned(at, size);
+                }
+
+                on_value(property, at, size);
+                at += size;
+            }
+
+            return true;
+        }
+
+        template <bool json, typename Out>
+        bool append_mapped(Out &out, const event_map &map, ULONG value)
+        {
+            const std::wstring *name = nullptr;
+            if (!map.is_bitmap()) {
+                name = map.find(value);
+                if (name == nullptr) {
+                    return false;
+                }
+            }
+
+            if (json) out.push_back('"');
+            if (name != nullptr) {
+                append_wide<json>(out, name->c_str(), name->size());
+            } else {
+                // Set flags as "A | B", with any bits the map doesn't name
+                // after them in hex.
+                bool first = true;
+                ULONG unnamed = map.for_each_set(value, [&](const std::wstring &flag) {
+                    if (!first) {
+                        out.append(" | ", 3);
+                    }
+                    first = false;
+                    append_wide<json>(out, flag.c_str(), flag.size());
+                });
+
+                if (unnamed != 0 || first) {
+                    if (!first) {
+                        out.append(" | ", 3);
+                    }
+                    append_hex(out, unnamed);
+                }
+            }
+            if (json) out.push_back('"');
+            return true;
+        }
+
+        template <bool json, typename Out>
+        void append_value(
+            Out &out,
+            const property_format &property,
+            const BYTE *data,
+            ULONG size,
+            const EVENT_RECORD &record)
+        {
+            const char quote = '"';
+            if (property.map != nullptr && size <= sizeof(ULONG) && is_integer(property.format)) {
+                if (append_mapped<json>(out, *property.map, static_cast<ULONG>(read_unsigned(data, size)))) {
+                    return;
+                }
+            }
+
+            switch (property.format) {
+            case value_format::signed_int:
+                append_int(out, read_signed(data, size));
+                return;
+            case value_format::unsigned_int:
+            case value_format::sizet:
+                append_uint(out, read_unsigned(data, size));
+                return;
+            case value_format::hex_int:
+            case value_format::pointer:
+                if (json) out.push_back(quote);
+                append_hex(out, read_unsigned(data, size));
+                if (json) out.push_back(quote);
+                return;
+            case value_format::float32:
+            case value_format::float64: {
+                double value = property.format == value_format::float32
+                    ? read_value<float>(data)
+                    : read_value<double>(data);
+                if (json && !std::isfinite(value)) {
+                    out.append("null", 4);
+                } else {
+                    append_double(out, value);
+                }
+                return;
+            }
+            case value_format::boolean:
+                if (read_unsigned(data, size) != 0) {
+                    out.append("true", 4);
+                } else {
+                    out.append("false", 5);
+                }
+                return;
+            case value_format::port: {
+                append_uint(out, (static_cast<ULONG>(data[0]) << 8) | data[1]);
+                return;
+            }
+            default:
+                break;
+            }
+
+            // Everything else is text.
+            if (json) out.push_back(quote);
+            switch (property.format) {
+            case value_format::guid:
+                append_guid(out, read_value<GUID>(data));
+                break;
+            case value_format::filetime:
+                append_filetime(out, read_value<uint64_t>(data));
+                break;
+            case value_format::systemtime:
+                append_systemtime(out, read_value<SYSTEMTIME>(data));
+                break;
+            case value_format::sid:
+                if (!append_sid(out, data, size)) {
+                    append_hex_bytes(out, data, size);
+                }
+                break;
+            case value_format::wbem_sid: {
+                ULONG token_user = 2 * pointer_size(record);
+                if (!append_sid(out, data + token_user, size - token_user)) {
+                    append_hex_bytes(out, data, size);
+                }
+                break;
+            }
+            case value_format::ipv4:
+                append_ipv4(out, data);
+                break;
+            case value_format::ipv6:
+                append_ipv6(out, data);
+                break;
+            case value_format::socket_address:
+                if (!append_socket_address(out, data, size)) {
+                    append_hex_bytes(out, data, size);
+                }
+                break;
+            case value_format::unicode_string:
+            case value_format::unicode_char: {
+                // Drop the terminator, if any.
+                size_t count = size / 2;
+                while (count > 0 && data[2 * count - 2] == 0 && data[2 * count - 1] == 0) {
+                    --count;
+                }
+                append_utf16<json>(out, data, count);
+                break;
+            }
+            case value_format::ansi_string:
+            case value_format::ansi_char: {
+                size_t count = size;
+                while (count > 0 && data[count - 1] == 0) {
+                    --count;
+                }
+                append_ansi<json>(out, reinterpret_cast<const char*>(data), count);
+                break;
+            }
+            case value_format::counted_unicode_string:
+                append_utf16<json>(out, data + sizeof(USHORT), (size - sizeof(USHORT)) / 2);
+                break;
+            case value_format::counted_ansi_string:
+                append_ansi<json>(out, reinterpret_cast<const char*>(data + sizeof(USHORT)), size - sizeof(USHORT));
+                break;
+            default:
+                append_hex_bytes(out, data, size);
+                break;
+            }
+            if (json) out.push_back(quote);
+        }
+
+    } /* namespace details */
+
+} /* namespace format */ } /* namespace krabs */
@@ -0,0 +1,265 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#ifndef  WIN32_LEAN_AND_MEAN
+#define  WIN32_LEAN_AND_MEAN
+#endif
+
+#include <windows.h>
+#include <evntcons.h>
+
+#include <string>
+
+#include "../compiler_check.hpp"
+#include "../schema_locator.hpp"
+#include "../trace_context.hpp"
+#include "format_plan.hpp"
+#include "text_writers.hpp"
+
+#ifndef EVENT_HEADER_EXT_TYPE_CONTAINER_ID
+    #define EVENT_HEADER_EXT_TYPE_CONTAINER_ID 16
+#endif
+
+namespace krabs { namespace format {
+
+    /**
+     * <summary>
+     *   Serializes whole events to JSON: the header fields, every top level
+     *   property formatted according to its TDH in and out types, and the
+     *   extended data items.
+     * </summary>
+     * <remarks>
+     *   Output goes into a buffer owned by the serializer that is reused for
+     *   every event, so once it has grown to the size of the largest event
+     *   and the schema_locator holds the plan of every kind of event,
+     *   serializing doesn't allocate. The returned string is only valid
+     *   until the next call. Use one serializer per thread.
+     *
+     *   An event whose schema can't be found is still serialized, with its
+     *   user data as a hex string.
+     * </remarks>
+     * <example>
+     *   krabs::format::json_serializer json;
+     *   provider.add_on_event_callback([&](const EVENT_RECORD &record, const krabs::trace_context &context) {
+     *       const std::string &line = json.serialize(record, context);
+     *       fwrite(line.data(), 1, line.size(), output);
+     *   });
+     * </example>
+     */
+    class json_serializer {
+    public:
+
+        json_serializer();
+
+        /**
+         * <summary>
+         *   Serializes the event, returning UTF-8 JSON without a trailing
+         *   newline.
+         * </summary>
+         */
+        const std::string &serialize(const EVENT_RECORD &record, const krabs::trace_context &context);
+
+    private:
+        void append_header(const EVENT_RECORD &record);
+        void append_extended_data(const EVENT_RECORD &record);
+        template <size_t length>
+        void append_key(const char (&key)[length]);
+        void append_string(const std::string &value);
+
+    private:
+        std::string buffer_;
+    };
+
+    // Implementation
+    // ------------------------------------------------------------------------
+
+    inline json_serializer::json_serializer()
+    : buffer_()
+    {
+        buffer_.reserve(4096);
+    }
+
+    inline const std::string &json_serializer::serialize(
+        const EVENT_RECORD &record,
+        const krabs::trace_context &context)
+    {
+        buffer_.clear();
+        buffer_.push_back('{');
+        append_header(record);
+
+        const TRACE_EVENT_INFO *schema = nullptr;
+        const format_plan *plan = nullptr;
+        try {
+            schema = context.schema_locator.get_event_schema(record);
+            plan = &context.schema_locator.get_format_plan(record);
+        } catch (const std::exception &) {
+            // Serialized without property names below.
+        }
+
+        if (plan != nullptr) {
+            append_key(",\"provider_name\":");
+            append_string(plan->provider_name);
+            append_key(",\"event_name\":");
+            append_string(plan->event_name);
+            append_key(",\"task_name\":");
+            append_string(plan->task_name);
+            append_key(",\"opcode_name\":");
+            append_string(plan->opcode_name);
+
+            append_key(",\"properties\":{");
+            bool first = true;
+            details::for_each_value(*plan, *schema, record,
+                [&](const property_format &property, const BYTE *data, ULONG size) {
+                    if (!first) {
+                        buffer_.push_back(',');
+                    }
+                    first = false;
+
+                    append_string(property.utf8_name);
+                    buffer_.push_back(':');
+                    details::append_value<true>(buffer_, property, data, size, record);
+                });
+            buffer_.push_back('}');
+        } else {
+            append_key(",\"user_data\":\"");
+            details::append_hex_bytes(buffer_, static_cast<const BYTE*>(record.UserData), record.UserDataLength);
+            buffer_.push_back('"');
+        }
+
+        if (record.ExtendedDataCount > 0) {
+            append_extended_data(record);
+        }
+
+        buffer_.push_back('}');
+        return buffer_;
+    }
+
+    inline void json_serializer::append_header(const EVENT_RECORD &record)
+    {
+        const auto &header = record.EventHeader;
+        const auto &descriptor = header.EventDescriptor;
+
+        append_key("\"provider_id\":\"");
+        details::append_guid(buffer_, header.ProviderId);
+        append_key("\",\"id\":");
+        details::append_uint(buffer_, descriptor.Id);
+        append_key(",\"version\":");
+        details::append_uint(buffer_, descriptor.Version);
+        append_key(",\"opcode\":");
+        details::append_uint(buffer_, descriptor.Opcode);
+        append_key(",\"level\":");
+        details::append_uint(buffer_, descriptor.Level);
+        append_key(",\"task\":");
+        details::append_uint(buffer_, descriptor.Task);
+        append_key(",\"keywords\":\"");
+        details::append_hex(buffer_, descriptor.Keyword);
+        append_key("\",\"timestamp\":");
+        details::append_int(buffer_, header.TimeStamp.QuadPart);
+        append_key(",\"process_id\":");
+        details::append_uint(buffer_, header.ProcessId);
+        append_key(",\"thread_id\":");
+        details::append_uint(buffer_, header.ThreadId);
+        append_key(",\"activity_id\":\"");
+        details::append_guid(buffer_, header.ActivityId);
+        buffer_.push_back('"');
+    }
+
+    inline void json_serializer::append_extended_data(const EVENT_RECORD &record)
+    {
+        append_key(",\"extended_data\":[");
+        for (USHORT i = 0; i < record.ExtendedDataCount; ++i) {
+            const auto &item = record.ExtendedData[i];
+            auto data = reinterpret_cast<const BYTE*>(item.DataPtr);
+            const ULONG size = item.DataSize;
+
+            if (i > 0) {
+                buffer_.push_back(',');
+            }
+            append_key("{\"type\":");
+            details::append_uint(buffer_, item.ExtType);
+            append_key(",\"value\":");
+
+            bool decoded = true;
+            switch (item.ExtType) {
+            case EVENT_HEADER_EXT_TYPE_RELATED_ACTIVITYID:
+                decoded = size == sizeof(GUID);
+                if (decoded) {
+                    buffer_.push_back('"');
+                    details::append_guid(buffer_, details::read_value<GUID>(data));
+                    buffer_.push_back('"');
+                }
+                break;
+            case EVENT_HEADER_EXT_TYPE_SID:
+                buffer_.push_back('"');
+                if (!details::append_sid(buffer_, data, size)) {
+                    details::append_hex_bytes(buffer_, data, size);
+                }
+                buffer_.push_back('"');
+                break;
+            case EVENT_HEADER_EXT_TYPE_TS_ID:
+            case EVENT_HEADER_EXT_TYPE_EVENT_KEY:
+            case EVENT_HEADER_EXT_TYPE_PROCESS_START_KEY:
+                decoded = size == sizeof(ULONG) || size == sizeof(ULONG64);
+                if (decoded) {
+                    details::append_uint(buffer_, details::read_unsigned(data, size));
+                }
+                break;
+            case EVENT_HEADER_EXT_TYPE_STACK_TRACE32:
+            case EVENT_HEADER_EXT_TYPE_STACK_TRACE64: {
+                // The match id, then the return addresses.
+                decoded = size >= sizeof(ULONG64);
+                if (decoded) {
+                    const ULONG width = item.ExtType == EVENT_HEADER_EXT_TYPE_STACK_TRACE32 ? 4 : 8;
+                    buffer_.push_back('[');
+                    for (ULONG offset = sizeof(ULONG64); offset + width <= size; offset += width) {
+                        if (offset > sizeof(ULONG64)) {
+                            buffer_.push_back(',');
+                        }
+                        buffer_.push_back('"');
+                        details::append_hex(buffer_, details::read_unsigned(data + offset, width));
+                        buffer_.push_back('"');
+                    }
+                    append_key("],\"match_id\":");
+                    details::append_uint(buffer_, details::read_value<ULONG64>(data));
+                }
+                break;
+            }
+            case EVENT_HEADER_EXT_TYPE_CONTAINER_ID:
+                // The container id is stored as text.
+                buffer_.push_back('"');
+                details::append_ansi<true>(buffer_, reinterpret_cast<const char*>(data), size);
+                buffer_.push_back('"');
+                break;
+            default:
+                decoded = false;
+                break;
+            }
+
+            if (!decoded) {
+                buffer_.push_back('"');
+                details::append_hex_bytes(buffer_, data, size);
+                buffer_.push_back('"');
+            }
+
+            buffer_.push_back('}');
+        }
+
+        buffer_.push_back(']');
+    }
+
+    template <size_t length>
+    void json_serializer::append_key(const char (&key)[length])
+    {
+        buffer_.append(key, length - 1);
+    }
+
+    inline void json_serializer::append_string(const std::string &value)
+    {
+        buffer_.push_back('"');
+        details::append_utf8<true>(buffer_, value.data(), value.size());
+        buffer_.push_back('"');
+    }
+
+} /* namespace format */ } /* namespace krabs */
@@ -0,0 +1,194 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#ifndef  WIN32_LEAN_AND_MEAN
+#define  WIN32_LEAN_AND_MEAN
+#endif
+
+#include <windows.h>
+#include <evntcons.h>
+
+#include <cstring>
+
+#include "../compiler_check.hpp"
+#include "../schema_locator.hpp"
+#include "../trace_context.hpp"
+#include "format_plan.hpp"
+#include "text_writers.hpp"
+
+namespace krabs { namespace format {
+
+    /**
+     * <summary>
+     *   Renders an event as a single line of text into a caller supplied
+     *   buffer, like snprintf: at most capacity - 1 characters are written,
+     *   followed by a terminator, and the return value is the length the
+     *   whole line needs.
+     * </summary>
+     * <remarks>
+     *   The line is the provider name and event id, the process and thread
+     *   ids, then Name=Value for every top level property:
+     *
+     *     Microsoft-Windows-WinINet/1057 pid=4 tid=8 URL=https://bing.com Status=200
+     *
+     *   Values are formatted through the schema's format_plan, which the
+     *   schema_locator builds the first time it sees the schema, so
+     *   rendering is a single pass over the user data that neither allocates
+     *   nor calls TDH for fixed size and terminated values. Integers whose
+     *   out type is hexadecimal or an error code are written in hex, and
+     *   GUIDs, SIDs, IP addresses, FILETIMEs, SYSTEMTIMEs and booleans are
+     *   written the way Windows displays them. Strings are written as is.
+     *
+     *   An event whose schema can't be found is written with its provider
+     *   id and its user data in hex.
+     * </remarks>
+     * <example>
+     *   char line[1024];
+     *   provider.add_on_event_callback([&](const EVENT_RECORD &record, const krabs::trace_context &context) {
+     *       if (krabs::format::format_event(record, context, line, sizeof(line)) < sizeof(line)) {
+     *           puts(line);
+     *       }
+     *   });
+     * </example>
+     */
+    size_t format_event(
+        const EVENT_RECORD &record,
+        const krabs::trace_context &context,
+        char *buffer,
+        size_t capacity);
+
+    /**
+     * <summary>
+     *   Appends the same line to anything with append(const char*, size_t)
+     *   and push_back(char), such as a std::string.
+     * </summary>
+     */
+    template <typename Out>
+    void format_event(const EVENT_RECORD &record, const krabs::trace_context &context, Out &out);
+
+    namespace details {
+
+        /**
+         * <summary>
+         *   Writes into a fixed buffer, keeping count of what didn't fit.
+         * </summary>
+         */
+        class buffer_writer {
+        public:
+            buffer_writer(char *buffer, size_t capacity);
+
+            void append(const char *text, size_t length);
+            void push_back(char c);
+
+            /**
+             * <summary>
+             *   Terminates the text and returns the length it needed.
+             * </summary>
+             */
+            size_t finish();
+
+        private:
+            char *buffer_;
+            size_t capacity_;
+            size_t size_;
+        };
+
+    } /* namespace details */
+
+    // Implementation
+    // ------------------------------------------------------------------------
+
+    namespace details {
+
+        inline buffer_writer::buffer_writer(char *buffer, size_t capacity)
+        : buffer_(buffer)
+        , capacity_(capacity)
+        , size_(0)
+        {}
+
+        inline void buffer_writer::append(const char *text, size_t length)
+        {
+            if (size_ < capacity_) {
+                size_t fits = capacity_ - size_;
+                memcpy(buffer_ + size_, text, length < fits ? length : fits);
+            }
+
+            size_ += length;
+        }
+
+        inline void buffer_writer::push_back(char c)
+        {
+            if (size_ < capacity_) {
+                buffer_[size_] = c;
+            }
+
+            ++size_;
+        }
+
+        inline size_t buffer_writer::finish()
+        {
+            if (capacity_ > 0) {
+                buffer_[size_ < capacity_ ? size_ : capacity_ - 1] = '\0';
+            }
+
+            return size_;
+        }
+
+    } /* namespace details */
+
+    inline size_t format_event(
+        const EVENT_RECORD &record,
+        const krabs::trace_context &context,
+        char *buffer,
+        size_t capacity)
+    {
+        details::buffer_writer out(buffer, capacity);
+        format_event(record, context, out);
+        return out.finish();
+    }
+
+    template <typename Out>
+    void format_event(const EVENT_RECORD &record, const krabs::trace_context &context, Out &out)
+    {
+        const auto &header = record.EventHeader;
+
+        const TRACE_EVENT_INFO *schema = nullptr;
+        const format_plan *plan = nullptr;
+        try {
+            schema = context.schema_locator.get_event_schema(record);
+            plan = &context.schema_locator.get_format_plan(record);
+        } catch (const std::exception &) {
+            // Written with the provider id and raw user data below.
+        }
+
+        if (plan != nullptr && !plan->provider_name.empty()) {
+            out.append(plan->provider_name.data(), plan->provider_name.size());
+        } else {
+            details::append_guid(out, header.ProviderId);
+        }
+
+        out.push_back('/');
+        details::append_uint(out, header.EventDescriptor.Id);
+        details::append_literal(out, " pid=");
+        details::append_uint(out, header.ProcessId);
+        details::append_literal(out, " tid=");
+        details::append_uint(out, header.ThreadId);
+
+        if (plan == nullptr) {
+            details::append_literal(out, " user_data=");
+            details::append_hex_bytes(out, static_cast<const BYTE*>(record.UserData), record.UserDataLength);
+            return;
+        }
+
+        details::for_each_value(*plan, *schema, record,
+            [&](const property_format &property, const BYTE *data, ULONG size) {
+                out.push_back(' ');
+                out.append(property.utf8_name.data(), property.utf8_name.size());
+                out.push_back('=');
+                details::append_value<false>(out, property, data, size, record);
+            });
+    }
+
+} /* namespace format */ } /* namespace krabs */
@@ -0,0 +1,649 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#ifndef  WIN32_LEAN_AND_MEAN
+#define  WIN32_LEAN_AND_MEAN
+#endif
+
+#include <windows.h>
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include "../compiler_check.hpp"
+
+namespace krabs { namespace format { namespace details {
+
+    // These append the text form of a value to an output without allocating
+    // (beyond what the output itself does). The output can be any type with
+    // append(const char *, size_t) and push_back(char), such as std::string.
+    // Text is UTF-8.
+
+    template <typename Out>
+    void append_literal(Out &out, const char *text);
+
+    template <typename Out>
+    void append_uint(Out &out, uint64_t value);
+
+    template <typename Out>
+    void append_int(Out &out, int64_t value);
+
+    /** <summary>Appends 0x followed by upper case hex digits.</summary> */
+    template <typename Out>
+    void append_hex(Out &out, uint64_t value);
+
+    /** <summary>Appends 0x followed by two hex digits per byte.</summary> */
+    template <typename Out>
+    void append_hex_bytes(Out &out, const BYTE *data, size_t size);
+
+    /**
+     * <summary>
+     *   Appends a finite double with enough digits to round trip. Callers
+     *   decide what to do with NaN and infinities.
+     * </summary>
+     */
+    template <typename Out>
+    void append_double(Out &out, double value);
+
+    /** <summary>Appends a GUID the way StringFromCLSID formats it.</summary> */
+    template <typename Out>
+    void append_guid(Out &out, const GUID &guid);
+
+    /**
+     * <summary>
+     *   Appends a binary SID in its S-1-... form. Returns false, appending
+     *   nothing, if the bytes aren't a well formed SID.
+     * </summary>
+     */
+    template <typename Out>
+    bool append_sid(Out &out, const BYTE *data, size_t size);
+
+    /** <summary>Appends an IPv4 address stored in network order.</summary> */
+    template <typename Out>
+    void append_ipv4(Out &out, const BYTE *address);
+
+    /**
+     * <summary>
+     *   Appends an IPv6 address in its RFC 5952 form (lower case, longest
+     *   run of zero groups compressed).
+     * </summary>
+     */
+    template <typename Out>
+    void append_ipv6(Out &out, const BYTE *address);
+
+    /**
+     * <summary>
+     *   Appends a SOCKADDR_IN or SOCKADDR_IN6 as address:port. Returns false,
+     *   appending nothing, for other families or short buffers.
+     * </summary>
+     */
+    template <typename Out>
+    bool append_socket_address(Out &out, const BYTE *data, size_t size);
+
+    /**
+     * <summary>
+     *   Appends a FILETIME as an ISO 8601 UTC date and time with 100ns
+     *   precision.
+     * </summary>
+     */
+    template <typename Out>
+    void append_filetime(Out &out, uint64_t filetime);
+
+    /** <summary>Appends a SYSTEMTIME as an ISO 8601 date and time.</summary> */
+    template <typename Out>
+    void append_systemtime(Out &out, const SYSTEMTIME &time);
+
+    /**
+     * <summary>
+     *   Converts `count` UTF-16 code units to UTF-8. The data doesn't need to
+     *   be aligned, as is often the case for strings in event data. With
+     *   json set, quotes, backslashes and control characters are escaped.
+     *   Unpaired surrogates become U+FFFD.
+     * </summary>
+     */
+    template <bool json, typename Out>
+    void append_utf16(Out &out, const BYTE *data, size_t count);
+
+    /**
+     * <summary>
+     *   Converts a wide string to UTF-8, like append_utf16.
+     * </summary>
+     */
+    template <bool json, typename Out>
+    void append_wide(Out &out, const wchar_t *text, size_t count);
+
+    /**
+     * <summary>
+     *   Appends a string in the ANSI code page. Bytes above 0x7F are taken
+     *   as Latin-1, which keeps the output valid UTF-8 without a code page
+     *   conversion.
+     * </summary>
+     */
+    template <bool json, typename Out>
+    void append_ansi(Out &out, const char *text, size_t count);
+
+    /**
+     * <summary>
+     *   Appends text that is already UTF-8, escaping it if json is set.
+     * </summary>
+     */
+    template <bool json, typename Out>
+    void append_utf8(Out &out, const char *text, size_t count);
+
+    // Implementation
+    // ------------------------------------------------------------------------
+
+    const char hex_digits[] = "0123456789ABCDEF";
+    const char lower_hex_digits[] = "0123456789abcdef";
+
+    template <typename Out>
+    void append_literal(Out &out, const char *text)
+    {
+        out.append(text, strlen(text));
+    }
+
+    template <typename Out>
+    void append_uint(Out &out, uint64_t value)
+    {
+        char digits[20];
+        size_t count = 0;
+        do {
+            digits[sizeof(digits) - ++count] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        } while (value != 0);
+
+        out.append(digits + sizeof(digits) - count, count);
+    }
+
+    template <typename Out>
+    void append_int(Out &out, int64_t value)
+    {
+        if (value < 0) {
+            out.push_back('-');
+            append_uint(out, 0 - static_cast<uint64_t>(value));
+        } else {
+            append_uint(out, static_cast<uint64_t>(value));
+        }
+    }
+
+    template <typename Out>
+    void append_hex(Out &out, uint64_t value)
+    {
+        char digits[18];
+        size_t count = 0;
+        do {
+            digits[sizeof(digits) - ++count] = hex_digits[value & 0xF];
+            value >>= 4;
+        } while (value != 0);
+
+        digits[sizeof(digits) - ++count] = 'x';
+        digits[sizeof(digits) - ++count] = '0';
+        out.append(digits + sizeof(digits) - count, count);
+    }
+
+    template <typename Out>
+    void append_hex_bytes(Out &out, const BYTE *data, size_t size)
+    {
+        out.append("0x", 2);
+
+        char digits[64];
+        while (size > 0) {
+            size_t chunk = size < sizeof(digits) / 2 ? size : sizeof(digits) / 2;
+            for (size_t i = 0; i < chunk; ++i) {
+                digits[2 * i] = hex_digits[data[i] >> 4];
+                digits[2 * i + 1] = hex_digits[data[i] & 0xF];
+            }
+
+            out.append(digits, 2 * chunk);
+            data += chunk;
+            size -= chunk;
+        }
+    }
+
+    template <typename Out>
+    void append_double(Out &out, double value)
+    {
+        char digits[32];
+        int count = snprintf(digits, sizeof(digits), "%.17g", value);
+        if (count > 0) {
+            out.append(digits, static_cast<size_t>(count));
+        }
+    }
+
+    template <typename Out>
+    void append_guid(Out &out, const GUID &guid)
+    {
+        char text[38];
+        char *p = text;
+        auto put = [&](uint64_t value, int digits) {
+            for (int shift = (digits - 1) * 4; shift >= 0; shift -= 4) {
+                *p++ = hex_digits[(value >> shift) & 0xF];
+            }
+        };
+
+        *p++ = '{';
+        put(guid.Data1, 8);
+        *p++ = '-';
+        put(guid.Data2, 4);
+        *p++ = '-';
+        put(guid.Data3, 4);
+        *p++ = '-';
+        put(guid.Data4[0], 2);
+        put(guid.Data4[1], 2);
+        *p++ = '-';
+        for (int i = 2; i < 8; ++i) {
+            put(guid.Data4[i], 2);
+        }
+        *p++ = '}';
+
+        out.append(text, sizeof(text));
+    }
+
+    template <typename Out>
+    bool append_sid(Out &out, const BYTE *data, size_t size)
+    {
+        // Revision, sub authority count, 48 bit big endian authority, then
+        // the sub authorities.
+        if (size < 8 || data[0] != 1 || size < 8 + 4 * static_cast<size_t>(data[1])) {
+            return false;
+        }
+
+        uint64_t authority = 0;
+        for (int i = 2; i < 8; ++i) {
+            authority = (authority << 8) | data[i];
+        }
+
+        out.append("S-1-", 4);
+        if (authority < 0x100000000ULL) {
+            append_uint(out, authority);
+        } else {
+            append_hex(out, authority);
+        }
+
+        for (size_t i = 0; i < data[1]; ++i) {
+            ULONG sub_authority;
+            memcpy(&sub_authority, data + 8 + 4 * i, sizeof(sub_authority));
+            out.push_back('-');
+            append_uint(out, sub_authority);
+        }
+
+        return true;
+    }
+
+    template <typename Out>
+    void append_ipv4(Out &out, const BYTE *address)
+    {
+        for (int i = 0; i < 4; ++i) {
+            if (i > 0) {
+                out.push_back('.');
+            }
+            append_uint(out, address[i]);
+        }
+    }
+
+    template <typename Out>
+    void append_ipv6(Out &out, const BYTE *address)
+    {
+        USHORT groups[8];
+        for (int i = 0; i < 8; ++i) {
+            groups[i] = static_cast<USHORT>((address[2 * i] << 8) | address[2 * i + 1]);
+        }
+
+        // Find the longest run of two or more zero groups; it becomes "::".
+        int best_start = -1;
+        int best_length = 1;
+        for (int i = 0; i < 8;) {
+            if (groups[i] != 0) {
+                ++i;
+                continue;
+            }
+
+            int start = i;
+            while (i < 8 && groups[i] == 0) {
+                ++i;
+            }
+            if (i - start > best_length) {
+                best_start = start;
+                best_length = i - start;
+            }
+        }
+
+        for (int i = 0; i < 8; ++i) {
+            if (i == best_start) {
+                out.append("::", 2);
+                i += best_length - 1;
+                continue;
+            }
+
+            if (i > 0 && i != best_start + best_length) {
+                out.push_back(':');
+            }
+
+            char digits[4];
+            size_t count = 0;
+            USHORT value = groups[i];
+            do {
+                digits[sizeof(digits) - ++count] = lower_hex_digits[value & 0xF];
+                value >>= 4;
+            } while (value != 0);
+            out.append(digits + sizeof(digits) - count, count);
+        }
+    }
+
+    template <typename Out>
+    bool append_socket_address(Out &out, const BYTE *data, size_t size)
+    {
+        // SOCKADDR_IN: family, port (network order), address.
+        // SOCKADDR_IN6: family, port, flow info, address, scope id.
+        if (size < 8) {
+            return false;
+        }
+
+        USHORT family;
+        memcpy(&family, data, sizeof(family));
+        ULONG port = (data[2] << 8) | data[3];
+
+        if (family == 2 /* AF_INET */) {
+            append_ipv4(out, data + 4);
+            out.push_back(':');
+        } else if (family == 23 /* AF_INET6 */ && size >= 24) {
+            out.push_back('[');
+            append_ipv6(out, data + 8);
+            out.append("]:", 2);
+        } else {
+            return false;
+        }
+
+        append_uint(out, port);
+        return true;
+    }
+
+    template <typename Out>
+    void append_two_digits(Out &out, unsigned value)
+    {
+        char digits[2] = { static_cast<char>('0' + value / 10 % 10), static_cast<char>('0' + value % 10) };
+        out.append(digits, 2);
+    }
+
+    template <typename Out>
+    void append_date(Out &out, int64_t year, unsigned month, unsigned day)
+    {
+        if (year >= 0 && year < 10000) {
+            append_two_digits(out, static_cast<unsigned>(year / 100));
+            append_two_digits(out, static_cast<unsigned>(year % 100));
+        } else {
+            append_int(out, year);
+        }
+
+        out.push_back('-');
+        append_two_digits(out, month);
+        out.push_back('-');
+        append_two_digits(out, day);
+    }
+
+    template <typename Out>
+    void append_filetime(Out &out, uint64_t filetime)
+    {
+        const uint64_t ticks_per_second = 10000000;
+        const uint64_t seconds_per_day = 86400;
+
+        uint64_t seconds = filetime / ticks_per_second;
+        uint64_t fraction = filetime % ticks_per_second;
+
+        // FILETIME counts from 1601-01-01; convert the day number to a civil
+        // date (http://howardhinnant.github.io/date_algorithms.html).
+        int64_t days = static_cast<int64_t>(seconds / seconds_per_day) - 134774 + 719468;
+        uint64_t time = seconds % seconds_per_day;
+
+        int64_t era = days / 146097;
+        int64_t day_of_era = days - era * 146097;
+        int64_t year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+        int64_t day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+        int64_t shifted_month = (5 * day_of_year + 2) / 153;
+        unsigned day = static_cast<unsigned>(day_of_year - (153 * shifted_month + 2) / 5 + 1);
+        unsigned month = static_cast<unsigned>(shifted_month < 10 ? shifted_month + 3 : shifted_month - 9);
+        int64_t year = year_of_era + era * 400 + (month <= 2 ? 1 : 0);
+
+        append_date(out, year, month, day);
+        out.push_back('T');
+        append_two_digits(out, static_cast<unsigned>(time / 3600));
+        out.push_back(':');
+        append_two_digits(out, static_cast<unsigned>(time / 60 % 60));
+        out.push_back(':');
+        append_two_digits(out, static_cast<unsigned>(time % 60));
+
+        char digits[8] = { '.' };
+        for (int i = 7; i >= 1; --i) {
+            digits[i] = static_cast<char>('0' + fraction % 10);
+            fraction /= 10;
+        }
+        out.append(digits, sizeof(digits));
+        out.push_back('Z');
+    }
+
+    template <typename Out>
+    void append_systemtime(Out &out, const SYSTEMTIME &time)
+    {
+        append_date(out, time.wYear, time.wMonth, time.wDay);
+        out.push_back('T');
+        append_two_digits(out, time.wHour);
+        out.push_back(':');
+        append_two_digits(out, time.wMinute);
+        out.push_back(':');
+        append_two_digits(out, time.wSecond);
+        out.push_back('.');
+        append_two_digits(out, time.wMilliseconds / 10);
+        out.push_back(static_cast<char>('0' + time.wMilliseconds % 10));
+    }
+
+    template <typename Out>
+    void append_escaped(Out &out, uint32_t c)
+    {
+        switch (c) {
+        case '"':  out.append("\\\"", 2); return;
+        case '\\': out.append("\\\\", 2); return;
+        case '\n': out.append("\\n", 2); return;
+        case '\r': out.append("\\r", 2); return;
+        case '\t': out.append("\\t", 2); return;
+        case '\b': out.append("\\b", 2); return;
+        case '\f': out.append("\\f", 2); return;
+        default: {
+            char escape[6] = { '\\', 'u', '0', '0', hex_digits[(c >> 4) & 0xF], hex_digits[c & 0xF] };
+            out.append(escape, sizeof(escape));
+            return;
+        }
+        }
+    }
+
+    template <typename Out>
+    void append_code_point(Out &out, uint32_t c)
+    {
+        char bytes[4];
+        if (c < 0x800) {
+            bytes[0] = static_cast<char>(0xC0 | (c >> 6));
+            bytes[1] = static_cast<char>(0x80 | (c & 0x3F));
+            out.append(bytes, 2);
+        } else if (c < 0x10000) {
+            bytes[0] = static_cast<char>(0xE0 | (c >> 12));
+            bytes[1] = static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+            bytes[2] = static_cast<char>(0x80 | (c & 0x3F));
+            out.append(bytes, 3);
+        } else {
+            bytes[0] = static_cast<char>(0xF0 | (c >> 18));
+            bytes[1] = static_cast<char>(0x80 | ((c >> 12) & 0x3F));
+            bytes[2] = static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+            bytes[3] = static_cast<char>(0x80 | (c & 0x3F));
+            out.append(bytes, 4);
+        }
+    }
+
+    template <bool json>
+    inline bool needs_escape(uint32_t c)
+    {
+        return json && (c < 0x20 || c == '"' || c == '\\');
+    }
+
+    /**
+     * <summary>
+     *   Returns whether all four UTF-16 units packed into a 64 bit word are
+     *   plain ASCII that needs no escaping. Checking four lanes at a time
+     *   keeps the common all-ASCII case to a handful of integer operations
+     *   per four characters.
+     * </summary>
+     */
+    template <bool json>
+    inline bool plain_ascii4(uint64_t units)
+    {
+        const uint64_t ones = 0x0001000100010001ULL;
+        const uint64_t highs = 0x8000800080008000ULL;
+
+        uint64_t special = units & 0xFF80FF80FF80FF80ULL;
+        if (json) {
+            // A lane is below 0x20, or equal to '"' or '\\', when the
+            // subtraction borrows into its high bit. Borrows only spill over
+            // past lanes that already matched, so "any" is exact.
+            uint64_t quote = units ^ (ones * '"');
+            uint64_t backslash = units ^ (ones * '\\');
+            special |= (units - ones * 0x20) & ~units & highs;
+            special |= (quote - ones) & ~quote & highs;
+            special |= (backslash - ones) & ~backslash & highs;
+        }
+
+        return special == 0;
+    }
+
+    template <typename Out>
+    void append_wide_char(Out &out, uint32_t c, uint32_t next, size_t &consumed)
+    {
+        consumed = 1;
+        if (c >= 0xD800 && c <= 0xDFFF) {
+            if (c <= 0xDBFF && next >= 0xDC00 && next <= 0xDFFF) {
+                c = 0x10000 + ((c - 0xD800) << 10) + (next - 0xDC00);
+                consumed = 2;
+            } else {
+                c = 0xFFFD;
+            }
+        }
+
+        append_code_point(out, c);
+    }
+
+    template <bool json, typename Out>
+    void append_utf16(Out &out, const BYTE *data, size_t count)
+    {
+        auto unit = [&](size_t i) -> uint32_t {
+            return i < count ? static_cast<uint32_t>(data[2 * i] | (data[2 * i + 1] << 8)) : 0;
+        };
+
+        char ascii[64];
+        size_t i = 0;
+        while (i < count) {
+            // Copy runs of plain ASCII in blocks, four characters at a time
+            // while that lasts.
+            size_t run = 0;
+            while (i + run + 4 <= count && run + 4 <= sizeof(ascii)) {
+                uint64_t units;
+                memcpy(&units, data + 2 * (i + run), sizeof(units));
+                if (!plain_ascii4<json>(units)) {
+                    break;
+                }
+
+                ascii[run]     = static_cast<char>(units);
+                ascii[run + 1] = static_cast<char>(units >> 16);
+                ascii[run + 2] = static_cast<char>(units >> 32);
+                ascii[run + 3] = static_cast<char>(units >> 48);
+                run += 4;
+            }
+
+            while (i + run < count && run < sizeof(ascii)) {
+                uint32_t c = unit(i + run);
+                if (c >= 0x80 || needs_escape<json>(c)) {
+                    break;
+                }
+                ascii[run++] = static_cast<char>(c);
+            }
+
+            if (run > 0) {
+                out.append(ascii, run);
+                i += run;
+                continue;
+            }
+
+            uint32_t c = unit(i);
+            if (c < 0x80) {
+                append_escaped(out, c);
+                ++i;
+                continue;
+            }
+
+            size_t consumed = 0;
+            append_wide_char(out, c, unit(i + 1), consumed);
+            i += consumed;
+        }
+    }
+
+    template <bool json, typename Out>
+    void append_wide(Out &out, const wchar_t *text, size_t count)
+    {
+        size_t i = 0;
+        while (i < count) {
+            uint32_t c = static_cast<uint32_t>(text[i]);
+            if (c < 0x80) {
+                if (needs_escape<json>(c)) {
+                    append_escaped(out, c);
+                } else {
+                    out.push_back(static_cast<char>(c));
+                }
+                ++i;
+                continue;
+            }
+
+            size_t consumed = 0;
+            append_wide_char(out, c, i + 1 < count ? static_cast<uint32_t>(text[i + 1]) : 0, consumed);
+            i += consumed;
+        }
+    }
+
+    template <bool json, typename Out>
+    void append_utf8(Out &out, const char *text, size_t count)
+    {
+        size_t start = 0;
+        for (size_t i = 0; i < count; ++i) {
+            auto c = static_cast<uint32_t>(static_cast<unsigned char>(text[i]));
+            if (needs_escape<json>(c)) {
+                out.append(text + start, i - start);
+                start = i + 1;
+                append_escaped(out, c);
+            }
+        }
+
+        out.append(text + start, count - start);
+    }
+
+    template <bool json, typename Out>
+    void append_ansi(Out &out, const char *text, size_t count)
+    {
+        size_t start = 0;
+        for (size_t i = 0; i < count; ++i) {
+            auto c = static_cast<uint32_t>(static_cast<unsigned char>(text[i]));
+            if (c < 0x80 && !needs_escape<json>(c)) {
+                continue;
+            }
+
+            out.append(text + start, i - start);
+            start = i + 1;
+            if (c < 0x80) {
+                append_escaped(out, c);
+            } else {
+                append_code_point(out, c);
+            }
+        }
+
+        out.append(text + start, count - start);
+    }
+
+} /* namespace details */ } /* namespace format */ } /* namespace krabs */
@@ -15,6 +15,8 @@
 #include <sstream>
 #include <iomanip>
 #include <cassert>
+#include <cstdint>
+#include <cstring>
 
 #include "compiler_check.hpp"
 
@@ -97,6 +99,27 @@ namespace krabs {
           * </summary>
           */
         static GUID parse_guid(const char* str, unsigned int length);
+
+        /** <summary>
+          * Parses a GUID literal of "D" format, with or without braces, at compile time when the
+          * result is used as a constant. A malformed literal then fails to compile; otherwise it
+          * throws a std::runtime_error, like parse_guid.
+          * </summary>
+          * <example>
+          *    constexpr GUID powershell = krabs::guid_parser::parse_guid_literal("{A0C1853B-5C40-4B15-8766-3CF1C58F985A}");
+          * </example>
+          */
+        template <size_t N>
+        static constexpr GUID parse_guid_literal(const char (&str)[N]);
+
+    private:
+        // These only have a return statement each, so that they're
+        // constexpr for every compiler krabs supports.
+        static constexpr unsigned int literal_hex_digit(char c);
+        static constexpr unsigned long long literal_hex(const char* str, size_t digits);
+        static constexpr unsigned char literal_byte(const char* str);
+        static constexpr size_t literal_start(const char* str, size_t length);
+        static constexpr GUID literal_guid(const char* str);
     };
 
     // Implementation
@@ -296,6 +319,65 @@ namespace krabs {
 
         return guid;
     }
+
+    template <size_t N>
+    constexpr GUID guid_parser::parse_guid_literal(const char (&str)[N])
+    {
+        return literal_guid(str + literal_start(str, N - 1));
+    }
+
+    inline constexpr unsigned int guid_parser::literal_hex_digit(char c)
+    {
+        return (c >= '0' && c <= '9') ? static_cast<unsigned int>(c - '0')
+             : (c >= 'A' && c <= 'F') ? static_cast<unsigned int>(c - 'A' + 10)
+             : (c >= 'a' && c <= 'f') ? static_cast<unsigned int>(c - 'a' + 10)
+             : throw std::runtime_error("GUID string contains non-hex digits where hex digits are expected.");
+    }
+
+    inline constexpr unsigned long long guid_parser::literal_hex(const char* str, size_t digits)
+    {
+        return digits == 0
+            ? 0
+            : (literal_hex(str, digits - 1) << 4) | literal_hex_digit(str[digits - 1]);
+    }
+
+    inline constexpr unsigned char guid_parser::literal_byte(const char* str)
+    {
+        return static_cast<unsigned char>(literal_hex(str, 2));
+    }
+
+    inline constexpr size_t guid_parser::literal_start(const char* str, size_t length)
+    {
+        return length == UUID_STRING_LENGTH
+            ? 0
+            : (length == UUID_STRING_LENGTH + 2 && str[0] == '{' && str[length - 1] == '}')
+                ? 1
+                : throw std::runtime_error("Input data has incorrect length.");
+    }
+
+    inline constexpr GUID guid_parser::literal_guid(const char* str)
+    {
+        return (str[STR_POSITION_DATA2 - 1] != DELIMITER ||
+                str[STR_POSITION_DATA3 - 1] != DELIMITER ||
+                str[STR_POSITION_DATA4_PART1 - 1] != DELIMITER ||
+                str[STR_POSITION_DATA4_PART2 - 1] != DELIMITER)
+            ? throw std::runtime_error("Missing a hyphen where one was expected.")
+            : GUID{
+                static_cast<decltype(GUID::Data1)>(literal_hex(str + STR_POSITION_DATA1, 8)),
+                static_cast<decltype(GUID::Data2)>(literal_hex(str + STR_POSITION_DATA2, 4)),
+                static_cast<decltype(GUID::Data3)>(literal_hex(str + STR_POSITION_DATA3, 4)),
+                {
+                    literal_byte(str + STR_POSITION_DATA4_PART1),
+                    literal_byte(str + STR_POSITION_DATA4_PART1 + 2),
+                    literal_byte(str + STR_POSITION_DATA4_PART2),
+                    literal_byte(str + STR_POSITION_DATA4_PART2 + 2),
+                    literal_byte(str + STR_POSITION_DATA4_PART2 + 4),
+                    literal_byte(str + STR_POSITION_DATA4_PART2 + 6),
+                    literal_byte(str + STR_POSITION_DATA4_PART2 + 8),
+                    literal_byte(str + STR_POSITION_DATA4_PART2 + 10)
+                }
+            };
+    }
 }
 
 namespace std
@@ -317,10 +399,16 @@ namespace std
     {
         size_t operator()(const krabs::guid& guid) const
         {
-            // This algorithm comes from .NET's reference source for Guid.GetHashCode()
-            return guid.guid_.Data1 ^
-                 ((guid.guid_.Data2    << 16) | guid.guid_.Data3   ) ^
-                 ((guid.guid_.Data4[2] << 24) | guid.guid_.Data4[7]);
+            // All sixteen bytes count: provider GUIDs that only differ in
+            // the bytes .NET's Guid.GetHashCode() skips are common.
+            uint64_t words[2];
+            memcpy(words, &guid.guid_, sizeof(words));
+
+            uint64_t h = (words[0] * 0x9E3779B97F4A7C15ULL) ^ (words[1] * 0xC2B2AE3D27D4EB4FULL);
+            h ^= h >> 33;
+            h *= 0xFF51AFD7ED558CCDULL;
+            h ^= h >> 33;
+            return static_cast<size_t>(h);
         }
     };
 }
@@ -0,0 +1,596 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#ifndef  WIN32_LEAN_AND_MEAN
+#define  WIN32_LEAN_AND_MEAN
+#endif
+
+#include <windows.h>
+#include <evntcons.h>
+
+#include <cstdint>
+#include <string>
+
+#include "../compiler_check.hpp"
+#include "../event_view.hpp"
+#include "../kernel_guids.hpp"
+
+namespace krabs { namespace kernel {
+
+    using krabs::event_view;
+    using krabs::field_offset;
+
+    /**
+     * <summary>
+     *   A view bound to one opcode of a kernel MOF class. `matches` tells
+     *   whether an event has the provider, opcode and version the view was
+     *   written for.
+     * </summary>
+     * <example>
+     *   if (krabs::kernel::process_start_v4::matches(record)) {
+     *       krabs::kernel::process_start_v4 start(record);
+     *       auto pid = start.process_id();
+     *   }
+     * </example>
+     */
+    template <typename View, UCHAR Opcode>
+    class typed_event : public View {
+    public:
+        static constexpr UCHAR opcode = Opcode;
+
+        explicit typed_event(const EVENT_RECORD &record);
+
+        static bool matches(const EVENT_RECORD &record);
+    };
+
+    /**
+     * <summary>
+     *   Process_V4_TypeGroup1: process start, end and rundown events.
+     * </summary>
+     */
+    class process_v4 : public event_view {
+    public:
+        static constexpr UCHAR version = 4;
+        static const GUID &provider() { return krabs::guids::process; }
+
+        // Everything after user_sid is variable in size.
+        static constexpr field_offset unique_process_key_offset   = { 0, 0 };
+        static constexpr field_offset process_id_offset           = { 0, 1 };
+        static constexpr field_offset parent_id_offset            = { 4, 1 };
+        static constexpr field_offset session_id_offset           = { 8, 1 };
+        static constexpr field_offset exit_status_offset          = { 12, 1 };
+        static constexpr field_offset directory_table_base_offset = { 16, 1 };
+        static constexpr field_offset flags_offset                = { 16, 2 };
+        static constexpr field_offset user_sid_offset             = { 20, 2 };
+
+        explicit process_v4(const EVENT_RECORD &record);
+
+        uint64_t unique_process_key() const;
+        uint32_t process_id() const;
+        uint32_t parent_id() const;
+        uint32_t session_id() const;
+        int32_t exit_status() const;
+        uint64_t directory_table_base() const;
+        uint32_t flags() const;
+        krabs::sid user_sid() const;
+        std::string image_file_name() const;
+        std::wstring command_line() const;
+        std::wstring package_full_name() const;
+        std::wstring application_id() const;
+
+    private:
+        size_t image_file_name_at() const;
+    };
+
+    typedef typed_event<process_v4, 1>  process_start_v4;
+    typedef typed_event<process_v4, 2>  process_end_v4;
+    typedef typed_event<process_v4, 3>  process_dc_start_v4;
+    typedef typed_event<process_v4, 4>  process_dc_end_v4;
+    typedef typed_event<process_v4, 39> process_defunct_v4;
+
+    /**
+     * <summary>
+     *   Thread_V3_TypeGroup1: thread start, end and rundown events.
+     * </summary>
+     */
+    class thread_v3 : public event_view {
+    public:
+        static constexpr UCHAR version = 3;
+        static const GUID &provider() { return krabs::guids::thread; }
+
+        static constexpr field_offset process_id_offset       = { 0, 0 };
+        static constexpr field_offset thread_id_offset        = { 4, 0 };
+        static constexpr field_offset stack_base_offset       = { 8, 0 };
+        static constexpr field_offset stack_limit_offset      = { 8, 1 };
+        static constexpr field_offset user_stack_base_offset  = { 8, 2 };
+        static constexpr field_offset user_stack_limit_offset = { 8, 3 };
+        static constexpr field_offset affinity_offset         = { 8, 4 };
+        static constexpr field_offset win32_start_addr_offset = { 8, 5 };
+        static constexpr field_offset teb_base_offset         = { 8, 6 };
+        static constexpr field_offset sub_process_tag_offset  = { 8, 7 };
+        static constexpr field_offset base_priority_offset    = { 12, 7 };
+        static constexpr field_offset page_priority_offset    = { 13, 7 };
+        static constexpr field_offset io_priority_offset      = { 14, 7 };
+        static constexpr field_offset thread_flags_offset     = { 15, 7 };
+
+        explicit thread_v3(const EVENT_RECORD &record);
+
+        uint32_t process_id() const;
+        uint32_t thread_id() const;
+        uint64_t stack_base() const;
+        uint64_t stack_limit() const;
+        uint64_t user_stack_base() const;
+        uint64_t user_stack_limit() const;
+        uint64_t affinity() const;
+        uint64_t win32_start_addr() const;
+        uint64_t teb_base() const;
+        uint32_t sub_process_tag() const;
+        uint8_t base_priority() const;
+        uint8_t page_priority() const;
+        uint8_t io_priority() const;
+        uint8_t thread_flags() const;
+    };
+
+    typedef typed_event<thread_v3, 1> thread_start_v3;
+    typedef typed_event<thread_v3, 2> thread_end_v3;
+    typedef typed_event<thread_v3, 3> thread_dc_start_v3;
+    typedef typed_event<thread_v3, 4> thread_dc_end_v3;
+
+    /**
+     * <summary>
+     *   Image_Load (version 3): image load, unload and rundown events.
+     * </summary>
+     */
+    class image_v3 : public event_view {
+    public:
+        static constexpr UCHAR version = 3;
+        static const GUID &provider() { return krabs::guids::image_load; }
+
+        static constexpr field_offset image_base_offset      = { 0, 0 };
+        static constexpr field_offset image_size_offset      = { 0, 1 };
+        static constexpr field_offset process_id_offset      = { 0, 2 };
+        static constexpr field_offset image_checksum_offset  = { 4, 2 };
+        static constexpr field_offset time_date_stamp_offset = { 8, 2 };
+        static constexpr field_offset default_base_offset    = { 16, 2 };
+        static constexpr field_offset file_name_offset       = { 32, 3 };
+
+        explicit image_v3(const EVENT_RECORD &record);
+
+        uint64_t image_base() const;
+        uint64_t image_size() const;
+        uint32_t process_id() const;
+        uint32_t image_checksum() const;
+        uint32_t time_date_stamp() const;
+        uint64_t default_base() const;
+        std::wstring file_name() const;
+    };
+
+    typedef typed_event<image_v3, 10> image_load_v3;
+    typedef typed_event<image_v3, 2>  image_unload_v3;
+    typedef typed_event<image_v3, 3>  image_dc_start_v3;
+    typedef typed_event<image_v3, 4>  image_dc_end_v3;
+
+    /**
+     * <summary>
+     *   FileIo_Name: file name, create, delete and rundown events, whose
+     *   layout is the same in versions 2 and 3.
+     * </summary>
+     */
+    class file_io_name : public event_view {
+    public:
+        static constexpr UCHAR version = 2;
+        static const GUID &provider() { return krabs::guids::file_io; }
+        static bool matches_version(UCHAR event_version) { return event_version == 2 || event_version == 3; }
+
+        static constexpr field_offset file_object_offset = { 0, 0 };
+        static constexpr field_offset file_name_offset   = { 0, 1 };
+
+        explicit file_io_name(const EVENT_RECORD &record);
+
+        uint64_t file_object() const;
+        std::wstring file_name() const;
+    };
+
+    typedef typed_event<file_io_name, 0>  file_io_name_event;
+    typedef typed_event<file_io_name, 32> file_io_file_create;
+    typedef typed_event<file_io_name, 35> file_io_file_delete;
+    typedef typed_event<file_io_name, 36> file_io_file_rundown;
+
+    /**
+     * <summary>
+     *   DiskIo_TypeGroup1 (version 3): disk read and write completions.
+     * </summary>
+     */
+    class disk_io_v3 : public event_view {
+    public:
+        static constexpr UCHAR version = 3;
+        static const GUID &provider() { return krabs::guids::disk_io; }
+
+        static constexpr field_offset disk_number_offset            = { 0, 0 };
+        static constexpr field_offset irp_flags_offset              = { 4, 0 };
+        static constexpr field_offset transfer_size_offset          = { 8, 0 };
+        static constexpr field_offset byte_offset_offset            = { 16, 0 };
+        static constexpr field_offset file_object_offset            = { 24, 0 };
+        static constexpr field_offset irp_offset                    = { 24, 1 };
+        static constexpr field_offset high_res_response_time_offset = { 24, 2 };
+        static constexpr field_offset issuing_thread_id_offset      = { 32, 2 };
+
+        explicit disk_io_v3(const EVENT_RECORD &record);
+
+        uint32_t disk_number() const;
+        uint32_t irp_flags() const;
+        uint32_t transfer_size() const;
+        int64_t byte_offset() const;
+        uint64_t file_object() const;
+        uint64_t irp() const;
+        uint64_t high_res_response_time() const;
+        uint32_t issuing_thread_id() const;
+    };
+
+    typedef typed_event<disk_io_v3, 10> disk_read_v3;
+    typedef typed_event<disk_io_v3, 11> disk_write_v3;
+
+    /**
+     * <summary>
+     *   TcpIp_TypeGroup1 (version 2): IPv4 TCP receive, disconnect,
+     *   retransmit, reconnect and copy events. Addresses and ports are in
+     *   network byte order, as logged.
+     * </summary>
+     */
+    class tcp_ipv4_v2 : public event_view {
+    public:
+        static constexpr UCHAR version = 2;
+        static const GUID &provider() { return krabs::guids::tcp_ip; }
+
+        static constexpr field_offset pid_offset    = { 0, 0 };
+        static constexpr field_offset size_offset   = { 4, 0 };
+        static constexpr field_offset daddr_offset  = { 8, 0 };
+        static constexpr field_offset saddr_offset  = { 12, 0 };
+        static constexpr field_offset dport_offset  = { 16, 0 };
+        static constexpr field_offset sport_offset  = { 18, 0 };
+        static constexpr field_offset seqnum_offset = { 20, 0 };
+        static constexpr field_offset connid_offset = { 24, 0 };
+
+        explicit tcp_ipv4_v2(const EVENT_RECORD &record);
+
+        uint32_t pid() const;
+        uint32_t size() const;
+        uint32_t daddr() const;
+        uint32_t saddr() const;
+        uint16_t dport() const;
+        uint16_t sport() const;
+        uint32_t seqnum() const;
+        uint64_t connid() const;
+    };
+
+    typedef typed_event<tcp_ipv4_v2, 11> tcp_receive_ipv4_v2;
+    typedef typed_event<tcp_ipv4_v2, 13> tcp_disconnect_ipv4_v2;
+    typedef typed_event<tcp_ipv4_v2, 14> tcp_retransmit_ipv4_v2;
+    typedef typed_event<tcp_ipv4_v2, 16> tcp_reconnect_ipv4_v2;
+    typedef typed_event<tcp_ipv4_v2, 18> tcp_copy_ipv4_v2;
+
+    /**
+     * <summary>
+     *   TcpIp_SendIPV4 (version 2): IPv4 TCP send events, which carry the
+     *   send start and end times before the sequence number.
+     * </summary>
+     */
+    class tcp_send_ipv4_v2 : public event_view {
+    public:
+        static constexpr UCHAR version = 2;
+        static const GUID &provider() { return krabs::guids::tcp_ip; }
+
+        static constexpr field_offset pid_offset      = { 0, 0 };
+        static constexpr field_offset size_offset     = { 4, 0 };
+        static constexpr field_offset daddr_offset    = { 8, 0 };
+        static constexpr field_offset saddr_offset    = { 12, 0 };
+        static constexpr field_offset dport_offset    = { 16, 0 };
+        static constexpr field_offset sport_offset    = { 18, 0 };
+        static constexpr field_offset startime_offset = { 20, 0 };
+        static constexpr field_offset endtime_offset  = { 24, 0 };
+        static constexpr field_offset seqnum_offset   = { 28, 0 };
+        static constexpr field_offset connid_offset   = { 32, 0 };
+
+        explicit tcp_send_ipv4_v2(const EVENT_RECORD &record);
+
+        uint32_t pid() const;
+        uint32_t size() const;
+        uint32_t daddr() const;
+        uint32_t saddr() const;
+        uint16_t dport() const;
+        uint16_t sport() const;
+        uint32_t startime() const;
+        uint32_t endtime() const;
+        uint32_t seqnum() const;
+        uint64_t connid() const;
+    };
+
+    typedef typed_event<tcp_send_ipv4_v2, 10> tcp_send_ipv4_event_v2;
+
+    /**
+     * <summary>
+     *   Registry_TypeGroup1 (version 2): registry key operations.
+     * </summary>
+     */
+    class registry_v2 : public event_view {
+    public:
+        static constexpr UCHAR version = 2;
+        static const GUID &provider() { return krabs::guids::registry; }
+
+        static constexpr field_offset initial_time_offset = { 0, 0 };
+        static constexpr field_offset status_offset       = { 8, 0 };
+        static constexpr field_offset index_offset        = { 12, 0 };
+        static constexpr field_offset key_handle_offset   = { 16, 0 };
+        static constexpr field_offset key_name_offset     = { 16, 1 };
+
+        explicit registry_v2(const EVENT_RECORD &record);
+
+        int64_t initial_time() const;
+        uint32_t status() const;
+        uint32_t index() const;
+        uint64_t key_handle() const;
+        std::wstring key_name() const;
+    };
+
+    typedef typed_event<registry_v2, 10> registry_create_v2;
+    typedef typed_event<registry_v2, 11> registry_open_v2;
+    typedef typed_event<registry_v2, 12> registry_delete_v2;
+    typedef typed_event<registry_v2, 13> registry_query_v2;
+    typedef typed_event<registry_v2, 14> registry_set_value_v2;
+    typedef typed_event<registry_v2, 15> registry_delete_value_v2;
+    typedef typed_event<registry_v2, 16> registry_query_value_v2;
+    typedef typed_event<registry_v2, 17> registry_enumerate_key_v2;
+    typedef typed_event<registry_v2, 18> registry_enumerate_value_key_v2;
+    typedef typed_event<registry_v2, 27> registry_close_v2;
+
+    // Implementation
+    // ------------------------------------------------------------------------
+
+    namespace details {
+
+        // Views that accept more than one version say so with their own
+        // matches_version; the rest match only their own.
+        template <typename View>
+        auto matches_version(UCHAR version, int) -> decltype(View::matches_version(version))
+        {
+            return View::matches_version(version);
+        }
+
+        template <typename View>
+        bool matches_version(UCHAR version, long)
+        {
+            return version == View::version;
+        }
+
+    } /* namespace details */
+
+    template <typename View, UCHAR Opcode>
+    constexpr UCHAR typed_event<View, Opcode>::opcode;
+
+    template <typename View, UCHAR Opcode>
+    typed_event<View, Opcode>::typed_event(const EVENT_RECORD &record)
+    : View(record)
+    {}
+
+    template <typename View, UCHAR Opcode>
+    bool typed_event<View, Opcode>::matches(const EVENT_RECORD &record)
+    {
+        const auto &descriptor = record.EventHeader.EventDescriptor;
+        return descriptor.Opcode == Opcode &&
+               details::matches_version<View>(descriptor.Version, 0) &&
+               IsEqualGUID(record.EventHeader.ProviderId, View::provider());
+    }
+
+    // process_v4
+    // ------------------------------------------------------------------------
+
+    inline process_v4::process_v4(const EVENT_RECORD &record)
+    : event_view(record)
+    {}
+
+    inline uint64_t process_v4::unique_process_key() const
+    {
+        return read_pointer(unique_process_key_offset.at(pointer_size_));
+    }
+
+    inline uint32_t process_v4::process_id() const
+    {
+        return read<uint32_t>(process_id_offset.at(pointer_size_));
+    }
+
+    inline uint32_t process_v4::parent_id() const
+    {
+        return read<uint32_t>(parent_id_offset.at(pointer_size_));
+    }
+
+    inline uint32_t process_v4::session_id() const
+    {
+        return read<uint32_t>(session_id_offset.at(pointer_size_));
+    }
+
+    inline int32_t process_v4::exit_status() const
+    {
+        return read<int32_t>(exit_status_offset.at(pointer_size_));
+    }
+
+    inline uint64_t process_v4::directory_table_base() const
+    {
+        return read_pointer(directory_table_base_offset.at(pointer_size_));
+    }
+
+    inline uint32_t process_v4::flags() const
+    {
+        return read<uint32_t>(flags_offset.at(pointer_size_));
+    }
+
+    inline krabs::sid process_v4::user_sid() const
+    {
+        size_t next = 0;
+        return read_wbem_sid(user_sid_offset.at(pointer_size_), next);
+    }
+
+    inline size_t process_v4::image_file_name_at() const
+    {
+        size_t next = 0;
+        read_wbem_sid(user_sid_offset.at(pointer_size_), next);
+        return next;
+    }
+
+    inline std::string process_v4::image_file_name() const
+    {
+        size_t next = 0;
+        return read_string(image_file_name_at(), next);
+    }
+
+    inline std::wstring process_v4::command_line() const
+    {
+        size_t next = 0;
+        read_string(image_file_name_at(), next);
+        return read_wstring(next, next);
+    }
+
+    inline std::wstring process_v4::package_full_name() const
+    {
+        size_t next = 0;
+        read_string(image_file_name_at(), next);
+        read_wstring(next, next);
+        return read_wstring(next, next);
+    }
+
+    inline std::wstring process_v4::application_id() const
+    {
+        size_t next = 0;
+        read_string(image_file_name_at(), next);
+        read_wstring(next, next);
+        read_wstring(next, next);
+        return read_wstring(next, next);
+    }
+
+    // thread_v3
+    // ------------------------------------------------------------------------
+
+    inline thread_v3::thread_v3(const EVENT_RECORD &record)
+    : event_view(record)
+    {}
+
+    inline uint32_t thread_v3::process_id() const       { return read<uint32_t>(process_id_offset.at(pointer_size_)); }
+    inline uint32_t thread_v3::thread_id() const        { return read<uint32_t>(thread_id_offset.at(pointer_size_)); }
+    inline uint64_t thread_v3::stack_base() const       { return read_pointer(stack_base_offset.at(pointer_size_)); }
+    inline uint64_t thread_v3::stack_limit() const      { return read_pointer(stack_limit_offset.at(pointer_size_)); }
+    inline uint64_t thread_v3::user_stack_base() const  { return read_pointer(user_stack_base_offset.at(pointer_size_)); }
+    inline uint64_t thread_v3::user_stack_limit() const { return read_pointer(user_stack_limit_offset.at(pointer_size_)); }
+    inline uint64_t thread_v3::affinity() const         { return read_pointer(affinity_offset.at(pointer_size_)); }
+    inline uint64_t thread_v3::win32_start_addr() const { return read_pointer(win32_start_addr_offset.at(pointer_size_)); }
+    inline uint64_t thread_v3::teb_base() const         { return read_pointer(teb_base_offset.at(pointer_size_)); }
+    inline uint32_t thread_v3::sub_process_tag() const  { return read<uint32_t>(sub_process_tag_offset.at(pointer_size_)); }
+    inline uint8_t thread_v3::base_priority() const     { return read<uint8_t>(base_priority_offset.at(pointer_size_)); }
+    inline uint8_t thread_v3::page_priority() const     { return read<uint8_t>(page_priority_offset.at(pointer_size_)); }
+    inline uint8_t thread_v3::io_priority() const       { return read<uint8_t>(io_priority_offset.at(pointer_size_)); }
+    inline uint8_t thread_v3::thread_flags() const      { return read<uint8_t>(thread_flags_offset.at(pointer_size_)); }
+
+    // image_v3
+    // ------------------------------------------------------------------------
+
+    inline image_v3::image_v3(const EVENT_RECORD &record)
+    : event_view(record)
+    {}
+
+    inline uint64_t image_v3::image_base() const      { return read_pointer(image_base_offset.at(pointer_size_)); }
+    inline uint64_t image_v3::image_size() const      { return read_pointer(image_size_offset.at(pointer_size_)); }
+    inline uint32_t image_v3::process_id() const      { return read<uint32_t>(process_id_offset.at(pointer_size_)); }
+    inline uint32_t image_v3::image_checksum() const  { return read<uint32_t>(image_checksum_offset.at(pointer_size_)); }
+    inline uint32_t image_v3::time_date_stamp() const { return read<uint32_t>(time_date_stamp_offset.at(pointer_size_)); }
+    inline uint64_t image_v3::default_base() const    { return read_pointer(default_base_offset.at(pointer_size_)); }
+
+    inline std::wstring image_v3::file_name() const
+    {
+        size_t next = 0;
+        return read_wstring(file_name_offset.at(pointer_size_), next);
+    }
+
+    // file_io_name
+    // ------------------------------------------------------------------------
+
+    inline file_io_name::file_io_name(const EVENT_RECORD &record)
+    : event_view(record)
+    {}
+
+    inline uint64_t file_io_name::file_object() const { return read_pointer(file_object_offset.at(pointer_size_)); }
+
+    inline std::wstring file_io_name::file_name() const
+    {
+        size_t next = 0;
+        return read_wstring(file_name_offset.at(pointer_size_), next);
+    }
+
+    // disk_io_v3
+    // ------------------------------------------------------------------------
+
+    inline disk_io_v3::disk_io_v3(const EVENT_RECORD &record)
+    : event_view(record)
+    {}
+
+    inline uint32_t disk_io_v3::disk_number() const            { return read<uint32_t>(disk_number_offset.at(pointer_size_)); }
+    inline uint32_t disk_io_v3::irp_flags() const              { return read<uint32_t>(irp_flags_offset.at(pointer_size_)); }
+    inline uint32_t disk_io_v3::transfer_size() const          { return read<uint32_t>(transfer_size_offset.at(pointer_size_)); }
+    inline int64_t disk_io_v3::byte_offset() const             { return read<int64_t>(byte_offset_offset.at(pointer_size_)); }
+    inline uint64_t disk_io_v3::file_object() const            { return read_pointer(file_object_offset.at(pointer_size_)); }
+    inline uint64_t disk_io_v3::irp() const                    { return read_pointer(irp_offset.at(pointer_size_)); }
+    inline uint64_t disk_io_v3::high_res_response_time() const { return read<uint64_t>(high_res_response_time_offset.at(pointer_size_)); }
+    inline uint32_t disk_io_v3::issuing_thread_id() const      { return read<uint32_t>(issuing_thread_id_offset.at(pointer_size_)); }
+
+    // tcp_ipv4_v2
+    // ------------------------------------------------------------------------
+
+    inline tcp_ipv4_v2::tcp_ipv4_v2(const EVENT_RECORD &record)
+    : event_view(record)
+    {}
+
+    inline uint32_t tcp_ipv4_v2::pid() const    { return read<uint32_t>(pid_offset.at(pointer_size_)); }
+    inline uint32_t tcp_ipv4_v2::size() const   { return read<uint32_t>(size_offset.at(pointer_size_)); }
+    inline uint32_t tcp_ipv4_v2::daddr() const  { return read<uint32_t>(daddr_offset.at(pointer_size_)); }
+    inline uint32_t tcp_ipv4_v2::saddr() const  { return read<uint32_t>(saddr_offset.at(pointer_size_)); }
+    inline uint16_t tcp_ipv4_v2::dport() const  { return read<uint16_t>(dport_offset.at(pointer_size_)); }
+    inline uint16_t tcp_ipv4_v2::sport() const  { return read<uint16_t>(sport_offset.at(pointer_size_)); }
+    inline uint32_t tcp_ipv4_v2::seqnum() const { return read<uint32_t>(seqnum_offset.at(pointer_size_)); }
+    inline uint64_t tcp_ipv4_v2::connid() const { return read_pointer(connid_offset.at(pointer_size_)); }
+
+    // tcp_send_ipv4_v2
+    // ------------------------------------------------------------------------
+
+    inline tcp_send_ipv4_v2::tcp_send_ipv4_v2(const EVENT_RECORD &record)
+    : event_view(record)
+    {}
+
+    inline uint32_t tcp_send_ipv4_v2::pid() const      { return read<uint32_t>(pid_offset.at(pointer_size_)); }
+    inline uint32_t tcp_send_ipv4_v2::size() const     { return read<uint32_t>(size_offset.at(pointer_size_)); }
+    inline uint32_t tcp_send_ipv4_v2::daddr() const    { return read<uint32_t>(daddr_offset.at(pointer_size_)); }
+    inline uint32_t tcp_send_ipv4_v2::saddr() const    { return read<uint32_t>(saddr_offset.at(pointer_size_)); }
+    inline uint16_t tcp_send_ipv4_v2::dport() const    { return read<uint16_t>(dport_offset.at(pointer_size_)); }
+    inline uint16_t tcp_send_ipv4_v2::sport() const    { return read<uint16_t>(sport_offset.at(pointer_size_)); }
+    inline uint32_t tcp_send_ipv4_v2::startime() const { return read<uint32_t>(startime_offset.at(pointer_size_)); }
+    inline uint32_t tcp_send_ipv4_v2::endtime() const  { return read<uint32_t>(endtime_offset.at(pointer_size_)); }
+    inline uint32_t tcp_send_ipv4_v2::seqnum() const   { return read<uint32_t>(seqnum_offset.at(pointer_size_)); }
+    inline uint64_t tcp_send_ipv4_v2::connid() const   { return read_pointer(connid_offset.at(pointer_size_)); }
+
+    // registry_v2
+    // ------------------------------------------------------------------------
+
+    inline registry_v2::registry_v2(const EVENT_RECORD &record)
+    : event_view(record)
+    {}
+
+    inline int64_t registry_v2::initial_time() const { return read<int64_t>(initial_time_offset.at(pointer_size_)); }
+    inline uint32_t registry_v2::status() const      { return read<uint32_t>(status_offset.at(pointer_size_)); }
+    inline uint32_t registry_v2::index() const       { return read<uint32_t>(index_offset.at(pointer_size_)); }
+    inline uint64_t registry_v2::key_handle() const  { return read_pointer(key_handle_offset.at(pointer_size_)); }
+
+    inline std::wstring registry_v2::key_name() const
+    {
+        size_t next = 0;
+        return read_wstring(key_name_offset.at(pointer_size_), next);
+    }
+
+} /* namespace kernel */ } /* namespace krabs */
@@ -5,6 +5,7 @@
 
 #include "compiler_check.hpp"
 #include "kernel_guids.hpp"
+#include "kernel/typed_events.hpp"
 #include "perfinfo_groupmask.hpp"
 #include "provider.hpp"
 
@@ -59,6 +59,18 @@ namespace krabs { namespace details {
         static void enable_providers(
             const krabs::trace<krabs::details::kt> &trace);
 
+        /**
+         * <summary>
+         *   Brings the session up to date after the provider was enabled
+         *   or disabled on a trace that's already running. Only group
+         *   masks can change; the flags are fixed when the trace starts.
+         * </summary>
+         */
+        static void update_provider(
+            const krabs::trace<krabs::details::kt> &trace,
+            const provider_type &p,
+            bool enabled);
+
         /**
          * <summary>
          *   Enables the configured kernel rundown flags.
@@ -79,6 +91,15 @@ namespace krabs { namespace details {
             const EVENT_RECORD &record,
             const krabs::trace<krabs::details::kt> &trace);
 
+        /**
+         * <summary>
+         *   The GUID of the provider forward_events hands the event to.
+         * </summary>
+         */
+        static GUID dispatch_guid(
+            const EVENT_RECORD &record,
+            const krabs::trace<krabs::details::kt> &trace);
+
         /**
          * <summary>
          *   Sets the ETW trace log file mode.
@@ -112,7 +133,8 @@ namespace krabs { namespace details {
         const krabs::trace<krabs::details::kt> &trace)
     {
         unsigned long flags = 0;
-        for (auto &provider : trace.providers_) {
+        krabs::trace<krabs::details::kt>::provider_reader providers(trace.providers_);
+        for (auto &provider : *providers) {
             flags |= provider.get().flags();
         }
 
@@ -131,7 +153,8 @@ namespace krabs { namespace details {
         error_check_common_conditions(status);
 
         auto group_mask_set = false;
-        for (auto& provider : trace.providers_) {
+        krabs::trace<krabs::details::kt>::provider_reader providers(trace.providers_);
+        for (auto &provider : *providers) {
             auto group = provider.get().group_mask();
             PERFINFO_OR_GROUP_WITH_GROUPMASK(group, &(gmi.EventTraceGroupMasks));
             group_mask_set |= (group != 0);
@@ -146,12 +169,25 @@ namespace krabs { namespace details {
         return;
     }
 
+    inline void kt::update_provider(
+        const krabs::trace<krabs::details::kt> &trace,
+        const provider_type &p,
+        bool enabled)
+    {
+        // Group masks that are set stay set, since another provider could
+        // share them.
+        if (enabled && p.group_mask() != 0 && trace.registrationHandle_ != INVALID_PROCESSTRACE_HANDLE) {
+            enable_providers(trace);
+        }
+    }
+
     inline void kt::enable_rundown(
         const krabs::trace<krabs::details::kt>& trace)
     {
         bool rundown_enabled = false;
         ULONG rundown_flags = 0;
-        for (auto& provider : trace.providers_) {
+        krabs::trace<krabs::details::kt>::provider_reader providers(trace.providers_);
+        for (auto &provider : *providers) {
             rundown_enabled |= provider.get().rundown_enabled();
             rundown_flags |= provider.get().rundown_flags();
         }
@@ -174,7 +210,8 @@ namespace krabs { namespace details {
         const EVENT_RECORD &record,
         const krabs::trace<krabs::details::kt> &trace)
     {
-        for (auto &provider : trace.providers_) {
+        krabs::trace<krabs::details::kt>::provider_reader providers(trace.providers_);
+        for (auto &provider : *providers) {
             if (provider.get().id() == record.EventHeader.ProviderId) {
                 provider.get().on_event(record, trace.context_);
                 return;
@@ -185,6 +222,15 @@ namespace krabs { namespace details {
             trace.default_callback_(record, trace.context_);
     }
 
+    inline GUID kt::dispatch_guid(
+        const EVENT_RECORD &record,
+        const krabs::trace<krabs::details::kt> &)
+    {
+        // Kernel providers are told apart by the event class GUID the
+        // events carry, so it already names the provider.
+        return record.EventHeader.ProviderId;
+    }
+
     inline unsigned long kt::augment_file_mode()
     {
         if (IsWindows8OrGreater()) {
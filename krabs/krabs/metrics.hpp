@@ -0,0 +1,660 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#ifndef  WIN32_LEAN_AND_MEAN
+#define  WIN32_LEAN_AND_MEAN
+#endif
+
+#include <windows.h>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "compiler_check.hpp"
+#include "guid.hpp"
+#include "schema_locator.hpp"
+
+namespace krabs {
+
+    typedef unsigned long long handler_id;
+
+    namespace details {
+        struct live_histogram;
+    }
+
+    /**
+     * <summary>
+     *   Counts values in buckets that grow with the value: every power of
+     *   two is split into eight, so a bucket is never more than an eighth
+     *   wider than the values in it, from 1 up to the largest uint64_t.
+     * </summary>
+     * <example>
+     *   krabs::latency_histogram histogram;
+     *   histogram.record(1500);
+     *   auto p99 = histogram.percentile(99.0);
+     * </example>
+     */
+    class latency_histogram {
+    public:
+        static const size_t sub_buckets = 8;
+        static const size_t bucket_count = 496;
+
+        latency_histogram();
+
+        void record(uint64_t value);
+
+        /**
+         * <summary>
+         *   Adds the other histogram's values to this one.
+         * </summary>
+         */
+        void merge(const latency_histogram &other);
+
+        uint64_t count() const { return count_; }
+        uint64_t sum() const { return sum_; }
+        uint64_t max() const { return max_; }
+        double mean() const;
+
+        /**
+         * <summary>
+         *   The largest value in the bucket the given percentage of values
+         *   are in or below, and never more than the largest value seen.
+         *   Returns 0 for an empty histogram.
+         * </summary>
+         */
+        uint64_t percentile(double percent) const;
+
+        /**
+         * <summary>
+         *   The number of values counted in the bucket.
+         * </summary>
+         */
+        uint64_t count_in(size_t bucket) const { return counts_[bucket]; }
+
+        static size_t bucket_of(uint64_t value);
+
+        /**
+         * <summary>
+         *   The largest value that goes in the bucket.
+         * </summary>
+         */
+        static uint64_t bucket_high(size_t bucket);
+
+    private:
+        uint64_t counts_[bucket_count];
+        uint64_t count_;
+        uint64_t sum_;
+        uint64_t max_;
+
+        friend struct details::live_histogram;
+    };
+
+    /**
+     * <summary>
+     *   What a provider saw of one event id.
+     * </summary>
+     */
+    struct event_id_metrics {
+        unsigned short event_id;
+        uint64_t events;
+        uint64_t bytes;
+        uint64_t accepted;
+    };
+
+    /**
+     * <summary>
+     *   What one of a provider's filters did: the events it was given, the
+     *   ones that satisfied its predicate, and how long the predicate and
+     *   the callbacks took, in QueryPerformanceCounter ticks.
+     * </summary>
+     */
+    struct filter_metrics {
+        handler_id filter;
+        uint64_t events;
+        uint64_t passed;
+        latency_histogram predicate_latency;
+        latency_histogram callback_latency;
+
+        filter_metrics() : filter(0), events(0), passed(0) {}
+    };
+
+    /**
+     * <summary>
+     *   What a provider saw: its events and their user data bytes, the
+     *   events some callback was called for, the same for each event id,
+     *   and how long the provider's own callbacks took per event. Latency
+     *   is in QueryPerformanceCounter ticks, of which there are
+     *   ticks_per_second.
+     * </summary>
+     */
+    struct provider_metrics {
+        krabs::guid provider;
+        uint64_t events;
+        uint64_t bytes;
+        uint64_t accepted;
+        LONGLONG ticks_per_second;
+        latency_histogram callback_latency;
+        std::vector<event_id_metrics> event_ids;
+        std::vector<filter_metrics> filters;
+
+        provider_metrics() : provider(GUID()), events(0), bytes(0), accepted(0), ticks_per_second(0) {}
+    };
+
+    /**
+     * <summary>
+     *   How late a provider's sampled events were when the trace got them,
+     *   in 100-nanosecond intervals (the unit of a FILETIME), and how often
+     *   that crossed the alert threshold.
+     * </summary>
+     */
+    struct delivery_lag_metrics {
+        krabs::guid provider;
+        uint64_t alerts;
+        latency_histogram lag;
+
+        delivery_lag_metrics() : provider(GUID()), alerts(0) {}
+    };
+
+    /**
+     * <summary>
+     *   The events a trace handled, the counters of its schema cache, the
+     *   metrics of each of its providers that has metrics enabled, and
+     *   the delivery lag of its providers if that's tracked.
+     * </summary>
+     */
+    struct trace_metrics {
+        uint64_t events_handled;
+        schema_cache_stats schema_cache;
+        std::vector<provider_metrics> providers;
+        std::vector<delivery_lag_metrics> delivery_lag;
+
+        // Times a provider couldn't be enabled again from the thread
+        // processing events, either with the ids the adaptive pushdown
+        // left out or after its callbacks and filters changed. The
+        // session keeps the settings it had.
+        uint64_t pushdown_failures;
+
+        trace_metrics() : events_handled(0), schema_cache(), pushdown_failures(0) {}
+    };
+
+    namespace details {
+
+        /**
+         * <summary>
+         *   A copy of T for each thread that uses it, so that each copy
+         *   only has one writer and counting takes no locks or interlocked
+         *   instructions. Readers add up the copies, which can be a little
+         *   behind while they're being written.
+         * </summary>
+         * <remarks>
+         *   A thread claims a copy the first time it asks for one and keeps
+         *   it. Thread ids are only reused once a thread is gone, so a new
+         *   thread with the same id carries on with the same copy. Once
+         *   every copy is claimed, a new thread takes over the copy of a
+         *   thread that has exited, counts and all, or else another
+         *   shard_count copies are added; copies are never shared. T is
+         *   value-initialized, so counters start at zero.
+         * </remarks>
+         */
+        template <typename T>
+        class sharded {
+        public:
+            static const size_t shard_count = 64;
+
+            sharded();
+            ~sharded();
+
+            sharded(const sharded &) = delete;
+            sharded &operator=(const sharded &) = delete;
+
+            /**
+             * <summary>
+             *   The copy of the thread with the given id.
+             * </summary>
+             */
+            T &local(DWORD thread_id);
+
+            /**
+             * <summary>
+             *   Calls visit with each copy that's been claimed.
+             * </summary>
+             */
+            template <typename Visit>
+            void for_each(Visit visit) const;
+
+        private:
+            struct shard {
+                volatile LONG owner;
+                T *volatile value;
+            };
+
+            struct block {
+                shard shards[shard_count];
+                block *volatile next;
+            };
+
+            static T &value_of(shard &s);
+            static bool has_exited(LONG thread_id);
+
+            block first_;
+        };
+
+        /**
+         * <summary>
+         *   A latency_histogram that one thread writes while others read.
+         * </summary>
+         */
+        struct live_histogram {
+            volatile uint64_t counts[latency_histogram::bucket_count];
+            volatile uint64_t sum;
+            volatile uint64_t max;
+
+            void record(uint64_t value);
+            void add_to(latency_histogram &histogram) const;
+        };
+
+        struct event_id_counts {
+            volatile uint64_t events;
+            volatile uint64_t bytes;
+            volatile uint64_t accepted;
+        };
+
+        /**
+         * <summary>
+         *   One thread's counts for a provider. Event ids are counted in
+         *   pages of 256, which are only allocated for ids that are seen.
+         * </summary>
+         */
+        struct provider_shard {
+            static const size_t page_size = 256;
+
+            volatile uint64_t events;
+            volatile uint64_t bytes;
+            volatile uint64_t accepted;
+            live_histogram callback_latency;
+            event_id_counts *volatile pages[65536 / page_size];
+
+            ~provider_shard();
+
+            event_id_counts &event_id(unsigned short id);
+        };
+
+        struct filter_shard {
+            volatile uint64_t events;
+            volatile uint64_t passed;
+            live_histogram predicate_latency;
+            live_histogram callback_latency;
+        };
+
+        typedef sharded<provider_shard> provider_stats;
+        typedef sharded<filter_shard> filter_stats;
+
+        struct event_count {
+            volatile uint64_t value;
+        };
+
+        typedef sharded<event_count> event_counter;
+
+        /**
+         * <summary>
+         *   The ticks between two calls to QueryPerformanceCounter.
+         * </summary>
+         */
+        inline uint64_t ticks_since(const LARGE_INTEGER &start, LARGE_INTEGER &now)
+        {
+            QueryPerformanceCounter(&now);
+            return static_cast<uint64_t>(now.QuadPart - start.QuadPart);
+        }
+
+        /**
+         * <summary>
+         *   Adds up what the provider's threads counted.
+         * </summary>
+         */
+        void add_provider_stats(
+            const provider_stats &stats,
+            provider_metrics &metrics);
+
+        void add_filter_stats(
+            const filter_stats &stats,
+            filter_metrics &metrics);
+
+        uint64_t total(const event_counter &counter);
+
+    } /* namespace details */
+
+    // Implementation
+    // ------------------------------------------------------------------------
+
+    inline latency_histogram::latency_histogram()
+    : counts_()
+    , count_(0)
+    , sum_(0)
+    , max_(0)
+    {}
+
+    inline void latency_histogram::record(uint64_t value)
+    {
+        ++counts_[bucket_of(value)];
+        ++count_;
+        sum_ += value;
+        if (value > max_) {
+            max_ = value;
+        }
+    }
+
+    inline void latency_histogram::merge(const latency_histogram &other)
+    {
+        for (size_t i = 0; i < bucket_count; ++i) {
+            counts_[i] += other.counts_[i];
+        }
+
+        count_ += other.count_;
+        sum_ += other.sum_;
+        if (other.max_ > max_) {
+            max_ = other.max_;
+        }
+    }
+
+    inline double latency_histogram::mean() const
+    {
+        return count_ == 0 ? 0.0 : static_cast<double>(sum_) / static_cast<double>(count_);
+    }
+
+    inline uint64_t latency_histogram::percentile(double percent) const
+    {
+        if (count_ == 0) {
+            return 0;
+        }
+
+        uint64_t wanted = static_cast<uint64_t>(static_cast<double>(count_) * percent / 100.0 + 0.5);
+        if (wanted == 0) {
+            wanted = 1;
+        }
+
+        uint64_t seen = 0;
+        for (size_t i = 0; i < bucket_count; ++i) {
+            seen += counts_[i];
+            if (seen >= wanted) {
+                const uint64_t high = bucket_high(i);
+                return high < max_ ? high : max_;
+            }
+        }
+
+        return max_;
+    }
+
+    inline size_t latency_histogram::bucket_of(uint64_t value)
+    {
+        if (value < sub_buckets) {
+            return static_cast<size_t>(value);
+        }
+
+        // The highest set bit picks the power of two, and the three bits
+        // below it the eighth of it.
+        unsigned int bit = 0;
+        uint64_t rest = value;
+        if (rest >> 32) { rest >>= 32; bit += 32; }
+        if (rest >> 16) { rest >>= 16; bit += 16; }
+        if (rest >> 8)  { rest >>= 8;  bit += 8; }
+        if (rest >> 4)  { rest >>= 4;  bit += 4; }
+        if (rest >> 2)  { rest >>= 2;  bit += 2; }
+        if (rest >> 1)  { bit += 1; }
+
+        const unsigned int shift = bit - 3;
+        return (shift + 1) * sub_buckets + static_cast<size_t>((value >> shift) & (sub_buckets - 1));
+    }
+
+    inline uint64_t latency_histogram::bucket_high(size_t bucket)
+    {
+        if (bucket < sub_buckets) {
+            return bucket;
+        }
+
+        const size_t shift = bucket / sub_buckets - 1;
+        const uint64_t next = (sub_buckets + bucket % sub_buckets + 1);
+
+        // The last bucket ends at the largest uint64_t, where this wraps.
+        return (next << shift) - 1;
+    }
+
+    namespace details {
+
+        template <typename T>
+        sharded<T>::sharded()
+        {
+            for (auto &s : first_.shards) {
+                s.owner = 0;
+                s.value = nullptr;
+            }
+
+            first_.next = nullptr;
+        }
+
+        template <typename T>
+        sharded<T>::~sharded()
+        {
+            for (block *b = &first_; b != nullptr; ) {
+                for (auto &s : b->shards) {
+                    delete s.value;
+                }
+
+                block *next = b->next;
+                if (b != &first_) {
+                    delete b;
+                }
+                b = next;
+            }
+        }
+
+        template <typename T>
+        T &sharded<T>::local(DWORD thread_id)
+        {
+            // Windows thread ids are multiples of four.
+            const size_t start = (thread_id >> 2) % shard_count;
+            const LONG self = static_cast<LONG>(thread_id);
+
+            for (;;) {
+                // Copies are never given up while their thread runs, so a
+                // thread that has one finds it before any unclaimed copy.
+                block *last = nullptr;
+                for (block *b = &first_; b != nullptr; b = b->next) {
+                    for (size_t i = 0; i < shard_count; ++i) {
+                        auto &s = b->shards[(start + i) % shard_count];
+
+                        if (s.owner == self) {
+                            return value_of(s);
+                        }
+
+                        if (s.owner == 0 && InterlockedCompareExchange(&s.owner, self, 0) == 0) {
+                            return value_of(s);
+                        }
+                    }
+
+                    last = b;
+                }
+
+                // Every copy is claimed. Counting carries on in the copy of
+                // a thread that's gone, which only that thread wrote to.
+                for (block *b = &first_; b != nullptr; b = b->next) {
+                    for (auto &s : b->shards) {
+                        const LONG owner = s.owner;
+                        if (owner != 0 && has_exited(owner) &&
+                            InterlockedCompareExchange(&s.owner, self, owner) == owner) {
+                            return value_of(s);
+                        }
+                    }
+                }
+
+                // Otherwise add copies. Whoever loses the race looks again.
+                std::unique_ptr<block> added(new block());
+                for (auto &s : added->shards) {
+                    s.owner = 0;
+                    s.value = nullptr;
+                }
+                added->next = nullptr;
+
+                if (InterlockedCompareExchangePointer(
+                        reinterpret_cast<PVOID volatile *>(&last->next), added.get(), nullptr) == nullptr) {
+                    added.release();
+                }
+            }
+        }
+
+        template <typename T>
+        T &sharded<T>::value_of(shard &s)
+        {
+            T *value = s.value;
+            if (value != nullptr) {
+                return *value;
+            }
+
+            // Just claimed, or taken over from a thread that exited before
+            // it got to allocate it.
+            value = new T();
+            InterlockedExchangePointer(reinterpret_cast<PVOID volatile *>(&s.value), value);
+            return *value;
+        }
+
+        template <typename T>
+        bool sharded<T>::has_exited(LONG thread_id)
+        {
+            HANDLE thread = OpenThread(SYNCHRONIZE, FALSE, static_cast<DWORD>(thread_id));
+            if (thread == nullptr) {
+                // No thread has the id anymore.
+                return GetLastError() == ERROR_INVALID_PARAMETER;
+            }
+
+            const bool exited = WaitForSingleObject(thread, 0) == WAIT_OBJECT_0;
+            CloseHandle(thread);
+            return exited;
+        }
+
+        template <typename T>
+        template <typename Visit>
+        void sharded<T>::for_each(Visit visit) const
+        {
+            for (const block *b = &first_; b != nullptr; b = b->next) {
+                for (auto &s : b->shards) {
+                    const T *value = s.value;
+                    if (value != nullptr) {
+                        visit(*value);
+                    }
+                }
+            }
+        }
+
+        inline void live_histogram::record(uint64_t value)
+        {
+            // Only the owning thread writes, so these needn't be atomic.
+            ++counts[latency_histogram::bucket_of(value)];
+            sum += value;
+            if (value > max) {
+                max = value;
+            }
+        }
+
+        inline void live_histogram::add_to(latency_histogram &histogram) const
+        {
+            for (size_t i = 0; i < latency_histogram::bucket_count; ++i) {
+                const uint64_t count = counts[i];
+                histogram.counts_[i] += count;
+                histogram.count_ += count;
+            }
+
+            histogram.sum_ += sum;
+            const uint64_t max = this->max;
+            if (max > histogram.max_) {
+                histogram.max_ = max;
+            }
+        }
+
+        inline provider_shard::~provider_shard()
+        {
+            for (auto page : pages) {
+                delete[] page;
+            }
+        }
+
+        inline event_id_counts &provider_shard::event_id(unsigned short id)
+        {
+            auto &page = pages[id / page_size];
+            if (page == nullptr) {
+                // Readers may look at the page as soon as it's published,
+                // so it's zeroed first.
+                auto counts = new event_id_counts[page_size]();
+                InterlockedExchangePointer(reinterpret_cast<PVOID volatile *>(&page), counts);
+            }
+
+            return page[id % page_size];
+        }
+
+        inline void add_provider_stats(
+            const provider_stats &stats,
+            provider_metrics &metrics)
+        {
+            // Ids are added up a page at a time, and only for the pages
+            // some thread has allocated.
+            const size_t page_count = 65536 / provider_shard::page_size;
+            std::vector<std::vector<event_id_metrics>> pages(page_count);
+
+            stats.for_each([&](const provider_shard &shard) {
+                metrics.events += shard.events;
+                metrics.bytes += shard.bytes;
+                metrics.accepted += shard.accepted;
+                shard.callback_latency.add_to(metrics.callback_latency);
+
+                for (size_t p = 0; p < page_count; ++p) {
+                    const event_id_counts *page = shard.pages[p];
+                    if (page == nullptr) {
+                        continue;
+                    }
+
+                    auto &totals = pages[p];
+                    if (totals.empty()) {
+                        totals.resize(provider_shard::page_size, event_id_metrics());
+                    }
+
+                    for (size_t i = 0; i < provider_shard::page_size; ++i) {
+                        totals[i].events += page[i].events;
+                        totals[i].bytes += page[i].bytes;
+                        totals[i].accepted += page[i].accepted;
+                    }
+                }
+            });
+
+            for (size_t p = 0; p < page_count; ++p) {
+                for (size_t i = 0; i < pages[p].size(); ++i) {
+                    if (pages[p][i].events != 0) {
+                        pages[p][i].event_id = static_cast<unsigned short>(p * provider_shard::page_size + i);
+                        metrics.event_ids.push_back(pages[p][i]);
+                    }
+                }
+            }
+        }
+
+        inline void add_filter_stats(
+            const filter_stats &stats,
+            filter_metrics &metrics)
+        {
+            stats.for_each([&](const filter_shard &shard) {
+                metrics.events += shard.events;
+                metrics.passed += shard.passed;
+                shard.predicate_latency.add_to(metrics.predicate_latency);
+                shard.callback_latency.add_to(metrics.callback_latency);
+            });
+        }
+
+        inline uint64_t total(const event_counter &counter)
+        {
+            uint64_t sum = 0;
+            counter.for_each([&sum](const event_count &count) { sum += count.value; });
+            return sum;
+        }
+
+    } /* namespace details */
+
+} /* namespace krabs */
@@ -0,0 +1,191 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+// Deliberately free of windows.h and the compiler check: tools that read the
+// metrics may be built with other compilers or on other platforms (to read a
+// copy of the section, say), and only need this header.
+
+#include <cstddef>
+#include <cstdint>
+
+namespace krabs { namespace monitoring {
+
+    /**
+     * <summary>
+     *   Layout of the shared memory krabs publishes metrics into.
+     * </summary>
+     * <remarks>
+     *   The memory holds a metrics_header followed by three arrays, at the
+     *   offsets the header gives: provider_records, filter_records and
+     *   event_id_records. Each provider record names the range of filters
+     *   and event ids that are its own. The arrays have a fixed capacity;
+     *   what doesn't fit is left out and flags_truncated is set.
+     *
+     *   The header's sequence is a seqlock. A publisher makes it odd,
+     *   writes everything after it, and makes it even again. A reader
+     *   copies what it needs between two reads of the sequence, and keeps
+     *   the copy only if both reads were the same even number. Reading
+     *   takes no system calls and never blocks the publisher.
+     *
+     *   Every field has a fixed size and is aligned to its size, so the
+     *   layout is the same for any compiler that maps the memory; the
+     *   static_asserts below pin the sizes and offsets readers rely on,
+     *   and changing any of them takes a new metrics_version. Latencies
+     *   are in QueryPerformanceCounter ticks, of which there are
+     *   ticks_per_second.
+     * </remarks>
+     */
+    namespace constants {
+        const uint64_t metrics_magic        = 0x315254454D534B52; // "RKSMETR1"
+        const uint32_t metrics_version      = 1;
+        const uint32_t flags_truncated      = 0x1;
+    }
+
+    // A GUID as Windows lays it out in memory.
+    struct metrics_guid
+    {
+        uint32_t data1;
+        uint16_t data2;
+        uint16_t data3;
+        uint8_t  data4[8];
+    };
+
+    struct latency_summary
+    {
+        uint64_t count;
+        uint64_t sum;
+        uint64_t max;
+        uint64_t p50;
+        uint64_t p90;
+        uint64_t p99;
+        uint64_t p999;
+    };
+
+    struct metrics_header
+    {
+        uint64_t magic;
+        uint32_t version;
+        uint32_t header_size;
+        uint64_t size;
+
+        // Odd while the publisher is writing.
+        volatile int32_t sequence;
+        uint32_t flags;
+
+        // When the metrics were published, as a FILETIME.
+        uint64_t published;
+        int64_t  ticks_per_second;
+
+        uint64_t events_handled;
+
+        uint64_t schema_hits;
+        uint64_t schema_misses;
+        uint64_t schema_evictions;
+        uint64_t schemas_resident;
+        uint64_t schema_bytes_resident;
+        uint64_t tdh_microseconds;
+
+        // Filled in when an event_merger is published along.
+        uint64_t queue_depth;
+        uint64_t queue_max_depth;
+        uint64_t queue_received;
+        uint64_t queue_delivered;
+        uint64_t queue_late;
+        uint64_t queue_dropped;
+
+        uint32_t providers_offset;
+        uint32_t provider_capacity;
+        uint32_t provider_count;
+        uint32_t filters_offset;
+        uint32_t filter_capacity;
+        uint32_t filter_count;
+        uint32_t event_ids_offset;
+        uint32_t event_id_capacity;
+        uint32_t event_id_count;
+        uint32_t reserved;
+    };
+
+    struct provider_record
+    {
+        metrics_guid provider;
+        uint32_t first_filter;
+        uint32_t filter_count;
+        uint32_t first_event_id;
+        uint32_t event_id_count;
+        uint64_t events;
+        uint64_t bytes;
+        uint64_t accepted;
+        latency_summary callback_latency;
+    };
+
+    struct filter_record
+    {
+        uint64_t filter;
+        uint64_t events;
+        uint64_t passed;
+        latency_summary predicate_latency;
+        latency_summary callback_latency;
+    };
+
+    struct event_id_record
+    {
+        uint16_t event_id;
+        uint16_t reserved[3];
+        uint64_t events;
+        uint64_t bytes;
+        uint64_t accepted;
+    };
+
+    namespace details {
+
+        /**
+         * <summary>
+         *   Where each array starts, and how many bytes the whole layout
+         *   takes, for the given capacities.
+         * </summary>
+         */
+        struct metrics_layout
+        {
+            uint32_t providers_offset;
+            uint32_t filters_offset;
+            uint32_t event_ids_offset;
+            size_t size;
+
+            metrics_layout(uint32_t provider_capacity, uint32_t filter_capacity, uint32_t event_id_capacity)
+            : providers_offset(sizeof(metrics_header))
+            , filters_offset(providers_offset + provider_capacity * sizeof(provider_record))
+            , event_ids_offset(filters_offset + filter_capacity * sizeof(filter_record))
+            , size(event_ids_offset + event_id_capacity * sizeof(event_id_record))
+            {}
+        };
+
+    } /* namespace details */
+
+    static_assert(sizeof(metrics_guid) == 16, "metrics_guid layout changed");
+    static_assert(sizeof(latency_summary) == 56, "latency_summary layout changed");
+
+    static_assert(sizeof(metrics_header) == 192, "metrics_header layout changed");
+    static_assert(offsetof(metrics_header, version) == 8, "metrics_header layout changed");
+    static_assert(offsetof(metrics_header, size) == 16, "metrics_header layout changed");
+    static_assert(offsetof(metrics_header, sequence) == 24, "metrics_header layout changed");
+    static_assert(offsetof(metrics_header, published) == 32, "metrics_header layout changed");
+    static_assert(offsetof(metrics_header, events_handled) == 48, "metrics_header layout changed");
+    static_assert(offsetof(metrics_header, queue_depth) == 104, "metrics_header layout changed");
+    static_assert(offsetof(metrics_header, providers_offset) == 152, "metrics_header layout changed");
+    static_assert(offsetof(metrics_header, event_id_count) == 184, "metrics_header layout changed");
+
+    static_assert(sizeof(provider_record) == 112, "provider_record layout changed");
+    static_assert(offsetof(provider_record, first_filter) == 16, "provider_record layout changed");
+    static_assert(offsetof(provider_record, events) == 32, "provider_record layout changed");
+    static_assert(offsetof(provider_record, callback_latency) == 56, "provider_record layout changed");
+
+    static_assert(sizeof(filter_record) == 136, "filter_record layout changed");
+    static_assert(offsetof(filter_record, predicate_latency) == 24, "filter_record layout changed");
+    static_assert(offsetof(filter_record, callback_latency) == 80, "filter_record layout changed");
+
+    static_assert(sizeof(event_id_record) == 32, "event_id_record layout changed");
+    static_assert(offsetof(event_id_record, events) == 8, "event_id_record layout changed");
+
+} /* namespace monitoring */ } /* namespace krabs */
@@ -0,0 +1,334 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#ifndef  WIN32_LEAN_AND_MEAN
+#define  WIN32_LEAN_AND_MEAN
+#endif
+
+#include <windows.h>
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../compiler_check.hpp"
+#include "../event_merger.hpp"
+#include "../metrics.hpp"
+#include "metrics_format.hpp"
+
+namespace krabs { namespace monitoring {
+
+    /**
+     * <summary>
+     *   Publishes a trace's metrics into a named shared memory section, so
+     *   that monitoring tools can read them with a monitoring::reader
+     *   without calling into the process or into ETW.
+     * </summary>
+     * <remarks>
+     *   Publishing is up to the caller, from whichever thread suits it;
+     *   it only reads counters and copies them, so it doesn't slow down
+     *   the thread processing events. Only one thread may publish at a
+     *   time. See metrics_format.hpp for the layout.
+     * </remarks>
+     * <example>
+     *   krabs::monitoring::publisher publisher(L"Local\\krabs-agent-metrics");
+     *   powershell.enable_metrics();
+     *   trace.enable(powershell);
+     *   // ... every few seconds, on a thread of your own
+     *   publisher.publish(trace.metrics());
+     * </example>
+     */
+    class publisher {
+    public:
+
+        /**
+         * <summary>
+         *   Creates the named section (or opens it, if it exists) with room
+         *   for the given number of providers, filters and event ids.
+         * </summary>
+         */
+        publisher(
+            const std::wstring &name,
+            ULONG provider_capacity = 64,
+            ULONG filter_capacity = 256,
+            ULONG event_id_capacity = 4096);
+
+        /**
+         * <summary>
+         *   Publishes into the given vector instead of shared memory. The
+         *   vector has to outlive the publisher.
+         * </summary>
+         */
+        publisher(
+            std::vector<BYTE> &destination,
+            ULONG provider_capacity = 64,
+            ULONG filter_capacity = 256,
+            ULONG event_id_capacity = 4096);
+
+        ~publisher();
+
+        publisher(const publisher &) = delete;
+        publisher &operator=(const publisher &) = delete;
+
+        /**
+         * <summary>
+         *   Replaces what's published with the given metrics.
+         * </summary>
+         */
+        void publish(const trace_metrics &metrics);
+
+        /**
+         * <summary>
+         *   Replaces what's published with the given metrics, and the
+         *   depth and counters of the given merger.
+         * </summary>
+         */
+        void publish(const trace_metrics &metrics, const event_merger &merger);
+
+    private:
+        void initialize(ULONG provider_capacity, ULONG filter_capacity, ULONG event_id_capacity);
+        void write(const trace_metrics &metrics, const event_merger *merger);
+
+        static void summarize(const latency_histogram &histogram, latency_summary &summary);
+
+    private:
+        HANDLE mapping_;
+        BYTE *data_;
+        metrics_header *header_;
+    };
+
+    namespace details {
+
+        // The layout sticks to fixed-width types so it doesn't need
+        // windows.h; these are the same sizes as their Windows types.
+        static_assert(sizeof(LONG) == sizeof(int32_t), "sequence has to be a LONG");
+        static_assert(sizeof(GUID) == sizeof(metrics_guid), "metrics_guid has to be a GUID");
+
+        inline void advance_sequence(volatile int32_t &sequence)
+        {
+            InterlockedIncrement(reinterpret_cast<volatile LONG*>(&sequence));
+        }
+
+    } /* namespace details */
+
+    // Implementation
+    // ------------------------------------------------------------------------
+
+    inline publisher::publisher(
+        const std::wstring &name,
+        ULONG provider_capacity,
+        ULONG filter_capacity,
+        ULONG event_id_capacity)
+    : mapping_(nullptr)
+    , data_(nullptr)
+    , header_(nullptr)
+    {
+        const details::metrics_layout layout(provider_capacity, filter_capacity, event_id_capacity);
+
+        mapping_ = CreateFileMappingW(
+            INVALID_HANDLE_VALUE,
+            nullptr,
+            PAGE_READWRITE,
+            0,
+            static_cast<DWORD>(layout.size),
+            name.c_str());
+
+        if (mapping_ == nullptr) {
+            throw std::runtime_error("Could not create the metrics section");
+        }
+
+        data_ = static_cast<BYTE*>(MapViewOfFile(mapping_, FILE_MAP_WRITE, 0, 0, layout.size));
+        if (data_ == nullptr) {
+            CloseHandle(mapping_);
+            throw std::runtime_error("Could not map the metrics section");
+        }
+
+        initialize(provider_capacity, filter_capacity, event_id_capacity);
+    }
+
+    inline publisher::publisher(
+        std::vector<BYTE> &destination,
+        ULONG provider_capacity,
+        ULONG filter_capacity,
+        ULONG event_id_capacity)
+    : mapping_(nullptr)
+    , data_(nullptr)
+    , header_(nullptr)
+    {
+        const details::metrics_layout layout(provider_capacity, filter_capacity, event_id_capacity);
+
+        // Vectors are allocated with new, which aligns well enough for
+        // every field of the layout.
+        destination.assign(layout.size, 0);
+        data_ = destination.data();
+
+        initialize(provider_capacity, filter_capacity, event_id_capacity);
+    }
+
+    inline publisher::~publisher()
+    {
+        if (mapping_ != nullptr) {
+            UnmapViewOfFile(data_);
+            CloseHandle(mapping_);
+        }
+    }
+
+    inline void publisher::publish(const trace_metrics &metrics)
+    {
+        write(metrics, nullptr);
+    }
+
+    inline void publisher::publish(const trace_metrics &metrics, const event_merger &merger)
+    {
+        write(metrics, &merger);
+    }
+
+    inline void publisher::initialize(ULONG provider_capacity, ULONG filter_capacity, ULONG event_id_capacity)
+    {
+        const details::metrics_layout layout(provider_capacity, filter_capacity, event_id_capacity);
+        header_ = reinterpret_cast<metrics_header*>(data_);
+
+        // The section may have outlived an earlier publisher, even one that
+        // died mid-write, so the sequence carries on from where it is.
+        if ((header_->sequence & 1) == 0) {
+            details::advance_sequence(header_->sequence);
+        }
+
+        header_->magic = constants::metrics_magic;
+        header_->version = constants::metrics_version;
+        header_->header_size = sizeof(metrics_header);
+        header_->size = layout.size;
+        header_->flags = 0;
+        header_->providers_offset = layout.providers_offset;
+        header_->provider_capacity = provider_capacity;
+        header_->provider_count = 0;
+        header_->filters_offset = layout.filters_offset;
+        header_->filter_capacity = filter_capacity;
+        header_->filter_count = 0;
+        header_->event_ids_offset = layout.event_ids_offset;
+        header_->event_id_capacity = event_id_capacity;
+        header_->event_id_count = 0;
+
+        details::advance_sequence(header_->sequence);
+    }
+
+    inline void publisher::write(const trace_metrics &metrics, const event_merger *merger)
+    {
+        metrics_header &header = *header_;
+        auto providers = reinterpret_cast<provider_record*>(data_ + header.providers_offset);
+        auto filters = reinterpret_cast<filter_record*>(data_ + header.filters_offset);
+        auto event_ids = reinterpret_cast<event_id_record*>(data_ + header.event_ids_offset);
+
+        // Odd until the write is done. The increments are full barriers,
+        // so nothing written here is seen outside of the two.
+        details::advance_sequence(header.sequence);
+
+        FILETIME now;
+        GetSystemTimeAsFileTime(&now);
+        header.published = (static_cast<ULONGLONG>(now.dwHighDateTime) << 32) | now.dwLowDateTime;
+
+        LARGE_INTEGER frequency;
+        QueryPerformanceFrequency(&frequency);
+        header.ticks_per_second = frequency.QuadPart;
+
+        header.events_handled = metrics.events_handled;
+        header.schema_hits = metrics.schema_cache.hits;
+        header.schema_misses = metrics.schema_cache.misses;
+        header.schema_evictions = metrics.schema_cache.evictions;
+        header.schemas_resident = metrics.schema_cache.schemas_resident;
+        header.schema_bytes_resident = metrics.schema_cache.bytes_resident;
+        header.tdh_microseconds = metrics.schema_cache.tdh_microseconds;
+
+        if (merger != nullptr) {
+            const auto stats = merger->stats();
+            header.queue_depth = merger->depth();
+            header.queue_max_depth = stats.max_depth;
+            header.queue_received = stats.events_received;
+            header.queue_delivered = stats.events_delivered;
+            header.queue_late = stats.events_late;
+            header.queue_dropped = stats.events_dropped;
+        }
+        else {
+            header.queue_depth = 0;
+            header.queue_max_depth = 0;
+            header.queue_received = 0;
+            header.queue_delivered = 0;
+            header.queue_late = 0;
+            header.queue_dropped = 0;
+        }
+
+        ULONG provider_count = 0;
+        ULONG filter_count = 0;
+        ULONG event_id_count = 0;
+        bool truncated = false;
+
+        for (const auto &provider : metrics.providers) {
+            if (provider_count == header.provider_capacity) {
+                truncated = true;
+                break;
+            }
+
+            provider_record &record = providers[provider_count++];
+            const GUID id = provider.provider;
+            std::memcpy(&record.provider, &id, sizeof(record.provider));
+            record.events = provider.events;
+            record.bytes = provider.bytes;
+            record.accepted = provider.accepted;
+            summarize(provider.callback_latency, record.callback_latency);
+
+            record.first_filter = filter_count;
+            for (const auto &filter : provider.filters) {
+                if (filter_count == header.filter_capacity) {
+                    truncated = true;
+                    break;
+                }
+
+                filter_record &out = filters[filter_count++];
+                out.filter = filter.filter;
+                out.events = filter.events;
+                out.passed = filter.passed;
+                summarize(filter.predicate_latency, out.predicate_latency);
+                summarize(filter.callback_latency, out.callback_latency);
+            }
+            record.filter_count = filter_count - record.first_filter;
+
+            record.first_event_id = event_id_count;
+            for (const auto &id : provider.event_ids) {
+                if (event_id_count == header.event_id_capacity) {
+                    truncated = true;
+                    break;
+                }
+
+                event_id_record &out = event_ids[event_id_count++];
+                std::memset(&out, 0, sizeof(out));
+                out.event_id = id.event_id;
+                out.events = id.events;
+                out.bytes = id.bytes;
+                out.accepted = id.accepted;
+            }
+            record.event_id_count = event_id_count - record.first_event_id;
+        }
+
+        header.provider_count = provider_count;
+        header.filter_count = filter_count;
+        header.event_id_count = event_id_count;
+        header.flags = truncated ? constants::flags_truncated : 0;
+
+        details::advance_sequence(header.sequence);
+    }
+
+    inline void publisher::summarize(const latency_histogram &histogram, latency_summary &summary)
+    {
+        summary.count = histogram.count();
+        summary.sum = histogram.sum();
+        summary.max = histogram.max();
+        summary.p50 = histogram.percentile(50.0);
+        summary.p90 = histogram.percentile(90.0);
+        summary.p99 = histogram.percentile(99.0);
+        summary.p999 = histogram.percentile(99.9);
+    }
+
+} /* namespace monitoring */ } /* namespace krabs */
@@ -0,0 +1,146 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#ifndef  WIN32_LEAN_AND_MEAN
+#define  WIN32_LEAN_AND_MEAN
+#endif
+
+#include <windows.h>
+
+#include <stdexcept>
+#include <string>
+
+#include "../compiler_check.hpp"
+#include "metrics_view.hpp"
+
+namespace krabs { namespace monitoring {
+
+    /**
+     * <summary>
+     *   Reads the metrics a monitoring::publisher publishes, typically
+     *   from another process. Reading doesn't call into the system: it
+     *   copies the shared memory, and copies again if the publisher was
+     *   writing meanwhile.
+     * </summary>
+     * <remarks>
+     *   Only opening the section takes Windows. The reading is done by a
+     *   monitoring::view, which tools on other platforms can use on
+     *   their own.
+     * </remarks>
+     * <example>
+     *   krabs::monitoring::reader reader(L"Local\\krabs-agent-metrics");
+     *   auto metrics = reader.read();
+     *   for (auto &provider : metrics.providers) { ... }
+     * </example>
+     */
+    class reader {
+    public:
+
+        /**
+         * <summary>
+         *   Opens the named section for reading.
+         * </summary>
+         */
+        reader(const std::wstring &name);
+
+        /**
+         * <summary>
+         *   Reads metrics that are already in memory. The memory has to stay
+         *   valid for the lifetime of the reader.
+         * </summary>
+         */
+        reader(const BYTE *data, size_t size);
+
+        ~reader();
+
+        reader(const reader &) = delete;
+        reader &operator=(const reader &) = delete;
+
+        /**
+         * <summary>
+         *   Copies the metrics if the publisher isn't writing them. Returns
+         *   false, leaving metrics in an unspecified state, if it was.
+         * </summary>
+         */
+        bool try_read(published_metrics &metrics) const { return view_.try_read(metrics); }
+
+        /**
+         * <summary>
+         *   Copies the metrics, trying again while the publisher is writing
+         *   them. Throws if it was writing every time.
+         * </summary>
+         */
+        published_metrics read(unsigned int attempts = 1000) const { return view_.read(attempts); }
+
+    private:
+
+        /**
+         * <summary>
+         *   Maps the named section and returns a view of it, leaving
+         *   nothing open if it isn't a metrics section.
+         * </summary>
+         */
+        static view open(const std::wstring &name, HANDLE &mapping, const BYTE *&data);
+
+    private:
+        HANDLE mapping_;
+        const BYTE *data_;
+        bool owns_view_;
+        view view_;
+    };
+
+    // Implementation
+    // ------------------------------------------------------------------------
+
+    inline reader::reader(const std::wstring &name)
+    : mapping_(nullptr)
+    , data_(nullptr)
+    , owns_view_(true)
+    , view_(open(name, mapping_, data_))
+    {
+    }
+
+    inline reader::reader(const BYTE *data, size_t size)
+    : mapping_(nullptr)
+    , data_(data)
+    , owns_view_(false)
+    , view_(data, size)
+    {
+    }
+
+    inline reader::~reader()
+    {
+        if (owns_view_) {
+            UnmapViewOfFile(data_);
+            CloseHandle(mapping_);
+        }
+    }
+
+    inline view reader::open(const std::wstring &name, HANDLE &mapping, const BYTE *&data)
+    {
+        mapping = OpenFileMappingW(FILE_MAP_READ, FALSE, name.c_str());
+        if (mapping == nullptr) {
+            throw std::runtime_error("Could not open the metrics section");
+        }
+
+        data = static_cast<const BYTE*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        if (data == nullptr) {
+            CloseHandle(mapping);
+            throw std::runtime_error("Could not map the metrics section");
+        }
+
+        // The size is only known once the header can be read.
+        try {
+            view header(data, sizeof(metrics_header));
+            return view(data, static_cast<size_t>(reinterpret_cast<const metrics_header*>(data)->size));
+        }
+        catch (...) {
+            UnmapViewOfFile(data);
+            CloseHandle(mapping);
+            throw;
+        }
+    }
+
+} /* namespace monitoring */ } /* namespace krabs */
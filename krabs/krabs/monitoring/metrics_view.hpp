@@ -0,0 +1,179 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+// Deliberately free of windows.h and the compiler check, like
+// metrics_format.hpp: a copy of the section can be read anywhere. Only
+// /clr, which has no <atomic>, takes its fence from windows.h.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#if defined(_M_CEE)
+#ifndef  WIN32_LEAN_AND_MEAN
+#define  WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <atomic>
+#endif
+
+#include "metrics_format.hpp"
+
+namespace krabs { namespace monitoring {
+
+    /**
+     * <summary>
+     *   A consistent copy of what a publisher last published.
+     * </summary>
+     */
+    struct published_metrics
+    {
+        metrics_header header;
+        std::vector<provider_record> providers;
+        std::vector<filter_record> filters;
+        std::vector<event_id_record> event_ids;
+
+        bool truncated() const { return (header.flags & constants::flags_truncated) != 0; }
+    };
+
+    /**
+     * <summary>
+     *   Reads metrics out of memory laid out as metrics_format.hpp
+     *   describes: the mapped section itself, or a copy of it. This is
+     *   what a monitoring::reader reads with once it has mapped the
+     *   section.
+     * </summary>
+     * <example>
+     *   krabs::monitoring::view view(bytes.data(), bytes.size());
+     *   auto metrics = view.read();
+     * </example>
+     */
+    class view {
+    public:
+
+        /**
+         * <summary>
+         *   Checks the header and reads from the given memory, which has to
+         *   stay valid for as long as the view is used.
+         * </summary>
+         */
+        view(const uint8_t *data, size_t size);
+
+        /**
+         * <summary>
+         *   Copies the metrics if the publisher isn't writing them. Returns
+         *   false, leaving metrics in an unspecified state, if it was.
+         * </summary>
+         */
+        bool try_read(published_metrics &metrics) const;
+
+        /**
+         * <summary>
+         *   Copies the metrics, trying again while the publisher is writing
+         *   them. Throws if it was writing every time.
+         * </summary>
+         */
+        published_metrics read(unsigned int attempts = 1000) const;
+
+    private:
+        void check_header() const;
+
+        template <typename Record>
+        void copy_records(uint32_t offset, uint32_t count, uint32_t capacity, std::vector<Record> &records) const;
+
+        static void fence();
+
+    private:
+        const uint8_t *data_;
+        size_t size_;
+    };
+
+    // Implementation
+    // ------------------------------------------------------------------------
+
+    inline view::view(const uint8_t *data, size_t size)
+    : data_(data)
+    , size_(size)
+    {
+        check_header();
+    }
+
+    inline void view::check_header() const
+    {
+        auto header = reinterpret_cast<const metrics_header*>(data_);
+        if (size_ < sizeof(metrics_header) || header->magic != constants::metrics_magic) {
+            throw std::runtime_error("Not a krabs metrics section");
+        }
+
+        if (header->version != constants::metrics_version) {
+            throw std::runtime_error("Unsupported krabs metrics version");
+        }
+    }
+
+    inline bool view::try_read(published_metrics &metrics) const
+    {
+        auto header = reinterpret_cast<const metrics_header*>(data_);
+
+        const int32_t before = header->sequence;
+        if ((before & 1) != 0) {
+            return false;
+        }
+
+        fence();
+        std::memcpy(&metrics.header, header, sizeof(metrics_header));
+
+        // The counts may be torn if the publisher started meanwhile, so
+        // they're only trusted as far as the capacities go.
+        copy_records(metrics.header.providers_offset, metrics.header.provider_count, metrics.header.provider_capacity, metrics.providers);
+        copy_records(metrics.header.filters_offset, metrics.header.filter_count, metrics.header.filter_capacity, metrics.filters);
+        copy_records(metrics.header.event_ids_offset, metrics.header.event_id_count, metrics.header.event_id_capacity, metrics.event_ids);
+
+        fence();
+        return header->sequence == before;
+    }
+
+    inline published_metrics view::read(unsigned int attempts) const
+    {
+        published_metrics metrics;
+        for (unsigned int i = 0; i < attempts; ++i) {
+            if (try_read(metrics)) {
+                return metrics;
+            }
+        }
+
+        throw std::runtime_error("The metrics were being published on every attempt");
+    }
+
+    template <typename Record>
+    void view::copy_records(uint32_t offset, uint32_t count, uint32_t capacity, std::vector<Record> &records) const
+    {
+        if (count > capacity) {
+            count = capacity;
+        }
+
+        if (offset > size_ || (size_ - offset) / sizeof(Record) < count) {
+            count = 0;
+        }
+
+        records.resize(count);
+        if (count > 0) {
+            std::memcpy(records.data(), data_ + offset, count * sizeof(Record));
+        }
+    }
+
+    inline void view::fence()
+    {
+        // A full fence, as the publisher's interlocked increments are.
+#if defined(_M_CEE)
+        MemoryBarrier();
+#else
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+#endif
+    }
+
+} /* namespace monitoring */ } /* namespace krabs */
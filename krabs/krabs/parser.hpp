@@ -90,8 +90,36 @@ namespace krabs {
         template <typename Adapter>
         auto view_of(const std::wstring &name, Adapter &adapter) -> collection_view<typename Adapter::const_iterator>;
 
-    private:
+        /**
+         * <summary>
+         * Locates the given property without interpreting it: where its bytes
+         * start, how many there are, and the schema's description of it.
+         * The result's found() is false if the event has no such property.
+         * </summary>
+         * <remarks>
+         * Meant for code that decodes many properties generically, e.g. into
+         * columns, and would otherwise copy every value through
+         * parse&lt;binary&gt;.
+         * </remarks>
+         */
         property_info find_property(const std::wstring &name);
+
+        /**
+         * <summary>
+         * Parses an integer property whose manifest gives it a value map or
+         * bitmap, along with that map, so that the value can be turned into
+         * names. Maps are fetched from TDH once per provider and cached by
+         * the schema_locator. Throws if the property doesn't exist or has no
+         * map.
+         * </summary>
+         * <example>
+         *    auto status = parser.parse_mapped(L"Status");
+         *    std::wcout << status.to_wstring() << std::endl;
+         * </example>
+         */
+        mapped_value parse_mapped(const std::wstring &name);
+
+    private:
         void cache_property(const wchar_t *name, property_info info);
 
     private:
@@ -223,6 +251,33 @@ namespace krabs {
         return 0;
     }
 
+    // parse_mapped
+    // ------------------------------------------------------------------------
+
+    inline mapped_value parser::parse_mapped(const std::wstring &name)
+    {
+        auto propInfo = find_property(name);
+        throw_if_property_not_found(propInfo);
+
+        const auto &info = *propInfo.pEventPropertyInfo_;
+        if ((info.Flags & PropertyStruct) != 0 || info.nonStructType.MapNameOffset == 0) {
+            throw std::runtime_error("Property does not have a value map");
+        }
+
+        if (propInfo.length_ == 0 || propInfo.length_ > sizeof(ULONG)) {
+            throw std::runtime_error("Property size doesn't match requested size");
+        }
+
+        ULONG value = 0;
+        memcpy(&value, propInfo.pPropertyIndex_, propInfo.length_);
+
+        const wchar_t *mapName = reinterpret_cast<const wchar_t*>(
+                                    reinterpret_cast<BYTE*>(schema_.pSchema_) +
+                                    info.nonStructType.MapNameOffset);
+
+        return mapped_value(value, schema_.schema_locator_.get_event_map(schema_.record_, mapName));
+    }
+
     // try_parse
     // ------------------------------------------------------------------------
 
@@ -5,12 +5,21 @@
 
 #define INITGUID
 
+#include <algorithm>
 #include <deque>
 #include <functional>
+#include <memory>
+#include <set>
+#include <stdexcept>
+#include <vector>
 
 #include "compiler_check.hpp"
 #include "filtering/event_filter.hpp"
+#include "filtering/filter_dispatch.hpp"
+#include "filtering/predicate_graph.hpp"
+#include "metrics.hpp"
 #include "perfinfo_groupmask.hpp"
+#include "snapshot.hpp"
 #include "trace_context.hpp"
 #include "wstring_convert.hpp"
 
@@ -41,6 +50,14 @@ namespace krabs {
     typedef void(*c_provider_callback)(const EVENT_RECORD &, const krabs::trace_context &);
     typedef std::function<void(const EVENT_RECORD &, const krabs::trace_context &)> provider_callback;
 
+    /**
+     * <summary>
+     *   Names a callback or filter added to a provider, so it can be
+     *   removed again.
+     * </summary>
+     */
+    typedef unsigned long long handler_id;
+
     namespace details {
 
         /**
@@ -56,6 +73,7 @@ namespace krabs {
             /**
              * <summary>
              * Adds a function to call when an event for this provider is fired.
+             * Returns the id to remove it by.
              * </summary>
              *
              * <param name="callback">the function to call into</param>
@@ -74,13 +92,13 @@ namespace krabs {
              *    provider.add_on_event_callback(fun);
              * </example>
              */
-            void add_on_event_callback(c_provider_callback callback);
+            handler_id add_on_event_callback(c_provider_callback callback);
 
             template <typename U>
-            void add_on_event_callback(U &callback);
+            handler_id add_on_event_callback(U &callback);
 
             template <typename U>
-            void add_on_event_callback(const U &callback);
+            handler_id add_on_event_callback(const U &callback);
 
             /**
              * <summary>
@@ -95,20 +113,180 @@ namespace krabs {
              *   powershell.add_filter(filter);
              * </example>
              */
-            void add_filter(const event_filter &f);
+            handler_id add_filter(const event_filter &f);
+
+            /**
+             * <summary>
+             *   Removes a callback, named by what add_on_event_callback
+             *   returned. Returns false if the provider doesn't have it.
+             * </summary>
+             * <remarks>
+             *   Callbacks and filters can be added and removed while the
+             *   trace is processing events. An event that's being processed
+             *   meanwhile still goes to the callbacks it started with, so a
+             *   callback added by reference must outlive it. The thread
+             *   processing events enables the provider again with what
+             *   its filters now ask for when it handles the next event.
+             * </remarks>
+             * <example>
+             *   auto id = powershell.add_on_event_callback(callback);
+             *   // ...
+             *   powershell.remove_on_event_callback(id);
+             * </example>
+             */
+            bool remove_on_event_callback(handler_id id);
+
+            /**
+             * <summary>
+             *   Removes a filter, named by what add_filter returned. Returns
+             *   false if the provider doesn't have it.
+             * </summary>
+             */
+            bool remove_filter(handler_id id);
+
+            /**
+             * <summary>
+             *   Starts counting the provider's events, their bytes and the
+             *   ones its callbacks were called for, overall and per event
+             *   id, and timing its callbacks and filters. Counts are kept
+             *   per thread and can be read while the trace runs.
+             * </summary>
+             * <remarks>
+             *   Timing costs two calls to QueryPerformanceCounter per event
+             *   and filter; providers without metrics don't pay for it.
+             * </remarks>
+             * <example>
+             *   powershell.enable_metrics();
+             *   trace.enable(powershell);
+             *   // ...
+             *   auto metrics = powershell.metrics();
+             *   auto p99 = metrics.callback_latency.percentile(99.0);
+             * </example>
+             */
+            void enable_metrics();
+
+            /**
+             * <summary>
+             *   Whether enable_metrics has been called.
+             * </summary>
+             */
+            bool metrics_enabled() const;
 
         protected:
 
             /**
              * <summary>
-             *   Called when an event occurs, forwards to callbacks and filters.
+             *   Called when an event occurs, forwards to callbacks and to the
+             *   filters for its id. Returns whether any callback was called.
+             * </summary>
+             */
+            bool on_event(const EVENT_RECORD &record, const krabs::trace_context &context) const;
+
+            /**
+             * <summary>
+             *   Whether the provider's event id filter, the union of the ids
+             *   of its filters, lets the id through. Without any ids, every
+             *   id gets through.
+             * </summary>
+             */
+            bool wants_event_id(unsigned short id) const;
+
+            /**
+             * <summary>
+             *   The ids the provider's filters were added for, sorted.
+             * </summary>
+             */
+            std::vector<unsigned short> filter_event_ids() const;
+
+            /**
+             * <summary>
+             *   What ETW can check on behalf of the provider's callbacks
+             *   and filters. Callbacks added straight to the provider get
+             *   every event, so they leave nothing to check.
+             * </summary>
+             */
+            filter_pushdown callbacks_pushdown() const;
+
+            /**
+             * <summary>
+             *   What's been counted so far, for the provider with the given
+             *   GUID. Empty if metrics aren't enabled.
              * </summary>
              */
-            void on_event(const EVENT_RECORD &record, const krabs::trace_context &context) const;
+            provider_metrics collect_metrics(const GUID &id) const;
 
         protected:
-            std::deque<provider_callback> callbacks_;
-            std::deque<event_filter> filters_;
+
+            /**
+             * <summary>
+             *   Everything that events are handed to. It's replaced as a
+             *   whole whenever something is added or removed, so events
+             *   can be processed meanwhile.
+             * </summary>
+             */
+            struct handlers {
+                std::deque<provider_callback> callbacks;
+                std::vector<handler_id> callback_ids;
+
+                std::deque<event_filter> filters;
+                std::vector<handler_id> filter_ids;
+
+                // Kept up to date as filters are added, so that an event only
+                // visits the filters that can take its id.
+                filter_dispatch dispatch;
+
+                // The predicates of the filters, merged so that what they share
+                // is only run once per event, and the node for each filter.
+                predicate_graph graph;
+                std::vector<unsigned int> roots;
+
+                // Set by enable_metrics, and shared by every copy so that
+                // counting carries on as handlers change. Filters' counts
+                // are kept in the same order as the filters.
+                std::shared_ptr<provider_stats> stats;
+                std::vector<std::shared_ptr<filter_stats>> per_filter_stats;
+
+                handler_id next_id = 1;
+            };
+
+            handler_id add_callback(const provider_callback &callback);
+
+            /**
+             * <summary>
+             *   Tells the trace the provider is enabled on that its
+             *   callbacks or filters changed, so that the thread processing
+             *   events enables it again with what they ask for now.
+             * </summary>
+             */
+            void handlers_changed();
+
+            /**
+             * <summary>
+             *   Adds the filter at index to the dispatch and the graph.
+             * </summary>
+             */
+            static void index_filter(handlers &next, size_t index);
+
+            /**
+             * <summary>
+             *   on_event for providers with metrics, which counts and times
+             *   what it does.
+             * </summary>
+             */
+            static bool measured_on_event(
+                const handlers &current,
+                const EVENT_RECORD &record,
+                const krabs::trace_context &trace_context);
+
+            details::snapshot<handlers> handlers_;
+            static const unsigned int no_root = ~0u;
+
+            // Set by the trace while the provider is enabled on it.
+            mutable volatile LONG *trace_changed_ = nullptr;
+
+            // Set with the trace's flag, and cleared by the thread
+            // processing events once the session is up to date.
+            mutable volatile LONG settings_changed_ = 0;
 
         private:
             template <typename T>
@@ -256,6 +434,47 @@ namespace krabs {
         */
         void enable_rundown_events();
 
+        /**
+        * <summary>
+        * Only receive events from the given processes, up to
+        * MAX_EVENT_FILTER_PID_COUNT of them. ETW does the filtering.
+        * </summary>
+        *
+        * <example>
+        *     krabs::provider<> process_provider(L"Microsoft-Windows-Kernel-Process");
+        *     process_provider.process_ids({ 1234, 5678 });
+        * </example>
+        */
+        void process_ids(const std::vector<ULONG> &process_ids);
+
+        /**
+        * <summary>
+        * Only receive events from processes started from the given
+        * executables, named by file name. ETW does the filtering, so it's
+        * lost if another provider in the trace has the same GUID and
+        * doesn't name executables as well.
+        * </summary>
+        *
+        * <example>
+        *     krabs::provider<> winINet(L"Microsoft-Windows-WinINet");
+        *     winINet.executable_names({ L"msedge.exe", L"outlook.exe" });
+        * </example>
+        */
+        void executable_names(const std::vector<std::wstring> &names);
+
+        /**
+        * <summary>
+        * Only collect stacks for the events with the given ids, rather than
+        * for every event. Turns on EVENT_ENABLE_PROPERTY_STACK_TRACE.
+        * </summary>
+        *
+        * <example>
+        *     krabs::provider<> process_provider(L"Microsoft-Windows-Kernel-Process");
+        *     process_provider.stack_trace_event_ids({ 1 });
+        * </example>
+        */
+        void stack_trace_event_ids(const std::vector<unsigned short> &event_ids);
+
         /**
          * <summary>
          * Turns a strongly typed provider<T> to provider<> (useful for
@@ -270,6 +489,36 @@ namespace krabs {
          */
         operator provider<>() const;
 
+        /**
+         * <summary>
+         *   What's been counted for the provider since enable_metrics was
+         *   called.
+         * </summary>
+         */
+        provider_metrics metrics() const;
+
+    private:
+
+        /**
+         * <summary>
+         *   Whether the event is one this provider would have been sent if
+         *   it had been enabled on its own: its keyword matches any and all,
+         *   its level is within level, its id passes the filters' ids and
+         *   it comes from one of its process ids.
+         *   Used to tell apart the providers that share a GUID, which are
+         *   enabled with the union of their settings.
+         * </summary>
+         */
+        bool accepts(const EVENT_RECORD &record) const;
+
+        /**
+         * <summary>
+         *   What ETW can check for the provider: its own process and
+         *   executable filters, and whatever its filters have in common.
+         * </summary>
+         */
+        filter_pushdown pushdown() const;
+
     private:
         GUID guid_;
         T any_;
@@ -277,6 +526,9 @@ namespace krabs {
         T level_;
         T trace_flags_;
         bool rundown_enabled_;
+        std::set<ULONG> process_ids_;
+        std::set<std::wstring> executable_names_;
+        std::set<unsigned short> stack_trace_event_ids_;
 
     private:
         template <typename T>
@@ -288,6 +540,9 @@ namespace krabs {
         template <typename S>
         friend class base_provider;
 
+        template <typename U>
+        friend class provider;
+
         friend struct details::ut;
 
     };
@@ -352,6 +607,34 @@ namespace krabs {
              rundown_enabled_ = true;
          };
 
+        /**
+         * <summary>
+         *   Adds a callback that's only called for events that match the
+         *   given typed view from krabs::kernel (provider, opcode and
+         *   version), and receives the view instead of the raw record.
+         * </summary>
+         * <example>
+         *   krabs::kernel::process_provider provider;
+         *   provider.add_on_typed_event_callback<krabs::kernel::process_start_v4>(
+         *       [](const krabs::kernel::process_start_v4 &start, const krabs::trace_context &) {
+         *           std::wcout << start.process_id() << L" " << start.command_line() << std::endl;
+         *       });
+         * </example>
+         */
+        template <typename Event, typename U>
+        handler_id add_on_typed_event_callback(U &callback);
+
+        template <typename Event, typename U>
+        handler_id add_on_typed_event_callback(const U &callback);
+
+        /**
+         * <summary>
+         *   What's been counted for the provider since enable_metrics was
+         *   called.
+         * </summary>
+         */
+        provider_metrics metrics() const;
+
     private:
 
         /**
@@ -400,51 +683,319 @@ namespace krabs {
     namespace details {
 
         template <typename T>
-        void base_provider<T>::add_on_event_callback(c_provider_callback callback)
+        handler_id base_provider<T>::add_on_event_callback(c_provider_callback callback)
         {
             // C function pointers don't interact well with std::ref, so we
             // overload to take care of this scenario.
-            callbacks_.push_back(callback);
+            return add_callback(callback);
         }
 
         template <typename T>
         template <typename U>
-        void base_provider<T>::add_on_event_callback(U &callback)
+        handler_id base_provider<T>::add_on_event_callback(U &callback)
         {
             // std::function copies its argument -- because our callbacks list
             // is a list of std::function, this causes problems when a user
             // intended for their particular instance to be called.
             // std::ref lets us get around this and point to a specific instance
             // that they handed us.
-            callbacks_.push_back(std::ref(callback));
+            return add_callback(std::ref(callback));
         }
 
         template <typename T>
         template <typename U>
-        void base_provider<T>::add_on_event_callback(const U &callback)
+        handler_id base_provider<T>::add_on_event_callback(const U &callback)
         {
             // This is where temporaries bind to. Temporaries can't be wrapped in
             // a std::ref because they'll go away very quickly. We are forced to
             // actually copy these.
-            callbacks_.push_back(callback);
+            return add_callback(callback);
+        }
+
+        template <typename T>
+        handler_id base_provider<T>::add_callback(const provider_callback &callback)
+        {
+            handler_id id = 0;
+            handlers_.update([&](handlers &next) {
+                next.callbacks.push_back(callback);
+                id = next.next_id++;
+                next.callback_ids.push_back(id);
+            });
+
+            handlers_changed();
+            return id;
         }
 
         template <typename T>
-        void base_provider<T>::add_filter(const event_filter &f)
+        handler_id base_provider<T>::add_filter(const event_filter &f)
         {
-            filters_.push_back(f);
+            handler_id id = 0;
+            handlers_.update([&](handlers &next) {
+                next.filters.push_back(f);
+                id = next.next_id++;
+                next.filter_ids.push_back(id);
+                if (next.stats) {
+                    next.per_filter_stats.push_back(std::make_shared<filter_stats>());
+                }
+                index_filter(next, next.filters.size() - 1);
+            });
+
+            handlers_changed();
+            return id;
         }
 
         template <typename T>
-        void base_provider<T>::on_event(const EVENT_RECORD &record, const krabs::trace_context &trace_context) const
+        bool base_provider<T>::remove_on_event_callback(handler_id id)
         {
-            for (auto &callback : callbacks_) {
+            bool removed = false;
+            handlers_.update([&](handlers &next) {
+                auto match = std::find(next.callback_ids.begin(), next.callback_ids.end(), id);
+                if (match != next.callback_ids.end()) {
+                    next.callbacks.erase(next.callbacks.begin() + (match - next.callback_ids.begin()));
+                    next.callback_ids.erase(match);
+                    removed = true;
+                }
+            });
+
+            if (removed) {
+                handlers_changed();
+            }
+
+            return removed;
+        }
+
+        template <typename T>
+        bool base_provider<T>::remove_filter(handler_id id)
+        {
+            bool removed = false;
+            handlers_.update([&](handlers &next) {
+                auto match = std::find(next.filter_ids.begin(), next.filter_ids.end(), id);
+                if (match == next.filter_ids.end()) {
+                    return;
+                }
+
+                const auto index = match - next.filter_ids.begin();
+                next.filters.erase(next.filters.begin() + index);
+                next.filter_ids.erase(match);
+                if (next.stats) {
+                    next.per_filter_stats.erase(next.per_filter_stats.begin() + index);
+                }
+                removed = true;
+
+                // Filters are named by where they are, which just changed
+                // for those after the one removed.
+                next.dispatch = filter_dispatch();
+                next.graph = predicate_graph();
+                next.roots.clear();
+                for (size_t i = 0; i < next.filters.size(); ++i) {
+                    index_filter(next, i);
+                }
+            });
+
+            if (removed) {
+                handlers_changed();
+            }
+
+            return removed;
+        }
+
+        template <typename T>
+        void base_provider<T>::handlers_changed()
+        {
+            // A filter added now may take ids, processes or payloads the
+            // session was told to leave out, and one removed may have been
+            // all that took some.
+            volatile LONG *changed = trace_changed_;
+            if (changed != nullptr) {
+                InterlockedExchange(&settings_changed_, 1);
+                InterlockedExchange(changed, 1);
+            }
+        }
+
+        template <typename T>
+        void base_provider<T>::enable_metrics()
+        {
+            handlers_.update([](handlers &next) {
+                if (next.stats) {
+                    return;
+                }
+
+                next.stats = std::make_shared<provider_stats>();
+                next.per_filter_stats.clear();
+                for (size_t i = 0; i < next.filters.size(); ++i) {
+                    next.per_filter_stats.push_back(std::make_shared<filter_stats>());
+                }
+            });
+        }
+
+        template <typename T>
+        bool base_provider<T>::metrics_enabled() const
+        {
+            typename snapshot<handlers>::reader current(handlers_);
+            return current->stats != nullptr;
+        }
+
+        template <typename T>
+        void base_provider<T>::index_filter(handlers &next, size_t index)
+        {
+            const auto &f = next.filters[index];
+            next.dispatch.add(static_cast<unsigned int>(index), f.provider_filter_event_ids());
+            next.roots.push_back(f.expression_ ? next.graph.add(*f.expression_) : no_root);
+        }
+
+        template <typename T>
+        bool base_provider<T>::on_event(const EVENT_RECORD &record, const krabs::trace_context &trace_context) const
+        {
+            typename snapshot<handlers>::reader current(handlers_);
+
+            if (current->stats) {
+                return measured_on_event(*current, record, trace_context);
+            }
+
+            for (auto &callback : current->callbacks) {
                 callback(record, trace_context);
             }
 
-            for (auto &filter : filters_) {
-                filter.on_event(record, trace_context);
+            bool handled = !current->callbacks.empty();
+            if (current->graph.size() != 0) {
+                current->graph.begin_event();
+            }
+
+            for (auto index : current->dispatch.candidates(record.EventHeader.EventDescriptor.Id)) {
+                const auto &filter = current->filters[index];
+
+                if (current->roots[index] == no_root) {
+                    handled |= filter.on_event(record, trace_context);
+                }
+                else if (!filter.callbacks_.empty() && current->graph.evaluate(current->roots[index], record, trace_context)) {
+                    handled |= filter.call_callbacks(record, trace_context);
+                }
+            }
+
+            return handled;
+        }
+
+        template <typename T>
+        bool base_provider<T>::measured_on_event(
+            const handlers &current,
+            const EVENT_RECORD &record,
+            const krabs::trace_context &trace_context)
+        {
+            const DWORD thread = GetCurrentThreadId();
+            const unsigned short event_id = record.EventHeader.EventDescriptor.Id;
+            auto &stats = current.stats->local(thread);
+
+            LARGE_INTEGER start;
+            LARGE_INTEGER now;
+            bool handled = false;
+
+            if (!current.callbacks.empty()) {
+                QueryPerformanceCounter(&start);
+                for (auto &callback : current.callbacks) {
+                    callback(record, trace_context);
+                }
+
+                stats.callback_latency.record(ticks_since(start, now));
+                handled = true;
+            }
+
+            if (current.graph.size() != 0) {
+                current.graph.begin_event();
+            }
+
+            for (auto index : current.dispatch.candidates(event_id)) {
+                const auto &filter = current.filters[index];
+                auto &counts = current.per_filter_stats[index]->local(thread);
+                ++counts.events;
+
+                if (filter.callbacks_.empty()) {
+                    continue;
+                }
+
+                QueryPerformanceCounter(&start);
+                const bool passed = current.roots[index] == no_root
+                    ? filter.matches(record, trace_context)
+                    : current.graph.evaluate(current.roots[index], record, trace_context);
+                counts.predicate_latency.record(ticks_since(start, now));
+
+                if (passed) {
+                    ++counts.passed;
+                    start = now;
+                    handled |= filter.call_callbacks(record, trace_context);
+                    counts.callback_latency.record(ticks_since(start, now));
+                }
+            }
+
+            auto &id_stats = stats.event_id(event_id);
+            ++stats.events;
+            ++id_stats.events;
+            stats.bytes += record.UserDataLength;
+            id_stats.bytes += record.UserDataLength;
+            if (handled) {
+                ++stats.accepted;
+                ++id_stats.accepted;
+            }
+
+            return handled;
+        }
+
+        template <typename T>
+        bool base_provider<T>::wants_event_id(unsigned short id) const
+        {
+            typename snapshot<handlers>::reader current(handlers_);
+            return current->dispatch.event_ids().empty() || current->dispatch.has_event_id(id);
+        }
+
+        template <typename T>
+        std::vector<unsigned short> base_provider<T>::filter_event_ids() const
+        {
+            typename snapshot<handlers>::reader current(handlers_);
+            return current->dispatch.event_ids();
+        }
+
+        template <typename T>
+        filter_pushdown base_provider<T>::callbacks_pushdown() const
+        {
+            typename snapshot<handlers>::reader current(handlers_);
+            const auto &filters = current->filters;
+
+            if (!current->callbacks.empty() || filters.empty()) {
+                return filter_pushdown();
+            }
+
+            auto result = filters[0].pushdown();
+            for (size_t i = 1; i < filters.size(); ++i) {
+                result = filter_pushdown::either(result, filters[i].pushdown());
+            }
+
+            return result;
+        }
+
+        template <typename T>
+        provider_metrics base_provider<T>::collect_metrics(const GUID &id) const
+        {
+            typename snapshot<handlers>::reader current(handlers_);
+
+            provider_metrics metrics;
+            metrics.provider = id;
+
+            LARGE_INTEGER frequency;
+            QueryPerformanceFrequency(&frequency);
+            metrics.ticks_per_second = frequency.QuadPart;
+
+            if (!current->stats) {
+                return metrics;
+            }
+
+            add_provider_stats(*current->stats, metrics);
+            for (size_t i = 0; i < current->filters.size(); ++i) {
+                filter_metrics filter;
+                filter.filter = current->filter_ids[i];
+                add_filter_stats(*current->per_filter_stats[i], filter);
+                metrics.filters.push_back(filter);
             }
+
+            return metrics;
         }
     } // namespace details
 
@@ -590,22 +1141,131 @@ namespace krabs {
         rundown_enabled_ = true;
     }
 
+    template <typename T>
+    void provider<T>::process_ids(const std::vector<ULONG> &process_ids)
+    {
+        std::set<ULONG> ids(process_ids.begin(), process_ids.end());
+        if (ids.size() > MAX_EVENT_FILTER_PID_COUNT) {
+            throw std::invalid_argument("ETW filters on at most MAX_EVENT_FILTER_PID_COUNT process ids");
+        }
+
+        process_ids_.swap(ids);
+    }
+
+    template <typename T>
+    void provider<T>::executable_names(const std::vector<std::wstring> &names)
+    {
+        executable_names_ = std::set<std::wstring>(names.begin(), names.end());
+    }
+
+    template <typename T>
+    void provider<T>::stack_trace_event_ids(const std::vector<unsigned short> &event_ids)
+    {
+        std::set<unsigned short> ids(event_ids.begin(), event_ids.end());
+        if (ids.size() > MAX_EVENT_FILTER_EVENT_ID_COUNT) {
+            throw std::invalid_argument("ETW filters on at most MAX_EVENT_FILTER_EVENT_ID_COUNT event ids");
+        }
+
+        stack_trace_event_ids_.swap(ids);
+    }
+
+    template <typename T>
+    bool provider<T>::accepts(const EVENT_RECORD &record) const
+    {
+        const auto &descriptor = record.EventHeader.EventDescriptor;
+
+        // These are the checks ETW makes when a provider writes an event.
+        // An enable level of 0 and an event level of 0 both mean any level;
+        // events without keywords pass the keyword checks, and any of 0
+        // means any keyword.
+        const UCHAR level = static_cast<UCHAR>(level_);
+        if (level != 0 && descriptor.Level != 0 && descriptor.Level > level) {
+            return false;
+        }
+
+        const ULONGLONG any = static_cast<ULONGLONG>(any_);
+        const ULONGLONG all = static_cast<ULONGLONG>(all_);
+        if (descriptor.Keyword != 0) {
+            if (any != 0 && (descriptor.Keyword & any) == 0) {
+                return false;
+            }
+
+            if ((descriptor.Keyword & all) != all) {
+                return false;
+            }
+        }
+
+        if (!process_ids_.empty() && process_ids_.count(record.EventHeader.ProcessId) == 0) {
+            return false;
+        }
+
+        return this->wants_event_id(descriptor.Id);
+    }
+
+    template <typename T>
+    filter_pushdown provider<T>::pushdown() const
+    {
+        filter_pushdown own;
+        own.process_ids = process_ids_;
+        own.executable_names = executable_names_;
+
+        return filter_pushdown::both(own, this->callbacks_pushdown());
+    }
+
     template <typename T>
     provider<T>::operator provider<>() const
     {
         provider<> tmp(guid_);
-        tmp.any_            = static_cast<ULONGLONG>(any_);
-        tmp.all_            = static_cast<ULONGLONG>(all_);
-        tmp.level_          = static_cast<UCHAR>(level_);
-        tmp.trace_flags_    = static_cast<ULONG>(trace_flags_);
-        tmp.callbacks_      = this.callbacks_;
+        tmp.any_                   = static_cast<ULONGLONG>(any_);
+        tmp.all_                   = static_cast<ULONGLONG>(all_);
+        tmp.level_                 = static_cast<UCHAR>(level_);
+        tmp.trace_flags_           = static_cast<ULONG>(trace_flags_);
+        tmp.rundown_enabled_       = rundown_enabled_;
+        tmp.process_ids_           = process_ids_;
+        tmp.executable_names_      = executable_names_;
+        tmp.stack_trace_event_ids_ = stack_trace_event_ids_;
+        tmp.handlers_              = this->handlers_;
 
         return tmp;
     }
 
+    template <typename T>
+    provider_metrics provider<T>::metrics() const
+    {
+        return this->collect_metrics(guid_);
+    }
+
+    inline provider_metrics kernel_provider::metrics() const
+    {
+        return collect_metrics(id_);
+    }
+
     inline const krabs::guid &kernel_provider::id() const
     {
         return id_;
     }
 
+    template <typename Event, typename U>
+    handler_id kernel_provider::add_on_typed_event_callback(U &callback)
+    {
+        // Keep calling the instance that was handed to us rather than a copy.
+        auto target = std::ref(callback);
+        return add_on_event_callback([target](const EVENT_RECORD &record, const krabs::trace_context &trace_context) {
+            if (Event::matches(record)) {
+                target(Event(record), trace_context);
+            }
+        });
+    }
+
+    template <typename Event, typename U>
+    handler_id kernel_provider::add_on_typed_event_callback(const U &callback)
+    {
+        // Temporaries can't be wrapped in a std::ref, so copy them.
+        return add_on_event_callback([callback](const EVENT_RECORD &record, const krabs::trace_context &trace_context) mutable {
+            if (Event::matches(record)) {
+                callback(Event(record), trace_context);
+            }
+        });
+    }
+
 }
@@ -0,0 +1,254 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+
+#include <windows.h>
+#include <evntrace.h>
+
+#include <cstdint>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+#include "compiler_check.hpp"
+#include "flat_table.hpp"
+#include "guid.hpp"
+
+namespace krabs {
+
+    /**
+     * <summary>
+     * Decides which event ids ETW should stop delivering for a provider,
+     * from how often the trace's callbacks accept them. An id is excluded
+     * once it has come in at least min_events times in each of
+     * quiet_windows windows in a row, and was never accepted. A window
+     * with fewer of its events starts the count again, and an id that
+     * has been accepted once is never excluded. Excluded ids aren't
+     * delivered anymore, so they stay excluded until reset().
+     * </summary>
+     * <remarks>
+     * This is a guess about the future from the past: an id whose events
+     * are all rejected for a while could be accepted later, for example by
+     * a predicate on its payload, and those events would then be missed.
+     * Only use it where that's acceptable.
+     *
+     * The policy only counts and decides; a user trace applies its
+     * decisions by enabling the provider again with the ids left out.
+     * </remarks>
+     * <example>
+     *   krabs::pushdown_policy policy(1000, 10, 2);
+     *   policy.record(provider_id, 5, false);
+     *   // ...
+     *   for (const auto &provider : policy.take_changes()) {
+     *       auto &ids = policy.excluded(provider);
+     *   }
+     * </example>
+     */
+    class pushdown_policy {
+    public:
+
+        /**
+         * <param name="window_events">events counted in each window</param>
+         * <param name="min_events">
+         *   events an id needs in a window for it to count as quiet
+         * </param>
+         * <param name="quiet_windows">windows in a row an id must be quiet</param>
+         */
+        pushdown_policy(
+            uint64_t window_events = 100000,
+            uint64_t min_events = 100,
+            unsigned int quiet_windows = 3);
+
+        pushdown_policy(const pushdown_policy &) = delete;
+        pushdown_policy &operator=(const pushdown_policy &) = delete;
+
+        /**
+         * <summary>
+         * Counts one event of the provider and whether any callback took it.
+         * Closes the window once it has window_events events.
+         * </summary>
+         */
+        void record(const GUID &provider, unsigned short id, bool accepted);
+
+        /**
+         * <summary>
+         * Closes the current window, excluding the ids that have now been
+         * quiet for long enough.
+         * </summary>
+         */
+        void end_window();
+
+        /**
+         * <summary>
+         * Whether some provider's excluded ids changed since the last call
+         * to take_changes.
+         * </summary>
+         */
+        bool has_changes() const;
+
+        /**
+         * <summary>
+         * Returns the providers whose excluded ids changed since the last
+         * call, and forgets them.
+         * </summary>
+         */
+        std::vector<krabs::guid> take_changes();
+
+        /**
+         * <summary>
+         * The ids ETW should no longer deliver for the provider.
+         * </summary>
+         */
+        const std::set<unsigned short> &excluded(const GUID &provider) const;
+
+        /**
+         * <summary>
+         * Forgets everything, so every id is delivered again. Used when
+         * the callbacks change and may now want what was excluded.
+         * </summary>
+         */
+        void reset();
+
+    private:
+        struct id_counts {
+            uint64_t seen;
+            uint64_t accepted;
+            unsigned int quiet;
+            bool ever_accepted;
+        };
+
+        struct provider_counts {
+            flat_table<unsigned short, id_counts> ids;
+            std::vector<unsigned short> tracked;
+            std::set<unsigned short> excluded;
+        };
+
+        provider_counts &counts_for(const GUID &provider);
+
+        uint64_t window_events_;
+        uint64_t min_events_;
+        unsigned int quiet_windows_;
+        uint64_t events_;
+
+        std::unordered_map<krabs::guid, provider_counts> providers_;
+        std::set<krabs::guid> changed_;
+
+        // Events tend to come in runs from one provider.
+        GUID last_guid_;
+        provider_counts *last_counts_;
+    };
+
+    // Implementation
+    // ------------------------------------------------------------------------
+
+    inline pushdown_policy::pushdown_policy(
+        uint64_t window_events,
+        uint64_t min_events,
+        unsigned int quiet_windows)
+    : window_events_(window_events)
+    , min_events_(min_events)
+    , quiet_windows_(quiet_windows)
+    , events_(0)
+    , last_guid_()
+    , last_counts_(nullptr)
+    {}
+
+    inline void pushdown_policy::record(const GUID &provider, unsigned short id, bool accepted)
+    {
+        auto &counts = counts_for(provider);
+        auto id_counts = counts.ids.find(id);
+
+        if (id_counts == nullptr) {
+            id_counts = &counts.ids[id];
+            counts.tracked.push_back(id);
+        }
+
+        ++id_counts->seen;
+        if (accepted) {
+            ++id_counts->accepted;
+            id_counts->ever_accepted = true;
+        }
+
+        if (++events_ >= window_events_) {
+            end_window();
+        }
+    }
+
+    inline void pushdown_policy::end_window()
+    {
+        for (auto &provider : providers_) {
+            auto &counts = provider.second;
+
+            // Ids that didn't come in at all weren't quiet in this window
+            // either, so every id is looked at.
+            for (auto id : counts.tracked) {
+                auto &id_counts = *counts.ids.find(id);
+                const bool quiet = !id_counts.ever_accepted && id_counts.seen >= min_events_;
+
+                id_counts.quiet = quiet ? id_counts.quiet + 1 : 0;
+                id_counts.seen = 0;
+                id_counts.accepted = 0;
+
+                // ETW takes at most MAX_EVENT_FILTER_EVENT_ID_COUNT ids.
+                if (id_counts.quiet >= quiet_windows_ &&
+                    counts.excluded.size() < MAX_EVENT_FILTER_EVENT_ID_COUNT &&
+                    counts.excluded.insert(id).second) {
+                    changed_.insert(provider.first);
+                }
+            }
+        }
+
+        events_ = 0;
+    }
+
+    inline bool pushdown_policy::has_changes() const
+    {
+        return !changed_.empty();
+    }
+
+    inline std::vector<krabs::guid> pushdown_policy::take_changes()
+    {
+        std::vector<krabs::guid> changes(changed_.begin(), changed_.end());
+        changed_.clear();
+        return changes;
+    }
+
+    inline const std::set<unsigned short> &pushdown_policy::excluded(const GUID &provider) const
+    {
+        static const std::set<unsigned short> none;
+
+        auto counts = providers_.find(provider);
+        return counts == providers_.end() ? none : counts->second.excluded;
+    }
+
+    inline void pushdown_policy::reset()
+    {
+        for (auto &provider : providers_) {
+            if (!provider.second.excluded.empty()) {
+                changed_.insert(provider.first);
+            }
+        }
+
+        providers_.clear();
+        last_counts_ = nullptr;
+        events_ = 0;
+    }
+
+    inline pushdown_policy::provider_counts &pushdown_policy::counts_for(const GUID &provider)
+    {
+        if (last_counts_ != nullptr && last_guid_ == provider) {
+            return *last_counts_;
+        }
+
+        // Nodes of an unordered_map don't move, so the memo stays valid.
+        last_counts_ = &providers_[provider];
+        last_guid_ = provider;
+        return *last_counts_;
+    }
+
+} /* namespace krabs */
@@ -237,6 +237,7 @@ namespace krabs {
     private:
         const EVENT_RECORD &record_;
         TRACE_EVENT_INFO *pSchema_;
+        const krabs::schema_locator &schema_locator_;
 
     private:
         friend std::wstring event_name(const schema &);
@@ -262,6 +263,7 @@ namespace krabs {
     inline schema::schema(const EVENT_RECORD &record, const krabs::schema_locator &schema_locator)
         : record_(record)
         , pSchema_(schema_locator.get_event_schema(record))
+        , schema_locator_(schema_locator)
     { }
 
     inline bool schema::operator==(const schema &other) const
@@ -13,12 +13,19 @@
 #include <tdh.h>
 #include <evntrace.h>
 
+#include <cstring>
 #include <memory>
+#include <string>
 #include <unordered_map>
+#include <vector>
 
 #include "compiler_check.hpp"
 #include "errors.hpp"
+#include "event_map.hpp"
+#include "flat_table.hpp"
 #include "guid.hpp"
+#include "format/format_plan.hpp"
+#include "tracelogging/metadata.hpp"
 
 #pragma comment(lib, "tdh.lib")
 
@@ -26,7 +33,9 @@ namespace krabs {
 
     /**
      * <summary>
-     * Type used as the key for cache lookup in a schema_locator.
+     * Type used as the key for cache lookup in a schema_locator. Packed
+     * into three 64-bit words, with the padding zeroed, so that it's
+     * compared and hashed a word at a time.
      * </summary>
      */
     struct schema_key
@@ -36,25 +45,85 @@ namespace krabs {
         uint8_t   opcode;
         uint8_t   version;
         uint8_t   level;
+        uint8_t   reserved[3];
+
+        schema_key()
+            : provider(GUID())
+            , id(0)
+            , opcode(0)
+            , version(0)
+            , level(0)
+            , reserved() { }
 
         schema_key(const EVENT_RECORD &record)
             : provider(record.EventHeader.ProviderId)
             , id(record.EventHeader.EventDescriptor.Id)
             , opcode(record.EventHeader.EventDescriptor.Opcode)
+            , version(record.EventHeader.EventDescriptor.Version)
             , level(record.EventHeader.EventDescriptor.Level)
-            , version(record.EventHeader.EventDescriptor.Version) { }
+            , reserved() { }
 
         bool operator==(const schema_key &rhs) const
         {
-            return provider == rhs.provider &&
-                   id == rhs.id &&
-                   opcode == rhs.opcode &&
-                   level == rhs.level &&
-                   version == rhs.version;
+            uint64_t lhs_words[3], rhs_words[3];
+            memcpy(lhs_words, this, sizeof(lhs_words));
+            memcpy(rhs_words, &rhs, sizeof(rhs_words));
+
+            return ((lhs_words[0] ^ rhs_words[0]) |
+                    (lhs_words[1] ^ rhs_words[1]) |
+                    (lhs_words[2] ^ rhs_words[2])) == 0;
         }
 
         bool operator!=(const schema_key &rhs) const { return !(*this == rhs); }
     };
+
+    static_assert(sizeof(schema_key) == 24, "schema_key is hashed and compared as three words");
+
+    /**
+     * <summary>
+     * Hashes a schema_key. Each word is multiplied by its own odd constant
+     * and the result finished with the murmur3 mixer, so every bit of the
+     * GUID, id, opcode, version and level moves the whole hash.
+     * </summary>
+     */
+    inline uint64_t hash_schema_key(const schema_key &key)
+    {
+        uint64_t words[3];
+        memcpy(words, &key, sizeof(words));
+
+        uint64_t h = (words[0] * 0x9E3779B97F4A7C15ULL) ^
+                     (words[1] * 0xC2B2AE3D27D4EB4FULL) ^
+                     (words[2] * 0x165667B19E3779F9ULL);
+        h ^= h >> 33;
+        h *= 0xFF51AFD7ED558CCDULL;
+        h ^= h >> 33;
+        h *= 0xC4CEB9FE1A85EC53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    /**
+     * <summary>
+     * Type used as the key for event map lookup in a schema_locator. Map
+     * names are only unique within a provider.
+     * </summary>
+     */
+    struct map_key
+    {
+        guid         provider;
+        std::wstring name;
+
+        map_key(const GUID &provider, const std::wstring &name)
+            : provider(provider)
+            , name(name) { }
+
+        bool operator==(const map_key &rhs) const
+        {
+            return provider == rhs.provider && name == rhs.name;
+        }
+
+        bool operator!=(const map_key &rhs) const { return !(*this == rhs); }
+    };
 }
 
 namespace std {
@@ -69,14 +138,22 @@ namespace std {
     {
         size_t operator()(const krabs::schema_key &key) const
         {
-            // Shift-Add-XOR hash - good enough for the small sets we deal with
-            size_t h = 2166136261;
+            return static_cast<size_t>(krabs::hash_schema_key(key));
+        }
+    };
 
-            h ^= (h << 5) + (h >> 2) + std::hash<krabs::guid>()(key.provider);
-            h ^= (h << 5) + (h >> 2) + key.id;
-            h ^= (h << 5) + (h >> 2) + key.opcode;
-            h ^= (h << 5) + (h >> 2) + key.version;
-            h ^= (h << 5) + (h >> 2) + key.level;
+    /**
+     * <summary>
+     * Builds a hash code for a map_key
+     * </summary>
+     */
+    template<>
+    struct std::hash<krabs::map_key>
+    {
+        size_t operator()(const krabs::map_key &key) const
+        {
+            size_t h = std::hash<krabs::guid>()(key.provider);
+            h ^= (h << 5) + (h >> 2) + std::hash<std::wstring>()(key.name);
 
             return h;
         }
@@ -85,6 +162,47 @@ namespace std {
 
 namespace krabs {
 
+    /**
+     * <summary>
+     * Counters kept by a schema_locator, to tune its cache budget.
+     * </summary>
+     */
+    struct schema_cache_stats
+    {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+        size_t   schemas_resident;
+        size_t   bytes_resident;
+
+        // Time spent waiting on TdhGetEventInformation and
+        // TdhGetEventMapInformation.
+        uint64_t tdh_microseconds;
+    };
+
+    /**
+     * <summary>
+     * Keeps a cached schema from being evicted for as long as it lives.
+     * </summary>
+     */
+    class schema_pin {
+    public:
+        schema_pin();
+        schema_pin(schema_pin &&other);
+        schema_pin &operator=(schema_pin &&other);
+        ~schema_pin();
+
+        schema_pin(const schema_pin &) = delete;
+        schema_pin &operator=(const schema_pin &) = delete;
+
+    private:
+        explicit schema_pin(unsigned int *pins);
+
+        unsigned int *pins_;
+
+        friend class schema_locator;
+    };
+
     /**
      * <summary>
      * Get event schema from TDH.
@@ -92,16 +210,38 @@ namespace krabs {
      */
     std::unique_ptr<char[]> get_event_schema_from_tdh(const EVENT_RECORD &);
 
+    /**
+     * <summary>
+     * Get event schema from TDH, along with the size of the returned buffer.
+     * </summary>
+     */
+    std::unique_ptr<char[]> get_event_schema_from_tdh(const EVENT_RECORD &, ULONG &size);
+
     /**
      * <summary>
      * Fetches and caches schemas from TDH.
      * NOTE: this cache also reduces the number of managed to native transitions
      * when krabs is compiled into a managed assembly.
      * </summary>
+     * <remarks>
+     * TraceLogging events carry their own schema, and their ids don't tell
+     * events apart (they're usually all 0). Their schemas are built from that
+     * metadata without calling TDH and cached by a hash of it instead.
+     *
+     * The cache is unbounded unless given a budget. Over budget, trim()
+     * evicts the schemas that have gone longest without being looked up
+     * (by the CLOCK approximation of LRU). Seeded schemas are kept, so a
+     * replayed capture never falls back to TDH. Schemas and parsers made
+     * during an event callback stay valid until it returns, because the
+     * trace only trims between events; anything kept past that needs a
+     * schema_pin.
+     * </remarks>
      */
     class schema_locator {
     public:
 
+        schema_locator();
+
         /**
          * <summary>
          * Retrieves the event schema from the cache or falls back to
@@ -110,31 +250,482 @@ namespace krabs {
          */
         const PTRACE_EVENT_INFO get_event_schema(const EVENT_RECORD &record) const;
 
+        /**
+         * <summary>
+         * Retrieves the event schema like above and returns the size of the
+         * schema buffer, which is needed to copy the schema elsewhere.
+         * </summary>
+         */
+        const PTRACE_EVENT_INFO get_event_schema(const EVENT_RECORD &record, ULONG &size) const;
+
+        /**
+         * <summary>
+         * Seeds the cache with a schema that was loaded elsewhere (for
+         * instance read back from a capture file), so that events with the
+         * same key as the given record are decoded without calling TDH.
+         * A schema that is already cached for the key is kept. Seeded
+         * schemas are never evicted, since TDH may not be able to load
+         * them again, but they count against the cache budget.
+         * </summary>
+         */
+        void add_event_schema(const EVENT_RECORD &record, const BYTE *schema, ULONG size) const;
+
+        /**
+         * <summary>
+         * Retrieves the formatting plan for the event's schema, building it
+         * the first time the schema is seen. The plan lives as long as the
+         * schema does.
+         * </summary>
+         */
+        const format::format_plan &get_format_plan(const EVENT_RECORD &record) const;
+
+        /**
+         * <summary>
+         * Retrieves the named value map or bitmap of the event's provider
+         * from the cache, or falls back to TDH the first time it's asked
+         * for. Returns nullptr if the provider has no such map; that answer
+         * is cached too.
+         * </summary>
+         */
+        const event_map *get_event_map(const EVENT_RECORD &record, const std::wstring &map_name) const;
+
+        /**
+         * <summary>
+         * Seeds the cache with a map that was saved elsewhere (from
+         * event_map::data), so that it can be used without calling TDH.
+         * A map that is already cached for the provider is kept.
+         * </summary>
+         */
+        void add_event_map(const GUID &provider, const BYTE *map, ULONG size) const;
+
+        /**
+         * <summary>
+         * Keeps the event's schema (and its format plan) cached, and so
+         * valid, for as long as the pin lives. The locator must outlive it.
+         * </summary>
+         * <example>
+         *   auto pin = context.schema_locator.pin(record);
+         *   krabs::schema schema(record, context.schema_locator);
+         *   // schema can be used after the callback returns
+         * </example>
+         */
+        schema_pin pin(const EVENT_RECORD &record) const;
+
+        /**
+         * <summary>
+         * Sets how many bytes of schemas to keep cached; 0, the default,
+         * keeps all of them. Takes effect at the next trim().
+         * </summary>
+         */
+        void set_cache_budget(size_t bytes) const;
+
+        /**
+         * <summary>
+         * Evicts schemas until the cache is within its budget or only
+         * pinned and seeded ones are left. Schemas returned since the last trim() are
+         * evicted last, but aren't safe from it; traces call this between
+         * events, when nothing else is using the cache.
+         * </summary>
+         */
+        void trim() const;
+
+        /**
+         * <summary>
+         * Returns the cache counters.
+         * </summary>
+         */
+        schema_cache_stats stats() const;
+
     private:
-        mutable std::unordered_map<schema_key, std::unique_ptr<char[]>> cache_;
+        struct cache_entry {
+            std::unique_ptr<char[]> buffer;
+            ULONG size = 0;
+            std::unique_ptr<format::format_plan> plan;
+
+            // CLOCK state. Every cached entry counts against the budget.
+            bool referenced = false;
+            bool seeded = false;
+            unsigned int pins = 0;
+            size_t bytes = 0;
+        };
+
+        struct tracelogging_entry {
+            guid provider;
+            std::vector<BYTE> metadata;
+            cache_entry schema;
+        };
+
+        // Where to find an entry again to evict it.
+        struct clock_slot {
+            cache_entry *entry;
+            schema_key key;
+            bool tracelogging;
+            uint64_t hash;
+        };
+
+        cache_entry &load(const EVENT_RECORD &record) const;
+        cache_entry *find(const EVENT_RECORD &record) const;
+        cache_entry &add(const EVENT_RECORD &record, std::unique_ptr<char[]> schema, ULONG size, bool seeded) const;
+        void evict(size_t slot) const;
+
+        mutable flat_table<schema_key, cache_entry> cache_;
+        mutable std::unordered_multimap<uint64_t, tracelogging_entry> tracelogging_cache_;
+        mutable std::unordered_map<map_key, std::unique_ptr<event_map>> maps_;
+
+        mutable std::vector<clock_slot> clock_;
+        mutable size_t hand_;
+        mutable size_t budget_;
+        // Written while events are processed and read by stats() from any
+        // thread, so they're only touched with interlocked instructions;
+        // plain 64-bit reads can tear on x86.
+        struct cache_counters {
+            volatile LONG64 hits;
+            volatile LONG64 misses;
+            volatile LONG64 evictions;
+            volatile LONG64 schemas_resident;
+            volatile LONG64 bytes_resident;
+            volatile LONG64 tdh_ticks;
+        };
+
+        static void count(volatile LONG64 &counter, LONG64 amount = 1);
+        static uint64_t read(volatile LONG64 &counter);
+
+        mutable cache_counters counters_;
     };
 
     // Implementation
     // ------------------------------------------------------------------------
 
+    inline schema_pin::schema_pin()
+    : pins_(nullptr)
+    {}
+
+    inline schema_pin::schema_pin(unsigned int *pins)
+    : pins_(pins)
+    {
+        ++*pins_;
+    }
+
+    inline schema_pin::schema_pin(schema_pin &&other)
+    : pins_(other.pins_)
+    {
+        other.pins_ = nullptr;
+    }
+
+    inline schema_pin &schema_pin::operator=(schema_pin &&other)
+    {
+        if (this != &other) {
+            if (pins_ != nullptr) {
+                --*pins_;
+            }
+
+            pins_ = other.pins_;
+            other.pins_ = nullptr;
+        }
+
+        return *this;
+    }
+
+    inline schema_pin::~schema_pin()
+    {
+        if (pins_ != nullptr) {
+            --*pins_;
+        }
+    }
+
+    inline schema_locator::schema_locator()
+    : hand_(0)
+    , budget_(0)
+    , counters_()
+    {}
+
     inline const PTRACE_EVENT_INFO schema_locator::get_event_schema(const EVENT_RECORD &record) const
+    {
+        ULONG size = 0;
+        return get_event_schema(record, size);
+    }
+
+    inline const PTRACE_EVENT_INFO schema_locator::get_event_schema(const EVENT_RECORD &record, ULONG &size) const
+    {
+        auto& entry = load(record);
+
+        size = entry.size;
+        return (PTRACE_EVENT_INFO)(entry.buffer.get());
+    }
+
+    inline schema_locator::cache_entry &schema_locator::load(const EVENT_RECORD &record) const
     {
         // check the cache
-        auto key = schema_key(record);
-        auto& buffer = cache_[key];
+        auto entry = find(record);
+        if (entry != nullptr) {
+            count(counters_.hits);
+            entry->referenced = true;
+            return *entry;
+        }
 
-        if (!buffer) {
-            auto temp = get_event_schema_from_tdh(record);
-            buffer.swap(temp);
+        count(counters_.misses);
+
+        // TraceLogging metadata the parser can't lay out on its own is left
+        // to TDH. Nothing is cached until there's a schema to cache, so a
+        // failed lookup doesn't leave an empty entry behind.
+        ULONG size = 0;
+        std::unique_ptr<char[]> schema;
+        auto metadata = tracelogging::find_extended_data(record, EVENT_HEADER_EXT_TYPE_EVENT_SCHEMA_TL);
+        if (metadata != nullptr) {
+            try {
+                schema = tracelogging::make_event_schema(
+                    record,
+                    tracelogging::parse_event_metadata(reinterpret_cast<const BYTE*>(metadata->DataPtr), metadata->DataSize),
+                    size);
+            }
+            catch (const std::runtime_error &) {
+            }
+        }
+
+        if (!schema) {
+            LARGE_INTEGER start, end;
+            QueryPerformanceCounter(&start);
+            schema = get_event_schema_from_tdh(record, size);
+            QueryPerformanceCounter(&end);
+            count(counters_.tdh_ticks, end.QuadPart - start.QuadPart);
+        }
+
+        return add(record, std::move(schema), size, false);
+    }
+
+    inline schema_locator::cache_entry *schema_locator::find(const EVENT_RECORD &record) const
+    {
+        auto metadata = tracelogging::find_extended_data(record, EVENT_HEADER_EXT_TYPE_EVENT_SCHEMA_TL);
+        if (metadata == nullptr) {
+            return cache_.find(schema_key(record));
+        }
+
+        auto data = reinterpret_cast<const BYTE*>(metadata->DataPtr);
+        const GUID &provider = record.EventHeader.ProviderId;
+
+        // A hash match still has to be the same metadata.
+        auto range = tracelogging_cache_.equal_range(tracelogging::hash_metadata(provider, data, metadata->DataSize));
+        for (auto it = range.first; it != range.second; ++it) {
+            auto &entry = it->second;
+            if (entry.provider == provider &&
+                entry.metadata.size() == metadata->DataSize &&
+                memcmp(entry.metadata.data(), data, metadata->DataSize) == 0) {
+                return &entry.schema;
+            }
         }
 
-        return (PTRACE_EVENT_INFO)(buffer.get());
+        return nullptr;
+    }
+
+    inline schema_locator::cache_entry &schema_locator::add(
+        const EVENT_RECORD &record,
+        std::unique_ptr<char[]> schema,
+        ULONG size,
+        bool seeded) const
+    {
+        clock_slot slot = { nullptr, schema_key(record), false, 0 };
+        size_t bytes = size;
+
+        auto metadata = tracelogging::find_extended_data(record, EVENT_HEADER_EXT_TYPE_EVENT_SCHEMA_TL);
+        if (metadata == nullptr) {
+            slot.entry = &cache_[slot.key];
+        } else {
+            auto data = reinterpret_cast<const BYTE*>(metadata->DataPtr);
+            slot.tracelogging = true;
+            slot.hash = tracelogging::hash_metadata(record.EventHeader.ProviderId, data, metadata->DataSize);
+            bytes += metadata->DataSize;
+
+            tracelogging_entry entry = { record.EventHeader.ProviderId, std::vector<BYTE>(data, data + metadata->DataSize) };
+            slot.entry = &tracelogging_cache_.emplace(slot.hash, std::move(entry))->second.schema;
+        }
+
+        cache_entry &entry = *slot.entry;
+        entry.buffer.swap(schema);
+        entry.size = size;
+        entry.bytes = bytes;
+        entry.seeded = seeded;
+
+        // New entries start unreferenced, so that a burst of events that
+        // are only seen once is the first to go.
+        entry.referenced = false;
+        count(counters_.bytes_resident, static_cast<LONG64>(entry.bytes));
+        count(counters_.schemas_resident);
+
+        clock_.push_back(slot);
+        return entry;
+    }
+
+    inline void schema_locator::evict(size_t index) const
+    {
+        const clock_slot slot = clock_[index];
+        clock_[index] = clock_.back();
+        clock_.pop_back();
+
+        count(counters_.bytes_resident, -static_cast<LONG64>(slot.entry->bytes));
+        count(counters_.schemas_resident, -1);
+        count(counters_.evictions);
+
+        if (!slot.tracelogging) {
+            cache_.erase(slot.key);
+            return;
+        }
+
+        auto range = tracelogging_cache_.equal_range(slot.hash);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (&it->second.schema == slot.entry) {
+                tracelogging_cache_.erase(it);
+                return;
+            }
+        }
+    }
+
+    inline schema_pin schema_locator::pin(const EVENT_RECORD &record) const
+    {
+        auto& entry = load(record);
+        return schema_pin(&entry.pins);
+    }
+
+    inline void schema_locator::set_cache_budget(size_t bytes) const
+    {
+        budget_ = bytes;
+    }
+
+    inline void schema_locator::trim() const
+    {
+        if (budget_ == 0 || read(counters_.bytes_resident) <= budget_) {
+            return;
+        }
+
+        // Two passes clear every reference bit, so whatever is left after
+        // that is pinned or seeded.
+        size_t steps = clock_.size() * 2;
+        while (read(counters_.bytes_resident) > budget_ && !clock_.empty() && steps-- > 0) {
+            if (hand_ >= clock_.size()) {
+                hand_ = 0;
+            }
+
+            auto entry = clock_[hand_].entry;
+            if (entry->pins > 0 || entry->seeded) {
+                ++hand_;
+            }
+            else if (entry->referenced) {
+                entry->referenced = false;
+                ++hand_;
+            }
+            else {
+                // The last slot moves here and is looked at next.
+                evict(hand_);
+            }
+        }
+    }
+
+    inline schema_cache_stats schema_locator::stats() const
+    {
+        LARGE_INTEGER frequency;
+        QueryPerformanceFrequency(&frequency);
+
+        schema_cache_stats stats = {};
+        stats.hits = read(counters_.hits);
+        stats.misses = read(counters_.misses);
+        stats.evictions = read(counters_.evictions);
+        stats.schemas_resident = static_cast<size_t>(read(counters_.schemas_resident));
+        stats.bytes_resident = static_cast<size_t>(read(counters_.bytes_resident));
+        if (frequency.QuadPart > 0) {
+            stats.tdh_microseconds = read(counters_.tdh_ticks) * 1000000 / frequency.QuadPart;
+        }
+
+        return stats;
+    }
+
+    inline void schema_locator::count(volatile LONG64 &counter, LONG64 amount)
+    {
+        InterlockedExchangeAdd64(&counter, amount);
+    }
+
+    inline uint64_t schema_locator::read(volatile LONG64 &counter)
+    {
+        // A compare-exchange that never swaps is an atomic 64-bit read on
+        // x86 as well.
+        return static_cast<uint64_t>(InterlockedCompareExchange64(&counter, 0, 0));
+    }
+
+    inline void schema_locator::add_event_schema(const EVENT_RECORD &record, const BYTE *schema, ULONG size) const
+    {
+        // Whatever is cached already is what events have been decoded
+        // with so far; it just isn't evicted anymore.
+        auto cached = find(record);
+        if (cached != nullptr) {
+            cached->seeded = true;
+            return;
+        }
+
+        std::unique_ptr<char[]> copy(new char[size]);
+        memcpy(copy.get(), schema, size);
+        add(record, std::move(copy), size, true);
+    }
+
+    inline const format::format_plan &schema_locator::get_format_plan(const EVENT_RECORD &record) const
+    {
+        auto& entry = load(record);
+        auto schema = (PTRACE_EVENT_INFO)(entry.buffer.get());
+
+        if (!entry.plan) {
+            std::unique_ptr<format::format_plan> plan(new format::format_plan(format::make_format_plan(*schema)));
+            for (auto &property : plan->properties) {
+                if (!property.map_name.empty()) {
+                    property.map = get_event_map(record, property.map_name);
+                }
+            }
+
+            entry.plan.swap(plan);
+        }
+
+        return *entry.plan;
+    }
+
+    inline const event_map *schema_locator::get_event_map(const EVENT_RECORD &record, const std::wstring &map_name) const
+    {
+        auto key = map_key(record.EventHeader.ProviderId, map_name);
+        auto found = maps_.find(key);
+        if (found != maps_.end()) {
+            return found->second.get();
+        }
+
+        LARGE_INTEGER start, end;
+        QueryPerformanceCounter(&start);
+        auto buffer = get_event_map_from_tdh(record, map_name);
+        QueryPerformanceCounter(&end);
+        count(counters_.tdh_ticks, end.QuadPart - start.QuadPart);
+
+        std::unique_ptr<event_map> map;
+        if (!buffer.empty()) {
+            map.reset(new event_map(buffer.data(), static_cast<ULONG>(buffer.size())));
+        }
+
+        return maps_.emplace(std::move(key), std::move(map)).first->second.get();
+    }
+
+    inline void schema_locator::add_event_map(const GUID &provider, const BYTE *map, ULONG size) const
+    {
+        std::unique_ptr<event_map> seeded(new event_map(map, size));
+        auto key = map_key(provider, seeded->name());
+
+        auto& entry = maps_[key];
+        if (!entry) {
+            entry.swap(seeded);
+        }
     }
 
     inline std::unique_ptr<char[]> get_event_schema_from_tdh(const EVENT_RECORD &record)
+    {
+        ULONG size = 0;
+        return get_event_schema_from_tdh(record, size);
+    }
+
+    inline std::unique_ptr<char[]> get_event_schema_from_tdh(const EVENT_RECORD &record, ULONG &bufferSize)
     {
         // get required size
-        ULONG bufferSize = 0;
+        bufferSize = 0;
         ULONG status = TdhGetEventInformation(
             (PEVENT_RECORD)&record,
             0,
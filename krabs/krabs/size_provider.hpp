@@ -45,6 +45,8 @@ namespace krabs {
         static ULONG get_tdh_size(
             const wchar_t*,
             const EVENT_RECORD&);
+
+        static ULONG fixed_count(const EVENT_PROPERTY_INFO&);
     };
 
     // Implementation
@@ -76,10 +78,10 @@ namespace krabs {
             // for details
             if (propertyInfo.nonStructType.InType == TDH_INTYPE_POINTER)
             {
-                return record.EventHeader.Flags & EVENT_HEADER_FLAG_32_BIT_HEADER ? 4 : 8;
+                return (record.EventHeader.Flags & EVENT_HEADER_FLAG_32_BIT_HEADER ? 4 : 8) * fixed_count(propertyInfo);
             }
 
-            return propertyInfo.length;
+            return propertyInfo.length * fixed_count(propertyInfo);
         }
 
         ULONG propertyLength = 0;
@@ -122,7 +124,13 @@ namespace krabs {
         // If a string is not-null terminated, propertyLength includes all bytes up
         // to the end of the record buffer.
 
-        if (propertyInfo.nonStructType.OutType == TDH_OUTTYPE_STRING)
+        // TraceLogging strings keep their out type (UTF-8, XML, JSON)
+        // rather than saying they're plain strings.
+        const auto outType = propertyInfo.nonStructType.OutType;
+        if (outType == TDH_OUTTYPE_STRING ||
+            outType == TDH_OUTTYPE_UTF8 ||
+            outType == TDH_OUTTYPE_XML ||
+            outType == TDH_OUTTYPE_JSON)
         {
             if (propertyInfo.nonStructType.InType == TDH_INTYPE_UNICODESTRING)
             {
@@ -149,6 +157,21 @@ namespace krabs {
             }
         }
 
+        // Counted strings and binary blobs start with their size in bytes.
+        switch (propertyInfo.nonStructType.InType)
+        {
+        case TDH_INTYPE_MANIFEST_COUNTEDSTRING:
+        case TDH_INTYPE_MANIFEST_COUNTEDANSISTRING:
+        case TDH_INTYPE_MANIFEST_COUNTEDBINARY:
+            if (propertyStart + sizeof(USHORT) <= pRecordEnd)
+            {
+                propertyLength = sizeof(USHORT) + *(const USHORT*)propertyStart;
+            }
+            break;
+        default:
+            break;
+        }
+
         return propertyLength;
     }
 
@@ -166,4 +189,18 @@ namespace krabs {
 
         return propertyLength;
     }
+
+    inline ULONG size_provider::fixed_count(const EVENT_PROPERTY_INFO& propertyInfo)
+    {
+        // Arrays with a constant count are laid out back to back; length
+        // is the size of one element.
+        if ((propertyInfo.Flags & PropertyParamFixedCount) != 0 &&
+            (propertyInfo.Flags & PropertyParamCount) == 0 &&
+            propertyInfo.count > 1)
+        {
+            return propertyInfo.count;
+        }
+
+        return 1;
+    }
 }
\ No newline at end of file
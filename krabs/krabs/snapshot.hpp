@@ -0,0 +1,245 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#ifndef  WIN32_LEAN_AND_MEAN
+#define  WIN32_LEAN_AND_MEAN
+#endif
+
+#include <windows.h>
+
+#include <memory>
+#include <vector>
+
+#include "compiler_check.hpp"
+
+namespace krabs { namespace details {
+
+    /**
+     * <summary>
+     *   Holds a value that the thread processing events reads without
+     *   taking a lock while other threads change it. A change copies the
+     *   current value, changes the copy and publishes it; readers that
+     *   started before keep the value they started with, which is only
+     *   freed once they've all finished.
+     * </summary>
+     * <remarks>
+     *   Readers are counted in one of two slots. Each time every reader
+     *   of the other slot has finished, new readers move to it, and what
+     *   was replaced before the previous move can no longer be in use.
+     *   That check is made whenever the value changes, so it never waits.
+     *   std::atomic and std::mutex aren't available when krabs is compiled
+     *   with /clr, hence the Interlocked functions and the SRWLOCK.
+     * </remarks>
+     * <example>
+     *   snapshot<std::vector<int>> numbers;
+     *   numbers.update([](std::vector<int> &copy) { copy.push_back(1); });
+     *
+     *   snapshot<std::vector<int>>::reader current(numbers);
+     *   for (auto number : *current) { ... }
+     * </example>
+     */
+    template <typename T>
+    class snapshot {
+    public:
+
+        /**
+         * <summary>
+         *   Reads the current value for as long as it's around. Changes
+         *   made meanwhile aren't seen.
+         * </summary>
+         */
+        class reader {
+        public:
+            explicit reader(const snapshot &owner);
+            ~reader();
+
+            reader(const reader &) = delete;
+            reader &operator=(const reader &) = delete;
+
+            const T &operator*() const { return *value_; }
+            const T *operator->() const { return value_; }
+
+        private:
+            const snapshot &owner_;
+            LONG slot_;
+            const T *value_;
+        };
+
+        snapshot();
+        snapshot(const snapshot &other);
+        snapshot &operator=(const snapshot &other);
+        ~snapshot();
+
+        /**
+         * <summary>
+         *   Calls modify on a copy of the current value and publishes the
+         *   copy. Changes are made one at a time.
+         * </summary>
+         */
+        template <typename Modify>
+        void update(Modify modify);
+
+        /**
+         * <summary>
+         *   Waits until every reader that could still see a value from
+         *   before the call has finished. Must not be called by a reader,
+         *   which would wait for itself.
+         * </summary>
+         */
+        void synchronize();
+
+    private:
+
+        /**
+         * <summary>
+         *   Moves new readers to the other slot if it has none, freeing
+         *   the values that were replaced before the previous move.
+         *   Called with the lock held.
+         * </summary>
+         */
+        bool try_advance();
+
+        T *volatile current_;
+        mutable volatile LONG readers_[2];
+        volatile LONG slot_;
+
+        std::vector<T *> retired_;
+        std::vector<T *> waiting_;
+
+        SRWLOCK lock_;
+    };
+
+    // Implementation
+    // ------------------------------------------------------------------------
+
+    template <typename T>
+    snapshot<T>::reader::reader(const snapshot &owner)
+    : owner_(owner)
+    , slot_(owner.slot_)
+    {
+        // The increment is a full barrier, so a writer that then finds the
+        // slot empty has already published whatever is read next.
+        InterlockedIncrement(&owner_.readers_[slot_]);
+        value_ = owner_.current_;
+    }
+
+    template <typename T>
+    snapshot<T>::reader::~reader()
+    {
+        InterlockedDecrement(&owner_.readers_[slot_]);
+    }
+
+    template <typename T>
+    snapshot<T>::snapshot()
+    : current_(new T())
+    , slot_(0)
+    {
+        readers_[0] = 0;
+        readers_[1] = 0;
+        InitializeSRWLock(&lock_);
+    }
+
+    template <typename T>
+    snapshot<T>::snapshot(const snapshot &other)
+    : slot_(0)
+    {
+        readers_[0] = 0;
+        readers_[1] = 0;
+        InitializeSRWLock(&lock_);
+
+        reader value(other);
+        current_ = new T(*value);
+    }
+
+    template <typename T>
+    snapshot<T> &snapshot<T>::operator=(const snapshot &other)
+    {
+        if (this != &other) {
+            reader value(other);
+            update([&value](T &copy) { copy = *value; });
+        }
+
+        return *this;
+    }
+
+    template <typename T>
+    snapshot<T>::~snapshot()
+    {
+        for (auto value : retired_) {
+            delete value;
+        }
+
+        for (auto value : waiting_) {
+            delete value;
+        }
+
+        delete current_;
+    }
+
+    template <typename T>
+    template <typename Modify>
+    void snapshot<T>::update(Modify modify)
+    {
+        AcquireSRWLockExclusive(&lock_);
+
+        try {
+            std::unique_ptr<T> next(new T(*current_));
+            modify(*next);
+
+            retired_.reserve(retired_.size() + 1);
+            retired_.push_back(static_cast<T *>(InterlockedExchangePointer(
+                reinterpret_cast<PVOID volatile *>(&current_), next.release())));
+
+            (void)try_advance();
+        }
+        catch (...) {
+            ReleaseSRWLockExclusive(&lock_);
+            throw;
+        }
+
+        ReleaseSRWLockExclusive(&lock_);
+    }
+
+    template <typename T>
+    void snapshot<T>::synchronize()
+    {
+        AcquireSRWLockExclusive(&lock_);
+
+        // Two moves: the first waits out readers of the other slot, the
+        // second those of the slot readers were in when this was called.
+        for (int moves = 0; moves < 2; ) {
+            if (try_advance()) {
+                ++moves;
+            }
+            else {
+                SwitchToThread();
+            }
+        }
+
+        ReleaseSRWLockExclusive(&lock_);
+    }
+
+    template <typename T>
+    bool snapshot<T>::try_advance()
+    {
+        const LONG slot = slot_;
+        if (InterlockedCompareExchange(&readers_[1 - slot], 0, 0) != 0) {
+            return false;
+        }
+
+        // Whatever was replaced before the last move was only readable by
+        // readers counted in a slot that has since been empty.
+        for (auto value : waiting_) {
+            delete value;
+        }
+
+        waiting_.swap(retired_);
+        retired_.clear();
+
+        InterlockedExchange(&slot_, 1 - slot);
+        return true;
+    }
+
+} /* namespace details */ } /* namespace krabs */
@@ -0,0 +1,225 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+
+#include <windows.h>
+#include <evntcons.h>
+
+#include <cstdint>
+#include <cstring>
+#include <tuple>
+#include <utility>
+
+#include "compiler_check.hpp"
+#include "guid.hpp"
+#include "provider.hpp"
+#include "trace_context.hpp"
+
+namespace krabs {
+
+    /**
+     * <summary>
+     *   A filter whose predicate and callback are known at compile time.
+     *   Unlike event_filter, neither is wrapped in a std::function, so a
+     *   static_provider's calls to them can be inlined.
+     * </summary>
+     * <example>
+     *   auto filter = krabs::make_static_filter(
+     *       krabs::predicates::id_is(7937) && krabs::predicates::process_id_is(1234),
+     *       [](const EVENT_RECORD &record, const krabs::trace_context &) { ... });
+     * </example>
+     */
+    template <typename Predicate, typename Callback>
+    class static_filter {
+    public:
+        static_filter(const Predicate &predicate, const Callback &callback);
+
+        /**
+         * <summary>
+         *   Calls the callback if the event satisfies the predicate, and
+         *   returns whether it did.
+         * </summary>
+         */
+        bool operator()(const EVENT_RECORD &record, const krabs::trace_context &trace_context) const;
+
+    private:
+        Predicate predicate_;
+
+        // Callbacks often count or collect, as mutable lambdas do.
+        mutable Callback callback_;
+    };
+
+    template <typename Predicate, typename Callback>
+    static_filter<Predicate, Callback> make_static_filter(const Predicate &predicate, Callback callback);
+
+    /**
+     * <summary>
+     *   A provider whose GUID and filters are fixed at compile time. All of
+     *   its filters are run from one callback, where each filter's
+     *   predicate and callback are called directly, so a trace makes one
+     *   indirect call per event for the whole provider.
+     * </summary>
+     * <remarks>
+     *   Guid is a type with a constexpr GUID named value. It's enabled on a
+     *   trace like any other provider, and can be given flags the same way.
+     *   It isn't copyable, since its callback points back at it.
+     * </remarks>
+     * <example>
+     *   struct powershell_guid {
+     *       static constexpr GUID value = krabs::guid_parser::parse_guid_literal(
+     *           "{A0C1853B-5C40-4B15-8766-3CF1C58F985A}");
+     *   };
+     *
+     *   auto filter = krabs::make_static_filter(krabs::predicates::id_is(7937), callback);
+     *   krabs::static_provider<powershell_guid, decltype(filter)> powershell(filter);
+     *   powershell.any(0xf0010000000003ff);
+     *   trace.enable(powershell);
+     * </example>
+     */
+    template <typename Guid, typename... Filters>
+    class static_provider : public provider<> {
+    public:
+        explicit static_provider(const Filters &... filters);
+
+        static_provider(const static_provider &) = delete;
+        static_provider &operator=(const static_provider &) = delete;
+
+        /**
+         * <summary>
+         *   Whether the GUID is this provider's. The comparison is against
+         *   constants, without a load of the provider's GUID.
+         * </summary>
+         */
+        static bool handles(const GUID &provider_id);
+
+        /**
+         * <summary>
+         *   Runs the filters on the event if it comes from this provider,
+         *   for events that don't reach it through a trace, like those read
+         *   from a file. Returns whether any callback was called.
+         * </summary>
+         */
+        bool forward(const EVENT_RECORD &record, const krabs::trace_context &trace_context) const;
+
+    private:
+        template <size_t... Index>
+        bool dispatch(const EVENT_RECORD &record, const krabs::trace_context &trace_context, std::index_sequence<Index...>) const;
+
+        // What the trace calls: events it forwards already have the GUID.
+        struct thunk {
+            const static_provider *self;
+
+            void operator()(const EVENT_RECORD &record, const krabs::trace_context &trace_context) const
+            {
+                self->dispatch(record, trace_context, std::index_sequence_for<Filters...>());
+            }
+        };
+
+        std::tuple<Filters...> filters_;
+    };
+
+    namespace details {
+
+        // GUIDs are laid out little-endian, so the first eight bytes read
+        // as one 64-bit word are Data1, then Data2, then Data3.
+        inline constexpr uint64_t guid_low_word(const GUID &id)
+        {
+            return static_cast<uint64_t>(id.Data1) |
+                   (static_cast<uint64_t>(id.Data2) << 32) |
+                   (static_cast<uint64_t>(id.Data3) << 48);
+        }
+
+        inline constexpr uint64_t guid_high_word(const GUID &id)
+        {
+            return static_cast<uint64_t>(id.Data4[0]) |
+                   (static_cast<uint64_t>(id.Data4[1]) << 8) |
+                   (static_cast<uint64_t>(id.Data4[2]) << 16) |
+                   (static_cast<uint64_t>(id.Data4[3]) << 24) |
+                   (static_cast<uint64_t>(id.Data4[4]) << 32) |
+                   (static_cast<uint64_t>(id.Data4[5]) << 40) |
+                   (static_cast<uint64_t>(id.Data4[6]) << 48) |
+                   (static_cast<uint64_t>(id.Data4[7]) << 56);
+        }
+    } /* namespace details */
+
+    // Implementation
+    // ------------------------------------------------------------------------
+
+    template <typename Predicate, typename Callback>
+    static_filter<Predicate, Callback>::static_filter(const Predicate &predicate, const Callback &callback)
+    : predicate_(predicate)
+    , callback_(callback)
+    {}
+
+    template <typename Predicate, typename Callback>
+    bool static_filter<Predicate, Callback>::operator()(
+        const EVENT_RECORD &record,
+        const krabs::trace_context &trace_context) const
+    {
+        if (!predicate_(record, trace_context)) {
+            return false;
+        }
+
+        callback_(record, trace_context);
+        return true;
+    }
+
+    template <typename Predicate, typename Callback>
+    static_filter<Predicate, Callback> make_static_filter(const Predicate &predicate, Callback callback)
+    {
+        // Callback is taken by value so that functions decay to pointers.
+        return static_filter<Predicate, Callback>(predicate, callback);
+    }
+
+    template <typename Guid, typename... Filters>
+    static_provider<Guid, Filters...>::static_provider(const Filters &... filters)
+    : provider<>(Guid::value)
+    , filters_(filters...)
+    {
+        add_on_event_callback(thunk{ this });
+    }
+
+    template <typename Guid, typename... Filters>
+    bool static_provider<Guid, Filters...>::handles(const GUID &provider_id)
+    {
+        constexpr uint64_t low = details::guid_low_word(Guid::value);
+        constexpr uint64_t high = details::guid_high_word(Guid::value);
+
+        uint64_t words[2];
+        memcpy(words, &provider_id, sizeof(words));
+        return words[0] == low && words[1] == high;
+    }
+
+    template <typename Guid, typename... Filters>
+    bool static_provider<Guid, Filters...>::forward(
+        const EVENT_RECORD &record,
+        const krabs::trace_context &trace_context) const
+    {
+        return handles(record.EventHeader.ProviderId) &&
+               dispatch(record, trace_context, std::index_sequence_for<Filters...>());
+    }
+
+    template <typename Guid, typename... Filters>
+    template <size_t... Index>
+    bool static_provider<Guid, Filters...>::dispatch(
+        const EVENT_RECORD &record,
+        const krabs::trace_context &trace_context,
+        std::index_sequence<Index...>) const
+    {
+        // Every filter gets the event, in order, as with event_filters.
+        bool handled = false;
+        const bool results[] = { false, std::get<Index>(filters_)(record, trace_context)... };
+
+        for (auto result : results) {
+            handled |= result;
+        }
+
+        return handled;
+    }
+
+} /* namespace krabs */
@@ -6,6 +6,7 @@
 #include <algorithm>
 #include <vector>
 #include <memory>
+#include <string>
 
 #include <evntcons.h>
 #include <WinDef.h>
@@ -65,6 +66,13 @@ namespace krabs { namespace testing {
         // Mocks a container ID type extended data item.
         void add_container_id(const GUID& container_id);
 
+        // Mocks the TraceLogging event metadata extended data item.
+        void add_tracelogging_schema(const std::vector<BYTE>& metadata);
+
+        // Mocks the provider traits extended data item, which holds the
+        // provider name of TraceLogging events.
+        void add_provider_traits(const std::string& provider_name);
+
         // This generates a contiguous buffer holding all of the data for
         // the extended data items. Non-trivial because the actual structs
         // have to be a contiguous array, and they each contain pointers,
@@ -107,6 +115,23 @@ namespace krabs { namespace testing {
         items_.emplace_back(static_cast<USHORT>(EVENT_HEADER_EXT_TYPE_CONTAINER_ID), guid_data, GUID_STRING_LENGTH_NO_BRACES);
     }
 
+    inline void extended_data_builder::add_tracelogging_schema(const std::vector<BYTE>& metadata)
+    {
+        items_.emplace_back(static_cast<USHORT>(EVENT_HEADER_EXT_TYPE_EVENT_SCHEMA_TL), const_cast<BYTE*>(metadata.data()), metadata.size());
+    }
+
+    inline void extended_data_builder::add_provider_traits(const std::string& provider_name)
+    {
+        // The traits start with their total size, then the name.
+        std::vector<BYTE> traits(sizeof(USHORT));
+        traits.insert(traits.end(), provider_name.c_str(), provider_name.c_str() + provider_name.size() + 1);
+
+        const USHORT size = static_cast<USHORT>(traits.size());
+        memcpy(traits.data(), &size, sizeof(size));
+
+        items_.emplace_back(static_cast<USHORT>(EVENT_HEADER_EXT_TYPE_PROV_TRAITS), traits.data(), traits.size());
+    }
+
     inline std::pair<std::shared_ptr<BYTE[]>, size_t> extended_data_builder::pack() const
     {
         // Return null for buffer if there are no extended data items.
@@ -0,0 +1,346 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+// Deliberately free of windows.h and the compiler check: converting and
+// formatting timestamps is plain arithmetic, and tools that read captures
+// or ETL files on other platforms only need this header. Reading the
+// clocks themselves is left to clock.hpp.
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace krabs {
+
+    /**
+     * <summary>
+     *   The clock a session stamps its events with: its
+     *   EVENT_TRACE_PROPERTIES Wnode.ClientContext, which a consumer finds
+     *   again in TRACE_LOGFILE_HEADER.ReservedFlags.
+     * </summary>
+     * <remarks>
+     *   The CPU cycle counter is the cheapest to read when events are
+     *   written, but its rate is only known to the MHz and may drift on
+     *   processors without an invariant counter.
+     * </remarks>
+     */
+    enum class clock_type : uint32_t {
+        query_performance_counter = 1,
+        system_time = 2,
+        cpu_cycle_counter = 3
+    };
+
+    /**
+     * <summary>
+     *   Converts raw event timestamps to FILETIMEs, Unix nanoseconds or
+     *   ISO-8601 text. Everything that needs a division is worked out when
+     *   the converter is made, so a conversion is a subtraction, two
+     *   multiplications and an addition.
+     * </summary>
+     * <remarks>
+     *   A converter knows one timestamp in the session's clock and the
+     *   FILETIME it was taken at, and the clock's rate. Conversions are
+     *   within one unit of the exact result. A default converter takes
+     *   timestamps to be FILETIMEs already, which is what ETW hands out
+     *   unless it's asked for raw timestamps.
+     * </remarks>
+     * <example>
+     *   auto converter = krabs::timestamp_converter::sample_now(
+     *       krabs::clock_type::query_performance_counter, frequency.QuadPart);
+     *   auto filetime = converter.to_filetime(record.EventHeader.TimeStamp.QuadPart);
+     *   auto text = converter.to_iso8601(record.EventHeader.TimeStamp.QuadPart);
+     * </example>
+     */
+    class timestamp_converter {
+    public:
+
+        /**
+         * <summary>
+         *   The length of the text to_iso8601 writes, for example
+         *   2024-01-31T12:34:56.1234567Z, without the terminating zero.
+         * </summary>
+         */
+        static const size_t iso8601_length = 28;
+
+        timestamp_converter();
+
+        /**
+         * <param name="clock">the clock the timestamps are in</param>
+         * <param name="ticks_per_second">the rate of the clock</param>
+         * <param name="anchor_timestamp">a timestamp in the clock</param>
+         * <param name="anchor_filetime">the FILETIME anchor_timestamp was taken at</param>
+         */
+        timestamp_converter(
+            clock_type clock,
+            int64_t ticks_per_second,
+            int64_t anchor_timestamp,
+            int64_t anchor_filetime);
+
+        /**
+         * <summary>
+         *   A converter anchored on the current time, read from the given
+         *   clock and from the system time one right after the other.
+         *   Defined in clock.hpp, since reading the clocks takes Windows.
+         * </summary>
+         */
+        static timestamp_converter sample_now(clock_type clock, int64_t ticks_per_second);
+
+        clock_type clock() const { return clock_; }
+
+        int64_t to_filetime(int64_t timestamp) const;
+        int64_t to_unix_nanoseconds(int64_t timestamp) const;
+
+        /**
+         * <summary>
+         *   Converts count timestamps at once. in and out may be the same.
+         * </summary>
+         */
+        void to_filetime(const int64_t *in, int64_t *out, size_t count) const;
+        void to_unix_nanoseconds(const int64_t *in, int64_t *out, size_t count) const;
+
+        /**
+         * <summary>
+         *   Writes the timestamp as UTC ISO-8601 text, to the 100ns, into
+         *   out, which has room for iso8601_length characters and a
+         *   terminating zero. Returns the number of characters written.
+         * </summary>
+         */
+        size_t to_iso8601(int64_t timestamp, char *out) const;
+        std::string to_iso8601(int64_t timestamp) const;
+
+    private:
+
+        /**
+         * <summary>
+         *   A ratio of two rates, as a whole part and a 64 bit fraction,
+         *   so that scaling by it doesn't divide.
+         * </summary>
+         */
+        struct ratio {
+            uint64_t whole;
+            uint64_t fraction;
+
+            ratio(uint64_t numerator, uint64_t denominator);
+
+            int64_t scale(int64_t ticks) const;
+        };
+
+    private:
+        clock_type clock_;
+        int64_t anchor_timestamp_;
+        int64_t anchor_filetime_;
+        int64_t anchor_unix_nanoseconds_;
+        ratio to_100ns_;
+        ratio to_nanoseconds_;
+    };
+
+    namespace details {
+
+        // FILETIME of 1970-01-01T00:00:00Z.
+        const int64_t unix_epoch_filetime = 116444736000000000LL;
+
+        /**
+         * <summary>
+         *   The high 64 bits of the 128 bit product, without intrinsics so
+         *   that it's the same on every compiler and architecture.
+         * </summary>
+         */
+        inline uint64_t multiply_high(uint64_t a, uint64_t b)
+        {
+            const uint64_t a_low = a & 0xFFFFFFFF;
+            const uint64_t a_high = a >> 32;
+            const uint64_t b_low = b & 0xFFFFFFFF;
+            const uint64_t b_high = b >> 32;
+
+            const uint64_t low_low = a_low * b_low;
+            const uint64_t high_low = a_high * b_low;
+            const uint64_t low_high = a_low * b_high;
+            const uint64_t high_high = a_high * b_high;
+
+            const uint64_t middle = (low_low >> 32) + (high_low & 0xFFFFFFFF) + low_high;
+            return high_high + (high_low >> 32) + (middle >> 32);
+        }
+
+    } /* namespace details */
+
+    // Implementation
+    // ------------------------------------------------------------------------
+
+    inline timestamp_converter::ratio::ratio(uint64_t numerator, uint64_t denominator)
+    : whole(numerator / denominator)
+    , fraction(0)
+    {
+        // Long division of the remainder, one bit of the fraction at a
+        // time. The remainder stays below the denominator, which is below
+        // 2^63, so shifting it never overflows.
+        uint64_t remainder = numerator % denominator;
+        for (int bit = 0; bit < 64; ++bit) {
+            remainder <<= 1;
+            fraction <<= 1;
+            if (remainder >= denominator) {
+                remainder -= denominator;
+                fraction |= 1;
+            }
+        }
+    }
+
+    inline int64_t timestamp_converter::ratio::scale(int64_t ticks) const
+    {
+        const uint64_t magnitude = ticks < 0 ? 0 - static_cast<uint64_t>(ticks) : static_cast<uint64_t>(ticks);
+        const uint64_t scaled = magnitude * whole + details::multiply_high(magnitude, fraction);
+        return ticks < 0 ? -static_cast<int64_t>(scaled) : static_cast<int64_t>(scaled);
+    }
+
+    inline timestamp_converter::timestamp_converter()
+    : clock_(clock_type::system_time)
+    , anchor_timestamp_(details::unix_epoch_filetime)
+    , anchor_filetime_(details::unix_epoch_filetime)
+    , anchor_unix_nanoseconds_(0)
+    , to_100ns_(1, 1)
+    , to_nanoseconds_(100, 1)
+    {}
+
+    inline timestamp_converter::timestamp_converter(
+        clock_type clock,
+        int64_t ticks_per_second,
+        int64_t anchor_timestamp,
+        int64_t anchor_filetime)
+    : clock_(clock)
+    , anchor_timestamp_(anchor_timestamp)
+    , anchor_filetime_(anchor_filetime)
+    , anchor_unix_nanoseconds_(static_cast<int64_t>(
+        static_cast<uint64_t>(anchor_filetime - details::unix_epoch_filetime) * 100))
+    , to_100ns_(1, 1)
+    , to_nanoseconds_(100, 1)
+    {
+        // System time is already in FILETIME units, and a clock without a
+        // rate can't be converted, so those are left as they are. They're
+        // anchored on the Unix epoch, since nanoseconds from further back
+        // don't fit in 64 bits.
+        const bool counter = clock == clock_type::query_performance_counter ||
+                             clock == clock_type::cpu_cycle_counter;
+        if (counter && ticks_per_second > 0) {
+            to_100ns_ = ratio(10000000, static_cast<uint64_t>(ticks_per_second));
+            to_nanoseconds_ = ratio(1000000000, static_cast<uint64_t>(ticks_per_second));
+        }
+        else {
+            anchor_timestamp_ = details::unix_epoch_filetime;
+            anchor_filetime_ = details::unix_epoch_filetime;
+            anchor_unix_nanoseconds_ = 0;
+        }
+    }
+
+    inline int64_t timestamp_converter::to_filetime(int64_t timestamp) const
+    {
+        return anchor_filetime_ + to_100ns_.scale(timestamp - anchor_timestamp_);
+    }
+
+    inline int64_t timestamp_converter::to_unix_nanoseconds(int64_t timestamp) const
+    {
+        // Nanoseconds are added up modulo 2^64: an anchor too far from 1970
+        // for them to fit still gives the right result for timestamps that
+        // aren't.
+        return static_cast<int64_t>(
+            static_cast<uint64_t>(anchor_unix_nanoseconds_) +
+            static_cast<uint64_t>(to_nanoseconds_.scale(timestamp - anchor_timestamp_)));
+    }
+
+    inline void timestamp_converter::to_filetime(const int64_t *in, int64_t *out, size_t count) const
+    {
+        // Each conversion is independent and free of divisions, which lets
+        // the compiler unroll and interleave them.
+        const ratio scale = to_100ns_;
+        const int64_t anchor_timestamp = anchor_timestamp_;
+        const int64_t anchor_filetime = anchor_filetime_;
+
+        for (size_t i = 0; i < count; ++i) {
+            out[i] = anchor_filetime + scale.scale(in[i] - anchor_timestamp);
+        }
+    }
+
+    inline void timestamp_converter::to_unix_nanoseconds(const int64_t *in, int64_t *out, size_t count) const
+    {
+        const ratio scale = to_nanoseconds_;
+        const int64_t anchor_timestamp = anchor_timestamp_;
+        const int64_t anchor_unix_nanoseconds = anchor_unix_nanoseconds_;
+
+        for (size_t i = 0; i < count; ++i) {
+            out[i] = static_cast<int64_t>(
+                static_cast<uint64_t>(anchor_unix_nanoseconds) +
+                static_cast<uint64_t>(scale.scale(in[i] - anchor_timestamp)));
+        }
+    }
+
+    inline size_t timestamp_converter::to_iso8601(int64_t timestamp, char *out) const
+    {
+        const int64_t filetime = to_filetime(timestamp);
+        const int64_t per_day = 864000000000LL;
+
+        // Days since 1601-01-01, which is a Monday and the start of a 400
+        // year cycle, so the Gregorian rules apply from day 0.
+        int64_t days = filetime / per_day;
+        int64_t in_day = filetime % per_day;
+        if (in_day < 0) {
+            in_day += per_day;
+            --days;
+        }
+
+        const int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+        const int64_t day_of_era = days - era * 146097;
+        const int64_t year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+        const int64_t day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+
+        // Months counted from January, with the day of the year worked out
+        // from a table rather than shifting the year to start in March.
+        static const int month_starts[2][13] = {
+            { 0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334, 365 },
+            { 0, 31, 60, 91, 121, 152, 182, 213, 244, 274, 305, 335, 366 },
+        };
+
+        const int64_t year = 1601 + era * 400 + year_of_era;
+        const int leap = (year % 4 == 0 && (year % 100 != 0 || year % 400 == 0)) ? 1 : 0;
+
+        int month = 0;
+        while (month < 11 && day_of_year >= month_starts[leap][month + 1]) {
+            ++month;
+        }
+
+        const int64_t day = day_of_year - month_starts[leap][month] + 1;
+        const int64_t seconds = in_day / 10000000;
+        const int64_t fraction = in_day % 10000000;
+
+        auto put = [&out](size_t at, int64_t value, int digits) {
+            for (int i = digits - 1; i >= 0; --i) {
+                out[at + i] = static_cast<char>('0' + value % 10);
+                value /= 10;
+            }
+        };
+
+        put(0, year, 4);
+        out[4] = '-';
+        put(5, month + 1, 2);
+        out[7] = '-';
+        put(8, day, 2);
+        out[10] = 'T';
+        put(11, seconds / 3600, 2);
+        out[13] = ':';
+        put(14, seconds / 60 % 60, 2);
+        out[16] = ':';
+        put(17, seconds % 60, 2);
+        out[19] = '.';
+        put(20, fraction, 7);
+        out[27] = 'Z';
+        out[28] = '\0';
+
+        return iso8601_length;
+    }
+
+    inline std::string timestamp_converter::to_iso8601(int64_t timestamp) const
+    {
+        char text[iso8601_length + 1];
+        return std::string(text, to_iso8601(timestamp, text));
+    }
+
+} /* namespace krabs */
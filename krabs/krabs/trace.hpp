@@ -4,10 +4,15 @@
 #pragma once
 
 #include <deque>
+#include <memory>
 
 #include "compiler_check.hpp"
+#include "delivery_lag.hpp"
 #include "guid.hpp"
+#include "metrics.hpp"
 #include "provider.hpp"
+#include "pushdown_policy.hpp"
+#include "snapshot.hpp"
 #include "trace_context.hpp"
 #include "etw.hpp"
 
@@ -125,7 +130,11 @@ namespace krabs {
 
         /**
          * <summary>
-         * Enables the provider on the given user trace.
+         * Enables the provider on the given user trace. This can be done
+         * while the trace is processing events, from any thread: for a user
+         * trace the session is asked for the provider's events right away.
+         * A kernel trace only gets events for the flags it was started
+         * with, though group masks are updated.
          * </summary>
          * <example>
          *    krabs::trace trace;
@@ -136,6 +145,26 @@ namespace krabs {
          */
         void enable(const typename T::provider_type &p);
 
+        /**
+         * <summary>
+         * Stops forwarding events to the provider, and for a user trace,
+         * stops the session getting its events if no other provider has
+         * its GUID. Returns false if the provider wasn't enabled.
+         * </summary>
+         * <remarks>
+         * Once this returns, no event is being forwarded to the provider
+         * anymore, so it can be destroyed -- unless this is called from one
+         * of the trace's callbacks, where the event being processed may
+         * still be headed for it.
+         * </remarks>
+         * <example>
+         *    trace.enable(powershell);
+         *    // ...
+         *    trace.disable(powershell);
+         * </example>
+         */
+        bool disable(const typename T::provider_type &p);
+
         /**
          * <summary>
          * Starts a trace session.
@@ -204,6 +233,23 @@ namespace krabs {
          */
         trace_stats query_stats();
 
+        /**
+         * <summary>
+         * The events the trace has handled, the counters of its schema
+         * cache, and the metrics of each of its providers that has
+         * enable_metrics called. Can be called while the trace runs.
+         * </summary>
+         * <example>
+         *    krabs::user_trace trace;
+         *    krabs::provider<> powershell(id);
+         *    powershell.enable_metrics();
+         *    trace.enable(powershell);
+         *    // ... on another thread, while the trace runs
+         *    for (auto &provider : trace.metrics().providers) { ... }
+         * </example>
+         */
+        trace_metrics metrics() const;
+
         /**
          * <summary>
          * Returns the number of buffers that were processed.
@@ -241,6 +287,72 @@ namespace krabs {
          */
         void set_default_event_callback(c_provider_callback callback);
 
+        /**
+         * <summary>
+         * Has ETW stop delivering event ids that none of the callbacks of a
+         * provider have accepted for a while. See pushdown_policy for what
+         * the arguments mean. Enabling another provider delivers every id
+         * again. Only user traces do this; kernel traces ignore it.
+         * </summary>
+         * <example>
+         *    krabs::user_trace trace;
+         *    trace.enable_adaptive_pushdown(100000, 100, 3);
+         * </example>
+         */
+        void enable_adaptive_pushdown(
+            uint64_t window_events = 100000,
+            uint64_t min_events = 100,
+            unsigned int quiet_windows = 3);
+
+        /**
+         * <summary>
+         * Measures how late events are by the time the trace gets them,
+         * for one in every sample_every events, per provider. The lags show
+         * up in metrics(). on_alert is called on the thread processing
+         * events when a provider's lag reaches alert_threshold_ms. See
+         * delivery_lag_tracker. Throws if the trace is already running.
+         * </summary>
+         * <example>
+         *    krabs::user_trace trace;
+         *    trace.enable_delivery_lag_tracking(64, 2000, [](const krabs::delivery_lag_alert &alert) {
+         *        // more than two seconds behind: shed load
+         *    });
+         * </example>
+         */
+        void enable_delivery_lag_tracking(
+            uint64_t sample_every = 64,
+            uint64_t alert_threshold_ms = 0,
+            delivery_lag_callback on_alert = nullptr);
+
+        /**
+         * <summary>
+         * Sets the clock the session stamps its events with. Call it before
+         * the trace starts. The default is the performance counter.
+         * </summary>
+         * <example>
+         *    krabs::user_trace trace;
+         *    trace.set_timestamp_clock(krabs::clock_type::cpu_cycle_counter);
+         * </example>
+         */
+        void set_timestamp_clock(clock_type clock);
+
+        /**
+         * <summary>
+         * Keeps event timestamps in the session's clock instead of having
+         * ETW convert them to FILETIMEs, which saves the conversion on
+         * every event. Callbacks convert the timestamps they need with
+         * the timestamp_converter of the trace_context they're given.
+         * Call it before the trace starts.
+         * </summary>
+         * <example>
+         *    krabs::user_trace trace;
+         *    trace.set_raw_timestamps(true);
+         *    // ... in a callback
+         *    auto text = context.timestamps.to_iso8601(record.EventHeader.TimeStamp.QuadPart);
+         * </example>
+         */
+        void set_raw_timestamps(bool raw);
+
     private:
 
         /**
@@ -250,22 +362,58 @@ namespace krabs {
          */
         void on_event(const EVENT_RECORD &);
 
+        uint64_t events_handled() const;
+        void reset_events_handled();
+
     private:
+        typedef std::deque<std::reference_wrapper<const typename T::provider_type>> provider_list;
+        typedef typename details::snapshot<provider_list>::reader provider_reader;
+
         std::wstring name_;
-        std::deque<std::reference_wrapper<const typename T::provider_type>> providers_;
+
+        // Read by the thread processing events without a lock, so that
+        // providers can be enabled and disabled meanwhile.
+        details::snapshot<provider_list> providers_;
 
         TRACEHANDLE registrationHandle_;
         TRACEHANDLE sessionHandle_;
 
+        // The thread that last processed an event, which mustn't wait
+        // for events to be done with a provider it disables.
+        volatile DWORD processing_thread_;
+
         size_t buffersRead_;
-        uint64_t eventsHandled_;
+
+        // Counted per thread, so that counting needs no interlocked
+        // instructions and reading while events are handled is safe.
+        // Starting the trace again only moves the baseline.
+        details::event_counter eventsHandled_;
+        volatile uint64_t eventsHandledBaseline_;
 
         EVENT_TRACE_PROPERTIES properties_;
 
-        const trace_context context_;
+        trace_context context_;
+
+        clock_type clock_;
+        bool raw_timestamps_;
 
         provider_callback default_callback_ = nullptr;
 
+        std::unique_ptr<pushdown_policy> pushdown_policy_;
+
+        std::unique_ptr<delivery_lag_tracker> delivery_lag_;
+
+        // Set when providers change. The policy belongs to the thread
+        // processing events, which resets it when it sees this.
+        mutable volatile LONG pushdown_reset_;
+
+        // Set when the callbacks or filters of an enabled provider change.
+        // The thread processing events enables it again.
+        mutable volatile LONG providers_changed_;
+
+        // Counted by the thread processing events, read by metrics().
+        mutable volatile LONG64 pushdown_failures_;
+
     private:
         template <typename T>
         friend class details::trace_manager;
@@ -283,9 +431,15 @@ namespace krabs {
     trace<T>::trace(const std::wstring &name)
     : registrationHandle_(INVALID_PROCESSTRACE_HANDLE)
     , sessionHandle_(INVALID_PROCESSTRACE_HANDLE)
-    , eventsHandled_(0)
+    , processing_thread_(0)
     , buffersRead_(0)
+    , eventsHandledBaseline_(0)
     , context_()
+    , clock_(clock_type::query_performance_counter)
+    , raw_timestamps_(false)
+    , pushdown_reset_(0)
+    , providers_changed_(0)
+    , pushdown_failures_(0)
     {
         name_ = T::enforce_name_policy(name);
         ZeroMemory(&properties_, sizeof(EVENT_TRACE_PROPERTIES));
@@ -295,9 +449,15 @@ namespace krabs {
     trace<T>::trace(const wchar_t *name)
     : registrationHandle_(INVALID_PROCESSTRACE_HANDLE)
     , sessionHandle_(INVALID_PROCESSTRACE_HANDLE)
-    , eventsHandled_(0)
+    , processing_thread_(0)
     , buffersRead_(0)
+    , eventsHandledBaseline_(0)
     , context_()
+    , clock_(clock_type::query_performance_counter)
+    , raw_timestamps_(false)
+    , pushdown_reset_(0)
+    , providers_changed_(0)
+    , pushdown_failures_(0)
     {
         name_ = T::enforce_name_policy(name);
         ZeroMemory(&properties_, sizeof(EVENT_TRACE_PROPERTIES));
@@ -322,20 +482,71 @@ namespace krabs {
     template <typename T>
     void trace<T>::on_event(const EVENT_RECORD &record)
     {
-        ++eventsHandled_;
+        const DWORD thread = GetCurrentThreadId();
+        processing_thread_ = thread;
+        ++eventsHandled_.local(thread).value;
+
+        uint64_t lag = 0;
+        if (delivery_lag_ && delivery_lag_->sample(record, context_.timestamps, lag)) {
+            delivery_lag_->record_lag(T::dispatch_guid(record, *this), lag);
+        }
+
         T::forward_events(record, *this);
+
+        // Nothing from the callbacks is using a schema anymore.
+        context_.schema_locator.trim();
     }
 
     template <typename T>
     void trace<T>::enable(const typename T::provider_type &p)
     {
-        providers_.push_back(std::ref(p));
+        providers_.update([&p](provider_list &providers) {
+            providers.push_back(std::ref(p));
+        });
+
+        p.trace_changed_ = &providers_changed_;
+        if (pushdown_policy_) {
+            InterlockedExchange(&pushdown_reset_, 1);
+        }
+
+        T::update_provider(*this, p, true);
+    }
+
+    template <typename T>
+    bool trace<T>::disable(const typename T::provider_type &p)
+    {
+        bool removed = false;
+        providers_.update([&p, &removed](provider_list &providers) {
+            for (auto provider = providers.begin(); provider != providers.end(); ++provider) {
+                if (&provider->get() == &p) {
+                    providers.erase(provider);
+                    removed = true;
+                    break;
+                }
+            }
+        });
+
+        if (!removed) {
+            return false;
+        }
+
+        if (p.trace_changed_ == &providers_changed_) {
+            p.trace_changed_ = nullptr;
+        }
+
+        T::update_provider(*this, p, false);
+
+        if (processing_thread_ != GetCurrentThreadId()) {
+            providers_.synchronize();
+        }
+
+        return true;
     }
 
     template <typename T>
     void trace<T>::start()
     {
-        eventsHandled_ = 0;
+        reset_events_handled();
 
         details::trace_manager<trace> manager(*this);
         manager.start();
@@ -351,7 +562,7 @@ namespace krabs {
     template <typename T>
     EVENT_TRACE_LOGFILE trace<T>::open()
     {
-        eventsHandled_ = 0;
+        reset_events_handled();
 
         details::trace_manager<trace> manager(*this);
         return manager.open();
@@ -360,7 +571,7 @@ namespace krabs {
     template <typename T>
     void trace<T>::process()
     {
-        eventsHandled_ = 0;
+        reset_events_handled();
 
         details::trace_manager<trace> manager(*this);
         manager.process();
@@ -370,7 +581,40 @@ namespace krabs {
     trace_stats trace<T>::query_stats()
     {
         details::trace_manager<trace> manager(*this);
-        return { eventsHandled_, manager.query() };
+        return { events_handled(), manager.query() };
+    }
+
+    template <typename T>
+    trace_metrics trace<T>::metrics() const
+    {
+        trace_metrics metrics;
+        metrics.events_handled = events_handled();
+        metrics.schema_cache = context_.schema_locator.stats();
+        metrics.pushdown_failures = static_cast<uint64_t>(InterlockedCompareExchange64(&pushdown_failures_, 0, 0));
+        if (delivery_lag_) {
+            metrics.delivery_lag = delivery_lag_->metrics();
+        }
+
+        provider_reader providers(providers_);
+        for (auto &provider : *providers) {
+            if (provider.get().metrics_enabled()) {
+                metrics.providers.push_back(provider.get().metrics());
+            }
+        }
+
+        return metrics;
+    }
+
+    template <typename T>
+    uint64_t trace<T>::events_handled() const
+    {
+        return details::total(eventsHandled_) - eventsHandledBaseline_;
+    }
+
+    template <typename T>
+    void trace<T>::reset_events_handled()
+    {
+        eventsHandledBaseline_ = details::total(eventsHandled_);
     }
 
     template <typename T>
@@ -385,4 +629,39 @@ namespace krabs {
         default_callback_ = callback;
     }
 
+    template <typename T>
+    void trace<T>::enable_adaptive_pushdown(
+        uint64_t window_events,
+        uint64_t min_events,
+        unsigned int quiet_windows)
+    {
+        pushdown_policy_.reset(new pushdown_policy(window_events, min_events, quiet_windows));
+    }
+
+    template <typename T>
+    void trace<T>::enable_delivery_lag_tracking(
+        uint64_t sample_every,
+        uint64_t alert_threshold_ms,
+        delivery_lag_callback on_alert)
+    {
+        // The thread processing events uses the tracker without a lock.
+        if (sessionHandle_ != INVALID_PROCESSTRACE_HANDLE) {
+            throw std::runtime_error("Delivery lag tracking must be enabled before the trace starts");
+        }
+
+        delivery_lag_.reset(new delivery_lag_tracker(sample_every, alert_threshold_ms, on_alert));
+    }
+
+    template <typename T>
+    void trace<T>::set_timestamp_clock(clock_type clock)
+    {
+        clock_ = clock;
+    }
+
+    template <typename T>
+    void trace<T>::set_raw_timestamps(bool raw)
+    {
+        raw_timestamps_ = raw;
+    }
+
 }
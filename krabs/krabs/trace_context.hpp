@@ -3,6 +3,7 @@
 
 #pragma once
 
+#include "clock.hpp"
 #include "schema_locator.hpp"
 
 namespace krabs {
@@ -16,6 +17,11 @@ namespace krabs {
     struct trace_context
     {
         const schema_locator schema_locator;
+
+        // Converts the raw timestamps of events to FILETIMEs and other
+        // forms. ETW converts timestamps itself unless it's asked not to,
+        // and then this leaves them as they are.
+        timestamp_converter timestamps;
         /* Add additional trace context here. */
     };
 
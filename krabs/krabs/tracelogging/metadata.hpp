@@ -0,0 +1,409 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#ifndef  WIN32_LEAN_AND_MEAN
+#define  WIN32_LEAN_AND_MEAN
+#endif
+
+#include <windows.h>
+#include <tdh.h>
+#include <evntcons.h>
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../compiler_check.hpp"
+#include "../wstring_convert.hpp"
+
+namespace krabs { namespace tracelogging {
+
+    /**
+     * <summary>
+     *   Bits of the in type byte of a TraceLogging field. The low five bits
+     *   are the type, numbered like TDH_INTYPE.
+     * </summary>
+     */
+    enum in_type_bits : uint8_t {
+        in_type_mask      = 0x1F,
+        in_count_mask     = 0x60,
+        in_constant_count = 0x20,
+        in_variable_count = 0x40,
+        in_custom         = 0x60,
+        in_chain          = 0x80,
+    };
+
+    /**
+     * <summary>
+     *   The in type that opens a struct; its out type byte holds the number
+     *   of fields that belong to the struct.
+     * </summary>
+     */
+    static constexpr uint8_t in_struct = 24;
+    static constexpr uint8_t out_chain = 0x80;
+
+    /**
+     * <summary>
+     *   One field of a TraceLogging event, as described by its metadata.
+     * </summary>
+     */
+    struct field_metadata {
+        std::wstring name;
+        uint8_t in_type;     // without flags
+        uint8_t out_type;    // TraceLogging's numbering, not TDH_OUTTYPE's
+        uint8_t count_kind;  // 0, in_constant_count, in_variable_count or in_custom
+        uint16_t count;      // the constant count, or the number of struct fields
+    };
+
+    /**
+     * <summary>
+     *   The decoded EVENT_HEADER_EXT_TYPE_EVENT_SCHEMA_TL extended item of a
+     *   TraceLogging event: its name and its fields in payload order.
+     * </summary>
+     */
+    struct event_metadata {
+        std::wstring name;
+        std::vector<field_metadata> fields;
+    };
+
+    /**
+     * <summary>
+     *   Decodes TraceLogging event metadata. Throws std::runtime_error if the
+     *   blob is malformed.
+     * </summary>
+     */
+    event_metadata parse_event_metadata(const BYTE *data, size_t size);
+
+    /**
+     * <summary>
+     *   Returns the first extended data item of the given type, or nullptr.
+     * </summary>
+     */
+    const EVENT_HEADER_EXTENDED_DATA_ITEM *find_extended_data(const EVENT_RECORD &record, USHORT type);
+
+    /**
+     * <summary>
+     *   The provider name from the event's EVENT_HEADER_EXT_TYPE_PROV_TRAITS
+     *   item, or an empty string if it doesn't have one.
+     * </summary>
+     */
+    std::wstring provider_name(const EVENT_RECORD &record);
+
+    /**
+     * <summary>
+     *   A 64-bit FNV-1a hash of the provider id and metadata blob, which is
+     *   how TraceLogging schemas are cached: their event ids are often all 0.
+     * </summary>
+     */
+    uint64_t hash_metadata(const GUID &provider, const BYTE *data, size_t size);
+
+    /**
+     * <summary>
+     *   Lays the metadata out as the TRACE_EVENT_INFO TdhGetEventInformation
+     *   would return for the event, so that schema, parser and format_plan
+     *   work on it unchanged. Returns nullptr for events whose layout needs
+     *   more than a TRACE_EVENT_INFO expresses on its own (variable counts,
+     *   custom types and structs); those are left to TDH.
+     * </summary>
+     */
+    std::unique_ptr<char[]> make_event_schema(const EVENT_RECORD &record, const event_metadata &metadata, ULONG &size);
+
+    // Implementation
+    // ------------------------------------------------------------------------
+
+    namespace details {
+
+        class metadata_reader {
+        public:
+            metadata_reader(const BYTE *data, size_t size)
+            : data_(data)
+            , size_(size)
+            , at_(0)
+            {}
+
+            bool done() const { return at_ >= size_; }
+
+            uint8_t byte()
+            {
+                if (at_ >= size_) {
+                    throw std::runtime_error("TraceLogging metadata is truncated");
+                }
+
+                return data_[at_++];
+            }
+
+            uint16_t word()
+            {
+                uint16_t low = byte();
+                return static_cast<uint16_t>(low | (byte() << 8));
+            }
+
+            // Extension chains carry their own chain bit in every byte.
+            void skip_chain()
+            {
+                while ((byte() & 0x80) != 0) {
+                }
+            }
+
+            void skip(size_t count)
+            {
+                if (count > size_ - at_) {
+                    throw std::runtime_error("TraceLogging metadata is truncated");
+                }
+
+                at_ += count;
+            }
+
+            std::wstring name()
+            {
+                auto start = reinterpret_cast<const char*>(data_ + at_);
+                auto terminator = static_cast<const char*>(memchr(start, 0, size_ - at_));
+                if (terminator == nullptr) {
+                    throw std::runtime_error("TraceLogging metadata name isn't terminated");
+                }
+
+                at_ += (terminator - start) + 1;
+                return from_string(std::string(start, terminator));
+            }
+
+        private:
+            const BYTE *data_;
+            size_t size_;
+            size_t at_;
+        };
+
+        // TraceLogging out types are a compact numbering of their own.
+        inline USHORT to_tdh_out_type(uint8_t out_type, uint8_t in_type)
+        {
+            switch (out_type) {
+            case 2:  return TDH_OUTTYPE_STRING;
+            case 3:  return TDH_OUTTYPE_BOOLEAN;
+            case 4:
+                switch (in_type) {
+                case TDH_INTYPE_INT8:
+                case TDH_INTYPE_UINT8:  return TDH_OUTTYPE_HEXINT8;
+                case TDH_INTYPE_INT16:
+                case TDH_INTYPE_UINT16: return TDH_OUTTYPE_HEXINT16;
+                case TDH_INTYPE_INT32:
+                case TDH_INTYPE_UINT32: return TDH_OUTTYPE_HEXINT32;
+                case TDH_INTYPE_INT64:
+                case TDH_INTYPE_UINT64: return TDH_OUTTYPE_HEXINT64;
+                default:                return TDH_OUTTYPE_HEXBINARY;
+                }
+            case 5:  return TDH_OUTTYPE_PID;
+            case 6:  return TDH_OUTTYPE_TID;
+            case 7:  return TDH_OUTTYPE_PORT;
+            case 8:  return TDH_OUTTYPE_IPV4;
+            case 9:  return TDH_OUTTYPE_IPV6;
+            case 10: return TDH_OUTTYPE_SOCKETADDRESS;
+            case 11: return TDH_OUTTYPE_XML;
+            case 12: return TDH_OUTTYPE_JSON;
+            case 13: return TDH_OUTTYPE_WIN32ERROR;
+            case 14: return TDH_OUTTYPE_NTSTATUS;
+            case 15: return TDH_OUTTYPE_HRESULT;
+            case 16: return TDH_OUTTYPE_DATETIME;
+            case 33: return TDH_OUTTYPE_CULTURE_INSENSITIVE_DATETIME;
+            case 35: return TDH_OUTTYPE_UTF8;
+            case 36: return TDH_OUTTYPE_PKCS7_WITH_TYPE_INFO;
+            case 37: return TDH_OUTTYPE_CODE_POINTER;
+            case 38: return TDH_OUTTYPE_DATETIME_UTC;
+            default: break;
+            }
+
+            // Strings have no out type by default, but the parser only sizes
+            // them without TDH when they say they're strings.
+            if (in_type == TDH_INTYPE_UNICODESTRING || in_type == TDH_INTYPE_ANSISTRING) {
+                return TDH_OUTTYPE_STRING;
+            }
+
+            return TDH_OUTTYPE_NULL;
+        }
+
+        inline USHORT fixed_size(uint8_t in_type)
+        {
+            switch (in_type) {
+            case TDH_INTYPE_INT8:
+            case TDH_INTYPE_UINT8:      return 1;
+            case TDH_INTYPE_INT16:
+            case TDH_INTYPE_UINT16:     return 2;
+            case TDH_INTYPE_INT32:
+            case TDH_INTYPE_UINT32:
+            case TDH_INTYPE_HEXINT32:
+            case TDH_INTYPE_FLOAT:
+            case TDH_INTYPE_BOOLEAN:    return 4;
+            case TDH_INTYPE_INT64:
+            case TDH_INTYPE_UINT64:
+            case TDH_INTYPE_HEXINT64:
+            case TDH_INTYPE_DOUBLE:
+            case TDH_INTYPE_FILETIME:   return 8;
+            case TDH_INTYPE_POINTER:    return 8;  // sized from the header by the parser
+            case TDH_INTYPE_GUID:
+            case TDH_INTYPE_SYSTEMTIME: return 16;
+            default:                    return 0;
+            }
+        }
+
+    } /* namespace details */
+
+    inline event_metadata parse_event_metadata(const BYTE *data, size_t size)
+    {
+        details::metadata_reader reader(data, size);
+
+        // The blob starts with its own size, which may be less than the item.
+        const uint16_t declared = reader.word();
+        if (declared < 2 || declared > size) {
+            throw std::runtime_error("TraceLogging metadata size is out of range");
+        }
+
+        reader = details::metadata_reader(data, declared);
+        reader.word();
+        reader.skip_chain();
+
+        event_metadata metadata;
+        metadata.name = reader.name();
+
+        while (!reader.done()) {
+            field_metadata field;
+            field.name = reader.name();
+
+            const uint8_t in = reader.byte();
+            field.in_type = in & in_type_mask;
+            field.count_kind = in & in_count_mask;
+            field.out_type = 0;
+            field.count = 1;
+
+            if ((in & in_chain) != 0) {
+                const uint8_t out = reader.byte();
+                field.out_type = out & 0x7F;
+                if ((out & out_chain) != 0) {
+                    reader.skip_chain();
+                }
+            }
+
+            if (field.in_type == in_struct) {
+                field.count = field.out_type;
+                field.out_type = 0;
+            }
+
+            if (field.count_kind == in_constant_count) {
+                field.count = reader.word();
+            } else if (field.count_kind == in_custom) {
+                reader.skip(reader.word());
+            }
+
+            metadata.fields.push_back(std::move(field));
+        }
+
+        return metadata;
+    }
+
+    inline const EVENT_HEADER_EXTENDED_DATA_ITEM *find_extended_data(const EVENT_RECORD &record, USHORT type)
+    {
+        for (USHORT i = 0; i < record.ExtendedDataCount; ++i) {
+            if (record.ExtendedData[i].ExtType == type) {
+                return &record.ExtendedData[i];
+            }
+        }
+
+        return nullptr;
+    }
+
+    inline std::wstring provider_name(const EVENT_RECORD &record)
+    {
+        auto traits = find_extended_data(record, EVENT_HEADER_EXT_TYPE_PROV_TRAITS);
+        if (traits == nullptr || traits->DataSize < 3) {
+            return std::wstring();
+        }
+
+        // UINT16 size, then the nul-terminated UTF-8 provider name.
+        auto start = reinterpret_cast<const char*>(traits->DataPtr) + 2;
+        auto terminator = static_cast<const char*>(memchr(start, 0, traits->DataSize - 2));
+        if (terminator == nullptr) {
+            return std::wstring();
+        }
+
+        return from_string(std::string(start, terminator));
+    }
+
+    inline uint64_t hash_metadata(const GUID &provider, const BYTE *data, size_t size)
+    {
+        uint64_t hash = 14695981039346656037ULL;
+        auto mix = [&hash](const BYTE *bytes, size_t count) {
+            for (size_t i = 0; i < count; ++i) {
+                hash ^= bytes[i];
+                hash *= 1099511628211ULL;
+            }
+        };
+
+        mix(reinterpret_cast<const BYTE*>(&provider), sizeof(provider));
+        mix(data, size);
+        return hash;
+    }
+
+    inline std::unique_ptr<char[]> make_event_schema(const EVENT_RECORD &record, const event_metadata &metadata, ULONG &size)
+    {
+        for (const auto &field : metadata.fields) {
+            if (field.in_type == in_struct ||
+                field.count_kind == in_variable_count ||
+                field.count_kind == in_custom) {
+                return nullptr;
+            }
+        }
+
+        const std::wstring provider = provider_name(record);
+        const size_t count = metadata.fields.size();
+
+        // The properties, then every string they point at.
+        size_t total = FIELD_OFFSET(TRACE_EVENT_INFO, EventPropertyInfoArray) + count * sizeof(EVENT_PROPERTY_INFO);
+        total += (provider.size() + 1 + metadata.name.size() + 1) * sizeof(wchar_t);
+        for (const auto &field : metadata.fields) {
+            total += (field.name.size() + 1) * sizeof(wchar_t);
+        }
+
+        std::unique_ptr<char[]> buffer(new char[total]);
+        memset(buffer.get(), 0, total);
+
+        size_t at = FIELD_OFFSET(TRACE_EVENT_INFO, EventPropertyInfoArray) + count * sizeof(EVENT_PROPERTY_INFO);
+        auto add_string = [&](const std::wstring &text) {
+            const ULONG offset = static_cast<ULONG>(at);
+            memcpy(buffer.get() + at, text.c_str(), (text.size() + 1) * sizeof(wchar_t));
+            at += (text.size() + 1) * sizeof(wchar_t);
+            return offset;
+        };
+
+        auto info = reinterpret_cast<TRACE_EVENT_INFO*>(buffer.get());
+        info->ProviderGuid = record.EventHeader.ProviderId;
+        info->EventDescriptor = record.EventHeader.EventDescriptor;
+        info->DecodingSource = DecodingSourceTlg;
+        info->ProviderNameOffset = add_string(provider);
+
+        // TDH reports the TraceLogging event name as the task name too.
+        info->EventNameOffset = add_string(metadata.name);
+        info->TaskNameOffset = info->EventNameOffset;
+        info->PropertyCount = static_cast<ULONG>(count);
+        info->TopLevelPropertyCount = static_cast<ULONG>(count);
+
+        for (size_t i = 0; i < count; ++i) {
+            const auto &field = metadata.fields[i];
+            auto &property = info->EventPropertyInfoArray[i];
+
+            property.NameOffset = add_string(field.name);
+            property.nonStructType.InType = field.in_type;
+            property.nonStructType.OutType = details::to_tdh_out_type(field.out_type, field.in_type);
+            property.count = field.count;
+            property.length = details::fixed_size(field.in_type);
+            if (field.count_kind == in_constant_count) {
+                property.Flags = PropertyParamFixedCount;
+            }
+        }
+
+        size = static_cast<ULONG>(total);
+        return buffer;
+    }
+
+} /* namespace tracelogging */ } /* namespace krabs */
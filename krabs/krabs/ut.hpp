@@ -3,11 +3,14 @@
 
 #pragma once
 
+#include <algorithm>
+#include <iterator>
 #include <set>
 
 #include "compiler_check.hpp"
 #include "trace.hpp"
 #include "provider.hpp"
+#include "filtering/filter_descriptors.hpp"
 
 namespace krabs { namespace details {
 
@@ -31,8 +34,13 @@ namespace krabs { namespace details {
 
         struct filter_settings{
             std::set<unsigned short> provider_filter_event_ids_;
+            std::set<unsigned short> stack_trace_event_ids_;
+            krabs::filter_pushdown pushdown_;
             filter_flags filter_flags_{};
             bool rundown_enabled_ = false;
+            bool any_event_id_ = false;
+            bool any_stack_trace_ = false;
+            bool first_ = true;
         };
 
         typedef std::map<krabs::guid, filter_settings> provider_filter_settings;
@@ -68,6 +76,56 @@ namespace krabs { namespace details {
         static void enable_providers(
             const krabs::trace<krabs::details::ut> &trace);
 
+        /**
+         * <summary>
+         *   Combines the settings of the providers that share a GUID.
+         * </summary>
+         */
+        static provider_filter_settings collect_settings(
+            const krabs::trace<krabs::details::ut> &trace);
+
+        /**
+         * <summary>
+         *   Enables one provider GUID, leaving out the excluded event ids.
+         *   Enabling it again replaces its settings in the session.
+         * </summary>
+         */
+        static void enable_provider(
+            const krabs::trace<krabs::details::ut> &trace,
+            const GUID &provider_guid,
+            const filter_settings &settings,
+            const std::set<unsigned short> &excluded_event_ids);
+
+        /**
+         * <summary>
+         *   Enables the providers whose excluded event ids the trace's
+         *   pushdown policy changed.
+         * </summary>
+         */
+        static void apply_pushdown_policy(
+            const krabs::trace<krabs::details::ut> &trace);
+
+        /**
+         * <summary>
+         *   Brings the session up to date after the provider was enabled
+         *   or disabled on a trace that's already running.
+         * </summary>
+         */
+        static void update_provider(
+            const krabs::trace<krabs::details::ut> &trace,
+            const provider_type &p,
+            bool enabled);
+
+        /**
+         * <summary>
+         *   Calls update_provider for the providers whose callbacks or
+         *   filters changed since the last call. Runs on the thread
+         *   processing events.
+         * </summary>
+         */
+        static void update_changed_providers(
+            const krabs::trace<krabs::details::ut> &trace);
+
         /**
          * <summary>
          *   Enables the configured rundown events for each provider.
@@ -86,6 +144,29 @@ namespace krabs { namespace details {
             const EVENT_RECORD &record,
             const krabs::trace<krabs::details::ut> &trace);
 
+        /**
+         * <summary>
+         *   The GUID of the provider forward_events hands the event to.
+         * </summary>
+         */
+        static GUID dispatch_guid(
+            const EVENT_RECORD &record,
+            const krabs::trace<krabs::details::ut> &trace);
+
+        /**
+         * <summary>
+         *   Forwards the event to the providers with the given GUID. When
+         *   more than one has it, each only gets the events that match its
+         *   own settings. Returns false if none of them have the GUID, and
+         *   sets accepted to whether any callback was called.
+         * </summary>
+         */
+        static bool forward_to_providers(
+            const EVENT_RECORD &record,
+            const GUID &provider_guid,
+            const krabs::trace<krabs::details::ut> &trace,
+            bool &accepted);
+
         /**
          * <summary>
          *   Sets the ETW trace log file mode.
@@ -127,87 +208,241 @@ namespace krabs { namespace details {
         if (trace.registrationHandle_ == INVALID_PROCESSTRACE_HANDLE)
             return;
 
+        static const std::set<unsigned short> none;
+        for (auto &provider : collect_settings(trace)) {
+            enable_provider(trace, provider.first, provider.second, none);
+        }
+    }
+
+    inline ut::provider_filter_settings ut::collect_settings(
+        const krabs::trace<krabs::details::ut> &trace)
+    {
         provider_filter_settings provider_flags;
 
         // This function essentially takes the union of all the provider flags
         // for a given provider GUID. This comes about when multiple providers
         // for the same GUID are provided and request different provider flags.
-        // TODO: Only forward the calls that are requested to each provider.
-        for (auto &provider : trace.providers_) {
+        // The session has to get every event any of them asked for, and
+        // forward_events then only hands each of them the events it asked for.
+        krabs::trace<krabs::details::ut>::provider_reader providers(trace.providers_);
+        for (auto &provider : *providers) {
             auto& settings = provider_flags[provider.get().guid_];
-            settings.filter_flags_.level_       |= provider.get().level_;
-            settings.filter_flags_.any_         |= provider.get().any_;
-            settings.filter_flags_.all_         |= provider.get().all_;
-            settings.filter_flags_.trace_flags_ |= provider.get().trace_flags_;
-            settings.rundown_enabled_           |= provider.get().rundown_enabled_;
-
-            for (const auto& filter : provider.get().filters_) {
-                settings.provider_filter_event_ids_.insert(
-                    filter.provider_filter_event_ids().begin(),
-                    filter.provider_filter_event_ids().end());
+            auto& flags = settings.filter_flags_;
+            const auto& p = provider.get();
+
+            // ETW can only check what every one of them needs checked.
+            settings.pushdown_ = settings.first_
+                ? p.pushdown()
+                : krabs::filter_pushdown::either(settings.pushdown_, p.pushdown());
+
+            if (settings.first_) {
+                flags.level_ = static_cast<UCHAR>(p.level_);
+                flags.any_   = p.any_;
+                flags.all_   = p.all_;
+                settings.first_ = false;
+            }
+            else {
+                // 0 means every level and every keyword, so it wins;
+                // otherwise the widest level and any of the keywords. Only
+                // keywords all of them require can still be required.
+                const auto level = static_cast<UCHAR>(p.level_);
+                flags.level_ = (flags.level_ == 0 || level == 0) ? 0 : (level > flags.level_ ? level : flags.level_);
+                flags.any_   = (flags.any_ == 0 || p.any_ == 0) ? 0 : (flags.any_ | p.any_);
+                flags.all_  &= p.all_;
+            }
+
+            flags.trace_flags_        |= p.trace_flags_;
+            settings.rundown_enabled_ |= p.rundown_enabled_;
+
+            // A provider without event ids wants them all.
+            const auto event_ids = p.filter_event_ids();
+            if (event_ids.empty()) {
+                settings.any_event_id_ = true;
+            }
+
+            settings.provider_filter_event_ids_.insert(
+                event_ids.begin(),
+                event_ids.end());
+
+            // Stacks for some events only, unless another asked for them all.
+            if (!p.stack_trace_event_ids_.empty()) {
+                settings.stack_trace_event_ids_.insert(
+                    p.stack_trace_event_ids_.begin(),
+                    p.stack_trace_event_ids_.end());
+            }
+            else if (p.trace_flags_ & EVENT_ENABLE_PROPERTY_STACK_TRACE) {
+                settings.any_stack_trace_ = true;
             }
         }
 
-        for (auto &provider : provider_flags) {
-            ENABLE_TRACE_PARAMETERS parameters;
-            parameters.ControlFlags = 0;
-            parameters.Version = ENABLE_TRACE_PARAMETERS_VERSION_2;
-            parameters.SourceId = provider.first;
-            
-            GUID guid = provider.first;
-            auto& settings = provider.second;
-
-            parameters.EnableProperty = settings.filter_flags_.trace_flags_;
-            parameters.EnableFilterDesc = nullptr;
-            parameters.FilterDescCount = 0;
-            EVENT_FILTER_DESCRIPTOR filterDesc{};
-            std::vector<BYTE> filterEventIdBuffer;
-            auto filterEventIdCount = settings.provider_filter_event_ids_.size();
-
-            if (filterEventIdCount > 0) {
-                //event filters existing, set native filters using API
-                parameters.FilterDescCount = 1;
-                filterDesc.Type = EVENT_FILTER_TYPE_EVENT_ID;
-
-                //allocate + size of expected events in filter
-                DWORD size = FIELD_OFFSET(EVENT_FILTER_EVENT_ID, Events[filterEventIdCount]);
-                filterEventIdBuffer.resize(size, 0);
-
-                auto filterEventIds = reinterpret_cast<PEVENT_FILTER_EVENT_ID>(&(filterEventIdBuffer[0]));
-                filterEventIds->FilterIn = TRUE;
-                filterEventIds->Count = static_cast<USHORT>(filterEventIdCount);
-
-                auto index = 0;
-                for (auto filter : settings.provider_filter_event_ids_) {
-                    filterEventIds->Events[index] = filter;
-                    index++;
-                }
+        return provider_flags;
+    }
+
+    inline void ut::enable_provider(
+        const krabs::trace<krabs::details::ut> &trace,
+        const GUID &provider_guid,
+        const filter_settings &settings,
+        const std::set<unsigned short> &excluded_event_ids)
+    {
+        ENABLE_TRACE_PARAMETERS parameters;
+        parameters.ControlFlags = 0;
+        parameters.Version = ENABLE_TRACE_PARAMETERS_VERSION_2;
+        parameters.SourceId = provider_guid;
+        
+        GUID guid = provider_guid;
+
+        parameters.EnableProperty = settings.filter_flags_.trace_flags_;
+
+        // Each kind of filter ETW is given has to pass an event for it to
+        // be delivered, so these only narrow what the session gets.
+        krabs::filter_descriptors filters;
+        if (!settings.any_event_id_) {
+            // ETW can't be asked for no ids at all, so if every one is
+            // excluded they all stay.
+            std::set<unsigned short> event_ids;
+            std::set_difference(
+                settings.provider_filter_event_ids_.begin(), settings.provider_filter_event_ids_.end(),
+                excluded_event_ids.begin(), excluded_event_ids.end(),
+                std::inserter(event_ids, event_ids.end()));
+
+            filters.add_event_ids(event_ids.empty() ? settings.provider_filter_event_ids_ : event_ids);
+        }
+        else {
+            filters.add_excluded_event_ids(excluded_event_ids);
+        }
+
+        filters.add_process_ids(settings.pushdown_.process_ids);
+        filters.add_executable_names(settings.pushdown_.executable_names);
+        filters.add_payload(guid, settings.pushdown_.payload);
+
+        if (!settings.any_stack_trace_ && filters.add_stack_walk_ids(settings.stack_trace_event_ids_)) {
+            parameters.EnableProperty |= EVENT_ENABLE_PROPERTY_STACK_TRACE;
+        }
 
-                filterDesc.Ptr = reinterpret_cast<ULONGLONG>(filterEventIds);
-                filterDesc.Size = size;
+        parameters.EnableFilterDesc = filters.data();
+        parameters.FilterDescCount = filters.count();
+
+        ULONG status = EnableTraceEx2(trace.registrationHandle_,
+                                      &guid,
+                                      EVENT_CONTROL_CODE_ENABLE_PROVIDER,
+                                      settings.filter_flags_.level_,
+                                      settings.filter_flags_.any_,
+                                      settings.filter_flags_.all_,
+                                      0,
+                                      &parameters);
+        error_check_common_conditions(status);
+    }
 
-                parameters.EnableFilterDesc = &filterDesc;
+    inline void ut::apply_pushdown_policy(
+        const krabs::trace<krabs::details::ut> &trace)
+    {
+        auto &policy = *trace.pushdown_policy_;
+        auto changes = policy.take_changes();
+
+        if (trace.registrationHandle_ == INVALID_PROCESSTRACE_HANDLE)
+            return;
+
+        auto settings = collect_settings(trace);
+        for (const auto &provider : changes) {
+            auto match = settings.find(provider);
+            if (match == settings.end()) {
+                continue;
             }
 
+            // This runs on the thread processing events, where there's no
+            // one to throw to. If it fails, the session just keeps getting
+            // the ids it already gets, and the failure shows up in metrics().
+            try {
+                enable_provider(trace, match->first, match->second, policy.excluded(match->first));
+            }
+            catch (const std::exception &) {
+                InterlockedIncrement64(&trace.pushdown_failures_);
+            }
+        }
+    }
+
+    inline void ut::update_provider(
+        const krabs::trace<krabs::details::ut> &trace,
+        const provider_type &p,
+        bool enabled)
+    {
+        if (trace.registrationHandle_ == INVALID_PROCESSTRACE_HANDLE)
+            return;
+
+        auto settings = collect_settings(trace);
+        auto match = settings.find(p.guid_);
+
+        if (match == settings.end()) {
+            // That was the last provider with the GUID.
+            GUID guid = p.guid_;
             ULONG status = EnableTraceEx2(trace.registrationHandle_,
                                           &guid,
-                                          EVENT_CONTROL_CODE_ENABLE_PROVIDER,
-                                          settings.filter_flags_.level_,
-                                          settings.filter_flags_.any_,
-                                          settings.filter_flags_.all_,
+                                          EVENT_CONTROL_CODE_DISABLE_PROVIDER,
                                           0,
-                                          &parameters);
+                                          0,
+                                          0,
+                                          0,
+                                          NULL);
+            error_check_common_conditions(status);
+            return;
+        }
+
+        // The pushdown policy starts over when providers change, so no
+        // ids are excluded until it has seen what the callbacks take now.
+        static const std::set<unsigned short> none;
+        enable_provider(trace, match->first, match->second, none);
+
+        if (enabled && p.rundown_enabled_) {
+            ULONG status = EnableTraceEx2(trace.registrationHandle_,
+                &p.guid_,
+                EVENT_CONTROL_CODE_CAPTURE_STATE,
+                0,
+                0,
+                0,
+                0,
+                NULL);
             error_check_common_conditions(status);
         }
     }
 
+    inline void ut::update_changed_providers(
+        const krabs::trace<krabs::details::ut> &trace)
+    {
+        // What was left out was worked out for the old filters.
+        auto &policy = trace.pushdown_policy_;
+        if (policy) {
+            policy->reset();
+        }
+
+        krabs::trace<krabs::details::ut>::provider_reader providers(trace.providers_);
+        for (auto &provider : *providers) {
+            const auto &p = provider.get();
+            if (p.settings_changed_ == 0 || InterlockedExchange(&p.settings_changed_, 0) == 0) {
+                continue;
+            }
+
+            // As with the pushdown policy, there's no one to throw to here.
+            try {
+                update_provider(trace, p, false);
+            }
+            catch (const std::exception &) {
+                InterlockedIncrement64(&trace.pushdown_failures_);
+            }
+        }
+
+        if (policy && policy->has_changes()) {
+            apply_pushdown_policy(trace);
+        }
+    }
+
     inline void ut::enable_rundown(
         const krabs::trace<krabs::details::ut>& trace)
     {
         if (trace.registrationHandle_ == INVALID_PROCESSTRACE_HANDLE)
             return;
 
-        for (auto& provider : trace.providers_) {
+        krabs::trace<krabs::details::ut>::provider_reader providers(trace.providers_);
+        for (auto& provider : *providers) {
             if (!provider.get().rundown_enabled_)
                 continue;
 
@@ -227,30 +462,100 @@ namespace krabs { namespace details {
         const EVENT_RECORD &record,
         const krabs::trace<krabs::details::ut> &trace)
     {
+        bool accepted = false;
+
+        if (trace.providers_changed_ != 0 && InterlockedExchange(&trace.providers_changed_, 0) != 0) {
+            update_changed_providers(trace);
+        }
+
         // for manifest providers, EventHeader.ProviderId is the Provider GUID
-        for (auto& provider : trace.providers_) {
-            if (record.EventHeader.ProviderId == provider.get().guid_) {
-                provider.get().on_event(record, trace.context_);
-                return;
+        if (forward_to_providers(record, record.EventHeader.ProviderId, trace, accepted)) {
+            // Event ids only mean one kind of event for manifest providers;
+            // TraceLogging events mostly share id 0.
+            auto &policy = trace.pushdown_policy_;
+            if (policy && tracelogging::find_extended_data(record, EVENT_HEADER_EXT_TYPE_EVENT_SCHEMA_TL) == nullptr) {
+                if (trace.pushdown_reset_ != 0 && InterlockedExchange(&trace.pushdown_reset_, 0) != 0) {
+                    policy->reset();
+                }
+
+                policy->record(record.EventHeader.ProviderId, record.EventHeader.EventDescriptor.Id, accepted);
+                if (policy->has_changes()) {
+                    apply_pushdown_policy(trace);
+                }
             }
+
+            return;
         }
 
         // for MOF providers, EventHeader.Provider is the *Message* GUID
         // we need to ask TDH for event information in order to determine the
-        // correct provider to pass this event to
-        auto schema = get_event_schema_from_tdh(record);
-        auto eventInfo = reinterpret_cast<PTRACE_EVENT_INFO>(schema.get());
-        for (auto& provider : trace.providers_) {
-            if (eventInfo->ProviderGuid == provider.get().guid_) {
-                provider.get().on_event(record, trace.context_);
-                return;
-            }
+        // correct provider to pass this event to. The schema locator caches
+        // the answer, and already knows it when events are replayed.
+        auto eventInfo = trace.context_.schema_locator.get_event_schema(record);
+        if (forward_to_providers(record, eventInfo->ProviderGuid, trace, accepted)) {
+            return;
         }
 
         if (trace.default_callback_ != nullptr)
             trace.default_callback_(record, trace.context_);
     }
 
+    inline GUID ut::dispatch_guid(
+        const EVENT_RECORD &record,
+        const krabs::trace<krabs::details::ut> &trace)
+    {
+        krabs::trace<krabs::details::ut>::provider_reader providers(trace.providers_);
+        for (auto &provider : *providers) {
+            if (provider.get().guid_ == record.EventHeader.ProviderId) {
+                return record.EventHeader.ProviderId;
+            }
+        }
+
+        // A MOF event names its class, and the schema names the provider.
+        return trace.context_.schema_locator.get_event_schema(record)->ProviderGuid;
+    }
+
+    inline bool ut::forward_to_providers(
+        const EVENT_RECORD &record,
+        const GUID &provider_guid,
+        const krabs::trace<krabs::details::ut> &trace,
+        bool &accepted)
+    {
+        const provider_type *first = nullptr;
+        bool shared = false;
+
+        krabs::trace<krabs::details::ut>::provider_reader providers(trace.providers_);
+        for (auto& provider : *providers) {
+            if (provider_guid == provider.get().guid_) {
+                if (first != nullptr) {
+                    shared = true;
+                    break;
+                }
+
+                first = &provider.get();
+            }
+        }
+
+        if (first == nullptr) {
+            return false;
+        }
+
+        // A provider with the GUID to itself was enabled with exactly its
+        // own settings, so ETW has already done the filtering.
+        if (!shared) {
+            accepted = first->on_event(record, trace.context_);
+            return true;
+        }
+
+        for (auto& provider : *providers) {
+            if (provider_guid == provider.get().guid_ && provider.get().accepts(record)) {
+                accepted |= provider.get().on_event(record, trace.context_);
+            }
+        }
+
+        return true;
+    }
+
     inline unsigned long ut::augment_file_mode()
     {
         return 0;
@@ -1,6 +1,8 @@
 // Copyright (c) Microsoft. All rights reserved.
 // Licensed under the MIT license. See LICENSE file in the project root for full license information.
 
+#pragma once
+
 #include <windows.h>
 
 namespace krabs {
@@ -28,4 +30,28 @@ namespace krabs {
 
         return result;
     }
+
+    /** <summary>
+      * Converts std::string argument to std::wstring using UTF-8 codepage
+      * Returns empty string if translation fails or input string is empty
+      * </summary>
+      */
+    inline std::wstring from_string(const std::string& str, UINT codePage = CP_UTF8)
+    {
+        if (str.empty())
+            return {};
+
+        const auto requiredLen = MultiByteToWideChar(codePage, 0, str.data(), static_cast<int>(str.size()),
+            nullptr, 0);
+        if (0 == requiredLen)
+            return {};
+
+        std::wstring result(requiredLen, 0);
+        const auto convertedLen = MultiByteToWideChar(codePage, 0, str.data(), static_cast<int>(str.size()),
+            &result[0], requiredLen);
+        if (0 == convertedLen)
+            return {};
+
+        return result;
+    }
 }
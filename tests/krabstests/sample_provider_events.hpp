@@ -0,0 +1,122 @@
+// Generated by tools/generate_decoders.py from sample_provider.man. Do not edit.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include <krabs/decoding/byte_view.hpp>
+
+namespace sample {
+
+    // Krabs-Sample-Provider
+    constexpr krabs::decoding::guid provider_id = { 0x9D43A1C4, 0x2B6F, 0x4F3E, { 0x8C, 0x2A, 0x7A, 0x51, 0xD8, 0xB0, 0xE6, 0xF1 } };
+
+    /**
+     * <summary>
+     *   RequestStart (event 1, version 0).
+     * </summary>
+     */
+    class request_start_v0 : public krabs::decoding::byte_view {
+    public:
+        static constexpr uint16_t id = 1;
+        static constexpr uint8_t version = 0;
+        static const krabs::decoding::guid &provider() { return provider_id; }
+
+        static constexpr krabs::decoding::field_descriptor fields[] = {
+            { L"URL", krabs::decoding::in_ansi_string, { 0, 0 }, krabs::decoding::field_descriptor::from_start },
+            { L"Status", krabs::decoding::in_uint32, { 0, 0 }, 0 },
+            { L"Handle", krabs::decoding::in_pointer, { 4, 0 }, 0 },
+        };
+
+        request_start_v0(const uint8_t *data, size_t size, size_t pointer_size)
+        : krabs::decoding::byte_view(data, size, pointer_size)
+        {
+            locate(fields, offsets_);
+        }
+
+        std::string url() const { size_t next = 0; return read_string(offsets_[0], next); }
+        uint32_t status() const { return read<uint32_t>(offsets_[1]); }
+        uint64_t handle() const { return read_pointer(offsets_[2]); }
+
+    private:
+        size_t offsets_[3];
+    };
+
+    /**
+     * <summary>
+     *   RequestStart (event 1, version 1).
+     * </summary>
+     */
+    class request_start_v1 : public krabs::decoding::byte_view {
+    public:
+        static constexpr uint16_t id = 1;
+        static constexpr uint8_t version = 1;
+        static const krabs::decoding::guid &provider() { return provider_id; }
+
+        static constexpr krabs::decoding::field_descriptor fields[] = {
+            { L"URL", krabs::decoding::in_ansi_string, { 0, 0 }, krabs::decoding::field_descriptor::from_start },
+            { L"Status", krabs::decoding::in_uint32, { 0, 0 }, 0 },
+            { L"Handle", krabs::decoding::in_pointer, { 4, 0 }, 0 },
+            { L"Path", krabs::decoding::in_unicode_string, { 4, 1 }, 0 },
+            { L"Duration", krabs::decoding::in_uint64, { 0, 0 }, 3 },
+            { L"Cached", krabs::decoding::in_boolean, { 8, 0 }, 3 },
+        };
+
+        request_start_v1(const uint8_t *data, size_t size, size_t pointer_size)
+        : krabs::decoding::byte_view(data, size, pointer_size)
+        {
+            locate(fields, offsets_);
+        }
+
+        std::string url() const { size_t next = 0; return read_string(offsets_[0], next); }
+        uint32_t status() const { return read<uint32_t>(offsets_[1]); }
+        uint64_t handle() const { return read_pointer(offsets_[2]); }
+        std::wstring path() const { size_t next = 0; return read_wstring(offsets_[3], next); }
+        uint64_t duration() const { return read<uint64_t>(offsets_[4]); }
+        bool cached() const { return read<uint32_t>(offsets_[5]) != 0; }
+
+    private:
+        size_t offsets_[6];
+    };
+
+    /**
+     * <summary>
+     *   Payload (event 2, version 0).
+     * </summary>
+     * <remarks>
+     *   Data and the fields after it are left to krabs::parser.
+     * </remarks>
+     */
+    class payload_v0 : public krabs::decoding::byte_view {
+    public:
+        static constexpr uint16_t id = 2;
+        static constexpr uint8_t version = 0;
+        static const krabs::decoding::guid &provider() { return provider_id; }
+
+        static constexpr krabs::decoding::field_descriptor fields[] = {
+            { L"ActivityId", krabs::decoding::in_guid, { 0, 0 }, krabs::decoding::field_descriptor::from_start },
+            { L"Size", krabs::decoding::in_uint32, { 16, 0 }, krabs::decoding::field_descriptor::from_start },
+        };
+
+        payload_v0(const uint8_t *data, size_t size, size_t pointer_size)
+        : krabs::decoding::byte_view(data, size, pointer_size)
+        {
+            locate(fields, offsets_);
+        }
+
+        krabs::decoding::guid activity_id() const { return read<krabs::decoding::guid>(offsets_[0]); }
+        uint32_t size() const { return read<uint32_t>(offsets_[1]); }
+
+    private:
+        size_t offsets_[2];
+    };
+
+    typedef krabs::decoding::dispatcher<
+        request_start_v0,
+        request_start_v1,
+        payload_v0
+    > dispatcher;
+
+} /* namespace sample */
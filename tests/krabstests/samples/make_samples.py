@@ -0,0 +1,146 @@
+#!/usr/bin/env python3
+# Copyright (c) Microsoft. All rights reserved.
+# Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+"""Writes the .etl files next to this script that test_etl_format.cpp reads.
+
+    python3 make_samples.py
+
+Each file is two 1024 byte buffers laid out as the kernel writes them: a
+buffer header, then 8 byte aligned records, then 0xFF up to the end. The
+first record is the logfile header. Between them the files hold every kind
+of record header krabs::etl decodes, plus an instance record that it skips:
+
+    events64.etl  written by a 64-bit logger, one record of each 64-bit kind
+    events32.etl  the same events from a 32-bit logger
+
+They are kept small so that they can be read byte by byte when a test
+fails; the values the tests check are the ones written here.
+"""
+
+import os
+import struct
+import uuid
+
+BUFFER_SIZE = 1024
+BUFFER_HEADER_SIZE = 0x48
+
+# 100ns units, so one performance counter tick per FILETIME unit.
+PERF_FREQ = 10000000
+START_TIME = 132000000000000000
+START_TIMESTAMP = 5000
+
+USER_PROVIDER = uuid.UUID('a0c1853b-5c40-4b15-8766-3cf1c58f985a')
+CLASSIC_PROVIDER = uuid.UUID('3d6fa8d0-fe05-11d0-9dda-00c04fd7ba7c')
+ACTIVITY = uuid.UUID('11223344-5566-7788-99aa-bbccddeeff00')
+
+EXT_TYPE_RELATED_ACTIVITYID = 1
+EXT_TYPE_TS_ID = 3
+
+
+def align8(size):
+    return (size + 7) & ~7
+
+
+class image:
+    def __init__(self, pointer_size):
+        self.pointer_size = pointer_size
+        self.buffers = []
+
+    def begin_buffer(self, processor):
+        self.buffers.append((processor, bytearray()))
+
+    def add(self, record):
+        self.buffers[-1][1].extend(record + b'\0' * (align8(len(record)) - len(record)))
+
+    def record_type(self, wide, narrow):
+        return wide if self.pointer_size == 8 else narrow
+
+    def system_event(self, hook, version, pid, tid, timestamp, data, compact=False):
+        size = (24 if compact else 32) + len(data)
+        kind = self.record_type(4, 3) if compact else self.record_type(2, 1)
+        header = struct.pack('<HBBHHIIq', version, kind, 0xC0, size, hook, tid, pid, timestamp)
+        if not compact:
+            header += struct.pack('<II', 7, 9)
+        self.add(header + data)
+
+    def perfinfo_event(self, hook, version, timestamp, data):
+        kind = self.record_type(17, 16)
+        self.add(struct.pack('<HBBHHq', version, kind, 0xC0, 16 + len(data), hook, timestamp) + data)
+
+    def classic_event(self, guid, opcode, level, version, pid, tid, timestamp, data):
+        kind = self.record_type(20, 10)
+        header = struct.pack('<HBBBBHIIq', 48 + len(data), kind, 0xC0, opcode, level, version, tid, pid, timestamp)
+        header += guid.bytes_le + struct.pack('<II', 3, 4)
+        self.add(header + data)
+
+    def manifest_event(self, guid, event_id, pid, tid, timestamp, data, extended=()):
+        items = b''
+        for i, (ext_type, payload) in enumerate(extended):
+            linkage = 1 if i + 1 < len(extended) else 0
+            item = struct.pack('<HHHH', 0, ext_type, linkage, len(payload)) + payload
+            items += item + b'\0' * (align8(len(item)) - len(item))
+
+        kind = self.record_type(19, 18)
+        flags = 0x0001 if extended else 0
+        header = struct.pack('<HBBHHIIq', 80 + len(items) + len(data), kind, 0xC0, flags, 0, tid, pid, timestamp)
+        header += guid.bytes_le
+        header += struct.pack('<HBBBBHQ', event_id, 1, 16, 4, 0, 0, 0x8000000000000000)
+        header += struct.pack('<II', 0, 0) + ACTIVITY.bytes_le
+        self.add(header + items + data)
+
+    def instance_record(self):
+        kind = self.record_type(21, 11)
+        self.add(struct.pack('<HBB', 56, kind, 0xC0) + b'\0' * 52)
+
+    def logfile_header(self, buffers_written):
+        logger_name = 'krabs sample\0'.encode('utf-16-le')
+        file_name = 'C:\\samples\\events.etl\0'.encode('utf-16-le')
+
+        data = struct.pack('<IIIIqIIIIIIII',
+            BUFFER_SIZE, 0x0A00, 19041, 4, START_TIME + 3000, 156250, 0,
+            0x00000001, buffers_written, 0, self.pointer_size, 0, 2400)
+        data += b'\0' * (2 * self.pointer_size + 172)
+        data += b'\0' * (align8(len(data)) - len(data))
+        data += struct.pack('<qqqII', START_TIME - 100000000, PERF_FREQ, START_TIME, 1, 0)
+        data += logger_name + file_name
+
+        self.system_event(0x0000, 2, 4, 8, START_TIMESTAMP, data)
+
+    def bytes(self):
+        out = bytearray()
+        for processor, records in self.buffers:
+            filled = BUFFER_HEADER_SIZE + len(records)
+            assert filled <= BUFFER_SIZE
+            header = bytearray(BUFFER_HEADER_SIZE)
+            struct.pack_into('<II', header, 0x00, BUFFER_SIZE, filled)
+            struct.pack_into('<BBH', header, 0x28, processor, 0, 1)
+            struct.pack_into('<I', header, 0x30, filled)
+            out += header + records + b'\xFF' * (BUFFER_SIZE - filled)
+        return bytes(out)
+
+
+def sample(pointer_size):
+    etl = image(pointer_size)
+
+    etl.begin_buffer(0)
+    etl.logfile_header(2)
+    etl.system_event(0x0301, 4, 100, 200, 6000, struct.pack('<II', 100, 4) + 'a.exe\0'.encode('ascii'))
+    etl.manifest_event(USER_PROVIDER, 7937, 44, 33, 7000, b'\1\2\3', [
+        (EXT_TYPE_TS_ID, struct.pack('<I', 5)),
+        (EXT_TYPE_RELATED_ACTIVITYID, ACTIVITY.bytes_le)])
+
+    etl.begin_buffer(1)
+    etl.classic_event(CLASSIC_PROVIDER, 2, 4, 3, 22, 11, 8000, b'\x09\x08\x07\x06')
+    etl.instance_record()
+    etl.perfinfo_event(0x0F2E, 2, 9000, struct.pack('<QI', 0x1000, 200))
+    etl.system_event(0x0502, 3, 100, 201, 10000, struct.pack('<II', 100, 201), compact=True)
+
+    return etl.bytes()
+
+
+if __name__ == '__main__':
+    here = os.path.dirname(os.path.abspath(__file__))
+    for name, pointer_size in (('events64.etl', 8), ('events32.etl', 4)):
+        with open(os.path.join(here, name), 'wb') as f:
+            f.write(sample(pointer_size))
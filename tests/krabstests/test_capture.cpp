@@ -0,0 +1,347 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "CppUnitTest.h"
+#include <krabs.hpp>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace krabstests
+{
+    TEST_CLASS(test_capture)
+    {
+        const krabs::guid provider_id = krabs::guid(L"{6990501B-4484-4EF6-8BB5-8F1A6C3B9A1D}");
+
+        // A TRACE_EVENT_INFO describing a single UINT32 property named Value,
+        // which is what TDH would return for such an event.
+        static std::vector<BYTE> make_schema(const GUID &provider)
+        {
+            const wchar_t name[] = L"Value";
+            std::vector<BYTE> schema(sizeof(TRACE_EVENT_INFO) + sizeof(name));
+
+            auto info = reinterpret_cast<PTRACE_EVENT_INFO>(schema.data());
+            info->ProviderGuid = provider;
+            info->DecodingSource = DecodingSourceXMLFile;
+            info->PropertyCount = 1;
+            info->TopLevelPropertyCount = 1;
+
+            auto &property = info->EventPropertyInfoArray[0];
+            property.NameOffset = sizeof(TRACE_EVENT_INFO);
+            property.nonStructType.InType = TDH_INTYPE_UINT32;
+            property.nonStructType.OutType = TDH_OUTTYPE_UNSIGNEDINT;
+            property.count = 1;
+            property.length = sizeof(uint32_t);
+
+            memcpy(schema.data() + sizeof(TRACE_EVENT_INFO), name, sizeof(name));
+            return schema;
+        }
+
+        krabs::testing::synth_record make_record(USHORT id, uint32_t value)
+        {
+            EVENT_RECORD record = {};
+            record.EventHeader.ProviderId = provider_id;
+            record.EventHeader.EventDescriptor.Id = id;
+            record.EventHeader.TimeStamp.QuadPart = 1000 + id;
+            record.EventHeader.ProcessId = 42;
+
+            auto bytes = reinterpret_cast<const BYTE*>(&value);
+            return krabs::testing::synth_record(record, std::vector<BYTE>(bytes, bytes + sizeof(value)));
+        }
+
+    public:
+        TEST_METHOD(should_round_trip_headers_and_user_data)
+        {
+            std::vector<BYTE> capture;
+            krabs::trace_context context;
+            {
+                krabs::capture::writer writer(capture);
+                writer(make_record(1, 10), context);
+                writer(make_record(2, 20), context);
+                Assert::AreEqual(uint64_t(2), writer.stats().events);
+                Assert::AreEqual(uint64_t(capture.size()), writer.stats().bytes);
+            }
+
+            std::vector<USHORT> ids;
+            std::vector<uint32_t> values;
+            krabs::capture::reader reader(capture.data(), capture.size());
+            reader.replay([&](const EVENT_RECORD &record, const krabs::trace_context &) {
+                Assert::IsTrue(record.EventHeader.ProviderId == provider_id);
+                Assert::AreEqual(ULONG(42), record.EventHeader.ProcessId);
+                Assert::AreEqual(LONGLONG(1000 + record.EventHeader.EventDescriptor.Id), record.EventHeader.TimeStamp.QuadPart);
+                Assert::AreEqual(USHORT(sizeof(uint32_t)), record.UserDataLength);
+
+                ids.push_back(record.EventHeader.EventDescriptor.Id);
+                values.push_back(*static_cast<const uint32_t*>(record.UserData));
+            });
+
+            Assert::IsTrue(ids == std::vector<USHORT>{ 1, 2 });
+            Assert::IsTrue(values == std::vector<uint32_t>{ 10, 20 });
+            Assert::AreEqual(uint64_t(2), reader.stats().events);
+            Assert::IsFalse(reader.stats().truncated);
+        }
+
+        TEST_METHOD(should_store_each_schema_once_and_parse_without_tdh)
+        {
+            auto schema = make_schema(provider_id);
+            auto first = make_record(1, 10);
+            auto second = make_record(1, 20);
+
+            std::vector<BYTE> capture;
+            {
+                krabs::trace_context context;
+                context.schema_locator.add_event_schema(first, schema.data(), static_cast<ULONG>(schema.size()));
+
+                krabs::capture::writer writer(capture);
+                writer(first, context);
+                writer(second, context);
+                Assert::AreEqual(uint64_t(1), writer.stats().schemas);
+            }
+
+            std::vector<uint32_t> values;
+            krabs::capture::reader reader(capture.data(), capture.size());
+            reader.replay([&](const EVENT_RECORD &record, const krabs::trace_context &context) {
+                ULONG size = 0;
+                auto replayed = context.schema_locator.get_event_schema(record, size);
+                Assert::AreEqual(ULONG(schema.size()), size);
+                Assert::AreEqual(0, memcmp(schema.data(), replayed, size));
+
+                krabs::schema event_schema(record, context.schema_locator);
+                krabs::parser parser(event_schema);
+                values.push_back(parser.parse<uint32_t>(L"Value"));
+            });
+
+            Assert::IsTrue(values == std::vector<uint32_t>{ 10, 20 });
+            Assert::AreEqual(uint64_t(1), reader.stats().schemas);
+        }
+
+        TEST_METHOD(should_round_trip_extended_data)
+        {
+            krabs::testing::extended_data_builder builder;
+            auto container = krabs::guid::random_guid();
+            builder.add_container_id(container);
+            auto extended = builder.pack();
+
+            auto record = make_record(1, 10);
+            EVENT_RECORD with_extended = record;
+            with_extended.ExtendedDataCount = static_cast<USHORT>(builder.count());
+            with_extended.ExtendedData = reinterpret_cast<PEVENT_HEADER_EXTENDED_DATA_ITEM>(extended.first.get());
+
+            std::vector<BYTE> capture;
+            krabs::trace_context context;
+            {
+                krabs::capture::writer writer(capture);
+                writer(with_extended, context);
+            }
+
+            auto original = with_extended.ExtendedData[0];
+            auto verified = false;
+            krabs::capture::reader reader(capture.data(), capture.size());
+            reader.replay([&](const EVENT_RECORD &replayed, const krabs::trace_context &) {
+                Assert::AreEqual(USHORT(1), replayed.ExtendedDataCount);
+                Assert::AreEqual(original.ExtType, replayed.ExtendedData[0].ExtType);
+                Assert::AreEqual(original.DataSize, replayed.ExtendedData[0].DataSize);
+                Assert::AreEqual(0, memcmp(
+                    reinterpret_cast<const void*>(original.DataPtr),
+                    reinterpret_cast<const void*>(replayed.ExtendedData[0].DataPtr),
+                    original.DataSize));
+                verified = true;
+            });
+
+            Assert::IsTrue(verified);
+        }
+
+        TEST_METHOD(should_replay_through_trace_providers)
+        {
+            std::vector<BYTE> capture;
+            krabs::trace_context context;
+            {
+                krabs::capture::writer writer(capture);
+                writer(make_record(1, 10), context);
+                writer(make_record(2, 20), context);
+            }
+
+            krabs::user_trace trace;
+            krabs::provider<> provider(provider_id);
+            std::vector<USHORT> ids;
+            provider.add_on_event_callback([&](const EVENT_RECORD &record, const krabs::trace_context &) {
+                ids.push_back(record.EventHeader.EventDescriptor.Id);
+            });
+            trace.enable(provider);
+
+            krabs::capture::reader reader(capture.data(), capture.size());
+            reader.replay(trace);
+
+            Assert::IsTrue(ids == std::vector<USHORT>{ 1, 2 });
+        }
+
+        TEST_METHOD(should_read_up_to_a_truncated_chunk)
+        {
+            std::vector<BYTE> capture;
+            krabs::trace_context context;
+            {
+                krabs::capture::writer writer(capture);
+                writer(make_record(1, 10), context);
+                writer(make_record(2, 20), context);
+            }
+
+            capture.resize(capture.size() - 6);
+
+            size_t events = 0;
+            krabs::capture::reader reader(capture.data(), capture.size());
+            reader.replay([&](const EVENT_RECORD &, const krabs::trace_context &) { ++events; });
+
+            Assert::AreEqual(size_t(1), events);
+            Assert::IsTrue(reader.stats().truncated);
+        }
+
+        TEST_METHOD(should_round_trip_compact_encoding_exactly)
+        {
+            krabs::testing::extended_data_builder builder;
+            builder.add_container_id(krabs::guid::random_guid());
+            auto extended = builder.pack();
+
+            std::vector<uint32_t> values(300);
+            std::vector<EVENT_RECORD> records(values.size());
+            for (USHORT i = 0; i < records.size(); ++i) {
+                values[i] = i * 7;
+
+                auto &record = records[i];
+                record.EventHeader.ProviderId = provider_id;
+                record.EventHeader.EventDescriptor.Id = i % 3;
+                record.EventHeader.TimeStamp.QuadPart = 5000 + i * 13 - (i % 4) * 20;
+                record.EventHeader.ProcessId = 4 + (i / 50);
+                record.EventHeader.ThreadId = 100 + (i % 2);
+                record.EventHeader.Flags = EVENT_HEADER_FLAG_64_BIT_HEADER;
+                record.BufferContext.ProcessorIndex = i % 8;
+                record.BufferContext.LoggerId = 12;
+                record.UserData = &values[i];
+                record.UserDataLength = sizeof(uint32_t);
+
+                if (i % 5 == 0) {
+                    record.EventHeader.ActivityId = krabs::guid::random_guid();
+                }
+                if (i % 7 == 0) {
+                    record.EventHeader.KernelTime = i;
+                    record.EventHeader.UserTime = i * 2;
+                }
+                if (i % 11 == 0) {
+                    record.ExtendedDataCount = static_cast<USHORT>(builder.count());
+                    record.ExtendedData = reinterpret_cast<PEVENT_HEADER_EXTENDED_DATA_ITEM>(extended.first.get());
+                }
+            }
+
+            std::vector<BYTE> capture;
+            krabs::trace_context context;
+            {
+                krabs::capture::writer writer(capture, krabs::capture::encoding::compact);
+                for (const auto &record : records) {
+                    writer(record, context);
+                }
+            }
+
+            size_t index = 0;
+            krabs::capture::reader reader(capture.data(), capture.size());
+            reader.replay([&](const EVENT_RECORD &replayed, const krabs::trace_context &) {
+                const auto &original = records[index++];
+                Assert::AreEqual(0, memcmp(&original.EventHeader, &replayed.EventHeader, sizeof(EVENT_HEADER)));
+                Assert::AreEqual(original.BufferContext.ProcessorIndex, replayed.BufferContext.ProcessorIndex);
+                Assert::AreEqual(original.BufferContext.LoggerId, replayed.BufferContext.LoggerId);
+                Assert::AreEqual(original.UserDataLength, replayed.UserDataLength);
+                Assert::AreEqual(0, memcmp(original.UserData, replayed.UserData, original.UserDataLength));
+                Assert::AreEqual(original.ExtendedDataCount, replayed.ExtendedDataCount);
+
+                for (USHORT i = 0; i < original.ExtendedDataCount; ++i) {
+                    Assert::AreEqual(original.ExtendedData[i].ExtType, replayed.ExtendedData[i].ExtType);
+                    Assert::AreEqual(original.ExtendedData[i].DataSize, replayed.ExtendedData[i].DataSize);
+                    Assert::AreEqual(0, memcmp(
+                        reinterpret_cast<const void*>(original.ExtendedData[i].DataPtr),
+                        reinterpret_cast<const void*>(replayed.ExtendedData[i].DataPtr),
+                        original.ExtendedData[i].DataSize));
+                }
+            });
+
+            Assert::AreEqual(records.size(), index);
+            Assert::AreEqual(uint64_t(0), reader.stats().malformed);
+        }
+
+        TEST_METHOD(should_shrink_repetitive_streams_with_compact_encoding)
+        {
+            std::vector<BYTE> capture;
+            krabs::trace_context context;
+            krabs::capture::writer_stats stats;
+            {
+                krabs::capture::writer writer(capture, krabs::capture::encoding::compact);
+                for (USHORT i = 0; i < 1000; ++i) {
+                    writer(make_record(1, i % 16), context);
+                }
+                writer.flush();
+                stats = writer.stats();
+            }
+
+            Assert::AreEqual(uint64_t(capture.size()), stats.bytes);
+            Assert::IsTrue(stats.bytes * 5 < stats.raw_bytes);
+        }
+
+        TEST_METHOD(should_parse_compact_events_without_tdh)
+        {
+            auto schema = make_schema(provider_id);
+            auto record = make_record(1, 10);
+
+            std::vector<BYTE> capture;
+            {
+                krabs::trace_context context;
+                context.schema_locator.add_event_schema(record, schema.data(), static_cast<ULONG>(schema.size()));
+
+                krabs::capture::writer writer(capture, krabs::capture::encoding::compact);
+                writer(record, context);
+                writer(make_record(1, 20), context);
+            }
+
+            std::vector<uint32_t> values;
+            krabs::capture::reader reader(capture.data(), capture.size());
+            reader.replay([&](const EVENT_RECORD &replayed, const krabs::trace_context &context) {
+                krabs::schema event_schema(replayed, context.schema_locator);
+                krabs::parser parser(event_schema);
+                values.push_back(parser.parse<uint32_t>(L"Value"));
+            });
+
+            Assert::IsTrue(values == std::vector<uint32_t>{ 10, 20 });
+        }
+
+        TEST_METHOD(should_round_trip_lz_compressed_data)
+        {
+            std::vector<BYTE> repetitive;
+            for (int i = 0; i < 5000; ++i) {
+                repetitive.push_back(static_cast<BYTE>("krabs"[i % 5]));
+            }
+
+            std::vector<BYTE> noise(5000);
+            ULONG state = 12345;
+            for (auto &b : noise) {
+                state = state * 1103515245 + 12345;
+                b = static_cast<BYTE>(state >> 16);
+            }
+
+            for (const auto *input : { &repetitive, &noise }) {
+                std::vector<BYTE> compressed;
+                krabs::capture::details::lz_compress(input->data(), input->size(), compressed);
+
+                std::vector<BYTE> output(input->size());
+                Assert::IsTrue(krabs::capture::details::lz_decompress(
+                    compressed.data(), compressed.size(), output.data(), output.size()));
+                Assert::IsTrue(*input == output);
+
+                Assert::IsFalse(krabs::capture::details::lz_decompress(
+                    compressed.data(), compressed.size() - 1, output.data(), output.size()));
+            }
+        }
+
+        TEST_METHOD(should_reject_data_that_is_not_a_capture)
+        {
+            std::vector<BYTE> data(64, 0xAB);
+            Assert::ExpectException<std::runtime_error>([&]() {
+                krabs::capture::reader reader(data.data(), data.size());
+            });
+        }
+    };
+}
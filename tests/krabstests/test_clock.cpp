@@ -0,0 +1,110 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "CppUnitTest.h"
+#include <krabs.hpp>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace krabstests
+{
+    TEST_CLASS(test_clock)
+    {
+        static const LONGLONG anchor_filetime = 130000000000000000LL;
+
+        // FILETIME units since the anchor, worked out with divisions.
+        static LONGLONG exact_100ns(LONGLONG ticks, LONGLONG ticks_per_second)
+        {
+            return (ticks / ticks_per_second) * 10000000
+                + (ticks % ticks_per_second) * 10000000 / ticks_per_second;
+        }
+
+    public:
+
+        TEST_METHOD(should_convert_counters_within_one_unit)
+        {
+            const LONGLONG rates[] = { 10000000, 14318180, 3000000000LL, 2904000000LL };
+
+            for (auto rate : rates) {
+                krabs::timestamp_converter converter(
+                    krabs::clock_type::query_performance_counter, rate, 5000, anchor_filetime);
+
+                // Up to about a year of ticks, either side of the anchor.
+                for (LONGLONG ticks = 1; ticks < rate * 31536000LL; ticks = ticks * 7 + 3) {
+                    const LONGLONG expected = anchor_filetime + exact_100ns(ticks, rate);
+                    const LONGLONG actual = converter.to_filetime(5000 + ticks);
+                    Assert::IsTrue(actual <= expected && expected - actual <= 1);
+
+                    const LONGLONG before = converter.to_filetime(5000 - ticks);
+                    Assert::IsTrue(before >= anchor_filetime - exact_100ns(ticks, rate) - 1);
+                    Assert::IsTrue(before <= anchor_filetime - exact_100ns(ticks, rate) + 1);
+                }
+            }
+        }
+
+        TEST_METHOD(should_convert_batches_like_single_timestamps)
+        {
+            krabs::timestamp_converter converter(
+                krabs::clock_type::cpu_cycle_counter, 2904000000LL, 123456789, anchor_filetime);
+
+            std::vector<LONGLONG> timestamps;
+            for (LONGLONG i = 0; i < 1000; ++i) {
+                timestamps.push_back(i * i * 104729);
+            }
+
+            std::vector<LONGLONG> filetimes(timestamps.size());
+            std::vector<LONGLONG> nanoseconds(timestamps.size());
+            converter.to_filetime(timestamps.data(), filetimes.data(), timestamps.size());
+            converter.to_unix_nanoseconds(timestamps.data(), nanoseconds.data(), timestamps.size());
+
+            for (size_t i = 0; i < timestamps.size(); ++i) {
+                Assert::AreEqual(converter.to_filetime(timestamps[i]), filetimes[i]);
+                Assert::AreEqual(converter.to_unix_nanoseconds(timestamps[i]), nanoseconds[i]);
+            }
+
+            // Converting in place.
+            converter.to_filetime(timestamps.data(), timestamps.data(), timestamps.size());
+            Assert::IsTrue(timestamps == filetimes);
+        }
+
+        TEST_METHOD(should_convert_to_unix_nanoseconds)
+        {
+            const LONGLONG unix_epoch = 116444736000000000LL;
+            krabs::timestamp_converter converter(
+                krabs::clock_type::query_performance_counter, 10000000, 1000, unix_epoch);
+
+            Assert::AreEqual(0LL, static_cast<long long>(converter.to_unix_nanoseconds(1000)));
+            Assert::AreEqual(1500000000LL, static_cast<long long>(converter.to_unix_nanoseconds(1000 + 15000000)));
+            Assert::AreEqual(-100LL, static_cast<long long>(converter.to_unix_nanoseconds(999)));
+
+            // Anchored too long before 1970 for the anchor to fit in nanoseconds.
+            krabs::timestamp_converter early(krabs::clock_type::query_performance_counter, 10000000, 0, 0);
+            Assert::AreEqual(500LL, static_cast<long long>(early.to_unix_nanoseconds(unix_epoch + 5)));
+        }
+
+        TEST_METHOD(should_format_iso8601)
+        {
+            krabs::timestamp_converter converter;
+
+            Assert::AreEqual(std::string("1970-01-01T00:00:00.0000000Z"), converter.to_iso8601(116444736000000000LL));
+            Assert::AreEqual(std::string("1601-01-01T00:00:00.0000000Z"), converter.to_iso8601(0));
+            Assert::AreEqual(std::string("2024-02-29T12:34:56.1234567Z"), converter.to_iso8601(133536836961234567LL));
+            Assert::AreEqual(std::string("2000-12-31T23:59:59.9999999Z"), converter.to_iso8601(126227807999999999LL));
+
+            char text[krabs::timestamp_converter::iso8601_length + 1];
+            Assert::AreEqual(size_t(krabs::timestamp_converter::iso8601_length), converter.to_iso8601(0, text));
+            Assert::IsTrue(text[krabs::timestamp_converter::iso8601_length] == '\0');
+        }
+
+        TEST_METHOD(should_leave_system_time_as_it_is)
+        {
+            krabs::timestamp_converter converter;
+            Assert::IsTrue(converter.clock() == krabs::clock_type::system_time);
+            Assert::AreEqual(LONGLONG(anchor_filetime), converter.to_filetime(anchor_filetime));
+
+            // A counter without a rate can't be converted either.
+            krabs::timestamp_converter no_rate(krabs::clock_type::query_performance_counter, 0, 5000, anchor_filetime);
+            Assert::AreEqual(LONGLONG(42), no_rate.to_filetime(42));
+        }
+    };
+}
@@ -0,0 +1,251 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "CppUnitTest.h"
+#include <krabs.hpp>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace krabstests
+{
+    TEST_CLASS(test_columnar)
+    {
+        const krabs::guid wininet = krabs::guid(L"{43D1A55C-76D6-4F7E-995C-64C711E5CAFE}");
+        krabs::trace_context trace_context;
+
+        krabs::testing::synth_record make_request(const std::string &url, unsigned int status, ULONG pid)
+        {
+            krabs::testing::record_builder builder(wininet, krabs::id(1057), krabs::version(0));
+            builder.header().ProcessId = pid;
+            builder.add_properties()
+                (L"URL", url)
+                (L"Status", status);
+
+            return builder.pack_incomplete();
+        }
+
+    public:
+        TEST_METHOD(should_collect_properties_into_typed_columns)
+        {
+            krabs::columnar::batch_extractor extractor(wininet, 1057, { L"URL", L"Status" }, 2);
+
+            std::vector<size_t> sizes;
+            std::vector<std::string> urls;
+            std::vector<uint32_t> statuses;
+            std::vector<ULONG> pids;
+            extractor.add_on_batch_callback([&](const krabs::columnar::column_batch &batch) {
+                sizes.push_back(batch.rows());
+
+                const auto &url = batch.at(L"URL");
+                const auto &status = batch.at(L"Status");
+                Assert::IsTrue(krabs::columnar::column_type::ansi_string == url.type());
+                Assert::IsTrue(krabs::columnar::column_type::uint32 == status.type());
+
+                for (size_t row = 0; row < batch.rows(); ++row) {
+                    urls.push_back(url.string_at(row));
+                    statuses.push_back(status.values<uint32_t>()[row]);
+                    pids.push_back(batch.process_ids()[row]);
+                }
+            });
+
+            extractor(make_request("https://microsoft.com", 200, 4), trace_context);
+            extractor(make_request("https://bing.com", 301, 8), trace_context);
+            extractor(make_request("https://github.com", 404, 12), trace_context);
+            Assert::IsTrue(sizes == std::vector<size_t>{ 2 });
+
+            extractor.flush();
+            Assert::IsTrue(sizes == std::vector<size_t>{ 2, 1 });
+            Assert::IsTrue(urls == std::vector<std::string>{ "https://microsoft.com", "https://bing.com", "https://github.com" });
+            Assert::IsTrue(statuses == std::vector<uint32_t>{ 200, 301, 404 });
+            Assert::IsTrue(pids == std::vector<ULONG>{ 4, 8, 12 });
+            Assert::AreEqual(uint64_t(2), extractor.stats().batches);
+        }
+
+        TEST_METHOD(should_store_missing_properties_as_nulls)
+        {
+            krabs::columnar::batch_extractor extractor(wininet, 1057, { L"Status", L"NotAProperty" });
+
+            auto verified = false;
+            extractor.add_on_batch_callback([&](const krabs::columnar::column_batch &batch) {
+                Assert::AreEqual(size_t(2), batch.column_count());
+                Assert::IsFalse(batch[0].is_null(0));
+                Assert::IsTrue(batch[1].is_null(0));
+                Assert::AreEqual(size_t(1), batch[1].null_count());
+                verified = true;
+            });
+
+            extractor(make_request("https://microsoft.com", 200, 4), trace_context);
+            extractor.flush();
+            Assert::IsTrue(verified);
+        }
+
+        TEST_METHOD(should_ignore_other_events)
+        {
+            krabs::columnar::batch_extractor extractor(wininet, 1058, { L"Status" });
+            extractor(make_request("https://microsoft.com", 200, 4), trace_context);
+            extractor.flush();
+
+            Assert::AreEqual(uint64_t(0), extractor.stats().events);
+            Assert::AreEqual(uint64_t(0), extractor.stats().batches);
+        }
+
+        TEST_METHOD(column_should_track_nulls_past_one_bitmap_word)
+        {
+            krabs::columnar::column column(L"Value", krabs::columnar::column_type::uint32);
+            for (uint32_t i = 0; i < 100; ++i) {
+                if (i % 3 == 0) {
+                    column.append_null();
+                } else {
+                    column.append(reinterpret_cast<const BYTE*>(&i), sizeof(i));
+                }
+            }
+
+            Assert::AreEqual(size_t(100), column.size());
+            Assert::AreEqual(size_t(34), column.null_count());
+            Assert::AreEqual(size_t(2), column.validity().size());
+            Assert::IsTrue(column.is_null(99));
+            Assert::IsFalse(column.is_null(98));
+            Assert::AreEqual(uint32_t(98), column.values<uint32_t>()[98]);
+            Assert::AreEqual(uint32_t(0), column.values<uint32_t>()[99]);
+
+            column.clear();
+            Assert::AreEqual(size_t(0), column.size());
+            Assert::AreEqual(size_t(0), column.null_count());
+        }
+
+        TEST_METHOD(column_should_convert_etw_booleans_and_narrow_pointers)
+        {
+            krabs::columnar::column flags(L"Flag", krabs::columnar::column_type::boolean);
+            ULONG etw_true = 1;
+            ULONG etw_false = 0;
+            flags.append(reinterpret_cast<const BYTE*>(&etw_true), sizeof(etw_true));
+            flags.append(reinterpret_cast<const BYTE*>(&etw_false), sizeof(etw_false));
+            Assert::IsTrue(flags.values<bool>()[0]);
+            Assert::IsFalse(flags.values<bool>()[1]);
+
+            krabs::columnar::column pointers(L"Address", krabs::columnar::column_type::uint64);
+            uint32_t narrow = 0x12345678;
+            Assert::IsTrue(pointers.append(reinterpret_cast<const BYTE*>(&narrow), sizeof(narrow)));
+            Assert::AreEqual(uint64_t(0x12345678), pointers.values<uint64_t>()[0]);
+
+            uint16_t wrong = 7;
+            Assert::IsFalse(pointers.append(reinterpret_cast<const BYTE*>(&wrong), sizeof(wrong)));
+            Assert::IsTrue(pointers.is_null(1));
+        }
+
+        TEST_METHOD(column_should_trim_string_terminators)
+        {
+            krabs::columnar::column names(L"Name", krabs::columnar::column_type::unicode_string);
+            const wchar_t name[] = L"krabs";
+            names.append(reinterpret_cast<const BYTE*>(name), sizeof(name));
+            names.append_null();
+            names.append(reinterpret_cast<const BYTE*>(name), 2 * sizeof(wchar_t));
+
+            Assert::AreEqual(std::wstring(L"krabs"), names.wstring_at(0));
+            Assert::AreEqual(std::wstring(), names.wstring_at(1));
+            Assert::AreEqual(std::wstring(L"kr"), names.wstring_at(2));
+            Assert::IsTrue(std::vector<uint32_t>{ 0, 10, 10, 14 } == names.offsets());
+        }
+
+        TEST_METHOD(column_should_reject_reads_of_the_wrong_type)
+        {
+            krabs::columnar::column column(L"Value", krabs::columnar::column_type::uint32);
+            Assert::ExpectException<std::runtime_error>([&]() { column.values<uint64_t>(); });
+            Assert::ExpectException<std::runtime_error>([&]() { column.wstring_at(0); });
+        }
+
+        TEST_METHOD(table_file_should_round_trip_events_in_row_groups)
+        {
+            const char *urls[] = { "https://microsoft.com", "https://bing.com", "https://github.com" };
+
+            std::vector<BYTE> file;
+            {
+                krabs::columnar::table_writer writer(file, 4);
+                for (unsigned int i = 0; i < 10; ++i) {
+                    writer(make_request(urls[i % 3], 200 + i, i), trace_context);
+                }
+
+                writer.close();
+                Assert::AreEqual(uint64_t(1), writer.stats().tables);
+                Assert::AreEqual(uint64_t(3), writer.stats().row_groups);
+                Assert::AreEqual(uint64_t(file.size()), writer.stats().bytes);
+            }
+
+            krabs::columnar::table_reader reader(file.data(), file.size());
+            Assert::IsTrue(reader.complete());
+            Assert::AreEqual(size_t(1), reader.tables().size());
+            Assert::AreEqual(size_t(3), reader.row_groups().size());
+
+            const auto &table = reader.tables()[0];
+            Assert::IsTrue(wininet == table.provider);
+            Assert::AreEqual(USHORT(1057), table.event_id);
+            Assert::AreEqual(size_t(2), table.columns.size());
+
+            ULONG row_number = 0;
+            for (size_t i = 0; i < reader.row_groups().size(); ++i) {
+                auto batch = reader.read(i);
+                for (size_t row = 0; row < batch.rows(); ++row, ++row_number) {
+                    Assert::AreEqual(row_number, batch.process_ids()[row]);
+                    Assert::AreEqual(std::string(urls[row_number % 3]), batch.at(L"URL").string_at(row));
+                    Assert::AreEqual(200 + row_number, batch.at(L"Status").values<uint32_t>()[row]);
+                }
+            }
+
+            Assert::AreEqual(ULONG(10), row_number);
+        }
+
+        TEST_METHOD(table_file_should_dictionary_encode_repeated_strings)
+        {
+            std::vector<BYTE> plain;
+            std::vector<BYTE> repeated;
+            krabs::columnar::table_writer_stats stats;
+            {
+                krabs::columnar::table_writer plain_writer(plain);
+                krabs::columnar::table_writer repeated_writer(repeated);
+                for (unsigned int i = 0; i < 100; ++i) {
+                    plain_writer(make_request("https://microsoft.com/" + std::to_string(i), 200, 4), trace_context);
+                    repeated_writer(make_request("https://microsoft.com/" + std::to_string(i % 2), 200, 4), trace_context);
+                }
+
+                plain_writer.close();
+                repeated_writer.close();
+                Assert::AreEqual(uint64_t(0), plain_writer.stats().dictionary_columns);
+                stats = repeated_writer.stats();
+            }
+
+            Assert::AreEqual(uint64_t(1), stats.dictionary_columns);
+            Assert::IsTrue(repeated.size() < plain.size());
+
+            krabs::columnar::table_reader reader(repeated.data(), repeated.size());
+            auto batch = reader.read(0);
+            Assert::AreEqual(std::string("https://microsoft.com/1"), batch.at(L"URL").string_at(99));
+        }
+
+        TEST_METHOD(table_file_without_footer_should_be_read_up_to_its_last_chunk)
+        {
+            std::vector<BYTE> file;
+            {
+                krabs::columnar::table_writer writer(file, 2);
+                for (unsigned int i = 0; i < 5; ++i) {
+                    writer(make_request("https://microsoft.com", 200, i), trace_context);
+                }
+            }
+
+            // Drop the trailer, as if the writer had died before closing.
+            file.resize(file.size() - sizeof(krabs::columnar::file_trailer));
+
+            krabs::columnar::table_reader reader(file.data(), file.size());
+            Assert::IsFalse(reader.complete());
+            Assert::AreEqual(size_t(3), reader.row_groups().size());
+            Assert::AreEqual(size_t(1), reader.read(2).rows());
+        }
+
+        TEST_METHOD(table_reader_should_reject_other_files)
+        {
+            std::vector<BYTE> file(64, 0);
+            Assert::ExpectException<std::runtime_error>([&]() {
+                krabs::columnar::table_reader reader(file.data(), file.size());
+            });
+        }
+    };
+}
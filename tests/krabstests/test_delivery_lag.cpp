@@ -0,0 +1,126 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "CppUnitTest.h"
+#include <krabs.hpp>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace krabstests
+{
+    TEST_CLASS(test_delivery_lag)
+    {
+        static const uint64_t one_second = 10000000;
+
+        // An event stamped the given number of 100ns intervals ago.
+        static krabs::testing::synth_record make_event(const GUID &provider, uint64_t age)
+        {
+            FILETIME now;
+            GetSystemTimePreciseAsFileTime(&now);
+
+            EVENT_RECORD record = {};
+            record.EventHeader.ProviderId = provider;
+            const ULONGLONG stamp = (static_cast<ULONGLONG>(now.dwHighDateTime) << 32) | now.dwLowDateTime;
+            record.EventHeader.TimeStamp.QuadPart = static_cast<LONGLONG>(stamp - age);
+            return krabs::testing::synth_record(record, std::vector<BYTE>());
+        }
+
+    public:
+
+        TEST_METHOD(should_alert_once_each_time_the_threshold_is_reached)
+        {
+            std::vector<uint64_t> alerts;
+            krabs::delivery_lag_tracker tracker(1, 1000, [&](const krabs::delivery_lag_alert &alert) {
+                alerts.push_back(alert.lag);
+            });
+
+            const GUID provider = krabs::guid::random_guid();
+            tracker.record_lag(provider, 2 * one_second);
+            tracker.record_lag(provider, 3 * one_second);
+            tracker.record_lag(provider, one_second / 2);
+            tracker.record_lag(provider, 4 * one_second);
+
+            Assert::AreEqual(size_t(2), alerts.size());
+            Assert::AreEqual(4 * one_second, alerts[1]);
+
+            auto metrics = tracker.metrics();
+            Assert::AreEqual(size_t(1), metrics.size());
+            Assert::AreEqual(uint64_t(2), metrics[0].alerts);
+            Assert::AreEqual(uint64_t(4), metrics[0].lag.count());
+        }
+
+        TEST_METHOD(should_sample_lag_from_timestamps)
+        {
+            krabs::delivery_lag_tracker tracker(2);
+            const GUID provider = krabs::guid::random_guid();
+
+            for (int i = 0; i < 10; ++i) {
+                tracker.record(make_event(provider, one_second));
+            }
+
+            // A timestamp from the future counts as no lag.
+            tracker.record(make_event(provider, 0ull - one_second));
+            tracker.record(make_event(provider, 0ull - one_second));
+
+            auto metrics = tracker.metrics();
+            Assert::AreEqual(size_t(1), metrics.size());
+            Assert::AreEqual(uint64_t(6), metrics[0].lag.count());
+            Assert::IsTrue(metrics[0].lag.max() >= one_second);
+            Assert::AreEqual(uint64_t(0), metrics[0].lag.percentile(1.0));
+        }
+
+        TEST_METHOD(should_let_the_caller_pick_the_provider_of_a_sample)
+        {
+            krabs::delivery_lag_tracker tracker(2);
+            const GUID event_class = krabs::guid::random_guid();
+            const GUID provider = krabs::guid::random_guid();
+
+            uint64_t lag = 0;
+            Assert::IsFalse(tracker.sample(make_event(event_class, one_second), krabs::timestamp_converter(), lag));
+            Assert::IsTrue(tracker.sample(make_event(event_class, one_second), krabs::timestamp_converter(), lag));
+            Assert::IsTrue(lag >= one_second);
+            Assert::AreEqual(size_t(0), tracker.metrics().size());
+
+            tracker.record_lag(provider, lag);
+            auto metrics = tracker.metrics();
+            Assert::AreEqual(size_t(1), metrics.size());
+            Assert::IsTrue(metrics[0].provider == provider);
+        }
+
+        TEST_METHOD(should_tell_apart_guids_that_only_differ_in_their_last_bytes)
+        {
+            krabs::delivery_lag_tracker tracker(1);
+            GUID provider = krabs::guid::random_guid();
+
+            for (size_t i = 0; i < krabs::delivery_lag_tracker::provider_capacity; ++i) {
+                provider.Data4[7] = static_cast<unsigned char>(i);
+                tracker.record_lag(provider, one_second);
+            }
+
+            auto metrics = tracker.metrics();
+            Assert::AreEqual(size_t(krabs::delivery_lag_tracker::provider_capacity), metrics.size());
+            for (const auto &entry : metrics) {
+                Assert::AreEqual(uint64_t(1), entry.lag.count());
+            }
+        }
+
+        TEST_METHOD(should_report_lag_from_a_trace)
+        {
+            krabs::guid id(L"{A0C1853B-5C40-4B15-8766-3CF1C58F985A}");
+            krabs::user_trace trace;
+            krabs::provider<> provider(id);
+            trace.enable(provider);
+
+            int alerts = 0;
+            trace.enable_delivery_lag_tracking(1, 500, [&](const krabs::delivery_lag_alert &) { ++alerts; });
+
+            krabs::testing::user_trace_proxy proxy(trace);
+            proxy.push_event(make_event(id, one_second));
+
+            auto metrics = trace.metrics();
+            Assert::AreEqual(1, alerts);
+            Assert::AreEqual(size_t(1), metrics.delivery_lag.size());
+            Assert::IsTrue(metrics.delivery_lag[0].provider == id);
+        }
+    };
+}
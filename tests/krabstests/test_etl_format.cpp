@@ -0,0 +1,186 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "CppUnitTest.h"
+
+// Only the portable part of the reader, so these tests don't use anything
+// that needs Windows.
+#include <krabs/etl/etl_format.hpp>
+
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace krabstests
+{
+    // When the samples say their session started, as a FILETIME.
+    const int64_t sample_start_time = 132000000000000000;
+
+    // Decodes the .etl files in samples/, which make_samples.py writes.
+    TEST_CLASS(test_etl_format)
+    {
+        static std::vector<uint8_t> read_sample(const char *name)
+        {
+            const std::string file = __FILE__;
+            const std::string path = file.substr(0, file.find_last_of("\\/") + 1) + "samples/" + name;
+
+            std::ifstream stream(path, std::ios::binary);
+            Assert::IsTrue(stream.good());
+            return std::vector<uint8_t>(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+        }
+
+        // Every record of the sample, with the data it points at kept alive
+        // by the sample's bytes.
+        static std::vector<krabs::etl::event_record> decode_sample(
+            const std::vector<uint8_t> &bytes,
+            std::vector<krabs::etl::decoded_buffer> &buffers,
+            size_t &skipped)
+        {
+            auto info = krabs::etl::read_image_header(bytes.data(), bytes.size());
+            auto offsets = krabs::etl::buffer_offsets(info, bytes.size());
+
+            std::vector<krabs::etl::event_record> records;
+            skipped = 0;
+            buffers.resize(offsets.size());
+            for (size_t i = 0; i < offsets.size(); ++i) {
+                krabs::etl::decode_buffer(bytes.data() + offsets[i], bytes.size() - offsets[i], buffers[i]);
+                Assert::IsFalse(buffers[i].malformed);
+                skipped += buffers[i].skipped;
+                records.insert(records.end(), buffers[i].records.begin(), buffers[i].records.end());
+            }
+
+            return records;
+        }
+
+        static void check_records(const std::vector<krabs::etl::event_record> &records, uint16_t pointer_flag)
+        {
+            namespace etl = krabs::etl;
+            const etl::guid user_provider = { 0xa0c1853b, 0x5c40, 0x4b15, { 0x87, 0x66, 0x3c, 0xf1, 0xc5, 0x8f, 0x98, 0x5a } };
+            const etl::guid activity = { 0x11223344, 0x5566, 0x7788, { 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff, 0x00 } };
+
+            Assert::AreEqual(size_t(6), records.size());
+            for (const auto &record : records) {
+                Assert::IsTrue((record.header.flags & pointer_flag) != 0);
+            }
+
+            const auto &process = records[1];
+            Assert::IsTrue(process.header.provider_id == etl::details::process_guid);
+            Assert::AreEqual(uint8_t(1), process.header.descriptor.opcode);
+            Assert::AreEqual(uint8_t(4), process.header.descriptor.version);
+            Assert::AreEqual(uint32_t(100), process.header.process_id);
+            Assert::AreEqual(uint32_t(200), process.header.thread_id);
+            Assert::AreEqual(uint32_t(7), process.header.kernel_time);
+            Assert::AreEqual(uint16_t(14), process.user_data_length);
+            Assert::AreEqual(std::string("a.exe"), std::string(reinterpret_cast<const char*>(process.user_data + 8)));
+
+            const auto &manifest = records[2];
+            Assert::IsTrue(manifest.header.provider_id == user_provider);
+            Assert::IsTrue(manifest.header.activity_id == activity);
+            Assert::AreEqual(uint16_t(7937), manifest.header.descriptor.id);
+            Assert::AreEqual(uint8_t(16), manifest.header.descriptor.channel);
+            Assert::AreEqual(uint32_t(44), manifest.header.process_id);
+            Assert::AreEqual(int64_t(7000), manifest.header.timestamp);
+            Assert::AreEqual(uint16_t(3), manifest.user_data_length);
+            Assert::AreEqual(uint8_t(3), manifest.user_data[2]);
+
+            Assert::AreEqual(uint16_t(2), manifest.extended_data_count);
+            Assert::AreEqual(uint16_t(3), manifest.extended_data[0].ext_type);
+            Assert::AreEqual(uint16_t(4), manifest.extended_data[0].data_size);
+            Assert::AreEqual(uint8_t(5), *reinterpret_cast<const uint8_t*>(static_cast<uintptr_t>(manifest.extended_data[0].data_ptr)));
+            Assert::AreEqual(uint16_t(1), manifest.extended_data[1].ext_type);
+            Assert::AreEqual(0, memcmp(&activity, reinterpret_cast<const void*>(static_cast<uintptr_t>(manifest.extended_data[1].data_ptr)), sizeof(etl::guid)));
+
+            const auto &classic = records[3];
+            Assert::IsTrue(classic.header.provider_id == etl::details::process_guid);
+            Assert::IsTrue((classic.header.flags & etl::constants::header_flag_classic) != 0);
+            Assert::AreEqual(uint8_t(2), classic.header.descriptor.opcode);
+            Assert::AreEqual(uint8_t(4), classic.header.descriptor.level);
+            Assert::AreEqual(uint8_t(3), classic.header.descriptor.version);
+            Assert::AreEqual(uint32_t(22), classic.header.process_id);
+            Assert::AreEqual(uint8_t(1), classic.context.processor_number);
+            Assert::AreEqual(uint16_t(4), classic.user_data_length);
+            Assert::AreEqual(uint8_t(9), classic.user_data[0]);
+
+            const auto &perfinfo = records[4];
+            Assert::IsTrue(perfinfo.header.provider_id == etl::details::perf_info_guid);
+            Assert::AreEqual(uint8_t(0x2E), perfinfo.header.descriptor.opcode);
+            Assert::AreEqual(uint32_t(0xFFFFFFFF), perfinfo.header.thread_id);
+            Assert::AreEqual(int64_t(9000), perfinfo.header.timestamp);
+            Assert::IsTrue((perfinfo.header.flags & etl::constants::header_flag_no_cputime) != 0);
+
+            const auto &thread = records[5];
+            Assert::IsTrue(thread.header.provider_id == etl::details::thread_guid);
+            Assert::AreEqual(uint8_t(2), thread.header.descriptor.opcode);
+            Assert::AreEqual(uint32_t(201), thread.header.thread_id);
+            Assert::IsTrue((thread.header.flags & etl::constants::header_flag_no_cputime) != 0);
+            Assert::AreEqual(uint16_t(8), thread.user_data_length);
+        }
+
+    public:
+        TEST_METHOD(should_read_the_logfile_header_of_a_sample)
+        {
+            auto bytes = read_sample("events64.etl");
+            auto info = krabs::etl::read_image_header(bytes.data(), bytes.size());
+
+            Assert::AreEqual(uint32_t(1024), info.buffer_size);
+            Assert::AreEqual(uint32_t(8), info.pointer_size);
+            Assert::AreEqual(uint32_t(4), info.number_of_processors);
+            Assert::AreEqual(uint32_t(2), info.buffers_written);
+            Assert::AreEqual(uint32_t(2400), info.cpu_speed_mhz);
+            Assert::AreEqual(int64_t(10000000), info.perf_freq);
+            Assert::AreEqual(sample_start_time, info.start_time);
+            Assert::AreEqual(int64_t(5000), info.start_timestamp);
+            Assert::IsTrue(info.clock == krabs::etl::clock_type::query_performance_counter);
+            Assert::AreEqual(size_t(2), krabs::etl::buffer_offsets(info, bytes.size()).size());
+        }
+
+        TEST_METHOD(should_decode_every_record_of_a_sample)
+        {
+            auto bytes = read_sample("events64.etl");
+            std::vector<krabs::etl::decoded_buffer> buffers;
+            size_t skipped = 0;
+            auto records = decode_sample(bytes, buffers, skipped);
+
+            check_records(records, krabs::etl::constants::header_flag_64_bit);
+            Assert::AreEqual(size_t(1), skipped);
+        }
+
+        TEST_METHOD(should_decode_a_sample_from_a_32_bit_logger)
+        {
+            auto bytes = read_sample("events32.etl");
+            auto info = krabs::etl::read_image_header(bytes.data(), bytes.size());
+            Assert::AreEqual(uint32_t(4), info.pointer_size);
+            Assert::AreEqual(sample_start_time, info.start_time);
+
+            std::vector<krabs::etl::decoded_buffer> buffers;
+            size_t skipped = 0;
+            auto records = decode_sample(bytes, buffers, skipped);
+
+            check_records(records, krabs::etl::constants::header_flag_32_bit);
+            Assert::AreEqual(size_t(1), skipped);
+        }
+
+        TEST_METHOD(should_convert_sample_timestamps_to_filetime)
+        {
+            auto bytes = read_sample("events64.etl");
+            auto info = krabs::etl::read_image_header(bytes.data(), bytes.size());
+
+            // 10MHz performance counter, so one tick per FILETIME unit.
+            Assert::AreEqual(sample_start_time, krabs::etl::to_filetime(info, 5000));
+            Assert::AreEqual(sample_start_time + 2000, krabs::etl::to_filetime(info, 7000));
+        }
+
+        TEST_METHOD(should_reject_a_truncated_sample)
+        {
+            auto bytes = read_sample("events64.etl");
+            Assert::ExpectException<std::runtime_error>([&]() { krabs::etl::read_image_header(bytes.data(), 100); });
+
+            krabs::etl::decoded_buffer buffer;
+            krabs::etl::decode_buffer(bytes.data(), 0x40, buffer);
+            Assert::IsTrue(buffer.malformed);
+        }
+    };
+}
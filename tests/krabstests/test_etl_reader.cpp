@@ -0,0 +1,473 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "CppUnitTest.h"
+#include <krabs.hpp>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace krabstests
+{
+    // Writes ETL buffers byte by byte, the way the kernel lays them out.
+    class etl_image
+    {
+    public:
+        static constexpr ULONG buffer_size = 1024;
+
+        etl_image()
+        {
+            begin_buffer();
+        }
+
+        void begin_buffer(UCHAR processor = 0)
+        {
+            if (!bytes_.empty()) {
+                end_buffer();
+            }
+
+            current_ = bytes_.size();
+            bytes_.resize(current_ + buffer_size, 0xFF);
+            std::fill(bytes_.begin() + current_, bytes_.begin() + current_ + 0x48, BYTE(0));
+            put<ULONG>(current_ + 0x00, buffer_size);
+            bytes_[current_ + 0x28] = processor;
+            offset_ = 0x48;
+        }
+
+        void add_logfile_header(LONGLONG start_timestamp, LONGLONG perf_freq, LONGLONG start_time, ULONG log_file_mode = 0)
+        {
+            std::vector<BYTE> header(272, 0);
+            put<ULONG>(header, 0, buffer_size);
+            put<ULONG>(header, 12, 4);
+            put<ULONG>(header, 32, log_file_mode);
+            put<ULONG>(header, 44, 8);
+            put<ULONG>(header, 52, 3000);
+            put<LONGLONG>(header, 256, perf_freq);
+            put<LONGLONG>(header, 264, start_time);
+            header.resize(280, 0);
+            put<ULONG>(header, 272, 1);
+
+            add_system_event(0x0000, 1, 4, 8, start_timestamp, header);
+        }
+
+        void add_system_event(USHORT hook, USHORT version, ULONG pid, ULONG tid, LONGLONG timestamp, const std::vector<BYTE> &data)
+        {
+            size_t size = 32 + data.size();
+            size_t at = reserve(size);
+            put<USHORT>(at + 0, version);
+            bytes_[at + 2] = 2; // system64
+            bytes_[at + 3] = 0xC0;
+            put<USHORT>(at + 4, static_cast<USHORT>(size));
+            put<USHORT>(at + 6, hook);
+            put<ULONG>(at + 8, tid);
+            put<ULONG>(at + 12, pid);
+            put<LONGLONG>(at + 16, timestamp);
+            put<ULONG>(at + 24, 7);
+            put<ULONG>(at + 28, 9);
+            std::copy(data.begin(), data.end(), bytes_.begin() + at + 32);
+        }
+
+        void add_perfinfo_event(USHORT hook, LONGLONG timestamp, const std::vector<BYTE> &data)
+        {
+            size_t size = 16 + data.size();
+            size_t at = reserve(size);
+            put<USHORT>(at + 0, 2);
+            bytes_[at + 2] = 17; // perfinfo64
+            bytes_[at + 3] = 0xC0;
+            put<USHORT>(at + 4, static_cast<USHORT>(size));
+            put<USHORT>(at + 6, hook);
+            put<LONGLONG>(at + 8, timestamp);
+            std::copy(data.begin(), data.end(), bytes_.begin() + at + 16);
+        }
+
+        void add_classic_event(const GUID &guid, UCHAR opcode, LONGLONG timestamp, const std::vector<BYTE> &data)
+        {
+            size_t size = 48 + data.size();
+            size_t at = reserve(size);
+            put<USHORT>(at + 0, static_cast<USHORT>(size));
+            bytes_[at + 2] = 20; // full_header64
+            bytes_[at + 3] = 0xC0;
+            bytes_[at + 4] = opcode;
+            bytes_[at + 5] = 4;
+            put<USHORT>(at + 6, 2);
+            put<ULONG>(at + 8, 11);
+            put<ULONG>(at + 12, 22);
+            put<LONGLONG>(at + 16, timestamp);
+            put<GUID>(at + 24, guid);
+            std::copy(data.begin(), data.end(), bytes_.begin() + at + 48);
+        }
+
+        void add_manifest_event(
+            const GUID &provider,
+            USHORT id,
+            LONGLONG timestamp,
+            const std::vector<BYTE> &data,
+            const std::vector<std::pair<USHORT, std::vector<BYTE>>> &extended = {})
+        {
+            size_t extended_size = 0;
+            for (const auto &item : extended) {
+                extended_size += 8 + ((item.second.size() + 7) & ~size_t(7));
+            }
+
+            size_t size = sizeof(EVENT_HEADER) + extended_size + data.size();
+            size_t at = reserve(size);
+
+            EVENT_HEADER header = {};
+            header.Size = static_cast<USHORT>(size);
+            header.Flags = extended.empty() ? 0 : EVENT_HEADER_FLAG_EXTENDED_INFO;
+            header.ThreadId = 33;
+            header.ProcessId = 44;
+            header.TimeStamp.QuadPart = timestamp;
+            header.ProviderId = provider;
+            header.EventDescriptor.Id = id;
+            header.EventDescriptor.Version = 1;
+            put<EVENT_HEADER>(at, header);
+            bytes_[at + 2] = 19; // event_header64
+            bytes_[at + 3] = 0xC0;
+
+            size_t offset = at + sizeof(EVENT_HEADER);
+            for (size_t i = 0; i < extended.size(); ++i) {
+                const auto &item = extended[i];
+                put<USHORT>(offset + 2, item.first);
+                put<USHORT>(offset + 4, i + 1 < extended.size() ? 1 : 0);
+                put<USHORT>(offset + 6, static_cast<USHORT>(item.second.size()));
+                std::fill(bytes_.begin() + offset + 8, bytes_.begin() + offset + 8 + ((item.second.size() + 7) & ~size_t(7)), BYTE(0));
+                std::copy(item.second.begin(), item.second.end(), bytes_.begin() + offset + 8);
+                offset += 8 + ((item.second.size() + 7) & ~size_t(7));
+            }
+
+            std::copy(data.begin(), data.end(), bytes_.begin() + offset);
+        }
+
+        void add_instance_record()
+        {
+            size_t at = reserve(56);
+            put<USHORT>(at + 0, 56);
+            bytes_[at + 2] = 21; // instance64
+            bytes_[at + 3] = 0xC0;
+        }
+
+        const std::vector<BYTE> &finish()
+        {
+            end_buffer();
+            return bytes_;
+        }
+
+    private:
+        size_t reserve(size_t size)
+        {
+            size_t at = current_ + offset_;
+            std::fill(bytes_.begin() + at, bytes_.begin() + at + ((size + 7) & ~size_t(7)), BYTE(0));
+            offset_ += (size + 7) & ~size_t(7);
+            Assert::IsTrue(offset_ <= buffer_size);
+            return at;
+        }
+
+        void end_buffer()
+        {
+            put<ULONG>(current_ + 0x30, static_cast<ULONG>(offset_));
+        }
+
+        template <typename T>
+        void put(size_t at, const T &value)
+        {
+            memcpy(&bytes_[at], &value, sizeof(T));
+        }
+
+        template <typename T>
+        static void put(std::vector<BYTE> &bytes, size_t at, const T &value)
+        {
+            memcpy(&bytes[at], &value, sizeof(T));
+        }
+
+        std::vector<BYTE> bytes_;
+        size_t current_ = 0;
+        size_t offset_ = 0;
+    };
+
+    TEST_CLASS(test_etl_reader)
+    {
+        const krabs::guid provider_id = krabs::guid(L"{A0C1853B-5C40-4B15-8766-3CF1C58F985A}");
+        const krabs::guid classic_id = krabs::guid(L"{3D6FA8D0-FE05-11D0-9DDA-00C04FD7BA7C}");
+
+        std::vector<BYTE> build_image(ULONG log_file_mode = 0)
+        {
+            etl_image image;
+            image.add_logfile_header(1000, 10000000, 130000000000000000, log_file_mode);
+            image.add_manifest_event(provider_id, 7937, 2000, { 1, 2, 3 }, {
+                { USHORT(EVENT_HEADER_EXT_TYPE_TS_ID), { 5, 0, 0, 0 } },
+                { USHORT(EVENT_HEADER_EXT_TYPE_EVENT_KEY), { 1, 2, 3, 4, 5, 6, 7, 8, 9 } } });
+
+            image.begin_buffer(1);
+            image.add_classic_event(classic_id, 1, 3000, { 9, 8, 7, 6 });
+            image.add_instance_record();
+            image.add_perfinfo_event(0x0F2F, 4000, { 4, 4 });
+            image.add_system_event(0x0301, 4, 100, 200, 5000, { 1 });
+
+            return image.finish();
+        }
+
+    public:
+        TEST_METHOD(should_read_the_logfile_header)
+        {
+            auto image = build_image();
+            krabs::etl::reader reader(image.data(), image.size());
+
+            auto &header = reader.header();
+            Assert::AreEqual(uint32_t(etl_image::buffer_size), header.buffer_size);
+            Assert::AreEqual(uint32_t(8), header.pointer_size);
+            Assert::AreEqual(int64_t(10000000), header.perf_freq);
+            Assert::AreEqual(int64_t(130000000000000000), header.start_time);
+            Assert::AreEqual(int64_t(1000), header.start_timestamp);
+            Assert::IsTrue(header.clock == krabs::etl::clock_type::query_performance_counter);
+        }
+
+        TEST_METHOD(should_decode_every_header_variant)
+        {
+            auto image = build_image();
+            krabs::etl::reader reader(image.data(), image.size());
+            reader.set_raw_timestamps(true);
+
+            std::vector<krabs::testing::synth_record> records;
+            std::vector<std::vector<BYTE>> user_data;
+            reader.process([&](const EVENT_RECORD &record, const krabs::trace_context &) {
+                auto data = static_cast<const BYTE*>(record.UserData);
+                user_data.emplace_back(data, data + record.UserDataLength);
+                records.emplace_back(record, user_data.back());
+            });
+
+            Assert::AreEqual(size_t(5), records.size());
+
+            const EVENT_RECORD &manifest = records[1];
+            Assert::IsTrue(provider_id == manifest.EventHeader.ProviderId);
+            Assert::AreEqual(USHORT(7937), manifest.EventHeader.EventDescriptor.Id);
+            Assert::AreEqual(ULONG(44), manifest.EventHeader.ProcessId);
+            Assert::AreEqual(LONGLONG(2000), manifest.EventHeader.TimeStamp.QuadPart);
+            Assert::IsTrue((manifest.EventHeader.Flags & EVENT_HEADER_FLAG_64_BIT_HEADER) != 0);
+            Assert::IsTrue(user_data[1] == std::vector<BYTE>{ 1, 2, 3 });
+
+            const EVENT_RECORD &classic = records[2];
+            Assert::IsTrue(classic_id == classic.EventHeader.ProviderId);
+            Assert::AreEqual(UCHAR(1), classic.EventHeader.EventDescriptor.Opcode);
+            Assert::AreEqual(UCHAR(2), classic.EventHeader.EventDescriptor.Version);
+            Assert::AreEqual(ULONG(22), classic.EventHeader.ProcessId);
+            Assert::IsTrue((classic.EventHeader.Flags & EVENT_HEADER_FLAG_CLASSIC_HEADER) != 0);
+            Assert::AreEqual(USHORT(1), classic.BufferContext.ProcessorIndex);
+            Assert::IsTrue(user_data[2] == std::vector<BYTE>{ 9, 8, 7, 6 });
+
+            const EVENT_RECORD &perfinfo = records[3];
+            Assert::IsTrue(krabs::guid(krabs::guids::perf_info) == perfinfo.EventHeader.ProviderId);
+            Assert::AreEqual(UCHAR(0x2F), perfinfo.EventHeader.EventDescriptor.Opcode);
+            Assert::AreEqual(ULONG(0xFFFFFFFF), perfinfo.EventHeader.ThreadId);
+            Assert::AreEqual(LONGLONG(4000), perfinfo.EventHeader.TimeStamp.QuadPart);
+
+            const EVENT_RECORD &process = records[4];
+            Assert::IsTrue(krabs::guid(krabs::guids::process) == process.EventHeader.ProviderId);
+            Assert::AreEqual(UCHAR(1), process.EventHeader.EventDescriptor.Opcode);
+            Assert::AreEqual(UCHAR(4), process.EventHeader.EventDescriptor.Version);
+            Assert::AreEqual(ULONG(100), process.EventHeader.ProcessId);
+            Assert::AreEqual(ULONG(200), process.EventHeader.ThreadId);
+
+            auto stats = reader.stats();
+            Assert::AreEqual(uint64_t(2), stats.buffers);
+            Assert::AreEqual(uint64_t(5), stats.events);
+            Assert::AreEqual(uint64_t(1), stats.skipped);
+            Assert::AreEqual(uint64_t(0), stats.malformed_buffers);
+        }
+
+        TEST_METHOD(should_decode_extended_data)
+        {
+            auto image = build_image();
+            krabs::etl::reader reader(image.data(), image.size());
+
+            auto verified = false;
+            reader.process([&](const EVENT_RECORD &record, const krabs::trace_context &) {
+                if (record.EventHeader.EventDescriptor.Id != 7937) {
+                    return;
+                }
+
+                Assert::AreEqual(USHORT(2), record.ExtendedDataCount);
+                Assert::AreEqual(USHORT(EVENT_HEADER_EXT_TYPE_TS_ID), record.ExtendedData[0].ExtType);
+                Assert::AreEqual(USHORT(4), record.ExtendedData[0].DataSize);
+                Assert::AreEqual(ULONG(5), *reinterpret_cast<const ULONG*>(record.ExtendedData[0].DataPtr));
+                Assert::AreEqual(USHORT(EVENT_HEADER_EXT_TYPE_EVENT_KEY), record.ExtendedData[1].ExtType);
+                Assert::AreEqual(USHORT(9), record.ExtendedData[1].DataSize);
+                Assert::AreEqual(BYTE(9), reinterpret_cast<const BYTE*>(record.ExtendedData[1].DataPtr)[8]);
+                verified = true;
+            });
+
+            Assert::IsTrue(verified);
+        }
+
+        TEST_METHOD(should_convert_timestamps_to_filetime)
+        {
+            auto image = build_image();
+            krabs::etl::reader reader(image.data(), image.size());
+
+            std::vector<LONGLONG> timestamps;
+            reader.process([&](const EVENT_RECORD &record, const krabs::trace_context &) {
+                timestamps.push_back(record.EventHeader.TimeStamp.QuadPart);
+            });
+
+            // 10MHz performance counter, so one tick per FILETIME unit.
+            Assert::AreEqual(LONGLONG(130000000000000000), timestamps[0]);
+            Assert::AreEqual(LONGLONG(130000000000001000), timestamps[1]);
+        }
+
+        TEST_METHOD(should_let_callbacks_convert_raw_timestamps)
+        {
+            auto image = build_image();
+            krabs::etl::reader reader(image.data(), image.size());
+            reader.set_raw_timestamps(true);
+
+            std::vector<LONGLONG> timestamps;
+            reader.process([&](const EVENT_RECORD &record, const krabs::trace_context &context) {
+                timestamps.push_back(context.timestamps.to_filetime(record.EventHeader.TimeStamp.QuadPart));
+            });
+
+            Assert::AreEqual(LONGLONG(130000000000000000), timestamps[0]);
+            Assert::AreEqual(LONGLONG(130000000000001000), timestamps[1]);
+        }
+
+        TEST_METHOD(should_decode_in_parallel_in_file_order)
+        {
+            etl_image image;
+            image.add_logfile_header(0, 10000000, 0);
+            for (int buffer = 0; buffer < 37; ++buffer) {
+                image.begin_buffer(static_cast<UCHAR>(buffer % 4));
+                for (int i = 0; i < 5; ++i) {
+                    image.add_manifest_event(provider_id, static_cast<USHORT>(buffer * 5 + i), buffer * 5 + i, { 0 });
+                }
+            }
+            auto &bytes = image.finish();
+
+            krabs::etl::reader reader(bytes.data(), bytes.size());
+            reader.set_worker_count(4);
+
+            std::vector<USHORT> ids;
+            reader.process([&](const EVENT_RECORD &record, const krabs::trace_context &) {
+                if (record.EventHeader.ProviderId == provider_id) {
+                    ids.push_back(record.EventHeader.EventDescriptor.Id);
+                }
+            });
+
+            Assert::AreEqual(size_t(37 * 5), ids.size());
+            for (size_t i = 0; i < ids.size(); ++i) {
+                Assert::AreEqual(USHORT(i), ids[i]);
+            }
+        }
+
+        TEST_METHOD(should_reuse_its_workers_after_a_callback_throws)
+        {
+            etl_image image;
+            image.add_logfile_header(0, 10000000, 0);
+            for (int buffer = 0; buffer < 37; ++buffer) {
+                image.begin_buffer();
+                image.add_manifest_event(provider_id, static_cast<USHORT>(buffer), buffer, { 0 });
+            }
+            auto &bytes = image.finish();
+
+            krabs::etl::reader reader(bytes.data(), bytes.size());
+            reader.set_worker_count(3);
+
+            Assert::ExpectException<std::runtime_error>([&]() {
+                reader.process([&](const EVENT_RECORD &record, const krabs::trace_context &) {
+                    if (record.EventHeader.EventDescriptor.Id == 5) {
+                        throw std::runtime_error("stop");
+                    }
+                });
+            });
+
+            std::vector<USHORT> ids;
+            reader.process([&](const EVENT_RECORD &record, const krabs::trace_context &) {
+                if (record.EventHeader.ProviderId == provider_id) {
+                    ids.push_back(record.EventHeader.EventDescriptor.Id);
+                }
+            });
+
+            Assert::AreEqual(size_t(37), ids.size());
+            for (size_t i = 0; i < ids.size(); ++i) {
+                Assert::AreEqual(USHORT(i), ids[i]);
+            }
+            Assert::AreEqual(uint64_t(38), reader.stats().buffers);
+        }
+
+        TEST_METHOD(should_dispatch_through_trace_providers)
+        {
+            // Classic events that no provider claims are looked up in TDH by
+            // user traces, so keep those to the kernel trace.
+            etl_image user_image;
+            user_image.add_logfile_header(1000, 10000000, 0);
+            user_image.add_manifest_event(provider_id, 7937, 2000, { 1 });
+            user_image.add_manifest_event(provider_id, 7938, 2001, { 1 });
+            auto &user_bytes = user_image.finish();
+            krabs::etl::reader user_reader(user_bytes.data(), user_bytes.size());
+
+            auto image = build_image();
+            krabs::etl::reader reader(image.data(), image.size());
+
+            krabs::user_trace trace;
+            krabs::provider<> provider(provider_id);
+            auto provider_events = 0;
+            provider.add_on_event_callback([&](const EVENT_RECORD &, const krabs::trace_context &) { ++provider_events; });
+
+            krabs::event_filter filter(7937);
+            auto filter_events = 0;
+            filter.add_on_event_callback([&](const EVENT_RECORD &, const krabs::trace_context &) { ++filter_events; });
+            provider.add_filter(filter);
+            trace.enable(provider);
+
+            krabs::kernel_trace kernel;
+            krabs::kernel::process_provider process;
+            auto process_events = 0;
+            process.add_on_event_callback([&](const EVENT_RECORD &, const krabs::trace_context &) { ++process_events; });
+            kernel.enable(process);
+
+            user_reader.process(trace);
+            reader.process(kernel);
+
+            Assert::AreEqual(2, provider_events);
+            Assert::AreEqual(1, filter_events);
+            Assert::AreEqual(1, process_events);
+            Assert::AreEqual(size_t(2), kernel.buffers_processed());
+        }
+
+        TEST_METHOD(should_read_a_sample_file)
+        {
+            // One of the files test_etl_format decodes byte by byte, this
+            // time mapped and handed out as EVENT_RECORDs.
+            const std::string file = __FILE__;
+            const std::wstring path(file.begin(), file.begin() + file.find_last_of("\\/") + 1);
+            krabs::etl::reader reader(path + L"samples\\events64.etl");
+            reader.set_raw_timestamps(true);
+
+            // Extended data only lives as long as its buffer, so it's
+            // checked in the callback.
+            std::vector<EVENT_HEADER> headers;
+            reader.process([&](const EVENT_RECORD &record, const krabs::trace_context &) {
+                headers.push_back(record.EventHeader);
+                if (record.EventHeader.EventDescriptor.Id == 7937) {
+                    Assert::AreEqual(USHORT(2), record.ExtendedDataCount);
+                    Assert::AreEqual(USHORT(EVENT_HEADER_EXT_TYPE_RELATED_ACTIVITYID), record.ExtendedData[1].ExtType);
+                    Assert::AreEqual(BYTE(3), static_cast<const BYTE*>(record.UserData)[2]);
+                }
+            });
+
+            Assert::AreEqual(size_t(6), headers.size());
+            Assert::IsTrue(provider_id == headers[2].ProviderId);
+            Assert::AreEqual(USHORT(7937), headers[2].EventDescriptor.Id);
+            Assert::AreEqual(LONGLONG(7000), headers[2].TimeStamp.QuadPart);
+            Assert::IsTrue(krabs::guid(krabs::guids::perf_info) == headers[4].ProviderId);
+            Assert::AreEqual(ULONG(0xFFFFFFFF), headers[4].ThreadId);
+            Assert::AreEqual(uint64_t(1), reader.stats().skipped);
+        }
+
+        TEST_METHOD(should_reject_files_it_cannot_read)
+        {
+            std::vector<BYTE> garbage(4096, 0x42);
+            Assert::ExpectException<std::runtime_error>([&]() { krabs::etl::reader reader(garbage.data(), garbage.size()); });
+
+            auto compressed = build_image(0x04000000);
+            Assert::ExpectException<std::runtime_error>([&]() { krabs::etl::reader reader(compressed.data(), compressed.size()); });
+        }
+    };
+}
@@ -0,0 +1,136 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "CppUnitTest.h"
+#include <krabs.hpp>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace krabstests
+{
+    TEST_CLASS(test_event_map)
+    {
+        // Lays out an EVENT_MAP_INFO the way TdhGetEventMapInformation does:
+        // the header and entries, then the strings they point at.
+        static std::vector<BYTE> make_map(
+            const std::wstring &name,
+            ULONG flags,
+            const std::vector<std::pair<ULONG, std::wstring>> &entries)
+        {
+            std::vector<BYTE> buffer(FIELD_OFFSET(EVENT_MAP_INFO, MapEntryArray) + entries.size() * sizeof(EVENT_MAP_ENTRY));
+            auto add_string = [&](const std::wstring &text) {
+                auto offset = static_cast<ULONG>(buffer.size());
+                auto bytes = reinterpret_cast<const BYTE*>(text.c_str());
+                buffer.insert(buffer.end(), bytes, bytes + (text.size() + 1) * sizeof(wchar_t));
+                return offset;
+            };
+
+            ULONG name_offset = add_string(name);
+            std::vector<ULONG> offsets;
+            for (const auto &entry : entries) {
+                offsets.push_back(add_string(entry.second));
+            }
+
+            auto map = reinterpret_cast<EVENT_MAP_INFO*>(buffer.data());
+            map->NameOffset = name_offset;
+            map->Flag = static_cast<MAP_FLAGS>(flags);
+            map->EntryCount = static_cast<ULONG>(entries.size());
+            for (size_t i = 0; i < entries.size(); ++i) {
+                map->MapEntryArray[i].OutputOffset = offsets[i];
+                map->MapEntryArray[i].Value = entries[i].first;
+            }
+
+            return buffer;
+        }
+
+        static std::vector<BYTE> status_map()
+        {
+            return make_map(L"StatusMap", EVENTMAP_INFO_FLAG_MANIFEST_VALUEMAP, { { 5, L"Done " }, { 1, L"Started " } });
+        }
+
+        static std::vector<BYTE> access_map()
+        {
+            return make_map(L"AccessMap", EVENTMAP_INFO_FLAG_MANIFEST_BITMAP, { { 1, L"Read" }, { 2, L"Write" }, { 4, L"Execute" } });
+        }
+
+    public:
+        TEST_METHOD(value_map_should_name_values)
+        {
+            auto buffer = status_map();
+            krabs::event_map map(buffer.data(), static_cast<ULONG>(buffer.size()));
+
+            Assert::AreEqual(std::wstring(L"StatusMap"), map.name());
+            Assert::IsFalse(map.is_bitmap());
+            Assert::AreEqual(std::wstring(L"Done"), *map.find(5));
+            Assert::IsNull(map.find(2));
+            Assert::AreEqual(ULONG(1), map.entries()[0].value);
+
+            Assert::AreEqual(std::wstring(L"Started"), krabs::mapped_value(1, &map).name());
+            Assert::AreEqual(std::wstring(L"7"), krabs::mapped_value(7, &map).to_wstring());
+        }
+
+        TEST_METHOD(bitmap_should_name_set_flags)
+        {
+            auto buffer = access_map();
+            krabs::event_map map(buffer.data(), static_cast<ULONG>(buffer.size()));
+            Assert::IsTrue(map.is_bitmap());
+
+            std::vector<std::wstring> names;
+            ULONG unnamed = krabs::mapped_value(13, &map).for_each_name([&](const std::wstring &name) {
+                names.push_back(name);
+            });
+
+            Assert::IsTrue(names == std::vector<std::wstring>{ L"Read", L"Execute" });
+            Assert::AreEqual(ULONG(8), unnamed);
+            Assert::AreEqual(std::wstring(L"Read | Execute | 0x8"), krabs::mapped_value(13, &map).to_wstring());
+            Assert::AreEqual(std::wstring(), krabs::mapped_value(1, &map).name());
+        }
+
+        TEST_METHOD(should_reject_truncated_maps)
+        {
+            auto buffer = status_map();
+            Assert::ExpectException<std::runtime_error>([&]() {
+                krabs::event_map map(buffer.data(), static_cast<ULONG>(buffer.size() - sizeof(wchar_t)));
+            });
+            Assert::ExpectException<std::runtime_error>([&]() {
+                krabs::event_map map(buffer.data(), sizeof(ULONG));
+            });
+        }
+
+        TEST_METHOD(schema_locator_should_use_seeded_maps)
+        {
+            auto buffer = access_map();
+            krabs::guid provider(L"{43D1A55C-76D6-4F7E-995C-64C711E5CAFE}");
+
+            krabs::testing::record_builder builder(provider, krabs::id(1057), krabs::version(0));
+            builder.add_properties()
+                (L"URL", std::string("https://bing.com"))
+                (L"Status", (unsigned int)200);
+            auto record = builder.pack_incomplete();
+
+            krabs::schema_locator locator;
+            locator.add_event_map(provider, buffer.data(), static_cast<ULONG>(buffer.size()));
+
+            auto map = locator.get_event_map(record, L"AccessMap");
+            Assert::IsNotNull(map);
+            Assert::IsTrue(map == locator.get_event_map(record, L"AccessMap"));
+            Assert::AreEqual(ULONG(buffer.size()), map->size());
+            Assert::IsTrue(memcmp(buffer.data(), map->data(), buffer.size()) == 0);
+        }
+
+        TEST_METHOD(parse_mapped_should_throw_for_properties_without_maps)
+        {
+            krabs::testing::record_builder builder(krabs::guid(L"{43D1A55C-76D6-4F7E-995C-64C711E5CAFE}"), krabs::id(1057), krabs::version(0));
+            builder.add_properties()
+                (L"URL", std::string("https://bing.com"))
+                (L"Status", (unsigned int)200);
+            auto record = builder.pack_incomplete();
+
+            krabs::schema_locator locator;
+            krabs::schema schema(record, locator);
+            krabs::parser parser(schema);
+            Assert::ExpectException<std::runtime_error>([&]() { parser.parse_mapped(L"URL"); });
+            Assert::ExpectException<std::runtime_error>([&]() { parser.parse_mapped(L"NotAProperty"); });
+        }
+    };
+}
@@ -0,0 +1,285 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "CppUnitTest.h"
+#include <krabs.hpp>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace krabstests
+{
+    TEST_CLASS(test_event_merger)
+    {
+        static krabs::testing::synth_record make_record(LONGLONG timestamp, USHORT id = 1)
+        {
+            EVENT_RECORD record = {};
+            record.EventHeader.TimeStamp.QuadPart = timestamp;
+            record.EventHeader.EventDescriptor.Id = id;
+
+            std::vector<BYTE> data{ static_cast<BYTE>(timestamp), static_cast<BYTE>(id) };
+            return krabs::testing::synth_record(record, data);
+        }
+
+        krabs::trace_context trace_context;
+        std::vector<LONGLONG> delivered;
+
+        void watch(krabs::event_merger &merger)
+        {
+            merger.add_on_event_callback([&](const EVENT_RECORD &record, const krabs::trace_context &) {
+                delivered.push_back(record.EventHeader.TimeStamp.QuadPart);
+            });
+        }
+
+    public:
+        TEST_METHOD(should_merge_ordered_sources_by_timestamp)
+        {
+            krabs::event_merger merger(1000);
+            watch(merger);
+            auto first = merger.add_source();
+            auto second = merger.add_source();
+
+            first(make_record(10), trace_context);
+            first(make_record(30), trace_context);
+            second(make_record(20), trace_context);
+            second(make_record(40), trace_context);
+            first(make_record(50), trace_context);
+            merger.flush();
+
+            Assert::IsTrue(delivered == std::vector<LONGLONG>{ 10, 20, 30, 40, 50 });
+        }
+
+        TEST_METHOD(should_hold_events_until_every_source_moves_past_them)
+        {
+            krabs::event_merger merger(1000);
+            watch(merger);
+            auto first = merger.add_source();
+            auto second = merger.add_source();
+
+            first(make_record(10), trace_context);
+            first(make_record(20), trace_context);
+            Assert::AreEqual(size_t(0), delivered.size());
+
+            second(make_record(15), trace_context);
+            Assert::IsTrue(delivered == std::vector<LONGLONG>{ 10, 15 });
+            Assert::AreEqual(size_t(1), merger.depth());
+        }
+
+        TEST_METHOD(should_not_wait_longer_than_max_delay_for_a_quiet_source)
+        {
+            krabs::event_merger merger(100);
+            watch(merger);
+            auto busy = merger.add_source();
+            merger.add_source();
+
+            busy(make_record(10), trace_context);
+            busy(make_record(50), trace_context);
+            Assert::AreEqual(size_t(0), delivered.size());
+
+            busy(make_record(120), trace_context);
+            Assert::IsTrue(delivered == std::vector<LONGLONG>{ 10 });
+        }
+
+        TEST_METHOD(should_stop_waiting_for_closed_sources)
+        {
+            krabs::event_merger merger(1000);
+            watch(merger);
+            auto first = merger.add_source();
+            merger.add_source();
+
+            first(make_record(10), trace_context);
+            Assert::AreEqual(size_t(0), delivered.size());
+
+            merger.close_source(1);
+            Assert::IsTrue(delivered == std::vector<LONGLONG>{ 10 });
+        }
+
+        TEST_METHOD(should_reorder_within_a_source_window)
+        {
+            krabs::event_merger merger(1000);
+            watch(merger);
+            auto per_cpu = merger.add_source(10);
+
+            per_cpu(make_record(20), trace_context);
+            per_cpu(make_record(15), trace_context);
+            per_cpu(make_record(30), trace_context);
+            per_cpu(make_record(25), trace_context);
+            Assert::IsTrue(delivered == std::vector<LONGLONG>{ 15, 20 });
+
+            merger.flush();
+            Assert::IsTrue(delivered == std::vector<LONGLONG>{ 15, 20, 25, 30 });
+            Assert::AreEqual(uint64_t(0), merger.stats().events_late);
+        }
+
+        TEST_METHOD(should_deliver_and_count_late_events)
+        {
+            krabs::event_merger merger(1000);
+            watch(merger);
+            auto source = merger.add_source();
+
+            source(make_record(20), trace_context);
+            source(make_record(10), trace_context);
+
+            auto stats = merger.stats();
+            Assert::IsTrue(delivered == std::vector<LONGLONG>{ 20, 10 });
+            Assert::AreEqual(uint64_t(1), stats.events_late);
+            Assert::AreEqual(uint64_t(0), stats.events_dropped);
+            Assert::AreEqual(uint64_t(1), merger.late_events(0));
+        }
+
+        TEST_METHOD(should_drop_late_events_when_asked_to)
+        {
+            krabs::event_merger merger(1000, 16, krabs::late_event_policy::drop);
+            watch(merger);
+            auto source = merger.add_source();
+
+            source(make_record(20), trace_context);
+            source(make_record(10), trace_context);
+
+            auto stats = merger.stats();
+            Assert::IsTrue(delivered == std::vector<LONGLONG>{ 20 });
+            Assert::AreEqual(uint64_t(1), stats.events_late);
+            Assert::AreEqual(uint64_t(1), stats.events_dropped);
+        }
+
+        TEST_METHOD(should_release_the_oldest_event_when_full)
+        {
+            krabs::event_merger merger(1000, 2);
+            watch(merger);
+            auto source = merger.add_source();
+            merger.add_source();
+
+            source(make_record(30), trace_context);
+            source(make_record(10), trace_context);
+            source(make_record(20), trace_context);
+
+            auto stats = merger.stats();
+            Assert::IsTrue(delivered == std::vector<LONGLONG>{ 10 });
+            Assert::AreEqual(uint64_t(1), stats.events_forced);
+            Assert::AreEqual(size_t(2), stats.max_depth);
+            Assert::AreEqual(size_t(2), merger.depth());
+        }
+
+        TEST_METHOD(should_keep_arrival_order_for_equal_timestamps)
+        {
+            krabs::event_merger merger(1000);
+            std::vector<USHORT> ids;
+            merger.add_on_event_callback([&](const EVENT_RECORD &record, const krabs::trace_context &) {
+                ids.push_back(record.EventHeader.EventDescriptor.Id);
+            });
+            auto first = merger.add_source();
+            auto second = merger.add_source();
+
+            first(make_record(10, 1), trace_context);
+            second(make_record(10, 2), trace_context);
+            first(make_record(10, 3), trace_context);
+            merger.flush();
+
+            Assert::IsTrue(ids == std::vector<USHORT>{ 1, 2, 3 });
+        }
+
+        TEST_METHOD(should_copy_user_and_extended_data)
+        {
+            krabs::event_merger merger(1000);
+            auto source = merger.add_source();
+            merger.add_source();
+
+            krabs::testing::extended_data_builder builder;
+            builder.add_container_id(krabs::guid::random_guid());
+            auto extended = builder.pack();
+
+            const std::vector<BYTE> expected{ 1, 2, 3, 4 };
+            std::vector<BYTE> user_data(expected);
+            EVENT_RECORD original = {};
+            original.EventHeader.TimeStamp.QuadPart = 10;
+            original.UserData = user_data.data();
+            original.UserDataLength = static_cast<USHORT>(user_data.size());
+            original.ExtendedDataCount = static_cast<USHORT>(builder.count());
+            original.ExtendedData = reinterpret_cast<PEVENT_HEADER_EXTENDED_DATA_ITEM>(extended.first.get());
+
+            auto original_item = original.ExtendedData[0];
+            std::vector<BYTE> original_item_data(
+                reinterpret_cast<const BYTE*>(original_item.DataPtr),
+                reinterpret_cast<const BYTE*>(original_item.DataPtr) + original_item.DataSize);
+
+            auto verified = false;
+            merger.add_on_event_callback([&](const EVENT_RECORD &record, const krabs::trace_context &) {
+                Assert::AreNotEqual(original.UserData, record.UserData);
+                Assert::AreEqual(0, memcmp(expected.data(), record.UserData, record.UserDataLength));
+                Assert::AreEqual(size_t(4), size_t(record.UserDataLength));
+
+                Assert::AreEqual(USHORT(1), record.ExtendedDataCount);
+                Assert::AreEqual(original_item.ExtType, record.ExtendedData[0].ExtType);
+                Assert::AreEqual(original_item.DataSize, record.ExtendedData[0].DataSize);
+                Assert::AreNotEqual(original_item.DataPtr, record.ExtendedData[0].DataPtr);
+                Assert::AreEqual(0, memcmp(
+                    original_item_data.data(),
+                    reinterpret_cast<const void*>(record.ExtendedData[0].DataPtr),
+                    original_item_data.size()));
+                verified = true;
+            });
+
+            source(original, trace_context);
+
+            // The ETW buffer the record came from gets reused.
+            std::fill(user_data.begin(), user_data.end(), BYTE(0xFF));
+            memset(reinterpret_cast<void*>(original_item.DataPtr), 0xFF, original_item.DataSize);
+
+            merger.flush();
+            Assert::IsTrue(verified);
+        }
+
+        TEST_METHOD(should_let_callbacks_call_back_into_the_merger)
+        {
+            krabs::event_merger merger(1000);
+            std::vector<size_t> depths;
+            merger.add_on_event_callback([&](const EVENT_RECORD &, const krabs::trace_context &) {
+                depths.push_back(merger.depth());
+                merger.stats();
+            });
+            auto first = merger.add_source();
+            auto second = merger.add_source();
+
+            first(make_record(10), trace_context);
+            first(make_record(20), trace_context);
+            second(make_record(15), trace_context);
+            Assert::IsTrue(depths == std::vector<size_t>{ 1, 1 });
+
+            // Late events are delivered the same way.
+            second(make_record(5), trace_context);
+            merger.flush();
+            Assert::IsTrue(depths == std::vector<size_t>{ 1, 1, 1, 0 });
+        }
+
+        TEST_METHOD(should_deliver_events_pushed_from_a_callback_in_order)
+        {
+            krabs::event_merger merger(1000);
+            watch(merger);
+            auto source = merger.add_source();
+            auto pushed = false;
+            merger.add_on_event_callback([&](const EVENT_RECORD &record, const krabs::trace_context &) {
+                if (!pushed && record.EventHeader.TimeStamp.QuadPart == 10) {
+                    pushed = true;
+                    source(make_record(20), trace_context);
+
+                    // Delivered after this callback returns, not from inside it.
+                    Assert::IsTrue(delivered == std::vector<LONGLONG>{ 10 });
+                }
+            });
+
+            source(make_record(10), trace_context);
+            source(make_record(30), trace_context);
+            merger.flush();
+
+            Assert::IsTrue(delivered == std::vector<LONGLONG>{ 10, 20, 30 });
+        }
+
+        TEST_METHOD(should_reject_invalid_configuration)
+        {
+            Assert::ExpectException<krabs::invalid_parameter>([]() { krabs::event_merger merger(10, 0); });
+            Assert::ExpectException<krabs::invalid_parameter>([]() { krabs::event_merger merger(-1); });
+
+            krabs::event_merger merger(10);
+            Assert::ExpectException<krabs::invalid_parameter>([&]() { merger.close_source(0); });
+        }
+    };
+}
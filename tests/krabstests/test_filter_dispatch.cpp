@@ -0,0 +1,88 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "CppUnitTest.h"
+#include <krabs.hpp>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace krabstests
+{
+    TEST_CLASS(test_filter_dispatch)
+    {
+        static krabs::testing::synth_record make_event(const GUID &provider, USHORT id)
+        {
+            EVENT_RECORD record = {};
+            record.EventHeader.ProviderId = provider;
+            record.EventHeader.EventDescriptor.Id = id;
+            return krabs::testing::synth_record(record, std::vector<BYTE>());
+        }
+
+    public:
+
+        TEST_METHOD(should_list_filters_for_an_id_in_the_order_added)
+        {
+            krabs::details::filter_dispatch dispatch;
+            dispatch.add(0, {});
+            dispatch.add(1, { 7, 3 });
+            dispatch.add(2, { 7, 7 });
+            dispatch.add(3, {});
+
+            Assert::IsTrue(std::vector<unsigned int>{ 0, 1, 2, 3 } == dispatch.candidates(7));
+            Assert::IsTrue(std::vector<unsigned int>{ 0, 1, 3 } == dispatch.candidates(3));
+            Assert::IsTrue(std::vector<unsigned int>{ 0, 3 } == dispatch.candidates(5));
+            Assert::IsTrue(std::vector<unsigned short>{ 3, 7 } == dispatch.event_ids());
+        }
+
+        TEST_METHOD(should_find_ids_across_the_whole_range)
+        {
+            krabs::details::filter_dispatch dispatch;
+            const std::vector<unsigned short> ids{ 0, 63, 64, 1000, 65535 };
+            for (unsigned int i = 0; i < ids.size(); ++i) {
+                dispatch.add(i, { ids[i] });
+            }
+
+            for (unsigned int i = 0; i < ids.size(); ++i) {
+                Assert::IsTrue(dispatch.has_event_id(ids[i]));
+                Assert::IsTrue(std::vector<unsigned int>{ i } == dispatch.candidates(ids[i]));
+            }
+
+            Assert::IsFalse(dispatch.has_event_id(1));
+            Assert::IsTrue(dispatch.candidates(65534).empty());
+        }
+
+        TEST_METHOD(should_only_give_filters_events_with_their_ids)
+        {
+            krabs::guid id(L"{A0C1853B-5C40-4B15-8766-3CF1C58F985A}");
+            krabs::user_trace trace;
+            krabs::provider<> provider(id);
+
+            std::vector<int> counts(60, 0);
+            for (unsigned short event_id = 0; event_id < counts.size(); ++event_id) {
+                krabs::event_filter filter(event_id);
+                filter.add_on_event_callback([&counts, event_id](const EVENT_RECORD &, const krabs::trace_context &) {
+                    ++counts[event_id];
+                });
+                provider.add_filter(filter);
+            }
+
+            int everything = 0;
+            krabs::event_filter any(krabs::predicates::any_event);
+            any.add_on_event_callback([&](const EVENT_RECORD &, const krabs::trace_context &) { ++everything; });
+            provider.add_filter(any);
+
+            trace.enable(provider);
+
+            krabs::testing::user_trace_proxy proxy(trace);
+            proxy.push_event(make_event(id, 4));
+            proxy.push_event(make_event(id, 4));
+            proxy.push_event(make_event(id, 59));
+            proxy.push_event(make_event(id, 100));
+
+            Assert::AreEqual(2, counts[4]);
+            Assert::AreEqual(1, counts[59]);
+            Assert::AreEqual(0, counts[0]);
+            Assert::AreEqual(4, everything);
+        }
+    };
+}
@@ -0,0 +1,146 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "CppUnitTest.h"
+#include <krabs.hpp>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace krabstests
+{
+    TEST_CLASS(test_filter_pushdown)
+    {
+        static std::vector<BYTE> bytes_of(const EVENT_FILTER_DESCRIPTOR &descriptor)
+        {
+            auto start = reinterpret_cast<const BYTE*>(descriptor.Ptr);
+            return std::vector<BYTE>(start, start + descriptor.Size);
+        }
+
+    public:
+
+        TEST_METHOD(should_push_down_process_ids_every_branch_needs)
+        {
+            krabs::event_filter both(krabs::predicates::and_filter(
+                krabs::predicates::process_id_is(4),
+                krabs::predicates::opcode_is(1)));
+            Assert::IsTrue(std::set<ULONG>{ 4 } == both.pushdown().process_ids);
+
+            krabs::event_filter either(krabs::predicates::or_filter(
+                krabs::predicates::process_id_is(4),
+                krabs::predicates::process_id_is(8)));
+            Assert::IsTrue(std::set<ULONG>{ 4, 8 } == either.pushdown().process_ids);
+
+            krabs::event_filter one_branch(krabs::predicates::or_filter(
+                krabs::predicates::process_id_is(4),
+                krabs::predicates::opcode_is(1)));
+            Assert::IsTrue(one_branch.pushdown().empty());
+
+            krabs::event_filter negated(krabs::predicates::not_filter(
+                krabs::predicates::process_id_is(4)));
+            Assert::IsTrue(negated.pushdown().empty());
+        }
+
+        TEST_METHOD(should_drop_executable_names_too_long_for_etw)
+        {
+            krabs::filter_pushdown lhs;
+            lhs.executable_names = { L"a.exe" };
+            krabs::filter_pushdown rhs;
+            rhs.executable_names = { L"b.exe" };
+            Assert::IsTrue(std::set<std::wstring>{ L"a.exe", L"b.exe" } ==
+                krabs::filter_pushdown::either(lhs, rhs).executable_names);
+
+            // Each name fits on its own, but joined they don't.
+            const size_t half = MAX_EVENT_FILTER_DATA_SIZE / sizeof(wchar_t) / 2;
+            lhs.executable_names = { std::wstring(half, L'a') };
+            rhs.executable_names = { std::wstring(half, L'b') };
+            Assert::IsTrue(krabs::details::executable_names_fit(lhs.executable_names));
+            Assert::IsTrue(krabs::filter_pushdown::either(lhs, rhs).executable_names.empty());
+
+            std::set<std::wstring> joined = lhs.executable_names;
+            joined.insert(rhs.executable_names.begin(), rhs.executable_names.end());
+            krabs::filter_descriptors filters;
+            Assert::IsFalse(filters.add_executable_names(joined));
+            Assert::AreEqual(ULONG(0), filters.count());
+        }
+
+        TEST_METHOD(should_push_down_simple_properties_for_filters_with_ids)
+        {
+            krabs::event_filter filter(7, krabs::predicates::and_filter(
+                krabs::predicates::property_is(L"Status", uint32_t(5)),
+                krabs::predicates::property_is(L"Name", L"svchost.exe")));
+
+            const auto &payload = filter.pushdown().payload;
+            Assert::AreEqual(size_t(1), payload.size());
+            Assert::IsTrue(std::vector<unsigned short>{ 7 } == payload[0].event_ids);
+            Assert::AreEqual(size_t(1), payload[0].clauses.size());
+
+            const auto &clause = payload[0].clauses[0];
+            Assert::AreEqual(size_t(2), clause.size());
+            Assert::IsTrue(krabs::payload_predicate{ L"Status", PAYLOADFIELD_EQ, L"5" } == clause[0]);
+            Assert::IsTrue(krabs::payload_predicate{ L"Name", PAYLOADFIELD_IS, L"svchost.exe" } == clause[1]);
+
+            // Without ids there's no event descriptor to tie it to.
+            krabs::event_filter without_ids(krabs::predicates::property_is(L"Status", uint32_t(5)));
+            Assert::IsTrue(without_ids.pushdown().empty());
+
+            // Lambdas and narrow strings can't be checked by ETW.
+            krabs::event_filter narrow(7, krabs::predicates::property_is(L"Name", "svchost.exe"));
+            Assert::IsTrue(narrow.pushdown().empty());
+        }
+
+        TEST_METHOD(should_lay_out_event_id_descriptors)
+        {
+            krabs::filter_descriptors filters;
+            Assert::IsTrue(filters.add_event_ids({ 0x0102, 1 }));
+            Assert::IsTrue(filters.add_stack_walk_ids({ 3 }));
+
+            Assert::AreEqual(ULONG(2), filters.count());
+            Assert::AreEqual(ULONG(EVENT_FILTER_TYPE_EVENT_ID), filters.data()[0].Type);
+            Assert::IsTrue(std::vector<BYTE>{ 1, 0, 2, 0, 0x01, 0x00, 0x02, 0x01 } == bytes_of(filters.data()[0]));
+            Assert::AreEqual(ULONG(EVENT_FILTER_TYPE_STACKWALK), filters.data()[1].Type);
+            Assert::IsTrue(std::vector<BYTE>{ 1, 0, 1, 0, 0x03, 0x00 } == bytes_of(filters.data()[1]));
+        }
+
+        TEST_METHOD(should_lay_out_excluded_event_ids)
+        {
+            krabs::filter_descriptors filters;
+            Assert::IsTrue(filters.add_excluded_event_ids({ 5 }));
+            Assert::IsFalse(filters.add_event_ids({ 6 }));
+
+            Assert::AreEqual(ULONG(1), filters.count());
+            Assert::IsTrue(std::vector<BYTE>{ 0, 0, 1, 0, 0x05, 0x00 } == bytes_of(filters.data()[0]));
+        }
+
+        TEST_METHOD(should_lay_out_process_and_executable_descriptors)
+        {
+            krabs::filter_descriptors filters;
+            Assert::IsTrue(filters.add_process_ids({ 0x1234, 8 }));
+            Assert::IsTrue(filters.add_executable_names({ L"b.exe", L"a.exe" }));
+
+            Assert::AreEqual(ULONG(EVENT_FILTER_TYPE_PID), filters.data()[0].Type);
+            Assert::IsTrue(std::vector<BYTE>{ 8, 0, 0, 0, 0x34, 0x12, 0, 0 } == bytes_of(filters.data()[0]));
+
+            const std::wstring names(L"a.exe;b.exe");
+            auto start = reinterpret_cast<const BYTE*>(names.c_str());
+            std::vector<BYTE> expected(start, start + (names.size() + 1) * sizeof(wchar_t));
+            Assert::AreEqual(ULONG(EVENT_FILTER_TYPE_EXECUTABLE_NAME), filters.data()[1].Type);
+            Assert::IsTrue(expected == bytes_of(filters.data()[1]));
+        }
+
+        TEST_METHOD(should_leave_out_filters_etw_cant_take)
+        {
+            krabs::filter_descriptors filters;
+            Assert::IsFalse(filters.add_process_ids({ 1, 2, 3, 4, 5, 6, 7, 8, 9 }));
+            Assert::IsFalse(filters.add_event_ids({}));
+
+            // Payload filters only cover their own ids.
+            krabs::payload_filter payload;
+            payload.event_ids = { 7 };
+            payload.clauses.push_back({ krabs::payload_predicate{ L"Status", PAYLOADFIELD_EQ, L"5" } });
+            Assert::IsFalse(filters.add_payload(GUID(), { payload }));
+
+            Assert::AreEqual(ULONG(0), filters.count());
+            Assert::IsTrue(filters.data() == nullptr);
+        }
+    };
+}
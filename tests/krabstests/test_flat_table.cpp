@@ -0,0 +1,85 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "CppUnitTest.h"
+#include <krabs.hpp>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace krabstests
+{
+    TEST_CLASS(test_flat_table)
+    {
+        // Sends every key to the same home slot, so every lookup probes.
+        struct colliding_hash {
+            size_t operator()(int) const { return 3; }
+        };
+
+        static krabs::schema_key make_key(USHORT id)
+        {
+            EVENT_RECORD record = {};
+            record.EventHeader.ProviderId = krabs::guid(L"{88154140-f63a-4028-8826-b0028614d67b}");
+            record.EventHeader.EventDescriptor.Id = id;
+            return krabs::schema_key(record);
+        }
+
+    public:
+
+        TEST_METHOD(should_add_values_on_first_lookup)
+        {
+            krabs::flat_table<krabs::schema_key, int> table;
+            table[make_key(1)] = 10;
+            table[make_key(2)] = 20;
+
+            Assert::AreEqual(size_t(2), table.size());
+            Assert::AreEqual(10, table[make_key(1)]);
+            Assert::AreEqual(20, *table.find(make_key(2)));
+            Assert::IsNull(table.find(make_key(3)));
+        }
+
+        TEST_METHOD(should_keep_values_in_place_when_growing)
+        {
+            krabs::flat_table<krabs::schema_key, int> table;
+            int *first = &table[make_key(0)];
+            *first = 42;
+
+            for (USHORT id = 1; id < 1000; ++id) {
+                table[make_key(id)] = id;
+            }
+
+            Assert::AreEqual(size_t(1000), table.size());
+            Assert::IsTrue(first == table.find(make_key(0)));
+            Assert::AreEqual(42, *first);
+            Assert::AreEqual(999, table[make_key(999)]);
+        }
+
+        TEST_METHOD(should_find_colliding_keys_after_erase)
+        {
+            krabs::flat_table<int, int, colliding_hash> table;
+            for (int i = 0; i < 8; ++i) {
+                table[i] = i * 10;
+            }
+
+            Assert::IsTrue(table.erase(2));
+            Assert::IsTrue(table.erase(0));
+            Assert::IsFalse(table.erase(0));
+
+            Assert::AreEqual(size_t(6), table.size());
+            Assert::IsNull(table.find(2));
+            for (int i = 3; i < 8; ++i) {
+                Assert::AreEqual(i * 10, *table.find(i));
+            }
+        }
+
+        TEST_METHOD(should_forget_erased_keys)
+        {
+            krabs::flat_table<krabs::schema_key, int> table;
+            table[make_key(1)] = 10;
+            Assert::AreEqual(10, table[make_key(1)]);
+
+            table.erase(make_key(1));
+            Assert::IsNull(table.find(make_key(1)));
+            Assert::AreEqual(0, table[make_key(1)]);
+        }
+    };
+}
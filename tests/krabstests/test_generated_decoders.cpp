@@ -0,0 +1,176 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "CppUnitTest.h"
+#include <krabs.hpp>
+
+// Regenerate with:
+//   python3 tools/generate_decoders.py tests/krabstests/sample_provider.man
+//       -o tests/krabstests/sample_provider_events.hpp --namespace sample
+#include "sample_provider_events.hpp"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace krabstests
+{
+    TEST_CLASS(test_generated_decoders)
+    {
+        template <typename T>
+        static void append(std::vector<BYTE> &bytes, T value)
+        {
+            auto start = reinterpret_cast<const BYTE*>(&value);
+            bytes.insert(bytes.end(), start, start + sizeof(T));
+        }
+
+        static void append_string(std::vector<BYTE> &bytes, const std::string &value)
+        {
+            bytes.insert(bytes.end(), value.c_str(), value.c_str() + value.size() + 1);
+        }
+
+        static void append_wstring(std::vector<BYTE> &bytes, const std::wstring &value)
+        {
+            auto start = reinterpret_cast<const BYTE*>(value.c_str());
+            bytes.insert(bytes.end(), start, start + (value.size() + 1) * sizeof(wchar_t));
+        }
+
+        // The sample provider isn't registered, so there's no TDH schema to
+        // build records from; the user data is laid out by hand.
+        static krabs::testing::synth_record make_event(USHORT id, UCHAR version, const std::vector<BYTE> &bytes, bool is_32_bit = false)
+        {
+            EVENT_RECORD record = {};
+            record.EventHeader.ProviderId = krabs::decoding::to_guid(sample::provider_id);
+            record.EventHeader.EventDescriptor.Id = id;
+            record.EventHeader.EventDescriptor.Version = version;
+            record.EventHeader.Flags = is_32_bit ? EVENT_HEADER_FLAG_32_BIT_HEADER : EVENT_HEADER_FLAG_64_BIT_HEADER;
+
+            return krabs::testing::synth_record(record, bytes);
+        }
+
+        static std::vector<BYTE> request_start_v1_bytes(bool is_32_bit)
+        {
+            std::vector<BYTE> bytes;
+            append_string(bytes, "https://bing.com");
+            append<uint32_t>(bytes, 200);
+            if (is_32_bit) {
+                append<uint32_t>(bytes, 0x1234);
+            } else {
+                append<uint64_t>(bytes, 0x7FF612340000);
+            }
+            append_wstring(bytes, L"/search");
+            append<uint64_t>(bytes, 1500);
+            append<uint32_t>(bytes, 1);
+            return bytes;
+        }
+
+        krabs::trace_context trace_context;
+
+    public:
+
+        TEST_METHOD(should_describe_fields_at_compile_time)
+        {
+            static_assert(sample::request_start_v1::fields[2].offset.at(8) == 4, "Handle follows Status");
+            static_assert(sample::request_start_v1::fields[4].after == 3, "Duration follows Path");
+            static_assert(sample::payload_v0::fields[1].offset.at(8) == 16, "Size follows ActivityId");
+
+            Assert::AreEqual(size_t(6), sizeof(sample::request_start_v1::fields) / sizeof(krabs::decoding::field_descriptor));
+            Assert::AreEqual(std::wstring(L"Path"), std::wstring(sample::request_start_v1::fields[3].name));
+            Assert::AreEqual(USHORT(TDH_INTYPE_UNICODESTRING), sample::request_start_v1::fields[3].in_type);
+        }
+
+        TEST_METHOD(views_should_read_fields_after_strings)
+        {
+            auto event = make_event(1, 1, request_start_v1_bytes(false));
+
+            Assert::IsTrue(krabs::decoding::matches<sample::request_start_v1>(event));
+            Assert::IsFalse(krabs::decoding::matches<sample::request_start_v0>(event));
+
+            auto start = krabs::decoding::view_of<sample::request_start_v1>(event);
+            Assert::AreEqual(std::string("https://bing.com"), start.url());
+            Assert::AreEqual(uint32_t(200), start.status());
+            Assert::AreEqual(uint64_t(0x7FF612340000), start.handle());
+            Assert::AreEqual(std::wstring(L"/search"), start.path());
+            Assert::AreEqual(uint64_t(1500), start.duration());
+            Assert::IsTrue(start.cached());
+        }
+
+        TEST_METHOD(views_should_read_32_bit_pointers)
+        {
+            auto event = make_event(1, 1, request_start_v1_bytes(true), true);
+
+            auto start = krabs::decoding::view_of<sample::request_start_v1>(event);
+            Assert::AreEqual(uint64_t(0x1234), start.handle());
+            Assert::AreEqual(std::wstring(L"/search"), start.path());
+            Assert::AreEqual(uint64_t(1500), start.duration());
+        }
+
+        TEST_METHOD(views_should_read_user_data_without_a_record)
+        {
+            // As copied out of a capture, say.
+            const auto bytes = request_start_v1_bytes(false);
+
+            sample::request_start_v1 start(bytes.data(), bytes.size(), 8);
+            Assert::AreEqual(std::wstring(L"/search"), start.path());
+            Assert::IsTrue(start.cached());
+
+            sample::request_start_v1 truncated(bytes.data(), 20, 8);
+            Assert::AreEqual(std::string("https://bing.com"), truncated.url());
+            Assert::ExpectException<std::out_of_range>([&]() { truncated.duration(); });
+        }
+
+        TEST_METHOD(dispatcher_should_route_by_id_and_version)
+        {
+            std::vector<BYTE> payload;
+            append<krabs::decoding::guid>(payload, sample::provider_id);
+            append<uint32_t>(payload, 3);
+            payload.insert(payload.end(), { 1, 2, 3 });
+
+            auto start = make_event(1, 1, request_start_v1_bytes(false));
+            auto data = make_event(2, 0, payload);
+            auto unknown = make_event(1, 7, request_start_v1_bytes(false));
+
+            std::wstring path;
+            uint32_t size = 0;
+            int fallbacks = 0;
+
+            sample::dispatcher dispatch;
+            dispatch.on<sample::request_start_v1>([&](const sample::request_start_v1 &view, const krabs::trace_context &) {
+                path = view.path();
+            });
+            dispatch.on<sample::payload_v0>([&](const sample::payload_v0 &view, const krabs::trace_context &) {
+                size = view.size();
+            });
+            dispatch.otherwise([&](const EVENT_RECORD &record, const krabs::trace_context &) {
+                Assert::AreEqual(UCHAR(7), record.EventHeader.EventDescriptor.Version);
+                ++fallbacks;
+            });
+
+            dispatch(start, trace_context);
+            dispatch(data, trace_context);
+            dispatch(unknown, trace_context);
+
+            Assert::AreEqual(std::wstring(L"/search"), path);
+            Assert::AreEqual(uint32_t(3), size);
+            Assert::AreEqual(1, fallbacks);
+        }
+
+        TEST_METHOD(dispatcher_should_plug_into_event_filters)
+        {
+            Assert::IsTrue(sample::dispatcher::event_ids() == std::vector<unsigned short>{ 1, 2 });
+
+            int calls = 0;
+            sample::dispatcher dispatch;
+            dispatch.on<sample::request_start_v1>([&](const sample::request_start_v1 &, const krabs::trace_context &) {
+                ++calls;
+            });
+
+            krabs::event_filter filter(sample::dispatcher::event_ids());
+            filter.add_on_event_callback(dispatch);
+
+            auto event = make_event(1, 1, request_start_v1_bytes(false));
+            krabs::testing::event_filter_proxy proxy(filter);
+            proxy.push_event(event);
+
+            Assert::AreEqual(1, calls);
+        }
+    };
+}
@@ -0,0 +1,129 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "CppUnitTest.h"
+#include <krabs.hpp>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace krabstests
+{
+    TEST_CLASS(test_json_serializer)
+    {
+        const krabs::guid wininet = krabs::guid(L"{43D1A55C-76D6-4F7E-995C-64C711E5CAFE}");
+        krabs::trace_context trace_context;
+
+        static bool contains(const std::string &text, const std::string &part)
+        {
+            return text.find(part) != std::string::npos;
+        }
+
+    public:
+        TEST_METHOD(should_serialize_header_and_typed_properties)
+        {
+            krabs::testing::record_builder builder(wininet, krabs::id(1057), krabs::version(0));
+            builder.header().ProcessId = 1234;
+            builder.add_properties()
+                (L"URL", "https://microsoft.com")
+                (L"Status", (unsigned int)300);
+
+            auto record = builder.pack_incomplete();
+
+            krabs::format::json_serializer serializer;
+            const auto &json = serializer.serialize(record, trace_context);
+
+            Assert::IsTrue(json.front() == '{' && json.back() == '}');
+            Assert::IsTrue(contains(json, "\"provider_id\":\"{43D1A55C-76D6-4F7E-995C-64C711E5CAFE}\""));
+            Assert::IsTrue(contains(json, "\"id\":1057,"));
+            Assert::IsTrue(contains(json, "\"process_id\":1234,"));
+            Assert::IsTrue(contains(json, "\"provider_name\":\"Microsoft-Windows-WinINet\""));
+            Assert::IsTrue(contains(json, "\"URL\":\"https://microsoft.com\""));
+            Assert::IsTrue(contains(json, "\"Status\":300"));
+        }
+
+        TEST_METHOD(should_escape_strings)
+        {
+            krabs::testing::record_builder builder(wininet, krabs::id(1057), krabs::version(0));
+            builder.add_properties()
+                (L"URL", "https://microsoft.com/\"quoted\"\\path\n")
+                (L"Status", (unsigned int)200);
+
+            auto record = builder.pack_incomplete();
+
+            krabs::format::json_serializer serializer;
+            const auto &json = serializer.serialize(record, trace_context);
+
+            Assert::IsTrue(contains(json, "\"URL\":\"https://microsoft.com/\\\"quoted\\\"\\\\path\\n\""));
+        }
+
+        TEST_METHOD(should_serialize_extended_data)
+        {
+            krabs::testing::record_builder builder(wininet, krabs::id(1057), krabs::version(0));
+            builder.add_properties()
+                (L"URL", "https://microsoft.com")
+                (L"Status", (unsigned int)200);
+            builder.add_container_id_extended_data(krabs::guid(L"{1B2D3F4A-5B6C-7D8E-9FA0-B1C2D3E4F5A6}"));
+
+            auto record = builder.pack_incomplete();
+
+            krabs::format::json_serializer serializer;
+            const auto &json = serializer.serialize(record, trace_context);
+
+            Assert::IsTrue(contains(json, "\"extended_data\":[{\"type\":16,\"value\":\"1B2D3F4A-5B6C-7D8E-9FA0-B1C2D3E4F5A6\"}]"));
+        }
+
+        TEST_METHOD(should_reuse_its_buffer)
+        {
+            krabs::testing::record_builder builder(wininet, krabs::id(1057), krabs::version(0));
+            builder.add_properties()
+                (L"URL", "https://microsoft.com")
+                (L"Status", (unsigned int)200);
+
+            auto record = builder.pack_incomplete();
+
+            krabs::format::json_serializer serializer;
+            const auto &first = serializer.serialize(record, trace_context);
+            auto copy = first;
+            auto data = first.data();
+
+            const auto &second = serializer.serialize(record, trace_context);
+            Assert::IsTrue(&first == &second);
+            Assert::IsTrue(data == second.data());
+            Assert::AreEqual(copy, second);
+        }
+
+        TEST_METHOD(should_format_values_like_windows)
+        {
+            std::string out;
+            krabs::format::details::append_guid(out, krabs::guid(L"{43D1A55C-76D6-4F7E-995C-64C711E5CAFE}"));
+            Assert::AreEqual(std::string("{43D1A55C-76D6-4F7E-995C-64C711E5CAFE}"), out);
+
+            // S-1-5-21-1000-1-2-3
+            const BYTE sid[] = { 1, 5, 0, 0, 0, 0, 0, 5, 21, 0, 0, 0, 0xE8, 3, 0, 0, 1, 0, 0, 0, 2, 0, 0, 0, 3, 0, 0, 0 };
+            out.clear();
+            Assert::IsTrue(krabs::format::details::append_sid(out, sid, sizeof(sid)));
+            Assert::AreEqual(std::string("S-1-5-21-1000-1-2-3"), out);
+            Assert::IsFalse(krabs::format::details::append_sid(out, sid, sizeof(sid) - 1));
+
+            const BYTE ipv6[] = { 0x20, 0x01, 0x0d, 0xb8, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 1 };
+            out.clear();
+            krabs::format::details::append_ipv6(out, ipv6);
+            Assert::AreEqual(std::string("2001:db8::1:0:0:1"), out);
+
+            // 2020-12-30 in FILETIME ticks.
+            out.clear();
+            krabs::format::details::append_filetime(out, 132537600001234567ULL);
+            Assert::AreEqual(std::string("2020-12-30T00:00:00.1234567Z"), out);
+        }
+
+        TEST_METHOD(should_convert_utf16_to_utf8)
+        {
+            // "a\u00e9" then U+1F600 as a surrogate pair, then a lone surrogate.
+            const wchar_t text[] = { L'a', 0x00E9, 0xD83D, 0xDE00, 0xD800, L'"' };
+
+            std::string out;
+            krabs::format::details::append_utf16<true>(out, reinterpret_cast<const BYTE*>(text), 6);
+            Assert::AreEqual(std::string("a\xC3\xA9\xF0\x9F\x98\x80\xEF\xBF\xBD\\\""), out);
+        }
+    };
+}
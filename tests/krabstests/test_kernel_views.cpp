@@ -0,0 +1,278 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "CppUnitTest.h"
+#include <krabs.hpp>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace krabstests
+{
+    TEST_CLASS(test_kernel_views)
+    {
+        static krabs::testing::record_builder kernel_builder(const GUID &provider, int opcode, int version)
+        {
+            krabs::testing::record_builder builder(provider, krabs::id(0), krabs::version(version), krabs::opcode(opcode));
+            builder.header().Flags = EVENT_HEADER_FLAG_CLASSIC_HEADER
+                | EVENT_HEADER_FLAG_64_BIT_HEADER
+                | EVENT_HEADER_FLAG_PROCESSOR_INDEX;
+
+            return builder;
+        }
+
+        template <typename T>
+        static void append(std::vector<BYTE> &bytes, T value)
+        {
+            auto start = reinterpret_cast<const BYTE*>(&value);
+            bytes.insert(bytes.end(), start, start + sizeof(T));
+        }
+
+        static void append_pointer(std::vector<BYTE> &bytes, uint64_t value, bool is_32_bit)
+        {
+            if (is_32_bit) {
+                append(bytes, static_cast<uint32_t>(value));
+            } else {
+                append(bytes, value);
+            }
+        }
+
+        static void append_wstring(std::vector<BYTE> &bytes, const std::wstring &value)
+        {
+            auto start = reinterpret_cast<const BYTE*>(value.c_str());
+            bytes.insert(bytes.end(), start, start + (value.size() + 1) * sizeof(wchar_t));
+        }
+
+        // record_builder can't fill the WBEMSID in Process events, so these
+        // are laid out by hand.
+        static std::vector<BYTE> process_start_bytes(bool is_32_bit)
+        {
+            std::vector<BYTE> bytes;
+            append_pointer(bytes, 0xFFFF800012345678, is_32_bit);
+            append<uint32_t>(bytes, 1234);
+            append<uint32_t>(bytes, 4);
+            append<uint32_t>(bytes, 1);
+            append<int32_t>(bytes, 259);
+            append_pointer(bytes, 0x1AB000, is_32_bit);
+            append<uint32_t>(bytes, 0x10);
+
+            // TOKEN_USER, then S-1-5-18.
+            append_pointer(bytes, 0xFFFF800000001000, is_32_bit);
+            append_pointer(bytes, 0, is_32_bit);
+            const BYTE local_system[] = { 1, 1, 0, 0, 0, 0, 0, 5, 18, 0, 0, 0 };
+            bytes.insert(bytes.end(), local_system, local_system + sizeof(local_system));
+
+            const char image[] = "notepad.exe";
+            bytes.insert(bytes.end(), image, image + sizeof(image));
+            append_wstring(bytes, L"notepad.exe a.txt");
+            append_wstring(bytes, L"");
+            append_wstring(bytes, L"App");
+
+            return bytes;
+        }
+
+        static EVENT_RECORD process_record(std::vector<BYTE> &bytes, bool is_32_bit)
+        {
+            EVENT_RECORD record = {};
+            record.EventHeader.ProviderId = krabs::guids::process;
+            record.EventHeader.EventDescriptor.Opcode = 1;
+            record.EventHeader.EventDescriptor.Version = 4;
+            record.EventHeader.Flags = EVENT_HEADER_FLAG_CLASSIC_HEADER
+                | (is_32_bit ? EVENT_HEADER_FLAG_32_BIT_HEADER : EVENT_HEADER_FLAG_64_BIT_HEADER);
+            record.UserData = bytes.data();
+            record.UserDataLength = static_cast<USHORT>(bytes.size());
+
+            return record;
+        }
+
+    public:
+
+        TEST_METHOD(offsets_should_account_for_pointer_size)
+        {
+            static_assert(krabs::kernel::thread_v3::sub_process_tag_offset.at(8) == 64, "thread v3 layout");
+            static_assert(krabs::kernel::thread_v3::sub_process_tag_offset.at(4) == 36, "thread v3 layout");
+            static_assert(krabs::kernel::image_v3::file_name_offset.at(8) == 56, "image v3 layout");
+            static_assert(krabs::kernel::disk_io_v3::issuing_thread_id_offset.at(8) == 48, "disk io v3 layout");
+        }
+
+        TEST_METHOD(process_view_should_read_64_bit_events)
+        {
+            auto bytes = process_start_bytes(false);
+            auto record = process_record(bytes, false);
+
+            Assert::IsTrue(krabs::kernel::process_start_v4::matches(record));
+            Assert::IsFalse(krabs::kernel::process_end_v4::matches(record));
+
+            krabs::kernel::process_start_v4 start(record);
+            Assert::AreEqual(size_t(8), start.pointer_size());
+            Assert::AreEqual(uint64_t(0xFFFF800012345678), start.unique_process_key());
+            Assert::AreEqual(uint32_t(1234), start.process_id());
+            Assert::AreEqual(uint32_t(4), start.parent_id());
+            Assert::AreEqual(uint32_t(1), start.session_id());
+            Assert::AreEqual(int32_t(259), start.exit_status());
+            Assert::AreEqual(uint64_t(0x1AB000), start.directory_table_base());
+            Assert::AreEqual(uint32_t(0x10), start.flags());
+            Assert::AreEqual(std::string("S-1-5-18"), start.user_sid().sid_string);
+            Assert::AreEqual(std::string("notepad.exe"), start.image_file_name());
+            Assert::AreEqual(std::wstring(L"notepad.exe a.txt"), start.command_line());
+            Assert::AreEqual(std::wstring(), start.package_full_name());
+            Assert::AreEqual(std::wstring(L"App"), start.application_id());
+        }
+
+        TEST_METHOD(process_view_should_read_32_bit_events)
+        {
+            auto bytes = process_start_bytes(true);
+            auto record = process_record(bytes, true);
+
+            krabs::kernel::process_start_v4 start(record);
+            Assert::AreEqual(size_t(4), start.pointer_size());
+            Assert::AreEqual(uint64_t(0x12345678), start.unique_process_key());
+            Assert::AreEqual(uint32_t(1234), start.process_id());
+            Assert::AreEqual(uint32_t(0x10), start.flags());
+            Assert::AreEqual(std::string("S-1-5-18"), start.user_sid().sid_string);
+            Assert::AreEqual(std::wstring(L"notepad.exe a.txt"), start.command_line());
+        }
+
+        TEST_METHOD(views_should_throw_past_the_end_of_the_user_data)
+        {
+            auto bytes = process_start_bytes(false);
+            bytes.resize(16);
+            auto record = process_record(bytes, false);
+
+            krabs::kernel::process_start_v4 start(record);
+            Assert::AreEqual(uint32_t(4), start.parent_id());
+            Assert::ExpectException<std::out_of_range>([&]() { start.session_id(); });
+            Assert::ExpectException<std::out_of_range>([&]() { start.command_line(); });
+        }
+
+        TEST_METHOD(thread_view_should_agree_with_parser)
+        {
+            auto builder = kernel_builder(krabs::guids::thread, 1, 3);
+            builder.add_properties()
+                (L"ProcessId", (unsigned int)1234)
+                (L"TThreadId", (unsigned int)5678)
+                (L"StackBase", (void*)0x1000)
+                (L"Win32StartAddr", (void*)0x7FF612340000)
+                (L"TebBase", (void*)0x2000);
+            auto record = builder.pack_incomplete();
+
+            krabs::schema schema(record, trace_context.schema_locator);
+            krabs::parser parser(schema);
+
+            Assert::IsTrue(krabs::kernel::thread_start_v3::matches(record));
+            krabs::kernel::thread_start_v3 start(record);
+            Assert::AreEqual(parser.parse<uint32_t>(L"ProcessId"), start.process_id());
+            Assert::AreEqual(parser.parse<uint32_t>(L"TThreadId"), start.thread_id());
+            Assert::AreEqual(uint64_t(parser.parse<krabs::pointer>(L"StackBase").address), start.stack_base());
+            Assert::AreEqual(uint64_t(parser.parse<krabs::pointer>(L"Win32StartAddr").address), start.win32_start_addr());
+            Assert::AreEqual(uint64_t(parser.parse<krabs::pointer>(L"TebBase").address), start.teb_base());
+        }
+
+        TEST_METHOD(image_view_should_agree_with_parser)
+        {
+            auto builder = kernel_builder(krabs::guids::image_load, 10, 3);
+            builder.add_properties()
+                (L"ImageBase", (void*)0x7FF612340000)
+                (L"ImageSize", (void*)0x5000)
+                (L"ProcessId", (unsigned int)1234)
+                (L"ImageCheckSum", (unsigned int)0xABCD)
+                (L"TimeDateStamp", (unsigned int)0x5F000000)
+                (L"DefaultBase", (void*)0x140000000)
+                (L"FileName", std::wstring(L"\\Device\\HarddiskVolume1\\Windows\\notepad.exe"));
+            auto record = builder.pack_incomplete();
+
+            krabs::schema schema(record, trace_context.schema_locator);
+            krabs::parser parser(schema);
+
+            Assert::IsTrue(krabs::kernel::image_load_v3::matches(record));
+            Assert::IsFalse(krabs::kernel::image_unload_v3::matches(record));
+            krabs::kernel::image_load_v3 load(record);
+            Assert::AreEqual(uint64_t(parser.parse<krabs::pointer>(L"ImageBase").address), load.image_base());
+            Assert::AreEqual(uint64_t(parser.parse<krabs::pointer>(L"ImageSize").address), load.image_size());
+            Assert::AreEqual(parser.parse<uint32_t>(L"ProcessId"), load.process_id());
+            Assert::AreEqual(parser.parse<uint32_t>(L"ImageCheckSum"), load.image_checksum());
+            Assert::AreEqual(parser.parse<uint32_t>(L"TimeDateStamp"), load.time_date_stamp());
+            Assert::AreEqual(uint64_t(parser.parse<krabs::pointer>(L"DefaultBase").address), load.default_base());
+            Assert::AreEqual(parser.parse<std::wstring>(L"FileName"), load.file_name());
+        }
+
+        TEST_METHOD(disk_io_view_should_agree_with_parser)
+        {
+            auto builder = kernel_builder(krabs::guids::disk_io, 10, 3);
+            builder.add_properties()
+                (L"DiskNumber", (unsigned int)1)
+                (L"TransferSize", (unsigned int)4096)
+                (L"ByteOffset", (long long)0x100000)
+                (L"Irp", (void*)0xFFFF800000002000)
+                (L"HighResResponseTime", (unsigned long long)42)
+                (L"IssuingThreadId", (unsigned int)5678);
+            auto record = builder.pack_incomplete();
+
+            krabs::schema schema(record, trace_context.schema_locator);
+            krabs::parser parser(schema);
+
+            Assert::IsTrue(krabs::kernel::disk_read_v3::matches(record));
+            krabs::kernel::disk_read_v3 read(record);
+            Assert::AreEqual(parser.parse<uint32_t>(L"DiskNumber"), read.disk_number());
+            Assert::AreEqual(parser.parse<uint32_t>(L"TransferSize"), read.transfer_size());
+            Assert::AreEqual(parser.parse<int64_t>(L"ByteOffset"), read.byte_offset());
+            Assert::AreEqual(uint64_t(parser.parse<krabs::pointer>(L"Irp").address), read.irp());
+            Assert::AreEqual(parser.parse<uint64_t>(L"HighResResponseTime"), read.high_res_response_time());
+            Assert::AreEqual(parser.parse<uint32_t>(L"IssuingThreadId"), read.issuing_thread_id());
+        }
+
+        TEST_METHOD(registry_view_should_agree_with_parser)
+        {
+            auto builder = kernel_builder(krabs::guids::registry, 11, 2);
+            builder.add_properties()
+                (L"InitialTime", (long long)132000000000000000)
+                (L"Status", (unsigned int)0xC0000034)
+                (L"KeyHandle", (void*)0xFFFF800000003000)
+                (L"KeyName", std::wstring(L"\\REGISTRY\\MACHINE\\SOFTWARE"));
+            auto record = builder.pack_incomplete();
+
+            krabs::schema schema(record, trace_context.schema_locator);
+            krabs::parser parser(schema);
+
+            Assert::IsTrue(krabs::kernel::registry_open_v2::matches(record));
+            krabs::kernel::registry_open_v2 open(record);
+            Assert::AreEqual(parser.parse<int64_t>(L"InitialTime"), open.initial_time());
+            Assert::AreEqual(parser.parse<uint32_t>(L"Status"), open.status());
+            Assert::AreEqual(uint64_t(parser.parse<krabs::pointer>(L"KeyHandle").address), open.key_handle());
+            Assert::AreEqual(parser.parse<std::wstring>(L"KeyName"), open.key_name());
+        }
+
+        TEST_METHOD(typed_callbacks_should_only_see_matching_events)
+        {
+            krabs::kernel_trace trace;
+            krabs::kernel::image_load_provider provider;
+
+            int loads = 0;
+            int unloads = 0;
+            uint32_t pid = 0;
+            provider.add_on_typed_event_callback<krabs::kernel::image_load_v3>(
+                [&](const krabs::kernel::image_load_v3 &load, const krabs::trace_context &) {
+                    ++loads;
+                    pid = load.process_id();
+                });
+            provider.add_on_typed_event_callback<krabs::kernel::image_unload_v3>(
+                [&](const krabs::kernel::image_unload_v3 &, const krabs::trace_context &) {
+                    ++unloads;
+                });
+            trace.enable(provider);
+
+            auto builder = kernel_builder(krabs::guids::image_load, 10, 3);
+            builder.add_properties()(L"ProcessId", (unsigned int)1234);
+            auto record = builder.pack_incomplete();
+
+            krabs::testing::kernel_trace_proxy proxy(trace);
+            proxy.push_event(record);
+
+            Assert::AreEqual(1, loads);
+            Assert::AreEqual(0, unloads);
+            Assert::AreEqual(uint32_t(1234), pid);
+        }
+
+    private:
+        krabs::trace_context trace_context;
+    };
+}
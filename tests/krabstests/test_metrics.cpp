@@ -0,0 +1,170 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "CppUnitTest.h"
+#include <krabs.hpp>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace krabstests
+{
+    TEST_CLASS(test_metrics)
+    {
+        static krabs::testing::synth_record make_event(const GUID &provider, USHORT id, size_t bytes)
+        {
+            EVENT_RECORD record = {};
+            record.EventHeader.ProviderId = provider;
+            record.EventHeader.EventDescriptor.Id = id;
+            return krabs::testing::synth_record(record, std::vector<BYTE>(bytes));
+        }
+
+    public:
+
+        TEST_METHOD(should_bucket_values_within_an_eighth)
+        {
+            for (uint64_t value : { 0ull, 7ull, 8ull, 15ull, 16ull, 1000ull, 123456789ull, ~0ull }) {
+                const auto bucket = krabs::latency_histogram::bucket_of(value);
+                const auto high = krabs::latency_histogram::bucket_high(bucket);
+
+                Assert::IsTrue(bucket < krabs::latency_histogram::bucket_count);
+                Assert::IsTrue(value <= high);
+                Assert::IsTrue(high - value <= value / 8);
+            }
+
+            Assert::AreEqual(krabs::latency_histogram::bucket_count - 1, krabs::latency_histogram::bucket_of(~0ull));
+        }
+
+        TEST_METHOD(should_report_percentiles_no_higher_than_the_max)
+        {
+            krabs::latency_histogram histogram;
+            Assert::AreEqual(0ull, static_cast<unsigned long long>(histogram.percentile(50.0)));
+
+            for (uint64_t value = 1; value <= 100; ++value) {
+                histogram.record(value);
+            }
+
+            Assert::AreEqual(100ull, static_cast<unsigned long long>(histogram.count()));
+            Assert::AreEqual(50.5, histogram.mean());
+
+            const auto median = histogram.percentile(50.0);
+            Assert::IsTrue(median >= 50 && median <= 50 + 50 / 8);
+            Assert::AreEqual(100ull, static_cast<unsigned long long>(histogram.percentile(100.0)));
+
+            krabs::latency_histogram more;
+            more.record(1000);
+            histogram.merge(more);
+            Assert::AreEqual(101ull, static_cast<unsigned long long>(histogram.count()));
+            Assert::AreEqual(1000ull, static_cast<unsigned long long>(histogram.max()));
+        }
+
+        TEST_METHOD(should_count_events_per_provider_id_and_filter)
+        {
+            krabs::guid id(L"{A0C1853B-5C40-4B15-8766-3CF1C58F985A}");
+            krabs::user_trace trace;
+            krabs::provider<> provider(id);
+
+            krabs::event_filter filter(krabs::predicates::id_is(2));
+            filter.add_on_event_callback([](const EVENT_RECORD &, const krabs::trace_context &) {});
+            auto filtered = provider.add_filter(filter);
+
+            provider.enable_metrics();
+            Assert::IsTrue(provider.metrics_enabled());
+
+            trace.enable(provider);
+            krabs::testing::user_trace_proxy proxy(trace);
+
+            proxy.push_event(make_event(id, 1, 4));
+            proxy.push_event(make_event(id, 2, 8));
+            proxy.push_event(make_event(id, 2, 8));
+
+            auto metrics = provider.metrics();
+            Assert::AreEqual(3ull, static_cast<unsigned long long>(metrics.events));
+            Assert::AreEqual(20ull, static_cast<unsigned long long>(metrics.bytes));
+            Assert::AreEqual(2ull, static_cast<unsigned long long>(metrics.accepted));
+            Assert::IsTrue(metrics.ticks_per_second > 0);
+
+            Assert::AreEqual(size_t(2), metrics.event_ids.size());
+            Assert::AreEqual(USHORT(2), metrics.event_ids[1].event_id);
+            Assert::AreEqual(16ull, static_cast<unsigned long long>(metrics.event_ids[1].bytes));
+
+            Assert::AreEqual(size_t(1), metrics.filters.size());
+            Assert::AreEqual(filtered, metrics.filters[0].filter);
+            Assert::AreEqual(2ull, static_cast<unsigned long long>(metrics.filters[0].passed));
+            Assert::AreEqual(2ull, static_cast<unsigned long long>(metrics.filters[0].callback_latency.count()));
+
+            auto totals = trace.metrics();
+            Assert::AreEqual(3ull, static_cast<unsigned long long>(totals.events_handled));
+            Assert::AreEqual(size_t(1), totals.providers.size());
+        }
+
+        TEST_METHOD(should_report_ids_from_every_page_in_order)
+        {
+            krabs::guid id(L"{A0C1853B-5C40-4B15-8766-3CF1C58F985A}");
+            krabs::user_trace trace;
+            krabs::provider<> provider(id);
+            provider.enable_metrics();
+            trace.enable(provider);
+
+            krabs::testing::user_trace_proxy proxy(trace);
+            proxy.push_event(make_event(id, 65535, 0));
+            proxy.push_event(make_event(id, 300, 0));
+            proxy.push_event(make_event(id, 1, 0));
+
+            auto metrics = provider.metrics();
+            Assert::AreEqual(size_t(3), metrics.event_ids.size());
+            Assert::AreEqual(USHORT(1), metrics.event_ids[0].event_id);
+            Assert::AreEqual(USHORT(300), metrics.event_ids[1].event_id);
+            Assert::AreEqual(USHORT(65535), metrics.event_ids[2].event_id);
+        }
+
+        TEST_METHOD(should_give_every_live_thread_its_own_counter)
+        {
+            struct shared_state {
+                krabs::details::event_counter counter;
+                volatile LONG ready;
+                HANDLE go;
+            } state;
+            state.ready = 0;
+            state.go = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+
+            // Twice as many threads as there are copies at first, each
+            // holding on to its copy until all of them have one.
+            const size_t thread_count = 2 * krabs::details::event_counter::shard_count;
+            std::vector<HANDLE> threads;
+            for (size_t i = 0; i < thread_count; ++i) {
+                threads.push_back(CreateThread(nullptr, 0, [](LPVOID parameter) -> DWORD {
+                    auto &state = *static_cast<shared_state *>(parameter);
+                    auto &count = state.counter.local(GetCurrentThreadId());
+                    InterlockedIncrement(&state.ready);
+                    WaitForSingleObject(state.go, INFINITE);
+
+                    for (int n = 0; n < 1000; ++n) {
+                        ++count.value;
+                    }
+                    return 0;
+                }, &state, 0, nullptr));
+            }
+
+            while (static_cast<size_t>(state.ready) < thread_count) {
+                Sleep(1);
+            }
+
+            SetEvent(state.go);
+            for (auto thread : threads) {
+                WaitForSingleObject(thread, INFINITE);
+                CloseHandle(thread);
+            }
+            CloseHandle(state.go);
+
+            Assert::AreEqual(uint64_t(thread_count * 1000), krabs::details::total(state.counter));
+
+            // The threads are gone, so a new one carries on in one of their
+            // copies rather than adding more.
+            ++state.counter.local(GetCurrentThreadId()).value;
+            size_t copies = 0;
+            state.counter.for_each([&copies](const krabs::details::event_count &) { ++copies; });
+            Assert::AreEqual(thread_count, copies);
+            Assert::AreEqual(uint64_t(thread_count * 1000 + 1), krabs::details::total(state.counter));
+        }
+    };
+}
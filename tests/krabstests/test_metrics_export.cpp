@@ -0,0 +1,149 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "CppUnitTest.h"
+#include <krabs.hpp>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace krabstests
+{
+    TEST_CLASS(test_metrics_export)
+    {
+        static krabs::trace_metrics make_metrics(size_t providers)
+        {
+            krabs::trace_metrics metrics;
+            metrics.events_handled = 42;
+            metrics.schema_cache.hits = 7;
+
+            for (size_t i = 0; i < providers; ++i) {
+                krabs::provider_metrics provider;
+                provider.provider = krabs::guid::random_guid();
+                provider.events = 10 + i;
+                provider.callback_latency.record(100);
+
+                krabs::filter_metrics filter;
+                filter.filter = i + 1;
+                filter.passed = 3;
+                provider.filters.push_back(filter);
+
+                krabs::event_id_metrics id = { 5, 10 + i, 80, 10 + i };
+                provider.event_ids.push_back(id);
+
+                metrics.providers.push_back(provider);
+            }
+
+            return metrics;
+        }
+
+    public:
+
+        TEST_METHOD(should_read_back_what_was_published)
+        {
+            std::vector<BYTE> memory;
+            krabs::monitoring::publisher publisher(memory, 4, 4, 4);
+            krabs::monitoring::reader reader(memory.data(), memory.size());
+
+            publisher.publish(make_metrics(2));
+            auto published = reader.read();
+
+            Assert::AreEqual(42ull, static_cast<unsigned long long>(published.header.events_handled));
+            Assert::AreEqual(7ull, static_cast<unsigned long long>(published.header.schema_hits));
+            Assert::IsFalse(published.truncated());
+            Assert::IsTrue((published.header.sequence & 1) == 0);
+
+            Assert::AreEqual(size_t(2), published.providers.size());
+            const auto &second = published.providers[1];
+            Assert::AreEqual(11ull, static_cast<unsigned long long>(second.events));
+            Assert::AreEqual(100ull, static_cast<unsigned long long>(second.callback_latency.p99));
+            Assert::AreEqual(uint64_t(1), uint64_t(second.filter_count));
+            Assert::AreEqual(2ull, static_cast<unsigned long long>(published.filters[second.first_filter].filter));
+            Assert::AreEqual(USHORT(5), published.event_ids[second.first_event_id].event_id);
+        }
+
+        TEST_METHOD(should_truncate_what_does_not_fit)
+        {
+            std::vector<BYTE> memory;
+            krabs::monitoring::publisher publisher(memory, 2, 2, 2);
+            krabs::monitoring::reader reader(memory.data(), memory.size());
+
+            publisher.publish(make_metrics(3));
+            auto published = reader.read();
+
+            Assert::IsTrue(published.truncated());
+            Assert::AreEqual(size_t(2), published.providers.size());
+        }
+
+        TEST_METHOD(should_read_a_copy_through_a_view)
+        {
+            std::vector<BYTE> memory;
+            krabs::monitoring::publisher publisher(memory, 4, 4, 4);
+            publisher.publish(make_metrics(2));
+
+            const std::vector<uint8_t> copy(memory.begin(), memory.end());
+            krabs::monitoring::view view(copy.data(), copy.size());
+            auto published = view.read();
+
+            Assert::AreEqual(42ull, static_cast<unsigned long long>(published.header.events_handled));
+            Assert::AreEqual(size_t(2), published.providers.size());
+        }
+
+        TEST_METHOD(should_read_a_named_section_through_another_view)
+        {
+            const std::wstring name = L"Local\\krabs-test-metrics-" + std::to_wstring(GetCurrentProcessId());
+            krabs::monitoring::publisher publisher(name, 4, 4, 4);
+            auto metrics = make_metrics(2);
+            publisher.publish(metrics);
+
+            // What a monitoring tool in another process does: map the section
+            // on its own and read it with nothing but the layout.
+            HANDLE mapping = OpenFileMappingW(FILE_MAP_READ, FALSE, name.c_str());
+            Assert::IsNotNull(mapping);
+            auto view = static_cast<const BYTE*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+            Assert::IsNotNull(view);
+
+            auto header = reinterpret_cast<const krabs::monitoring::metrics_header*>(view);
+            const int32_t sequence = header->sequence;
+            Assert::IsTrue((sequence & 1) == 0);
+            Assert::AreEqual(krabs::monitoring::constants::metrics_magic, header->magic);
+            Assert::AreEqual(uint32_t(2), header->provider_count);
+
+            auto providers = reinterpret_cast<const krabs::monitoring::provider_record*>(view + header->providers_offset);
+            const GUID first = metrics.providers[0].provider;
+            Assert::AreEqual(0, memcmp(&first, &providers[0].provider, sizeof(GUID)));
+            Assert::AreEqual(uint64_t(11), providers[1].events);
+
+            auto event_ids = reinterpret_cast<const krabs::monitoring::event_id_record*>(view + header->event_ids_offset);
+            Assert::AreEqual(uint16_t(5), event_ids[providers[1].first_event_id].event_id);
+
+            // Publishing again shows through the other view, a whole write later.
+            metrics.events_handled = 43;
+            publisher.publish(metrics);
+            Assert::AreEqual(sequence + 2, static_cast<int32_t>(header->sequence));
+            Assert::AreEqual(uint64_t(43), header->events_handled);
+
+            krabs::monitoring::reader reader(name);
+            Assert::AreEqual(uint64_t(43), reader.read().header.events_handled);
+
+            UnmapViewOfFile(view);
+            CloseHandle(mapping);
+        }
+
+        TEST_METHOD(should_not_read_while_publishing)
+        {
+            std::vector<BYTE> memory;
+            krabs::monitoring::publisher publisher(memory, 1, 1, 1);
+            krabs::monitoring::reader reader(memory.data(), memory.size());
+
+            auto header = reinterpret_cast<krabs::monitoring::metrics_header*>(memory.data());
+            InterlockedIncrement(reinterpret_cast<volatile LONG*>(&header->sequence));
+
+            krabs::monitoring::published_metrics published;
+            Assert::IsFalse(reader.try_read(published));
+            Assert::ExpectException<std::runtime_error>([&] { reader.read(3); });
+
+            std::vector<BYTE> garbage(memory.size());
+            Assert::ExpectException<std::runtime_error>([&] { krabs::monitoring::reader(garbage.data(), garbage.size()); });
+        }
+    };
+}
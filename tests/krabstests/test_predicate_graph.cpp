@@ -0,0 +1,131 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "CppUnitTest.h"
+#include <krabs.hpp>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace krabstests
+{
+    TEST_CLASS(test_predicate_graph)
+    {
+        static krabs::predicate_expression counting_leaf(const std::wstring &key, bool answer, int &calls)
+        {
+            krabs::predicate_expression leaf;
+            leaf.kind = krabs::predicate_expression::leaf;
+            leaf.key = key;
+            leaf.evaluate = [answer, &calls](const EVENT_RECORD &, const krabs::trace_context &) {
+                ++calls;
+                return answer;
+            };
+            return leaf;
+        }
+
+        static krabs::testing::synth_record make_event(const GUID &provider, USHORT id, ULONG process_id)
+        {
+            EVENT_RECORD record = {};
+            record.EventHeader.ProviderId = provider;
+            record.EventHeader.EventDescriptor.Id = id;
+            record.EventHeader.ProcessId = process_id;
+            return krabs::testing::synth_record(record, std::vector<BYTE>());
+        }
+
+    public:
+
+        TEST_METHOD(should_run_shared_checks_once_per_event)
+        {
+            int shared_calls = 0;
+            int first_calls = 0;
+            int second_calls = 0;
+
+            krabs::details::predicate_graph graph;
+            auto first = graph.add(krabs::predicate_expression::combine(krabs::predicate_expression::all, {
+                counting_leaf(L"shared", true, shared_calls),
+                counting_leaf(L"first", true, first_calls) }));
+            auto second = graph.add(krabs::predicate_expression::combine(krabs::predicate_expression::all, {
+                counting_leaf(L"shared", true, shared_calls),
+                counting_leaf(L"second", false, second_calls) }));
+
+            Assert::AreEqual(size_t(5), graph.size());
+
+            EVENT_RECORD record = {};
+            krabs::trace_context context;
+            for (int i = 0; i < 3; ++i) {
+                graph.begin_event();
+                Assert::IsTrue(graph.evaluate(first, record, context));
+                Assert::IsFalse(graph.evaluate(second, record, context));
+                Assert::IsTrue(graph.evaluate(first, record, context));
+            }
+
+            Assert::AreEqual(3, shared_calls);
+            Assert::AreEqual(3, first_calls);
+            Assert::AreEqual(3, second_calls);
+        }
+
+        TEST_METHOD(should_share_whole_predicates_with_the_same_arguments)
+        {
+            auto first_rule = krabs::predicates::and_filter(
+                krabs::predicates::id_is(1),
+                krabs::predicates::property_iends_with(L"ImageName", std::wstring(L"powershell.exe")));
+            auto second_rule = krabs::predicates::and_filter(
+                krabs::predicates::id_is(1),
+                krabs::predicates::property_iends_with(L"ImageName", std::wstring(L"powershell.exe")));
+            auto other_rule = krabs::predicates::and_filter(
+                krabs::predicates::id_is(1),
+                krabs::predicates::property_ends_with(L"ImageName", std::wstring(L"powershell.exe")));
+
+            // The rules outlive the graph, so nothing needs keeping alive.
+            std::shared_ptr<const void> owner;
+
+            krabs::details::predicate_graph graph;
+            auto first = graph.add(krabs::details::expression_of(first_rule, owner));
+            auto second = graph.add(krabs::details::expression_of(second_rule, owner));
+            auto other = graph.add(krabs::details::expression_of(other_rule, owner));
+
+            Assert::IsTrue(first == second);
+            Assert::IsTrue(first != other);
+            Assert::AreEqual(size_t(5), graph.size());
+        }
+
+        TEST_METHOD(should_call_each_filter_that_matches)
+        {
+            krabs::guid id(L"{A0C1853B-5C40-4B15-8766-3CF1C58F985A}");
+            krabs::user_trace trace;
+            krabs::provider<> provider(id);
+
+            int both = 0;
+            krabs::event_filter first(krabs::predicates::and_filter(
+                krabs::predicates::id_is(1),
+                krabs::predicates::process_id_is(4)));
+            first.add_on_event_callback([&](const EVENT_RECORD &, const krabs::trace_context &) { ++both; });
+            provider.add_filter(first);
+
+            int either = 0;
+            krabs::event_filter second(krabs::predicates::or_filter(
+                krabs::predicates::id_is(1),
+                krabs::predicates::process_id_is(4)));
+            second.add_on_event_callback([&](const EVENT_RECORD &, const krabs::trace_context &) { ++either; });
+            provider.add_filter(second);
+
+            int neither = 0;
+            krabs::event_filter third(krabs::predicates::not_filter(krabs::predicates::or_filter(
+                krabs::predicates::id_is(1),
+                krabs::predicates::process_id_is(4))));
+            third.add_on_event_callback([&](const EVENT_RECORD &, const krabs::trace_context &) { ++neither; });
+            provider.add_filter(third);
+
+            trace.enable(provider);
+
+            krabs::testing::user_trace_proxy proxy(trace);
+            proxy.push_event(make_event(id, 1, 4));
+            proxy.push_event(make_event(id, 1, 8));
+            proxy.push_event(make_event(id, 2, 4));
+            proxy.push_event(make_event(id, 2, 8));
+
+            Assert::AreEqual(1, both);
+            Assert::AreEqual(3, either);
+            Assert::AreEqual(1, neither);
+        }
+    };
+}
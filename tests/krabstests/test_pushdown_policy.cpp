@@ -0,0 +1,114 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "CppUnitTest.h"
+#include <krabs.hpp>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace krabstests
+{
+    TEST_CLASS(test_pushdown_policy)
+    {
+        // {5C0B9E3A-1F47-4D2E-8A6B-7E3D9C1F2A40}
+        static constexpr GUID provider_id = { 0x5c0b9e3a, 0x1f47, 0x4d2e, { 0x8a, 0x6b, 0x7e, 0x3d, 0x9c, 0x1f, 0x2a, 0x40 } };
+
+        static void record(krabs::pushdown_policy &policy, unsigned short id, int rejected, int accepted = 0)
+        {
+            for (int i = 0; i < rejected; ++i) {
+                policy.record(provider_id, id, false);
+            }
+
+            for (int i = 0; i < accepted; ++i) {
+                policy.record(provider_id, id, true);
+            }
+        }
+
+    public:
+
+        TEST_METHOD(should_exclude_ids_quiet_for_enough_windows)
+        {
+            krabs::pushdown_policy policy(1000, 3, 2);
+
+            record(policy, 5, 3);
+            record(policy, 6, 0, 3);
+            policy.end_window();
+            Assert::IsFalse(policy.has_changes());
+
+            record(policy, 5, 3);
+            record(policy, 6, 0, 3);
+            policy.end_window();
+            Assert::IsTrue(policy.has_changes());
+            Assert::IsTrue(std::set<unsigned short>{ 5 } == policy.excluded(provider_id));
+
+            auto changes = policy.take_changes();
+            Assert::AreEqual(size_t(1), changes.size());
+            Assert::IsTrue(changes[0] == provider_id);
+            Assert::IsFalse(policy.has_changes());
+        }
+
+        TEST_METHOD(should_keep_rare_and_sometimes_accepted_ids)
+        {
+            krabs::pushdown_policy policy(1000, 3, 2);
+
+            record(policy, 7, 2);
+            record(policy, 8, 3);
+            policy.end_window();
+
+            // One accepted event keeps the id from ever being excluded.
+            record(policy, 7, 2);
+            record(policy, 8, 3, 1);
+            policy.end_window();
+
+            for (int window = 0; window < 4; ++window) {
+                record(policy, 7, 2);
+                record(policy, 8, 3);
+                policy.end_window();
+            }
+
+            Assert::IsTrue(policy.excluded(provider_id).empty());
+        }
+
+        TEST_METHOD(should_only_exclude_ids_quiet_in_windows_in_a_row)
+        {
+            krabs::pushdown_policy policy(1000, 3, 2);
+
+            // A window without the id at all breaks the run.
+            record(policy, 5, 3);
+            policy.end_window();
+            record(policy, 6, 3);
+            policy.end_window();
+            record(policy, 5, 3);
+            policy.end_window();
+
+            Assert::IsTrue(policy.excluded(provider_id).empty());
+
+            record(policy, 5, 3);
+            policy.end_window();
+            Assert::AreEqual(size_t(1), policy.excluded(provider_id).count(5));
+        }
+
+        TEST_METHOD(should_close_windows_by_event_count)
+        {
+            krabs::pushdown_policy policy(4, 2, 1);
+
+            record(policy, 5, 3);
+            Assert::IsFalse(policy.has_changes());
+
+            record(policy, 5, 1);
+            Assert::IsTrue(std::set<unsigned short>{ 5 } == policy.excluded(provider_id));
+        }
+
+        TEST_METHOD(should_widen_again_on_reset)
+        {
+            krabs::pushdown_policy policy(1000, 1, 1);
+            record(policy, 5, 1);
+            policy.end_window();
+            policy.take_changes();
+
+            policy.reset();
+            Assert::IsTrue(policy.has_changes());
+            Assert::IsTrue(policy.excluded(provider_id).empty());
+        }
+    };
+}
@@ -0,0 +1,202 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "CppUnitTest.h"
+#include <krabs.hpp>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace krabstests
+{
+    TEST_CLASS(test_schema_cache)
+    {
+        // {0B6E3F52-8D1A-4C47-A2E9-5F0C7B3D1E64}
+        static constexpr GUID provider_id = { 0x0b6e3f52, 0x8d1a, 0x4c47, { 0xa2, 0xe9, 0x5f, 0x0c, 0x7b, 0x3d, 0x1e, 0x64 } };
+        static constexpr size_t schema_size = 128;
+
+        static EVENT_RECORD make_record(USHORT id)
+        {
+            EVENT_RECORD record = {};
+            record.EventHeader.ProviderId = provider_id;
+            record.EventHeader.EventDescriptor.Id = id;
+            return record;
+        }
+
+        // The schemas are never decoded here, so they're just a fill byte
+        // that tells which copy the cache handed back.
+        static void seed(const krabs::schema_locator &locator, USHORT id, BYTE fill)
+        {
+            std::vector<BYTE> schema(schema_size, fill);
+            locator.add_event_schema(make_record(id), schema.data(), static_cast<ULONG>(schema.size()));
+        }
+
+        static BYTE fill_of(const krabs::schema_locator &locator, USHORT id)
+        {
+            return *reinterpret_cast<const BYTE*>(locator.get_event_schema(make_record(id)));
+        }
+
+        // A TraceLogging event named by one letter, with a single UINT32
+        // field. Its schema is built from the metadata without TDH and,
+        // unlike a seeded one, can be evicted.
+        static krabs::testing::synth_record make_tracelogging_event(char name, BYTE in_type = TDH_INTYPE_UINT32)
+        {
+            std::vector<BYTE> metadata = { 0, 0, 0, BYTE(name), 0, 'V', 0, in_type };
+            metadata[0] = static_cast<BYTE>(metadata.size());
+
+            krabs::testing::extended_data_builder builder;
+            builder.add_tracelogging_schema(metadata);
+            auto extended = builder.pack();
+
+            EVENT_RECORD record = {};
+            record.EventHeader.ProviderId = provider_id;
+            record.EventHeader.Flags = EVENT_HEADER_FLAG_64_BIT_HEADER;
+            record.ExtendedDataCount = static_cast<USHORT>(builder.count());
+            record.ExtendedData = reinterpret_cast<PEVENT_HEADER_EXTENDED_DATA_ITEM>(extended.first.get());
+
+            return krabs::testing::synth_record(record, std::vector<BYTE>(sizeof(uint32_t), 0), extended.first);
+        }
+
+    public:
+
+        TEST_METHOD(should_count_hits_and_resident_bytes)
+        {
+            krabs::schema_locator locator;
+            seed(locator, 1, 'a');
+            seed(locator, 2, 'a');
+
+            fill_of(locator, 1);
+            fill_of(locator, 1);
+            fill_of(locator, 2);
+
+            auto stats = locator.stats();
+            Assert::AreEqual(uint64_t(3), stats.hits);
+            Assert::AreEqual(uint64_t(0), stats.misses);
+            Assert::AreEqual(size_t(2), stats.schemas_resident);
+            Assert::AreEqual(2 * schema_size, stats.bytes_resident);
+        }
+
+        TEST_METHOD(should_not_evict_without_a_budget)
+        {
+            krabs::schema_locator locator;
+            for (USHORT id = 0; id < 100; ++id) {
+                seed(locator, id, 'a');
+            }
+
+            locator.trim();
+            Assert::AreEqual(size_t(100), locator.stats().schemas_resident);
+            Assert::AreEqual(uint64_t(0), locator.stats().evictions);
+        }
+
+        TEST_METHOD(should_evict_schemas_not_used_since_the_last_sweep)
+        {
+            krabs::schema_locator locator;
+            auto a = make_tracelogging_event('a');
+            auto b = make_tracelogging_event('b');
+            auto c = make_tracelogging_event('c');
+
+            locator.get_event_schema(a);
+            locator.get_event_schema(b);
+            locator.get_event_schema(c);
+            const size_t entry_bytes = locator.stats().bytes_resident / 3;
+
+            locator.get_event_schema(a);
+            locator.get_event_schema(c);
+
+            locator.set_cache_budget(2 * entry_bytes);
+            locator.trim();
+
+            auto stats = locator.stats();
+            Assert::AreEqual(uint64_t(1), stats.evictions);
+            Assert::AreEqual(2 * entry_bytes, stats.bytes_resident);
+
+            // Only b has to be built again.
+            locator.get_event_schema(a);
+            locator.get_event_schema(c);
+            Assert::AreEqual(stats.misses, locator.stats().misses);
+            locator.get_event_schema(b);
+            Assert::AreEqual(stats.misses + 1, locator.stats().misses);
+        }
+
+        TEST_METHOD(should_keep_pinned_schemas)
+        {
+            krabs::schema_locator locator;
+            auto a = make_tracelogging_event('a');
+            auto b = make_tracelogging_event('b');
+            locator.get_event_schema(b);
+            locator.set_cache_budget(1);
+
+            {
+                auto pin = locator.pin(a);
+                auto schema = locator.get_event_schema(a);
+                locator.trim();
+
+                Assert::AreEqual(size_t(1), locator.stats().schemas_resident);
+                Assert::IsTrue(schema == locator.get_event_schema(a));
+            }
+
+            locator.trim();
+            Assert::AreEqual(size_t(0), locator.stats().schemas_resident);
+            Assert::AreEqual(size_t(0), locator.stats().bytes_resident);
+        }
+
+        TEST_METHOD(should_keep_seeded_schemas)
+        {
+            krabs::schema_locator locator;
+            seed(locator, 1, 'a');
+            seed(locator, 2, 'a');
+            locator.get_event_schema(make_tracelogging_event('c'));
+
+            locator.set_cache_budget(1);
+            locator.trim();
+
+            // Replaying a capture has to work without TDH, so only the
+            // schema that can be built again goes.
+            auto stats = locator.stats();
+            Assert::AreEqual(uint64_t(1), stats.evictions);
+            Assert::AreEqual(size_t(2), stats.schemas_resident);
+            Assert::AreEqual(2 * schema_size, stats.bytes_resident);
+            Assert::AreEqual(BYTE('a'), fill_of(locator, 1));
+            Assert::AreEqual(BYTE('a'), fill_of(locator, 2));
+        }
+
+        TEST_METHOD(should_not_cache_schemas_tdh_failed_to_load)
+        {
+            krabs::schema_locator locator;
+
+            // Nothing is registered for the provider, so TDH can't find it.
+            for (int attempt = 0; attempt < 2; ++attempt) {
+                Assert::ExpectException<krabs::could_not_find_schema>([&]() {
+                    locator.get_event_schema(make_record(1));
+                });
+            }
+
+            auto stats = locator.stats();
+            Assert::AreEqual(uint64_t(0), stats.hits);
+            Assert::AreEqual(uint64_t(2), stats.misses);
+            Assert::AreEqual(size_t(0), stats.schemas_resident);
+
+            // The failed lookups left nothing behind that seeding would keep.
+            seed(locator, 1, 'a');
+            Assert::AreEqual(BYTE('a'), fill_of(locator, 1));
+        }
+
+        TEST_METHOD(should_not_cache_tracelogging_schemas_tdh_failed_to_load)
+        {
+            krabs::schema_locator locator;
+
+            // A variable count is left to TDH, which doesn't know the
+            // provider either.
+            auto event = make_tracelogging_event('v', TDH_INTYPE_UINT32 | krabs::tracelogging::in_variable_count);
+            for (int attempt = 0; attempt < 2; ++attempt) {
+                Assert::ExpectException<krabs::could_not_find_schema>([&]() {
+                    locator.get_event_schema(event);
+                });
+            }
+
+            auto stats = locator.stats();
+            Assert::AreEqual(uint64_t(0), stats.hits);
+            Assert::AreEqual(uint64_t(2), stats.misses);
+            Assert::AreEqual(size_t(0), stats.schemas_resident);
+        }
+    };
+}
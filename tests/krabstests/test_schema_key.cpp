@@ -138,5 +138,23 @@ namespace krabstests
 
             Assert::IsFalse(hash(key1) == hash(key2));
         }
+        TEST_METHOD(should_not_hash_same_when_only_middle_guid_bytes_differ)
+        {
+            // Data4[3..6] used to be left out of the GUID hash.
+            const krabs::guid provider3(L"{88154140-f63a-4028-8826-b0128614d67b}");
+            auto key1 = GetKeyForRecord(provider1, 1, 2, 3, 4);
+            auto key2 = GetKeyForRecord(provider3, 1, 2, 3, 4);
+
+            Assert::IsFalse(key1 == key2);
+            Assert::IsFalse(hash(key1) == hash(key2));
+        }
+        TEST_METHOD(should_pack_into_three_words)
+        {
+            static_assert(sizeof(krabs::schema_key) == 3 * sizeof(uint64_t), "schema_key should be packed");
+
+            const krabs::schema_key empty;
+            const EVENT_RECORD eventRecord = {};
+            Assert::IsTrue(empty == krabs::schema_key{ eventRecord });
+        }
     };
 }
\ No newline at end of file
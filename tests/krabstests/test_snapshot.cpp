@@ -0,0 +1,113 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "CppUnitTest.h"
+#include <krabs.hpp>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace krabstests
+{
+    TEST_CLASS(test_snapshot)
+    {
+        static krabs::testing::synth_record make_event(const GUID &provider, USHORT id)
+        {
+            EVENT_RECORD record = {};
+            record.EventHeader.ProviderId = provider;
+            record.EventHeader.EventDescriptor.Id = id;
+            return krabs::testing::synth_record(record, std::vector<BYTE>());
+        }
+
+    public:
+
+        TEST_METHOD(should_keep_the_value_a_reader_started_with)
+        {
+            typedef krabs::details::snapshot<std::vector<int>> numbers_snapshot;
+
+            numbers_snapshot numbers;
+            numbers.update([](std::vector<int> &copy) { copy.push_back(1); });
+
+            {
+                numbers_snapshot::reader before(numbers);
+                numbers.update([](std::vector<int> &copy) { copy.push_back(2); });
+                numbers.update([](std::vector<int> &copy) { copy.push_back(3); });
+
+                numbers_snapshot::reader after(numbers);
+                Assert::AreEqual(size_t(1), before->size());
+                Assert::AreEqual(size_t(3), after->size());
+            }
+
+            numbers.synchronize();
+
+            numbers_snapshot copy(numbers);
+            numbers_snapshot::reader copied(copy);
+            Assert::AreEqual(size_t(3), copied->size());
+        }
+
+        TEST_METHOD(should_remove_callbacks_and_filters_by_id)
+        {
+            krabs::guid id(L"{A0C1853B-5C40-4B15-8766-3CF1C58F985A}");
+            krabs::user_trace trace;
+            krabs::provider<> provider(id);
+
+            int callback_calls = 0;
+            auto callback = provider.add_on_event_callback([&](const EVENT_RECORD &, const krabs::trace_context &) {
+                ++callback_calls;
+            });
+
+            int filter_calls = 0;
+            krabs::event_filter filter(krabs::predicates::id_is(1));
+            filter.add_on_event_callback([&](const EVENT_RECORD &, const krabs::trace_context &) { ++filter_calls; });
+            auto filtered = provider.add_filter(filter);
+
+            trace.enable(provider);
+            krabs::testing::user_trace_proxy proxy(trace);
+
+            proxy.push_event(make_event(id, 1));
+            Assert::IsTrue(provider.remove_on_event_callback(callback));
+            proxy.push_event(make_event(id, 1));
+            Assert::IsTrue(provider.remove_filter(filtered));
+            proxy.push_event(make_event(id, 1));
+
+            Assert::AreEqual(1, callback_calls);
+            Assert::AreEqual(2, filter_calls);
+            Assert::IsFalse(provider.remove_filter(filtered));
+            Assert::IsFalse(provider.remove_on_event_callback(filtered));
+        }
+
+        TEST_METHOD(should_enable_and_disable_providers_while_processing_events)
+        {
+            krabs::guid id(L"{A0C1853B-5C40-4B15-8766-3CF1C58F985A}");
+            krabs::user_trace trace;
+            krabs::provider<> first(id);
+            krabs::provider<> second(id);
+
+            int second_calls = 0;
+            second.add_on_event_callback([&](const EVENT_RECORD &, const krabs::trace_context &) { ++second_calls; });
+
+            // The first provider's callback changes what the trace forwards
+            // to while it's forwarding an event, which still goes to the
+            // providers it started with.
+            first.add_on_event_callback([&](const EVENT_RECORD &record, const krabs::trace_context &) {
+                if (record.EventHeader.EventDescriptor.Id == 1) {
+                    trace.enable(second);
+                }
+                else if (record.EventHeader.EventDescriptor.Id == 2) {
+                    trace.disable(second);
+                }
+            });
+
+            trace.enable(first);
+            krabs::testing::user_trace_proxy proxy(trace);
+
+            proxy.push_event(make_event(id, 1));
+            proxy.push_event(make_event(id, 3));
+            proxy.push_event(make_event(id, 2));
+            proxy.push_event(make_event(id, 3));
+
+            Assert::AreEqual(2, second_calls);
+            Assert::IsFalse(trace.disable(second));
+            Assert::IsTrue(trace.disable(first));
+        }
+    };
+}
@@ -0,0 +1,97 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "CppUnitTest.h"
+#include <krabs.hpp>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace krabstests
+{
+    struct powershell_guid {
+        static constexpr GUID value = krabs::guid_parser::parse_guid_literal("{A0C1853B-5C40-4B15-8766-3CF1C58F985A}");
+    };
+
+    static_assert(powershell_guid::value.Data1 == 0xA0C1853B, "Data1 should be parsed at compile time");
+    static_assert(powershell_guid::value.Data4[7] == 0x5A, "Data4 should be parsed at compile time");
+
+    TEST_CLASS(test_static_provider)
+    {
+        static krabs::testing::synth_record make_event(const GUID &provider, USHORT id, ULONG process_id)
+        {
+            EVENT_RECORD record = {};
+            record.EventHeader.ProviderId = provider;
+            record.EventHeader.EventDescriptor.Id = id;
+            record.EventHeader.ProcessId = process_id;
+            return krabs::testing::synth_record(record, std::vector<BYTE>());
+        }
+
+    public:
+
+        TEST_METHOD(should_parse_guid_literals_like_guid_strings)
+        {
+            constexpr GUID without_braces = krabs::guid_parser::parse_guid_literal("a0c1853b-5c40-4b15-8766-3cf1c58f985a");
+            krabs::guid expected(L"{A0C1853B-5C40-4B15-8766-3CF1C58F985A}");
+
+            Assert::IsTrue(expected == powershell_guid::value);
+            Assert::IsTrue(expected == without_braces);
+
+            auto missing_hyphen = [] { return krabs::guid_parser::parse_guid_literal("A0C1853B_5C40-4B15-8766-3CF1C58F985A"); };
+            Assert::ExpectException<std::runtime_error>(missing_hyphen);
+        }
+
+        TEST_METHOD(should_combine_predicates_with_operators)
+        {
+            auto predicate = krabs::predicates::id_is(1) && !krabs::predicates::process_id_is(4);
+            krabs::trace_context context;
+
+            Assert::IsTrue(predicate(make_event(powershell_guid::value, 1, 8), context));
+            Assert::IsFalse(predicate(make_event(powershell_guid::value, 1, 4), context));
+            Assert::IsFalse(predicate(make_event(powershell_guid::value, 2, 8), context));
+
+            auto either = krabs::predicates::id_is(1) || krabs::predicates::id_is(2);
+            Assert::IsTrue(either(make_event(powershell_guid::value, 2, 8), context));
+        }
+
+        TEST_METHOD(should_run_every_matching_filter_from_a_trace)
+        {
+            int first_count = 0;
+            auto first = krabs::make_static_filter(
+                krabs::predicates::id_is(1),
+                [&](const EVENT_RECORD &, const krabs::trace_context &) { ++first_count; });
+
+            int second_count = 0;
+            auto second = krabs::make_static_filter(
+                krabs::predicates::id_is(1) || krabs::predicates::process_id_is(4),
+                [&](const EVENT_RECORD &, const krabs::trace_context &) { ++second_count; });
+
+            krabs::static_provider<powershell_guid, decltype(first), decltype(second)> provider(first, second);
+
+            krabs::user_trace trace;
+            trace.enable(provider);
+
+            krabs::testing::user_trace_proxy proxy(trace);
+            proxy.push_event(make_event(powershell_guid::value, 1, 8));
+            proxy.push_event(make_event(powershell_guid::value, 2, 4));
+            proxy.push_event(make_event(powershell_guid::value, 2, 8));
+
+            Assert::AreEqual(1, first_count);
+            Assert::AreEqual(2, second_count);
+        }
+
+        TEST_METHOD(should_only_forward_events_of_its_guid)
+        {
+            int count = 0;
+            auto filter = krabs::make_static_filter(
+                krabs::predicates::any_event,
+                [&](const EVENT_RECORD &, const krabs::trace_context &) { ++count; });
+
+            krabs::static_provider<powershell_guid, decltype(filter)> provider(filter);
+            krabs::trace_context context;
+
+            Assert::IsTrue(provider.forward(make_event(powershell_guid::value, 1, 8), context));
+            Assert::IsFalse(provider.forward(make_event(krabs::guid::random_guid(), 1, 8), context));
+            Assert::AreEqual(1, count);
+        }
+    };
+}
@@ -0,0 +1,69 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "CppUnitTest.h"
+#include <krabs.hpp>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace krabstests
+{
+    TEST_CLASS(test_text_formatter)
+    {
+        const krabs::guid wininet = krabs::guid(L"{43D1A55C-76D6-4F7E-995C-64C711E5CAFE}");
+        krabs::trace_context trace_context;
+
+        krabs::testing::synth_record make_request(const std::string &url, unsigned int status)
+        {
+            krabs::testing::record_builder builder(wininet, krabs::id(1057), krabs::version(0));
+            builder.header().ProcessId = 4;
+            builder.header().ThreadId = 8;
+            builder.add_properties()
+                (L"URL", url)
+                (L"Status", status);
+
+            return builder.pack_incomplete();
+        }
+
+    public:
+        TEST_METHOD(should_render_properties_into_the_buffer)
+        {
+            char line[256];
+            auto length = krabs::format::format_event(make_request("https://bing.com", 200), trace_context, line, sizeof(line));
+
+            const std::string expected = "Microsoft-Windows-WinINet/1057 pid=4 tid=8 URL=https://bing.com Status=200";
+            Assert::AreEqual(expected, std::string(line));
+            Assert::AreEqual(expected.size(), length);
+        }
+
+        TEST_METHOD(should_truncate_like_snprintf)
+        {
+            auto record = make_request("https://bing.com", 200);
+
+            std::string whole;
+            krabs::format::format_event(record, trace_context, whole);
+
+            char line[16];
+            auto length = krabs::format::format_event(record, trace_context, line, sizeof(line));
+            Assert::AreEqual(whole.size(), length);
+            Assert::AreEqual(whole.substr(0, sizeof(line) - 1), std::string(line));
+
+            Assert::AreEqual(whole.size(), krabs::format::format_event(record, trace_context, nullptr, 0));
+        }
+
+        TEST_METHOD(schema_locator_should_build_each_plan_once)
+        {
+            auto first = make_request("https://bing.com", 200);
+            auto second = make_request("https://microsoft.com/a/longer/path", 404);
+
+            const auto &plan = trace_context.schema_locator.get_format_plan(first);
+            Assert::IsTrue(&plan == &trace_context.schema_locator.get_format_plan(second));
+
+            Assert::AreEqual(size_t(2), plan.properties.size());
+            Assert::AreEqual(std::string("URL"), plan.properties[0].utf8_name);
+            Assert::IsTrue(krabs::format::size_source::terminated == plan.properties[0].source);
+            Assert::IsTrue(krabs::format::size_source::fixed == plan.properties[1].source);
+            Assert::AreEqual(USHORT(4), plan.properties[1].width);
+        }
+    };
+}
@@ -0,0 +1,172 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "CppUnitTest.h"
+#include <krabs.hpp>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace krabstests
+{
+    TEST_CLASS(test_tracelogging)
+    {
+        // {4A1D5F0E-6C2B-4B8A-9E7D-3F2C1B0A9D8E}
+        static constexpr GUID provider_id = { 0x4a1d5f0e, 0x6c2b, 0x4b8a, { 0x9e, 0x7d, 0x3f, 0x2c, 0x1b, 0x0a, 0x9d, 0x8e } };
+
+        template <typename T>
+        static void append(std::vector<BYTE> &bytes, T value)
+        {
+            auto start = reinterpret_cast<const BYTE*>(&value);
+            bytes.insert(bytes.end(), start, start + sizeof(T));
+        }
+
+        static void append_string(std::vector<BYTE> &bytes, const std::string &value)
+        {
+            bytes.insert(bytes.end(), value.c_str(), value.c_str() + value.size() + 1);
+        }
+
+        static void append_wstring(std::vector<BYTE> &bytes, const std::wstring &value)
+        {
+            auto start = reinterpret_cast<const BYTE*>(value.c_str());
+            bytes.insert(bytes.end(), start, start + (value.size() + 1) * sizeof(wchar_t));
+        }
+
+        // Metadata as TraceLoggingWrite lays it out: the size, an empty tag
+        // chain and the event name, followed by the fields.
+        static std::vector<BYTE> make_metadata(const std::string &event_name, const std::vector<BYTE> &fields)
+        {
+            std::vector<BYTE> metadata;
+            append<uint16_t>(metadata, 0);
+            metadata.push_back(0);
+            append_string(metadata, event_name);
+            metadata.insert(metadata.end(), fields.begin(), fields.end());
+
+            const uint16_t size = static_cast<uint16_t>(metadata.size());
+            memcpy(metadata.data(), &size, sizeof(size));
+            return metadata;
+        }
+
+        // Url (UTF-8), Status, Codes[3], Name
+        static std::vector<BYTE> request_metadata(const std::string &event_name = "Request")
+        {
+            std::vector<BYTE> fields;
+            append_string(fields, "Url");
+            fields.push_back(TDH_INTYPE_ANSISTRING | krabs::tracelogging::in_chain);
+            fields.push_back(35);
+            append_string(fields, "Status");
+            fields.push_back(TDH_INTYPE_UINT32);
+            append_string(fields, "Codes");
+            fields.push_back(TDH_INTYPE_UINT16 | krabs::tracelogging::in_constant_count);
+            append<uint16_t>(fields, 3);
+            append_string(fields, "Name");
+            fields.push_back(TDH_INTYPE_UNICODESTRING);
+            return make_metadata(event_name, fields);
+        }
+
+        static std::vector<BYTE> request_bytes()
+        {
+            std::vector<BYTE> bytes;
+            append_string(bytes, "https://bing.com");
+            append<uint32_t>(bytes, 200);
+            append<uint16_t>(bytes, 1);
+            append<uint16_t>(bytes, 2);
+            append<uint16_t>(bytes, 3);
+            append_wstring(bytes, L"search");
+            return bytes;
+        }
+
+        // TraceLogging events all have id 0 unless they're given one.
+        static krabs::testing::synth_record make_event(const std::vector<BYTE> &metadata, USHORT id = 0)
+        {
+            krabs::testing::extended_data_builder builder;
+            builder.add_tracelogging_schema(metadata);
+            builder.add_provider_traits("Krabs.Sample");
+            auto extended = builder.pack();
+
+            EVENT_RECORD record = {};
+            record.EventHeader.ProviderId = provider_id;
+            record.EventHeader.EventDescriptor.Id = id;
+            record.EventHeader.Flags = EVENT_HEADER_FLAG_64_BIT_HEADER;
+            record.ExtendedDataCount = static_cast<USHORT>(builder.count());
+            record.ExtendedData = reinterpret_cast<PEVENT_HEADER_EXTENDED_DATA_ITEM>(extended.first.get());
+
+            return krabs::testing::synth_record(record, request_bytes(), extended.first);
+        }
+
+    public:
+
+        TEST_METHOD(should_decode_metadata)
+        {
+            auto metadata = krabs::tracelogging::parse_event_metadata(request_metadata().data(), request_metadata().size());
+
+            Assert::AreEqual(std::wstring(L"Request"), metadata.name);
+            Assert::AreEqual(size_t(4), metadata.fields.size());
+            Assert::AreEqual(std::wstring(L"Url"), metadata.fields[0].name);
+            Assert::AreEqual(uint8_t(35), metadata.fields[0].out_type);
+            Assert::AreEqual(uint8_t(krabs::tracelogging::in_constant_count), metadata.fields[2].count_kind);
+            Assert::AreEqual(uint16_t(3), metadata.fields[2].count);
+        }
+
+        TEST_METHOD(should_throw_on_truncated_metadata)
+        {
+            auto metadata = request_metadata();
+            metadata.resize(metadata.size() - 4);
+
+            Assert::ExpectException<std::runtime_error>([&]() {
+                krabs::tracelogging::parse_event_metadata(metadata.data(), metadata.size());
+            });
+        }
+
+        TEST_METHOD(should_parse_events_without_tdh)
+        {
+            auto event = make_event(request_metadata());
+            krabs::trace_context trace_context;
+
+            krabs::schema schema(event, trace_context.schema_locator);
+            Assert::AreEqual(std::wstring(L"Request"), std::wstring(schema.event_name()));
+            Assert::AreEqual(std::wstring(L"Krabs.Sample"), std::wstring(schema.provider_name()));
+
+            krabs::parser parser(schema);
+            Assert::AreEqual(std::string("https://bing.com"), parser.parse<std::string>(L"Url"));
+            Assert::AreEqual(uint32_t(200), parser.parse<uint32_t>(L"Status"));
+            Assert::AreEqual(std::wstring(L"search"), parser.parse<std::wstring>(L"Name"));
+        }
+
+        TEST_METHOD(should_share_schemas_by_metadata)
+        {
+            auto first = make_event(request_metadata(), 0);
+            auto second = make_event(request_metadata(), 5);
+            krabs::trace_context trace_context;
+
+            Assert::IsTrue(trace_context.schema_locator.get_event_schema(first) ==
+                           trace_context.schema_locator.get_event_schema(second));
+        }
+
+        TEST_METHOD(should_tell_apart_events_with_the_same_id)
+        {
+            auto request = make_event(request_metadata("Request"));
+            auto response = make_event(request_metadata("Response"));
+            krabs::trace_context trace_context;
+
+            krabs::schema request_schema(request, trace_context.schema_locator);
+            krabs::schema response_schema(response, trace_context.schema_locator);
+            Assert::AreEqual(std::wstring(L"Request"), std::wstring(request_schema.event_name()));
+            Assert::AreEqual(std::wstring(L"Response"), std::wstring(response_schema.event_name()));
+        }
+
+        TEST_METHOD(should_leave_variable_counts_to_tdh)
+        {
+            std::vector<BYTE> fields;
+            append_string(fields, "Values");
+            fields.push_back(TDH_INTYPE_UINT32 | krabs::tracelogging::in_variable_count);
+            auto bytes = make_metadata("Values", fields);
+
+            auto event = make_event(bytes);
+            ULONG size = 0;
+            auto schema = krabs::tracelogging::make_event_schema(
+                event, krabs::tracelogging::parse_event_metadata(bytes.data(), bytes.size()), size);
+
+            Assert::IsTrue(schema == nullptr);
+        }
+    };
+}
@@ -122,5 +122,125 @@ namespace krabstests
             foo.trace_flags(FLAGS);
             Assert::IsTrue(foo.trace_flags() == FLAGS);
         }
+
+        TEST_METHOD(should_route_shared_guid_events_by_keyword_and_level)
+        {
+            krabs::user_trace trace;
+            krabs::guid id(L"{A0C1853B-5C40-4B15-8766-3CF1C58F985A}");
+
+            int verbose_count = 0;
+            krabs::provider<> verbose(id);
+            verbose.any(0x1);
+            verbose.level(TRACE_LEVEL_VERBOSE);
+            verbose.add_on_event_callback([&](const EVENT_RECORD &, const krabs::trace_context &) { ++verbose_count; });
+
+            int errors_count = 0;
+            krabs::provider<> errors(id);
+            errors.any(0x2);
+            errors.level(TRACE_LEVEL_ERROR);
+            errors.add_on_event_callback([&](const EVENT_RECORD &, const krabs::trace_context &) { ++errors_count; });
+
+            trace.enable(verbose);
+            trace.enable(errors);
+
+            krabs::testing::user_trace_proxy proxy(trace);
+            proxy.push_event(make_event(id, 1, TRACE_LEVEL_VERBOSE, 0x1));
+            proxy.push_event(make_event(id, 1, TRACE_LEVEL_ERROR, 0x2));
+            proxy.push_event(make_event(id, 1, TRACE_LEVEL_ERROR, 0x3));
+            proxy.push_event(make_event(id, 1, TRACE_LEVEL_VERBOSE, 0x2));
+            proxy.push_event(make_event(id, 1, TRACE_LEVEL_ERROR, 0x4));
+
+            Assert::AreEqual(2, verbose_count);
+            Assert::AreEqual(2, errors_count);
+        }
+
+        TEST_METHOD(should_route_shared_guid_events_by_event_id)
+        {
+            krabs::user_trace trace;
+            krabs::guid id(L"{A0C1853B-5C40-4B15-8766-3CF1C58F985A}");
+
+            int filtered_count = 0;
+            krabs::provider<> filtered(id);
+            krabs::event_filter filter(std::vector<unsigned short>{ 1, 2 });
+            filter.add_on_event_callback([&](const EVENT_RECORD &, const krabs::trace_context &) { ++filtered_count; });
+            filtered.add_filter(filter);
+
+            int everything_count = 0;
+            krabs::provider<> everything(id);
+            everything.add_on_event_callback([&](const EVENT_RECORD &, const krabs::trace_context &) { ++everything_count; });
+
+            trace.enable(filtered);
+            trace.enable(everything);
+
+            krabs::testing::user_trace_proxy proxy(trace);
+            proxy.push_event(make_event(id, 1, TRACE_LEVEL_INFORMATION, 0));
+            proxy.push_event(make_event(id, 3, TRACE_LEVEL_INFORMATION, 0));
+
+            Assert::AreEqual(1, filtered_count);
+            Assert::AreEqual(2, everything_count);
+        }
+
+        TEST_METHOD(should_forward_everything_to_a_provider_with_its_own_guid)
+        {
+            krabs::user_trace trace;
+            krabs::guid id(L"{A0C1853B-5C40-4B15-8766-3CF1C58F985A}");
+
+            // ETW did the filtering when the provider is the only one.
+            int count = 0;
+            krabs::provider<> only(id);
+            only.any(0x1);
+            only.level(TRACE_LEVEL_ERROR);
+            only.add_on_event_callback([&](const EVENT_RECORD &, const krabs::trace_context &) { ++count; });
+            trace.enable(only);
+
+            krabs::testing::user_trace_proxy proxy(trace);
+            proxy.push_event(make_event(id, 1, TRACE_LEVEL_VERBOSE, 0x2));
+
+            Assert::AreEqual(1, count);
+        }
+
+        TEST_METHOD(should_keep_settings_and_callbacks_when_converted_to_provider)
+        {
+            krabs::user_trace trace;
+            krabs::guid id(L"{A0C1853B-5C40-4B15-8766-3CF1C58F985A}");
+
+            int typed_count = 0;
+            krabs::provider<unsigned int> typed(id);
+            typed.any(0x1);
+            typed.trace_flags(EVENT_ENABLE_PROPERTY_SID);
+            typed.process_ids({ 4 });
+            typed.add_on_event_callback([&](const EVENT_RECORD &, const krabs::trace_context &) { ++typed_count; });
+
+            krabs::provider<> converted(typed);
+            Assert::IsTrue(converted.trace_flags() == EVENT_ENABLE_PROPERTY_SID);
+
+            // Sharing the GUID makes the trace route by each provider's settings.
+            int everything_count = 0;
+            krabs::provider<> everything(id);
+            everything.add_on_event_callback([&](const EVENT_RECORD &, const krabs::trace_context &) { ++everything_count; });
+
+            trace.enable(converted);
+            trace.enable(everything);
+
+            krabs::testing::user_trace_proxy proxy(trace);
+            proxy.push_event(make_event(id, 1, TRACE_LEVEL_INFORMATION, 0x1, 4));
+            proxy.push_event(make_event(id, 1, TRACE_LEVEL_INFORMATION, 0x1, 8));
+            proxy.push_event(make_event(id, 1, TRACE_LEVEL_INFORMATION, 0x2, 4));
+
+            Assert::AreEqual(1, typed_count);
+            Assert::AreEqual(3, everything_count);
+        }
+
+    private:
+        static krabs::testing::synth_record make_event(const GUID &provider, USHORT id, UCHAR level, ULONGLONG keyword, ULONG process_id = 0)
+        {
+            EVENT_RECORD record = {};
+            record.EventHeader.ProviderId = provider;
+            record.EventHeader.ProcessId = process_id;
+            record.EventHeader.EventDescriptor.Id = id;
+            record.EventHeader.EventDescriptor.Level = level;
+            record.EventHeader.EventDescriptor.Keyword = keyword;
+            return krabs::testing::synth_record(record, std::vector<BYTE>());
+        }
     };
 }
\ No newline at end of file
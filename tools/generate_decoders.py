@@ -0,0 +1,313 @@
+#!/usr/bin/env python3
+# Copyright (c) Microsoft. All rights reserved.
+# Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+"""Generates typed krabs event views from an instrumentation manifest.
+
+    python3 generate_decoders.py provider.man -o provider_events.hpp [--namespace name]
+
+Each provider in the manifest gets a namespace with its GUID, one view per
+event and version (deriving krabs::decoding::byte_view, with a constexpr
+field_descriptor table and an accessor per field), and a
+krabs::decoding::dispatcher over all of them. Views read fields at offsets
+worked out here, so decoding a known event doesn't go through TDH; events the
+manifest doesn't describe reach the dispatcher's fallback, which can use
+krabs::parser.
+
+The header only includes krabs/decoding/byte_view.hpp, which doesn't need
+Windows, so the views also decode user data on other platforms. A view works
+out where its fields start once, when it's made, so reading a field after a
+string doesn't scan the string again.
+
+Fields are supported up to the first one whose size this generator can't know
+ahead of time (counted or length prefixed data, structs, SIDs and so on); the
+fields from there on are left to the parser. Only the Python standard library
+is used, so the generator runs wherever the build does.
+"""
+
+import argparse
+import keyword
+import re
+import sys
+import xml.etree.ElementTree as ElementTree
+
+# inType -> (in_ constant, C++ type, bytes, pointers, read expression)
+# Strings have no size: they run to their terminator.
+FIXED_TYPES = {
+    'win:Int8':       ('in_int8',       'int8_t',     1, 0, 'read<int8_t>({at})'),
+    'win:UInt8':      ('in_uint8',      'uint8_t',    1, 0, 'read<uint8_t>({at})'),
+    'win:Int16':      ('in_int16',      'int16_t',    2, 0, 'read<int16_t>({at})'),
+    'win:UInt16':     ('in_uint16',     'uint16_t',   2, 0, 'read<uint16_t>({at})'),
+    'win:Int32':      ('in_int32',      'int32_t',    4, 0, 'read<int32_t>({at})'),
+    'win:UInt32':     ('in_uint32',     'uint32_t',   4, 0, 'read<uint32_t>({at})'),
+    'win:HexInt32':   ('in_hexint32',   'uint32_t',   4, 0, 'read<uint32_t>({at})'),
+    'win:Int64':      ('in_int64',      'int64_t',    8, 0, 'read<int64_t>({at})'),
+    'win:UInt64':     ('in_uint64',     'uint64_t',   8, 0, 'read<uint64_t>({at})'),
+    'win:HexInt64':   ('in_hexint64',   'uint64_t',   8, 0, 'read<uint64_t>({at})'),
+    'win:Float':      ('in_float',      'float',      4, 0, 'read<float>({at})'),
+    'win:Double':     ('in_double',     'double',     8, 0, 'read<double>({at})'),
+    'win:Boolean':    ('in_boolean',    'bool',       4, 0, 'read<uint32_t>({at}) != 0'),
+    'win:Pointer':    ('in_pointer',    'uint64_t',   0, 1, 'read_pointer({at})'),
+    'win:GUID':       ('in_guid',       'krabs::decoding::guid', 16, 0, 'read<krabs::decoding::guid>({at})'),
+    'win:FILETIME':   ('in_filetime',   'uint64_t',   8, 0, 'read<uint64_t>({at})'),
+    'win:SYSTEMTIME': ('in_systemtime', 'krabs::decoding::systemtime', 16, 0, 'read<krabs::decoding::systemtime>({at})'),
+}
+
+STRING_TYPES = {
+    'win:UnicodeString': ('in_unicode_string', 'std::wstring', 'read_wstring'),
+    'win:AnsiString':    ('in_ansi_string',    'std::string',  'read_string'),
+}
+
+# Names a field accessor can't take because the view already uses them.
+RESERVED = {
+    'id', 'version', 'fields', 'provider', 'pointer_size', 'read',
+    'read_pointer', 'read_string', 'read_wstring', 'skip_string',
+    'skip_wstring', 'check', 'locate',
+}
+
+CPP_KEYWORDS = {
+    'alignas', 'alignof', 'and', 'asm', 'auto', 'bool', 'break', 'case', 'catch',
+    'char', 'class', 'const', 'constexpr', 'continue', 'decltype', 'default',
+    'delete', 'do', 'double', 'else', 'enum', 'explicit', 'export', 'extern',
+    'false', 'float', 'for', 'friend', 'goto', 'if', 'inline', 'int', 'long',
+    'mutable', 'namespace', 'new', 'noexcept', 'not', 'nullptr', 'operator',
+    'or', 'private', 'protected', 'public', 'register', 'return', 'short',
+    'signed', 'sizeof', 'static', 'struct', 'switch', 'template', 'this',
+    'throw', 'true', 'try', 'typedef', 'typeid', 'typename', 'union',
+    'unsigned', 'using', 'virtual', 'void', 'volatile', 'while', 'xor',
+}
+
+
+def local_name(tag):
+    return tag.rsplit('}', 1)[-1]
+
+
+def children(element, name):
+    return [child for child in element if local_name(child.tag) == name]
+
+
+def snake_case(name):
+    name = re.sub(r'[^0-9A-Za-z]+', '_', name)
+    name = re.sub(r'([a-z0-9])([A-Z])', r'\1_\2', name)
+    name = re.sub(r'([A-Z]+)([A-Z][a-z])', r'\1_\2', name)
+    name = name.strip('_').lower()
+    name = re.sub(r'_+', '_', name)
+    if not name:
+        name = 'unnamed'
+    if name[0].isdigit():
+        name = '_' + name
+    return name
+
+
+def identifier(name, taken):
+    result = snake_case(name)
+    if result in CPP_KEYWORDS or result in RESERVED or keyword.iskeyword(result):
+        result += '_'
+    base, n = result, 2
+    while result in taken:
+        result = '%s_%d' % (base, n)
+        n += 1
+    taken.add(result)
+    return result
+
+
+def wide_literal(text):
+    return 'L"%s"' % text.replace('\\', '\\\\').replace('"', '\\"')
+
+
+def guid_initializer(text):
+    digits = text.strip('{}')
+    parts = digits.split('-')
+    if len(parts) != 5:
+        raise ValueError('malformed GUID %s' % text)
+    tail = parts[3] + parts[4]
+    data4 = ', '.join('0x%s' % tail[i:i + 2] for i in range(0, 16, 2))
+    return '{ 0x%s, 0x%s, 0x%s, { %s } }' % (parts[0], parts[1], parts[2], data4)
+
+
+class Field(object):
+    def __init__(self, name, accessor, in_type, cpp_type, offset, after, read, string):
+        self.name = name
+        self.accessor = accessor
+        self.in_type = in_type
+        self.cpp_type = cpp_type
+        self.offset = offset
+        self.after = after
+        self.read = read
+        self.string = string
+
+
+def layout(template):
+    """Works out the fields of a template up to the first unsupported one.
+    Returns (fields, name of the first field left to the parser or None)."""
+    fields = []
+    taken = set()
+    after = -1
+    offset = [0, 0]
+
+    for data in template:
+        if local_name(data.tag) != 'data':
+            return fields, data.get('name', local_name(data.tag))
+
+        name = data.get('name')
+        in_type = data.get('inType')
+        sized = data.get('count') is not None or data.get('length') is not None
+
+        if in_type in FIXED_TYPES and not sized:
+            tdh, cpp, size, pointers, read = FIXED_TYPES[in_type]
+            fields.append(Field(name, identifier(name, taken), tdh, cpp, tuple(offset), after, read, False))
+            offset[0] += size
+            offset[1] += pointers
+        elif in_type in STRING_TYPES and not sized:
+            tdh, cpp, read = STRING_TYPES[in_type]
+            fields.append(Field(name, identifier(name, taken), tdh, cpp, tuple(offset), after, read, True))
+            after = len(fields) - 1
+            offset = [0, 0]
+        else:
+            return fields, name
+
+    return fields, None
+
+
+def render_event(out, provider_symbol, event, fields, unsupported):
+    cls = event['class']
+    out.append('    /**')
+    out.append('     * <summary>')
+    out.append('     *   %s (event %d, version %d).' % (event['title'], event['id'], event['version']))
+    out.append('     * </summary>')
+    if unsupported is not None:
+        out.append('     * <remarks>')
+        out.append('     *   %s and the fields after it are left to krabs::parser.' % unsupported)
+        out.append('     * </remarks>')
+    out.append('     */')
+    out.append('    class %s : public krabs::decoding::byte_view {' % cls)
+    out.append('    public:')
+    out.append('        static constexpr uint16_t id = %d;' % event['id'])
+    out.append('        static constexpr uint8_t version = %d;' % event['version'])
+    out.append('        static const krabs::decoding::guid &provider() { return %s; }' % provider_symbol)
+    out.append('')
+    if fields:
+        out.append('        static constexpr krabs::decoding::field_descriptor fields[] = {')
+        for field in fields:
+            after = 'krabs::decoding::field_descriptor::from_start' if field.after < 0 else str(field.after)
+            out.append('            { %s, krabs::decoding::%s, { %d, %d }, %s },' % (
+                wide_literal(field.name), field.in_type, field.offset[0], field.offset[1], after))
+        out.append('        };')
+        out.append('')
+    out.append('        %s(const uint8_t *data, size_t size, size_t pointer_size)' % cls)
+    out.append('        : krabs::decoding::byte_view(data, size, pointer_size)')
+    if fields:
+        out.append('        {')
+        out.append('            locate(fields, offsets_);')
+        out.append('        }')
+    else:
+        out.append('        {}')
+
+    if fields:
+        out.append('')
+    for index, field in enumerate(fields):
+        at = 'offsets_[%d]' % index
+        if field.string:
+            out.append('        %s %s() const { size_t next = 0; return %s(%s, next); }' % (
+                field.cpp_type, field.accessor, field.read, at))
+        else:
+            out.append('        %s %s() const { return %s; }' % (
+                field.cpp_type, field.accessor, field.read.format(at=at)))
+
+    if fields:
+        out.append('')
+        out.append('    private:')
+        out.append('        size_t offsets_[%d];' % len(fields))
+
+    out.append('    };')
+    out.append('')
+
+
+def render_provider(out, provider, namespace):
+    guid = provider.get('guid')
+    name = provider.get('name')
+    ns = namespace or snake_case(name)
+
+    templates = {}
+    for templates_element in children(provider, 'templates'):
+        for template in children(templates_element, 'template'):
+            templates[template.get('tid')] = template
+
+    events = []
+    taken = set()
+    for events_element in children(provider, 'events'):
+        for event in children(events_element, 'event'):
+            event_id = int(event.get('value'), 0)
+            version = int(event.get('version', '0'), 0)
+            title = event.get('symbol') or event.get('task') or ('Event%d' % event_id)
+            events.append({
+                'id': event_id,
+                'version': version,
+                'title': title,
+                'template': event.get('template'),
+                'class': identifier('%s_v%d' % (title, version), taken),
+            })
+
+    out.append('namespace %s {' % ns)
+    out.append('')
+    out.append('    // %s' % name)
+    out.append('    constexpr krabs::decoding::guid provider_id = %s;' % guid_initializer(guid))
+    out.append('')
+
+    for event in events:
+        template = templates.get(event['template'])
+        fields, unsupported = layout(template) if template is not None else ([], None)
+        render_event(out, 'provider_id', event, fields, unsupported)
+
+    out.append('    typedef krabs::decoding::dispatcher<')
+    out.append(',\n'.join('        %s' % event['class'] for event in events))
+    out.append('    > dispatcher;')
+    out.append('')
+    out.append('} /* namespace %s */' % ns)
+
+
+def generate(manifest_path, namespace=None):
+    root = ElementTree.parse(manifest_path).getroot()
+    providers = [element for element in root.iter() if local_name(element.tag) == 'provider']
+    if not providers:
+        raise ValueError('%s has no providers' % manifest_path)
+    if namespace is not None and len(providers) > 1:
+        raise ValueError('--namespace only applies to manifests with a single provider')
+
+    out = [
+        '// Generated by tools/generate_decoders.py from %s. Do not edit.' % manifest_path.replace('\\', '/').split('/')[-1],
+        '',
+        '#pragma once',
+        '',
+        '#include <cstddef>',
+        '#include <cstdint>',
+        '#include <string>',
+        '',
+        '#include <krabs/decoding/byte_view.hpp>',
+        '',
+    ]
+
+    for provider in providers:
+        render_provider(out, provider, namespace)
+
+    return '\n'.join(out) + '\n'
+
+
+def main(argv):
+    arguments = argparse.ArgumentParser(description='Generates typed krabs event views from a manifest.')
+    arguments.add_argument('manifest')
+    arguments.add_argument('-o', '--output', help='header to write, standard output if not given')
+    arguments.add_argument('--namespace', help='namespace for the provider, its snake_case name by default')
+    options = arguments.parse_args(argv)
+
+    header = generate(options.manifest, options.namespace)
+    if options.output:
+        with open(options.output, 'w', newline='\n') as output:
+            output.write(header)
+    else:
+        sys.stdout.write(header)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv[1:]))